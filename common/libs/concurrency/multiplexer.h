@@ -45,10 +45,13 @@ class Multiplexer {
     return id_to_return;
   }
 
+  // Queue::Push() returns whether the queue gained an item. It may not when
+  // it drops or replaces items, in which case there's nothing more to pop.
   void Push(const int idx, T&& t) {
     CheckIdx(idx);
-    queues_[idx]->Push(std::move(t));
-    sem_items_.SemPost();
+    if (queues_[idx]->Push(std::move(t))) {
+      sem_items_.SemPost();
+    }
   }
 
   T Pop(QueueSelector selector) {
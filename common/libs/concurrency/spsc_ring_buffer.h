@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace cuttlefish {
+
+/**
+ * A byte FIFO written by a single producer thread and read by a single
+ * consumer thread without any locking. Each side only modifies its own index,
+ * so neither ever waits for the other.
+ */
+class SpscRingBuffer {
+ public:
+  // The capacity is rounded up to a power of two.
+  explicit SpscRingBuffer(std::size_t capacity)
+      : buffer_(RoundUpToPowerOfTwo(capacity)), mask_(buffer_.size() - 1) {}
+
+  SpscRingBuffer(const SpscRingBuffer&) = delete;
+  SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+  std::size_t Capacity() const { return buffer_.size(); }
+
+  // The number of bytes available for reading. Exact for the consumer, the
+  // producer may only see it larger than it is.
+  std::size_t Size() const {
+    return write_index_.load(std::memory_order_acquire) -
+           read_index_.load(std::memory_order_acquire);
+  }
+
+  // The total number of bytes written so far, to be passed to DiscardUntil.
+  // May be read from any thread.
+  std::size_t WritePosition() const {
+    return write_index_.load(std::memory_order_acquire);
+  }
+
+  // Producer only. Writes as many of the len bytes as fit, returns how many.
+  std::size_t Write(const std::uint8_t* data, std::size_t len) {
+    const auto write_index = write_index_.load(std::memory_order_relaxed);
+    const auto read_index = read_index_.load(std::memory_order_acquire);
+    const auto count =
+        std::min(len, buffer_.size() - (write_index - read_index));
+    const auto offset = write_index & mask_;
+    const auto first_part = std::min(count, buffer_.size() - offset);
+    memcpy(buffer_.data() + offset, data, first_part);
+    memcpy(buffer_.data(), data + first_part, count - first_part);
+    write_index_.store(write_index + count, std::memory_order_release);
+    return count;
+  }
+
+  // Consumer only. Reads up to len bytes into dst, returns how many.
+  std::size_t Read(std::uint8_t* dst, std::size_t len) {
+    const auto read_index = read_index_.load(std::memory_order_relaxed);
+    const auto write_index = write_index_.load(std::memory_order_acquire);
+    const auto count = std::min(len, write_index - read_index);
+    const auto offset = read_index & mask_;
+    const auto first_part = std::min(count, buffer_.size() - offset);
+    memcpy(dst, buffer_.data() + offset, first_part);
+    memcpy(dst + first_part, buffer_.data(), count - first_part);
+    read_index_.store(read_index + count, std::memory_order_release);
+    return count;
+  }
+
+  // Consumer only. Drops everything available for reading, returns how many
+  // bytes were dropped.
+  std::size_t Clear() {
+    const auto read_index = read_index_.load(std::memory_order_relaxed);
+    const auto write_index = write_index_.load(std::memory_order_acquire);
+    read_index_.store(write_index, std::memory_order_release);
+    return write_index - read_index;
+  }
+
+  // Consumer only. Drops the bytes written before `position`, a value
+  // previously returned by WritePosition, and keeps the ones written since.
+  // Returns how many bytes were dropped.
+  std::size_t DiscardUntil(std::size_t position) {
+    const auto read_index = read_index_.load(std::memory_order_relaxed);
+    // Indices only grow, a position behind the read index was already read.
+    if (static_cast<std::ptrdiff_t>(position - read_index) <= 0) {
+      return 0;
+    }
+    read_index_.store(position, std::memory_order_release);
+    return position - read_index;
+  }
+
+ private:
+  static std::size_t RoundUpToPowerOfTwo(std::size_t value) {
+    std::size_t ret = 1;
+    while (ret < value) {
+      ret <<= 1;
+    }
+    return ret;
+  }
+
+  std::vector<std::uint8_t> buffer_;
+  const std::size_t mask_;
+  // Both indices only grow, they are reduced modulo the capacity on access.
+  // They live in separate cache lines so the two sides don't contend.
+  alignas(64) std::atomic<std::size_t> write_index_ = 0;
+  alignas(64) std::atomic<std::size_t> read_index_ = 0;
+};
+
+}  // namespace cuttlefish
@@ -0,0 +1,156 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/libs/concurrency/spsc_ring_buffer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace cuttlefish {
+namespace {
+
+std::vector<std::uint8_t> Bytes(std::size_t count, std::uint8_t first) {
+  std::vector<std::uint8_t> bytes(count);
+  for (std::size_t i = 0; i < count; i++) {
+    bytes[i] = static_cast<std::uint8_t>(first + i);
+  }
+  return bytes;
+}
+
+TEST(SpscRingBufferTest, RoundsCapacityUpToPowerOfTwo) {
+  EXPECT_EQ(SpscRingBuffer(1).Capacity(), 1u);
+  EXPECT_EQ(SpscRingBuffer(5).Capacity(), 8u);
+  EXPECT_EQ(SpscRingBuffer(16).Capacity(), 16u);
+}
+
+TEST(SpscRingBufferTest, EmptyRead) {
+  SpscRingBuffer ring(8);
+  std::uint8_t byte;
+
+  EXPECT_EQ(ring.Size(), 0u);
+  EXPECT_EQ(ring.Read(&byte, 1), 0u);
+}
+
+TEST(SpscRingBufferTest, WriteStopsWhenFull) {
+  SpscRingBuffer ring(8);
+  const auto data = Bytes(10, 0);
+
+  EXPECT_EQ(ring.Write(data.data(), data.size()), 8u);
+  EXPECT_EQ(ring.Size(), 8u);
+  EXPECT_EQ(ring.Write(data.data(), 1), 0u);
+
+  std::vector<std::uint8_t> read(10);
+  ASSERT_EQ(ring.Read(read.data(), read.size()), 8u);
+  read.resize(8);
+  EXPECT_EQ(read, Bytes(8, 0));
+  EXPECT_EQ(ring.Size(), 0u);
+}
+
+TEST(SpscRingBufferTest, WrapsAround) {
+  SpscRingBuffer ring(8);
+  const auto first = Bytes(6, 0);
+  ASSERT_EQ(ring.Write(first.data(), first.size()), 6u);
+  std::vector<std::uint8_t> read(6);
+  ASSERT_EQ(ring.Read(read.data(), 5), 5u);
+
+  // Starts at offset 6 and continues at the beginning of the buffer.
+  const auto second = Bytes(7, 100);
+  ASSERT_EQ(ring.Write(second.data(), second.size()), 7u);
+
+  read.resize(8);
+  ASSERT_EQ(ring.Read(read.data(), read.size()), 8u);
+  EXPECT_EQ(read, (std::vector<std::uint8_t>{5, 100, 101, 102, 103, 104, 105,
+                                             106}));
+}
+
+TEST(SpscRingBufferTest, ClearDropsEverything) {
+  SpscRingBuffer ring(8);
+  const auto data = Bytes(5, 0);
+  ASSERT_EQ(ring.Write(data.data(), data.size()), 5u);
+
+  EXPECT_EQ(ring.Clear(), 5u);
+  EXPECT_EQ(ring.Size(), 0u);
+  EXPECT_EQ(ring.Write(data.data(), data.size()), 5u);
+}
+
+TEST(SpscRingBufferTest, DiscardUntilKeepsLaterWrites) {
+  SpscRingBuffer ring(8);
+  const auto first = Bytes(5, 0);
+  ASSERT_EQ(ring.Write(first.data(), first.size()), 5u);
+  const auto position = ring.WritePosition();
+  const auto second = Bytes(2, 100);
+  ASSERT_EQ(ring.Write(second.data(), second.size()), 2u);
+
+  EXPECT_EQ(ring.DiscardUntil(position), 5u);
+
+  std::vector<std::uint8_t> read(8);
+  ASSERT_EQ(ring.Read(read.data(), read.size()), 2u);
+  read.resize(2);
+  EXPECT_EQ(read, second);
+}
+
+TEST(SpscRingBufferTest, DiscardUntilIgnoresReadBytes) {
+  SpscRingBuffer ring(8);
+  const auto data = Bytes(4, 0);
+  ASSERT_EQ(ring.Write(data.data(), data.size()), 4u);
+  const auto position = ring.WritePosition();
+  std::vector<std::uint8_t> read(4);
+  ASSERT_EQ(ring.Read(read.data(), read.size()), 4u);
+  ASSERT_EQ(ring.Write(data.data(), data.size()), 4u);
+
+  EXPECT_EQ(ring.DiscardUntil(position), 0u);
+  EXPECT_EQ(ring.Size(), 4u);
+}
+
+TEST(SpscRingBufferTest, ProducerAndConsumerThreads) {
+  constexpr std::size_t kTotal = 1 << 20;
+  SpscRingBuffer ring(64);
+  const auto data = Bytes(kTotal, 0);
+
+  std::thread producer([&ring, &data]() {
+    std::size_t written = 0;
+    while (written < data.size()) {
+      // Odd sizes so writes keep straddling the end of the buffer.
+      const auto len = std::min<std::size_t>(13, data.size() - written);
+      const auto count = ring.Write(data.data() + written, len);
+      if (count == 0) {
+        std::this_thread::yield();
+      }
+      written += count;
+    }
+  });
+  std::vector<std::uint8_t> read(kTotal);
+  std::size_t read_len = 0;
+  while (read_len < kTotal) {
+    EXPECT_LE(ring.Size(), ring.Capacity());
+    const auto count = ring.Read(read.data() + read_len,
+                                 std::min<std::size_t>(29, kTotal - read_len));
+    if (count == 0) {
+      std::this_thread::yield();
+    }
+    read_len += count;
+  }
+  producer.join();
+
+  EXPECT_EQ(read, data);
+  EXPECT_EQ(ring.Size(), 0u);
+}
+
+}  // namespace
+}  // namespace cuttlefish
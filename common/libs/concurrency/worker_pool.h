@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cuttlefish {
+/**
+ * Fixed set of threads to run batches of independent tasks.
+ *
+ * The thread calling Run() takes part in running the batch and only returns
+ * once all of its tasks are done, so a pool with concurrency N starts N - 1
+ * threads of its own. Batches from different callers are run one at a time.
+ */
+class WorkerPool {
+ public:
+  explicit WorkerPool(std::size_t concurrency) {
+    for (std::size_t i = 1; i < concurrency; i++) {
+      workers_.emplace_back([this]() { WorkerLoop(); });
+    }
+  }
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    batch_cv_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  std::size_t Concurrency() const { return workers_.size() + 1; }
+
+  // Runs each of `tasks` once and returns when all of them are done. Tasks
+  // must not throw, the host tools are built without exceptions. They report
+  // failures through the state they capture instead.
+  void Run(const std::vector<std::function<void()>>& tasks) {
+    std::lock_guard<std::mutex> run_lock(run_mutex_);
+    if (workers_.empty() || tasks.size() <= 1) {
+      for (const auto& task : tasks) {
+        task();
+      }
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_ = &tasks;
+      next_task_ = 0;
+      pending_tasks_ = tasks.size();
+      batch_number_++;
+    }
+    batch_cv_.notify_all();
+    RunTasks();
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this]() { return pending_tasks_ == 0; });
+    tasks_ = nullptr;
+  }
+
+ private:
+  void RunTasks() {
+    for (;;) {
+      const std::function<void()>* task;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tasks_ == nullptr || next_task_ == tasks_->size()) {
+          return;
+        }
+        task = &(*tasks_)[next_task_++];
+      }
+      (*task)();
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_tasks_ == 0) {
+          done_cv_.notify_all();
+        }
+      }
+    }
+  }
+
+  void WorkerLoop() {
+    std::uint64_t last_batch = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        batch_cv_.wait(lock, [this, last_batch]() {
+          return stop_ || batch_number_ != last_batch;
+        });
+        if (stop_) {
+          return;
+        }
+        last_batch = batch_number_;
+      }
+      RunTasks();
+    }
+  }
+
+  std::mutex run_mutex_;  // serializes Run() callers
+  std::mutex mutex_;      // guards the batch state below
+  std::condition_variable batch_cv_;
+  std::condition_variable done_cv_;
+  const std::vector<std::function<void()>>* tasks_ = nullptr;
+  std::size_t next_task_ = 0;
+  std::size_t pending_tasks_ = 0;
+  std::uint64_t batch_number_ = 0;
+  bool stop_ = false;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace cuttlefish
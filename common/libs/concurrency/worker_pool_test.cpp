@@ -0,0 +1,151 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/libs/concurrency/worker_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace cuttlefish {
+namespace {
+
+// Tasks that count how often each of them ran.
+std::vector<std::function<void()>> CountingTasks(
+    std::vector<std::atomic<int>>& runs) {
+  std::vector<std::function<void()>> tasks;
+  for (std::size_t i = 0; i < runs.size(); i++) {
+    tasks.emplace_back([&runs, i]() { runs[i]++; });
+  }
+  return tasks;
+}
+
+TEST(WorkerPoolTest, RunsEveryTaskOnce) {
+  for (std::size_t concurrency : {1, 2, 8}) {
+    WorkerPool pool(concurrency);
+    std::vector<std::atomic<int>> runs(1000);
+
+    pool.Run(CountingTasks(runs));
+
+    EXPECT_EQ(pool.Concurrency(), concurrency);
+    for (std::size_t i = 0; i < runs.size(); i++) {
+      ASSERT_EQ(runs[i], 1) << "task " << i << ", concurrency " << concurrency;
+    }
+  }
+}
+
+TEST(WorkerPoolTest, RunsNoTasks) {
+  WorkerPool pool(4);
+
+  pool.Run({});
+}
+
+TEST(WorkerPoolTest, ReturnsOnceAllTasksCompleted) {
+  WorkerPool pool(4);
+  std::atomic<int> completed = 0;
+  std::vector<std::function<void()>> tasks;
+  for (int i = 0; i < 16; i++) {
+    tasks.emplace_back([&completed, i]() {
+      // The last tasks to be picked up finish last.
+      std::this_thread::sleep_for(std::chrono::milliseconds(i));
+      completed++;
+    });
+  }
+
+  pool.Run(tasks);
+
+  EXPECT_EQ(completed, 16);
+}
+
+TEST(WorkerPoolTest, RunsTasksConcurrently) {
+  constexpr int kConcurrency = 4;
+  WorkerPool pool(kConcurrency);
+  std::mutex mutex;
+  std::condition_variable all_started;
+  int started = 0;
+  bool timed_out = false;
+  // Every task waits for all the others to start, which only happens when
+  // each of them is on a thread of its own.
+  std::vector<std::function<void()>> tasks(kConcurrency, [&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    started++;
+    all_started.notify_all();
+    if (!all_started.wait_for(lock, std::chrono::seconds(10),
+                              [&]() { return started == kConcurrency; })) {
+      timed_out = true;
+    }
+  });
+
+  pool.Run(tasks);
+
+  EXPECT_FALSE(timed_out);
+}
+
+TEST(WorkerPoolTest, RunsSuccessiveBatches) {
+  WorkerPool pool(4);
+  std::vector<std::atomic<int>> runs(100);
+  const auto tasks = CountingTasks(runs);
+
+  for (int batch = 1; batch <= 10; batch++) {
+    pool.Run(tasks);
+
+    for (std::size_t i = 0; i < runs.size(); i++) {
+      ASSERT_EQ(runs[i], batch) << "task " << i;
+    }
+  }
+}
+
+TEST(WorkerPoolTest, RunsBatchesOfConcurrentCallers) {
+  WorkerPool pool(4);
+  std::vector<std::vector<std::atomic<int>>> runs;
+  for (int i = 0; i < 4; i++) {
+    runs.emplace_back(500);
+  }
+
+  std::vector<std::thread> callers;
+  for (auto& caller_runs : runs) {
+    callers.emplace_back(
+        [&pool, &caller_runs]() { pool.Run(CountingTasks(caller_runs)); });
+  }
+  for (auto& caller : callers) {
+    caller.join();
+  }
+
+  for (const auto& caller_runs : runs) {
+    for (const auto& task_runs : caller_runs) {
+      ASSERT_EQ(task_runs, 1);
+    }
+  }
+}
+
+TEST(WorkerPoolTest, ShutsDownIdleWorkers) {
+  // Neither a pool that never ran a batch nor one that is done with its
+  // batches keeps its threads from being joined.
+  { WorkerPool pool(8); }
+  {
+    WorkerPool pool(8);
+    std::vector<std::atomic<int>> runs(100);
+    pool.Run(CountingTasks(runs));
+  }
+}
+
+}  // namespace
+}  // namespace cuttlefish
@@ -21,9 +21,10 @@
 #include <memory>
 #include <mutex>
 #include <optional>
-#include <set>
 #include <shared_mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "common/libs/fs/shared_fd.h"
 #include "common/libs/utils/result.h"
@@ -72,7 +73,7 @@ Result<void> Epoll::Add(SharedFD fd, uint32_t events) {
   std::lock(watched_lock, epoll_lock);
   CF_EXPECT(epoll_fd_->IsOpen(), "Empty Epoll instance");
 
-  if (watched_.count(fd) != 0) {
+  if (watched_.count(fd->fd_) != 0) {
     return CF_ERRNO("Watched set already contains fd");
   }
   epoll_event event;
@@ -85,7 +86,7 @@ Result<void> Epoll::Add(SharedFD fd, uint32_t events) {
   } else if (success != 0) {
     return CF_ERRNO("epoll_ctl: Add failed");
   }
-  watched_.insert(fd);
+  watched_[fd->fd_] = fd;
   return {};
 }
 
@@ -98,13 +99,13 @@ Result<void> Epoll::AddOrModify(SharedFD fd, uint32_t events) {
   epoll_event event;
   event.events = events;
   event.data.fd = fd->fd_;
-  int operation = watched_.count(fd) == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+  int operation = watched_.count(fd->fd_) == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
   int success = epoll_ctl(epoll_fd_->fd_, operation, fd->fd_, &event);
   if (success != 0) {
     std::string operation_str = operation == EPOLL_CTL_ADD ? "add" : "modify";
     return CF_ERRNO("epoll_ctl: Operation " << operation_str << " failed");
   }
-  watched_.insert(fd);
+  watched_[fd->fd_] = fd;
   return {};
 }
 
@@ -114,7 +115,7 @@ Result<void> Epoll::Modify(SharedFD fd, uint32_t events) {
   std::lock(watched_lock, epoll_lock);
   CF_EXPECT(epoll_fd_->IsOpen(), "Empty Epoll instance");
 
-  if (watched_.count(fd) == 0) {
+  if (watched_.count(fd->fd_) == 0) {
     return CF_ERR("Watched set did not contain fd");
   }
   epoll_event event;
@@ -133,14 +134,14 @@ Result<void> Epoll::Delete(SharedFD fd) {
   std::lock(watched_lock, epoll_lock);
   CF_EXPECT(epoll_fd_->IsOpen(), "Empty Epoll instance");
 
-  if (watched_.count(fd) == 0) {
+  if (watched_.count(fd->fd_) == 0) {
     return CF_ERR("Watched set did not contain fd");
   }
   int success = epoll_ctl(epoll_fd_->fd_, EPOLL_CTL_DEL, fd->fd_, nullptr);
   if (success != 0) {
     return CF_ERRNO("epoll_ctl: Delete failed");
   }
-  watched_.erase(fd);
+  watched_.erase(fd->fd_);
   return {};
 }
 
@@ -159,21 +160,42 @@ Result<std::optional<EpollEvent>> Epoll::Wait() {
   } else if (success != 1) {
     return CF_ERR("epoll_wait returned an unexpected value");
   }
-  EpollEvent ret;
-  ret.events = event.events;
   std::shared_lock lock(watched_mutex_);
-  for (const auto& watched : watched_) {
-    if (watched->fd_ == event.data.fd) {
-      ret.fd = watched;
-      break;
-    }
-  }
-  if (!ret.fd->IsOpen()) {
+  auto watched = watched_.find(event.data.fd);
+  if (watched == watched_.end()) {
     // Couldn't find the matching SharedFD to the file descriptor. We probably
     // lost the race to lock watched_mutex_ against a delete call. Treat this
     // as a spurious wakeup.
     return {};
   }
+  return EpollEvent{.fd = watched->second, .events = event.events};
+}
+
+Result<std::vector<EpollEvent>> Epoll::Wait(std::size_t max_events) {
+  CF_EXPECT(max_events > 0, "Must wait for at least one event");
+  std::vector<epoll_event> events(max_events);
+  int count;
+  {
+    std::shared_lock lock(epoll_mutex_);
+    CF_EXPECT(epoll_fd_->IsOpen(), "Empty Epoll instance");
+    count = TEMP_FAILURE_RETRY(
+        epoll_wait(epoll_fd_->fd_, events.data(), events.size(), -1));
+  }
+  if (count == -1) {
+    return CF_ERRNO("epoll_wait failed");
+  }
+  CF_EXPECT(count <= (int)max_events,
+            "epoll_wait returned an unexpected value");
+  std::vector<EpollEvent> ret;
+  ret.reserve(count);
+  std::shared_lock lock(watched_mutex_);
+  for (int i = 0; i < count; i++) {
+    auto watched = watched_.find(events[i].data.fd);
+    if (watched != watched_.end()) {
+      ret.push_back(
+          EpollEvent{.fd = watched->second, .events = events[i].events});
+    }
+  }
   return ret;
 }
 
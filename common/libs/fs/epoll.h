@@ -20,8 +20,9 @@
 
 #include <memory>
 #include <optional>
-#include <set>
 #include <shared_mutex>
+#include <unordered_map>
+#include <vector>
 
 #include "common/libs/fs/shared_fd.h"
 #include "common/libs/utils/result.h"
@@ -45,6 +46,12 @@ class Epoll {
   Result<void> AddOrModify(SharedFD fd, uint32_t events);
   Result<void> Delete(SharedFD fd);
   Result<std::optional<EpollEvent>> Wait();
+  /**
+   * Returns up to `max_events` ready descriptors from a single epoll_wait call.
+   * Events for descriptors deleted while waiting are dropped, so the result
+   * may be empty.
+   */
+  Result<std::vector<EpollEvent>> Wait(std::size_t max_events);
 
  private:
   Epoll(SharedFD);
@@ -62,10 +69,14 @@ class Epoll {
   SharedFD epoll_fd_;
   /**
    * This read-write mutex is read-locked when interacting with it as a const
-   * std::set, and write-locked when interacting with it as a std::set.
+   * std::unordered_map, and write-locked when interacting with it as a
+   * std::unordered_map.
+   *
+   * Keyed by the file descriptor number, which is also the data of its epoll
+   * events, so ready events are resolved without scanning the watched set.
    */
   std::shared_mutex watched_mutex_;
-  std::set<SharedFD> watched_;
+  std::unordered_map<int, SharedFD> watched_;
 };
 
 }  // namespace cuttlefish
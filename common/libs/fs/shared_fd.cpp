@@ -23,6 +23,9 @@
 #include <poll.h>
 #include <sys/file.h>
 #include <sys/mman.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
@@ -30,11 +33,13 @@
 #include <cstddef>
 
 #include <algorithm>
+#include <limits>
 #include <sstream>
 #include <vector>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/unique_fd.h>
 
 #include "common/libs/fs/shared_buf.h"
 #include "common/libs/fs/shared_select.h"
@@ -108,10 +113,134 @@ bool IsRegularFile(const int fd) {
 
 constexpr size_t kPreferredBufferSize = 8192;
 
+#ifdef __linux__
+
+#ifndef __NR_copy_file_range
+# if defined(__x86_64__)
+#  define __NR_copy_file_range 326
+# elif defined(__i386__)
+#  define __NR_copy_file_range 377
+# elif defined(__aarch64__)
+#  define __NR_copy_file_range 285
+# else
+#  error "Unknown architecture."
+# endif
+#endif
+
+// copy_file_range was only added in glibc 2.27, see memfd_create_wrapper.
+ssize_t copy_file_range_wrapper(int fd_in, int fd_out, size_t len) {
+#ifdef CUTTLEFISH_HOST
+  return syscall(__NR_copy_file_range, fd_in, nullptr, fd_out, nullptr, len,
+                 0);
+#else
+  return copy_file_range(fd_in, nullptr, fd_out, nullptr, len, 0);
+#endif
+}
+
+// Most data moved by a single in-kernel copy, so that the stop fd is still
+// checked regularly during long copies.
+constexpr size_t kMaxKernelCopySize = 1 << 20;
+
+// How CopyFrom moves the data, the in-kernel methods avoid bringing it into
+// user space.
+enum class CopyMethod {
+  kBuffered,
+  // Between regular files, may even share the blocks on some file systems.
+  kCopyFileRange,
+  // From a regular file to anything else.
+  kSendfile,
+  // From a socket, pipe or device, through an intermediate pipe.
+  kSplice,
+};
+
+CopyMethod PreferredCopyMethod(bool in_is_regular, bool out_is_regular) {
+  if (in_is_regular) {
+    return out_is_regular ? CopyMethod::kCopyFileRange : CopyMethod::kSendfile;
+  }
+  return CopyMethod::kSplice;
+}
+
+// Errors meaning the method is not supported for this pair of files, as
+// opposed to the copy having failed.
+bool IsUnsupportedCopy(int error) {
+  return error == EINVAL || error == ENOSYS || error == EXDEV ||
+         error == EOPNOTSUPP || error == EBADF;
+}
+
+// Moves up to len bytes from in_fd to out_fd through the pipe. All the data
+// taken from in_fd is delivered to out_fd before returning, by hand if out_fd
+// doesn't take spliced data. Returns the number of bytes moved, 0 at the end of
+// the input or -1 with errno set. Sets input_taken when failing after data was
+// taken from in_fd, that data is lost and the copy can't be resumed some other
+// way.
+ssize_t SpliceThroughPipe(int in_fd, int out_fd, const int pipe_fds[2],
+                          size_t len, bool* input_taken) {
+  *input_taken = false;
+  ssize_t moved = TEMP_FAILURE_RETRY(
+      splice(in_fd, nullptr, pipe_fds[1], nullptr, len, SPLICE_F_MOVE));
+  if (moved <= 0) {
+    return moved;
+  }
+  *input_taken = true;
+  ssize_t pending = moved;
+  while (pending > 0) {
+    ssize_t written = TEMP_FAILURE_RETRY(
+        splice(pipe_fds[0], nullptr, out_fd, nullptr, pending, SPLICE_F_MOVE));
+    if (written < 0 && IsUnsupportedCopy(errno)) {
+      // The output doesn't take spliced data, deliver the rest by hand.
+      char buffer[kPreferredBufferSize];
+      ssize_t num_read = TEMP_FAILURE_RETRY(
+          read(pipe_fds[0], buffer, std::min(sizeof(buffer), size_t(pending))));
+      if (num_read <= 0) {
+        errno = num_read == 0 ? EIO : errno;
+        return -1;
+      }
+      written = 0;
+      while (written < num_read) {
+        ssize_t res = TEMP_FAILURE_RETRY(
+            write(out_fd, buffer + written, num_read - written));
+        if (res <= 0) {
+          errno = res == 0 ? EIO : errno;
+          return -1;
+        }
+        written += res;
+      }
+    } else if (written <= 0) {
+      errno = written == 0 ? EIO : errno;
+      return -1;
+    }
+    pending -= written;
+  }
+  return moved;
+}
+
+// Whether an in-kernel copy from in_fd that returned 0 really reached the end
+// of the input. Some files, like those in procfs and sysfs, report a size of 0
+// and are only copied by reading them.
+bool AtEndOfRegularFile(int in_fd) {
+  struct stat st;
+  if (fstat(in_fd, &st) != 0 || st.st_size == 0) {
+    return false;
+  }
+  off_t offset = lseek(in_fd, 0, SEEK_CUR);
+  return offset >= 0 && offset >= st.st_size;
+}
+
+#endif  // __linux__
+
 }  // namespace
 
 bool FileInstance::CopyFrom(FileInstance& in, size_t length, FileInstance* stop) {
-  std::vector<char> buffer(kPreferredBufferSize);
+  std::vector<char> buffer;
+#ifdef __linux__
+  CopyMethod method = PreferredCopyMethod(in.is_regular_file_,
+                                          is_regular_file_);
+  android::base::unique_fd pipe_read, pipe_write;
+  if (method == CopyMethod::kSplice &&
+      !android::base::Pipe(&pipe_read, &pipe_write)) {
+    method = CopyMethod::kBuffered;
+  }
+#endif
   while (length > 0) {
     int nfds = stop == nullptr ? 2 : 3;
     // Wait until either in becomes readable or our fd closes.
@@ -144,6 +273,54 @@ bool FileInstance::CopyFrom(FileInstance& in, size_t length, FileInstance* stop)
       return false;
     }
 
+#ifdef __linux__
+    if (method != CopyMethod::kBuffered) {
+      const size_t chunk_size = std::min(length, kMaxKernelCopySize);
+      ssize_t copied = -1;
+      bool input_taken = false;
+      switch (method) {
+        case CopyMethod::kCopyFileRange:
+          copied = copy_file_range_wrapper(in.fd_, fd_, chunk_size);
+          break;
+        case CopyMethod::kSendfile:
+          copied = sendfile(fd_, in.fd_, nullptr, chunk_size);
+          break;
+        case CopyMethod::kSplice: {
+          const int pipe_fds[2] = {pipe_read.get(), pipe_write.get()};
+          copied = SpliceThroughPipe(in.fd_, fd_, pipe_fds, chunk_size,
+                                     &input_taken);
+          break;
+        }
+        case CopyMethod::kBuffered:
+          break;
+      }
+      if (copied < 0 && !input_taken && IsUnsupportedCopy(errno)) {
+        // Nothing was copied, continue the old fashioned way.
+        method = CopyMethod::kBuffered;
+        continue;
+      }
+      if (copied < 0) {
+        errno_ = errno;
+        return false;
+      }
+      if (copied == 0 && method != CopyMethod::kSplice &&
+          !AtEndOfRegularFile(in.fd_)) {
+        // The file can't be copied in the kernel even though it has more data.
+        method = CopyMethod::kBuffered;
+        continue;
+      }
+      if (copied == 0) {
+        // The end of the input.
+        return false;
+      }
+      length -= copied;
+      continue;
+    }
+#endif
+
+    if (buffer.empty()) {
+      buffer.resize(kPreferredBufferSize);
+    }
     ssize_t num_read = in.Read(buffer.data(), std::min(buffer.size(), length));
     if (num_read <= 0) {
       return false;
@@ -170,7 +347,9 @@ bool FileInstance::CopyAllFrom(FileInstance& in, FileInstance* stop) {
   // the errno variable is not zeroed out before.
   errno_ = 0;
   in.errno_ = 0;
-  while (CopyFrom(in, kPreferredBufferSize, stop)) {
+  // A single call keeps the state of the in-kernel copy methods for the whole
+  // transfer, it only returns at the end of the input or on error.
+  while (CopyFrom(in, std::numeric_limits<size_t>::max(), stop)) {
   }
   // Only return false if there was an actual error.
   return !GetErrno() && !in.GetErrno();
@@ -15,13 +15,18 @@
  */
 
 #include "common/libs/fs/shared_fd.h"
+#include "common/libs/fs/shared_buf.h"
 #include "common/libs/fs/shared_select.h"
 
+#include <fcntl.h>
 #include <stdlib.h>
+#include <sys/socket.h>
 #include <unistd.h>
+#include <android-base/file.h>
 #include <gtest/gtest.h>
 
 #include <string>
+#include <thread>
 
 namespace cuttlefish {
 
@@ -38,4 +43,120 @@ TEST(SendFD, Basic) {
   EXPECT_EQ(0, strcmp(buf, pipe_message));
 }
 
+// Not a multiple of any copy chunk size.
+std::string CopyTestData() {
+  std::string data(3 * 1024 * 1024 + 17, '\0');
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<char>(i * 7);
+  }
+  return data;
 }
+
+TEST(CopyFrom, RegularFiles) {
+  const std::string data = CopyTestData();
+  SharedFD in = SharedFD::MemfdCreateWithData("copy_in", data);
+  SharedFD out = SharedFD::MemfdCreate("copy_out");
+  ASSERT_TRUE(in->IsOpen());
+  ASSERT_TRUE(out->IsOpen());
+
+  EXPECT_TRUE(out->CopyFrom(*in, data.size()));
+
+  ASSERT_EQ(out->LSeek(0, SEEK_SET), 0);
+  std::string copied;
+  EXPECT_EQ(ReadAll(out, &copied), static_cast<ssize_t>(data.size()));
+  EXPECT_EQ(copied, data);
+}
+
+TEST(CopyFrom, StopsAtEndOfInput) {
+  const std::string data = "short";
+  SharedFD in = SharedFD::MemfdCreateWithData("copy_in", data);
+  SharedFD out = SharedFD::MemfdCreate("copy_out");
+
+  EXPECT_FALSE(out->CopyFrom(*in, data.size() + 1));
+
+  ASSERT_EQ(out->LSeek(0, SEEK_SET), 0);
+  std::string copied;
+  EXPECT_EQ(ReadAll(out, &copied), static_cast<ssize_t>(data.size()));
+  EXPECT_EQ(copied, data);
+}
+
+TEST(CopyFrom, RegularFileToPipe) {
+  const std::string data = "Testing the copy";
+  SharedFD in = SharedFD::MemfdCreateWithData("copy_in", data);
+  SharedFD pipe_read, pipe_write;
+  ASSERT_TRUE(SharedFD::Pipe(&pipe_read, &pipe_write));
+
+  EXPECT_TRUE(pipe_write->CopyFrom(*in, data.size()));
+  pipe_write->Close();
+
+  std::string copied;
+  EXPECT_EQ(ReadAll(pipe_read, &copied), static_cast<ssize_t>(data.size()));
+  EXPECT_EQ(copied, data);
+}
+
+// Files in procfs look empty to the in-kernel copies.
+TEST(CopyAllFrom, ProcFile) {
+  std::string expected;
+  ASSERT_TRUE(android::base::ReadFileToString("/proc/self/mountinfo",
+                                              &expected));
+  ASSERT_FALSE(expected.empty());
+  SharedFD in = SharedFD::Open("/proc/self/mountinfo", O_RDONLY);
+  SharedFD out = SharedFD::MemfdCreate("copy_out");
+  ASSERT_TRUE(in->IsOpen());
+
+  EXPECT_TRUE(out->CopyAllFrom(*in));
+
+  ASSERT_EQ(out->LSeek(0, SEEK_SET), 0);
+  std::string copied;
+  ReadAll(out, &copied);
+  // The mounts of the test process don't change while it runs.
+  EXPECT_EQ(copied, expected);
+}
+
+// Files opened for appending don't take spliced data, what was already taken
+// from the socket has to be delivered by hand.
+TEST(CopyAllFrom, SocketToAppendOnlyFile) {
+  const std::string data = CopyTestData();
+  TemporaryFile file;
+  SharedFD out = SharedFD::Open(file.path, O_WRONLY | O_APPEND);
+  SharedFD in_write, in_read;
+  ASSERT_TRUE(out->IsOpen());
+  ASSERT_TRUE(
+      SharedFD::SocketPair(AF_UNIX, SOCK_STREAM, 0, &in_write, &in_read));
+
+  std::thread writer([&in_write, &data]() {
+    EXPECT_EQ(WriteAll(in_write, data), static_cast<ssize_t>(data.size()));
+    in_write->Shutdown(SHUT_WR);
+  });
+  EXPECT_TRUE(out->CopyAllFrom(*in_read));
+  writer.join();
+
+  std::string copied;
+  ASSERT_TRUE(android::base::ReadFileToString(file.path, &copied));
+  EXPECT_EQ(copied, data);
+}
+
+TEST(CopyAllFrom, SocketToSocket) {
+  const std::string data = CopyTestData();
+  SharedFD in_write, in_read, out_write, out_read;
+  ASSERT_TRUE(
+      SharedFD::SocketPair(AF_UNIX, SOCK_STREAM, 0, &in_write, &in_read));
+  ASSERT_TRUE(
+      SharedFD::SocketPair(AF_UNIX, SOCK_STREAM, 0, &out_write, &out_read));
+
+  std::thread writer([&in_write, &data]() {
+    EXPECT_EQ(WriteAll(in_write, data), static_cast<ssize_t>(data.size()));
+    in_write->Shutdown(SHUT_WR);
+  });
+  std::thread copier([&in_read, &out_write]() {
+    EXPECT_TRUE(out_write->CopyAllFrom(*in_read));
+    out_write->Shutdown(SHUT_WR);
+  });
+  std::string copied;
+  EXPECT_EQ(ReadAll(out_read, &copied), static_cast<ssize_t>(data.size()));
+  writer.join();
+  copier.join();
+  EXPECT_EQ(copied, data);
+}
+
+}  // namespace cuttlefish
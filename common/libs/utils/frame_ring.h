@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+// Layout of a ring of fixed size frame slots in memory shared between a
+// writer on the host and a reader in the guest, such as a pmem device. Only
+// the slot and sequence number of each frame are then sent over the control
+// connection, as a FrameRingMessage.
+//
+// The region starts with a FrameRingHeader page, followed by `slot_count`
+// slots of `slot_size` bytes. Each slot is a FrameRingSlotHeader page followed
+// by the frame. Everything is page aligned so the guest can read it with
+// O_DIRECT, which bypasses its page cache.
+//
+// A slot's sequence number is odd while the writer is filling it and even once
+// the frame is complete, like a seqlock. A reader copies the frame out and
+// then checks that the sequence number still is the one it was sent, to know
+// the writer didn't reuse the slot in the meantime.
+
+namespace cuttlefish {
+
+inline constexpr std::uint32_t kFrameRingMagic = 0x52464643;  // "CFFR"
+inline constexpr std::uint32_t kFrameRingVersion = 1;
+inline constexpr std::size_t kFrameRingPageSize = 4096;
+
+struct FrameRingHeader {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t slot_count;
+  // Including the slot header page.
+  std::uint32_t slot_size;
+};
+
+struct FrameRingSlotHeader {
+  std::uint64_t sequence;
+  std::uint32_t size;
+  std::uint32_t reserved;
+};
+
+inline constexpr std::uint32_t kFrameRingMessageMagic = 0x4d464643;  // "CFFM"
+
+// Its size can't be confused with that of a YUV 4:2:0 frame, whose size is a
+// multiple of 3, nor its magic with that of a JPEG or PNG image.
+struct FrameRingMessage {
+  std::uint32_t magic;
+  std::uint32_t slot;
+  std::uint64_t sequence;
+};
+
+static_assert(sizeof(FrameRingMessage) % 3 != 0);
+
+inline std::vector<char> SerializeFrameRingMessage(
+    const FrameRingMessage& message) {
+  std::vector<char> data(sizeof(message));
+  std::memcpy(data.data(), &message, sizeof(message));
+  return data;
+}
+
+inline std::optional<FrameRingMessage> ParseFrameRingMessage(
+    const std::vector<char>& data) {
+  FrameRingMessage message;
+  if (data.size() != sizeof(message)) {
+    return std::nullopt;
+  }
+  std::memcpy(&message, data.data(), sizeof(message));
+  if (message.magic != kFrameRingMessageMagic) {
+    return std::nullopt;
+  }
+  return message;
+}
+
+inline std::size_t FrameRingSlotOffset(const FrameRingHeader& header,
+                                       std::uint32_t slot) {
+  return kFrameRingPageSize + std::size_t(slot) * header.slot_size;
+}
+
+inline std::size_t FrameRingSlotCapacity(const FrameRingHeader& header) {
+  return header.slot_size - kFrameRingPageSize;
+}
+
+// Whether `header` describes a ring that fits in `region_size` bytes.
+inline bool FrameRingHeaderIsValid(const FrameRingHeader& header,
+                                   std::size_t region_size) {
+  return header.magic == kFrameRingMagic &&
+         header.version == kFrameRingVersion && header.slot_count > 0 &&
+         header.slot_size > kFrameRingPageSize &&
+         header.slot_size % kFrameRingPageSize == 0 &&
+         region_size >= kFrameRingPageSize &&
+         (region_size - kFrameRingPageSize) / header.slot_size >=
+             header.slot_count;
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "common/libs/utils/frame_ring_writer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include <atomic>
+#include <cstring>
+#include <utility>
+
+#include "common/libs/utils/files.h"
+
+namespace cuttlefish {
+namespace {
+
+// The reader is another machine as far as the compiler knows, so the slot
+// sequence numbers are only ever accessed atomically.
+void StoreSequence(FrameRingSlotHeader* slot, std::uint64_t sequence) {
+  __atomic_store_n(&slot->sequence, sequence, __ATOMIC_RELEASE);
+}
+
+}  // namespace
+
+Result<std::unique_ptr<FrameRingWriter>> FrameRingWriter::Create(
+    const std::string& path, std::uint32_t slot_count) {
+  CF_EXPECT(slot_count > 0);
+  const std::size_t size = FileSize(path);
+  CF_EXPECTF(size > kFrameRingPageSize, "\"{}\" is too small for a frame ring",
+             path);
+  const std::size_t slot_size =
+      (size - kFrameRingPageSize) / slot_count / kFrameRingPageSize *
+      kFrameRingPageSize;
+  CF_EXPECTF(slot_size > kFrameRingPageSize,
+             "\"{}\" is too small for {} frame slots", path, slot_count);
+
+  SharedFD fd = SharedFD::Open(path, O_RDWR);
+  CF_EXPECTF(fd->IsOpen(), "Failed to open \"{}\": {}", path, fd->StrError());
+  ScopedMMap region =
+      fd->MMap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, 0);
+  CF_EXPECTF(static_cast<bool>(region), "Failed to map \"{}\": {}", path,
+             fd->StrError());
+
+  FrameRingHeader header{
+      .magic = kFrameRingMagic,
+      .version = kFrameRingVersion,
+      .slot_count = slot_count,
+      .slot_size = static_cast<std::uint32_t>(slot_size),
+  };
+  char* base = static_cast<char*>(region.get());
+  for (std::uint32_t slot = 0; slot < slot_count; slot++) {
+    std::memset(base + FrameRingSlotOffset(header, slot), 0,
+                sizeof(FrameRingSlotHeader));
+  }
+  // The magic goes in last, so a reader never sees a half written header as
+  // valid.
+  auto shared_header = reinterpret_cast<FrameRingHeader*>(base);
+  __atomic_store_n(&shared_header->magic, 0, __ATOMIC_RELAXED);
+  std::atomic_thread_fence(std::memory_order_release);
+  shared_header->version = header.version;
+  shared_header->slot_count = header.slot_count;
+  shared_header->slot_size = header.slot_size;
+  __atomic_store_n(&shared_header->magic, header.magic, __ATOMIC_RELEASE);
+
+  return std::unique_ptr<FrameRingWriter>(
+      new FrameRingWriter(std::move(region), header));
+}
+
+FrameRingWriter::FrameRingWriter(ScopedMMap region, FrameRingHeader header)
+    : region_(std::move(region)), header_(header) {}
+
+std::size_t FrameRingWriter::SlotCapacity() const {
+  return FrameRingSlotCapacity(header_);
+}
+
+std::optional<FrameRingMessage> FrameRingWriter::Write(
+    const std::vector<StridedBuffer>& buffers) {
+  std::size_t size = 0;
+  for (const auto& buffer : buffers) {
+    size += std::size_t(buffer.row_size) * buffer.rows;
+  }
+  if (size > SlotCapacity()) {
+    return std::nullopt;
+  }
+
+  const std::uint32_t slot = next_slot_;
+  next_slot_ = (next_slot_ + 1) % header_.slot_count;
+  char* slot_start =
+      static_cast<char*>(region_.get()) + FrameRingSlotOffset(header_, slot);
+  auto slot_header = reinterpret_cast<FrameRingSlotHeader*>(slot_start);
+
+  // An odd sequence number tells a reader still copying the previous frame
+  // out of this slot that it's being overwritten.
+  StoreSequence(slot_header, sequence_ + 1);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  char* dst = slot_start + kFrameRingPageSize;
+  for (const auto& buffer : buffers) {
+    if (buffer.stride == static_cast<int>(buffer.row_size)) {
+      std::size_t plane_size = std::size_t(buffer.row_size) * buffer.rows;
+      std::memcpy(dst, buffer.data, plane_size);
+      dst += plane_size;
+      continue;
+    }
+    const char* row = buffer.data;
+    for (unsigned int i = 0; i < buffer.rows; i++) {
+      std::memcpy(dst, row, buffer.row_size);
+      dst += buffer.row_size;
+      row += buffer.stride;
+    }
+  }
+  slot_header->size = static_cast<std::uint32_t>(size);
+
+  sequence_ += 2;
+  StoreSequence(slot_header, sequence_);
+  return FrameRingMessage{
+      .magic = kFrameRingMessageMagic,
+      .slot = slot,
+      .sequence = sequence_,
+  };
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common/libs/fs/shared_fd.h"
+#include "common/libs/utils/frame_ring.h"
+#include "common/libs/utils/result.h"
+#include "common/libs/utils/vsock_connection.h"
+
+namespace cuttlefish {
+
+// Fills the slots of a frame ring in the file at a path, in turn. The file is
+// shared with the reader, so it's (re)formatted when the writer is created.
+class FrameRingWriter {
+ public:
+  static Result<std::unique_ptr<FrameRingWriter>> Create(
+      const std::string& path, std::uint32_t slot_count);
+
+  FrameRingWriter(const FrameRingWriter&) = delete;
+  FrameRingWriter& operator=(const FrameRingWriter&) = delete;
+
+  std::size_t SlotCapacity() const;
+
+  // Copies the rows of all the buffers, in order, into the next slot and
+  // returns the message that hands the frame over to the reader. Returns
+  // nothing if the frame doesn't fit in a slot.
+  std::optional<FrameRingMessage> Write(
+      const std::vector<StridedBuffer>& buffers);
+
+ private:
+  FrameRingWriter(ScopedMMap region, FrameRingHeader header);
+
+  ScopedMMap region_;
+  FrameRingHeader header_;
+  std::uint32_t next_slot_ = 0;
+  // Even, and never reused while the writer lives.
+  std::uint64_t sequence_ = 0;
+};
+
+}  // namespace cuttlefish
@@ -0,0 +1,162 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/libs/utils/frame_ring_writer.h"
+
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "common/libs/utils/frame_ring.h"
+
+namespace cuttlefish {
+namespace {
+
+constexpr std::size_t kRegionSize = 64 * kFrameRingPageSize;
+
+class FrameRingWriterTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_EQ(ftruncate(file_.fd, kRegionSize), 0);
+  }
+
+  // What the reader would see of the region.
+  std::string Region() {
+    std::string region;
+    EXPECT_TRUE(android::base::ReadFileToString(file_.path, &region));
+    return region;
+  }
+
+  FrameRingHeader Header() {
+    FrameRingHeader header;
+    std::memcpy(&header, Region().data(), sizeof(header));
+    return header;
+  }
+
+  FrameRingSlotHeader SlotHeader(std::uint32_t slot) {
+    FrameRingSlotHeader slot_header;
+    std::memcpy(&slot_header,
+                Region().data() + FrameRingSlotOffset(Header(), slot),
+                sizeof(slot_header));
+    return slot_header;
+  }
+
+  std::string SlotData(std::uint32_t slot) {
+    return Region().substr(
+        FrameRingSlotOffset(Header(), slot) + kFrameRingPageSize,
+        SlotHeader(slot).size);
+  }
+
+  TemporaryFile file_;
+};
+
+TEST_F(FrameRingWriterTest, FormatsRegion) {
+  auto writer = FrameRingWriter::Create(file_.path, 3);
+  ASSERT_TRUE(writer.ok()) << writer.error().FormatForEnv();
+
+  auto header = Header();
+  EXPECT_TRUE(FrameRingHeaderIsValid(header, kRegionSize));
+  EXPECT_EQ(header.slot_count, 3);
+  EXPECT_EQ(header.slot_size, 21 * kFrameRingPageSize);
+  EXPECT_EQ((*writer)->SlotCapacity(), 20 * kFrameRingPageSize);
+  EXPECT_FALSE(FrameRingHeaderIsValid(header, kRegionSize / 2));
+}
+
+TEST_F(FrameRingWriterTest, RegionTooSmall) {
+  ASSERT_EQ(ftruncate(file_.fd, 4 * kFrameRingPageSize), 0);
+
+  EXPECT_FALSE(FrameRingWriter::Create(file_.path, 3).ok());
+}
+
+TEST_F(FrameRingWriterTest, WritesRowsWithoutPadding) {
+  auto writer = FrameRingWriter::Create(file_.path, 2);
+  ASSERT_TRUE(writer.ok()) << writer.error().FormatForEnv();
+  const std::string y = "ab..cd..";
+  const std::string uv = "xyz";
+
+  auto message = (*writer)->Write({
+      {.data = y.data(), .row_size = 2, .rows = 2, .stride = 4},
+      {.data = uv.data(), .row_size = 3, .rows = 1, .stride = 3},
+  });
+
+  ASSERT_TRUE(message.has_value());
+  EXPECT_EQ(message->slot, 0);
+  EXPECT_EQ(message->sequence % 2, 0);
+  EXPECT_EQ(SlotHeader(0).sequence, message->sequence);
+  EXPECT_EQ(SlotData(0), "abcdxyz");
+}
+
+TEST_F(FrameRingWriterTest, CyclesThroughSlots) {
+  auto writer = FrameRingWriter::Create(file_.path, 2);
+  ASSERT_TRUE(writer.ok()) << writer.error().FormatForEnv();
+  std::vector<FrameRingMessage> messages;
+  for (const std::string frame : {"one", "two", "three"}) {
+    auto message = (*writer)->Write({{.data = frame.data(),
+                                      .row_size = (unsigned int)frame.size(),
+                                      .rows = 1,
+                                      .stride = (int)frame.size()}});
+    ASSERT_TRUE(message.has_value());
+    messages.push_back(*message);
+  }
+
+  EXPECT_EQ(messages[0].slot, 0);
+  EXPECT_EQ(messages[1].slot, 1);
+  EXPECT_EQ(messages[2].slot, 0);
+  EXPECT_LT(messages[0].sequence, messages[2].sequence);
+  // The first frame was overwritten, which a reader of it would notice.
+  EXPECT_NE(SlotHeader(0).sequence, messages[0].sequence);
+  EXPECT_EQ(SlotHeader(0).sequence, messages[2].sequence);
+  EXPECT_EQ(SlotData(0), "three");
+  EXPECT_EQ(SlotData(1), "two");
+}
+
+TEST_F(FrameRingWriterTest, FrameTooLarge) {
+  auto writer = FrameRingWriter::Create(file_.path, 3);
+  ASSERT_TRUE(writer.ok()) << writer.error().FormatForEnv();
+  const std::string row((*writer)->SlotCapacity() / 2 + 1, 'x');
+
+  auto message = (*writer)->Write({{.data = row.data(),
+                                    .row_size = (unsigned int)row.size(),
+                                    .rows = 2,
+                                    .stride = 0}});
+
+  EXPECT_FALSE(message.has_value());
+}
+
+TEST(FrameRingMessageTest, RoundTrip) {
+  FrameRingMessage message{
+      .magic = kFrameRingMessageMagic, .slot = 2, .sequence = 42};
+
+  auto parsed = ParseFrameRingMessage(SerializeFrameRingMessage(message));
+
+  ASSERT_TRUE(parsed.has_value());
+  EXPECT_EQ(parsed->slot, 2);
+  EXPECT_EQ(parsed->sequence, 42);
+}
+
+TEST(FrameRingMessageTest, RejectsOtherMessages) {
+  EXPECT_FALSE(ParseFrameRingMessage(std::vector<char>(24, 0)).has_value());
+  EXPECT_FALSE(
+      ParseFrameRingMessage(std::vector<char>(sizeof(FrameRingMessage), 0))
+          .has_value());
+}
+
+}  // namespace
+}  // namespace cuttlefish
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace cuttlefish {
+
+/**
+ * Lock-free histogram of durations.
+ *
+ * Durations are kept in microseconds, in buckets of logarithmic width: every
+ * power of two is split in four buckets, so any reported percentile is within
+ * 25% of the real value. Record() may be called from any number of threads
+ * while others read the histogram.
+ */
+class LatencyHistogram {
+ public:
+  LatencyHistogram() = default;
+  LatencyHistogram(const LatencyHistogram&) = delete;
+  LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+  void Record(std::chrono::nanoseconds latency) {
+    const auto us =
+        std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    buckets_[BucketIndex(us > 0 ? us : 0)].fetch_add(1,
+                                                     std::memory_order_relaxed);
+  }
+
+  std::uint64_t Count() const {
+    std::uint64_t count = 0;
+    for (const auto& bucket : buckets_) {
+      count += bucket.load(std::memory_order_relaxed);
+    }
+    return count;
+  }
+
+  // Returns an upper bound of the given percentile, in [0, 100], of the
+  // recorded durations, or zero if nothing was recorded.
+  std::chrono::microseconds Percentile(double percentile) const {
+    std::array<std::uint64_t, kBucketCount> counts;
+    std::uint64_t total = 0;
+    for (std::size_t i = 0; i < kBucketCount; i++) {
+      counts[i] = buckets_[i].load(std::memory_order_relaxed);
+      total += counts[i];
+    }
+    if (total == 0) {
+      return std::chrono::microseconds(0);
+    }
+    // The rank of the sample at the percentile, starting at 1.
+    auto rank = static_cast<std::uint64_t>(percentile / 100.0 * total + 0.5);
+    rank = rank < 1 ? 1 : (rank > total ? total : rank);
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < kBucketCount; i++) {
+      seen += counts[i];
+      if (seen >= rank) {
+        return std::chrono::microseconds(BucketUpperBound(i));
+      }
+    }
+    return std::chrono::microseconds(BucketUpperBound(kBucketCount - 1));
+  }
+
+  void Reset() {
+    for (auto& bucket : buckets_) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+  }
+
+ private:
+  static constexpr std::size_t kSubBucketBits = 2;
+  static constexpr std::size_t kSubBuckets = 1 << kSubBucketBits;
+  // Enough for durations of a couple of weeks, longer ones are clamped.
+  static constexpr std::size_t kBucketCount = 40 * kSubBuckets;
+
+  static std::size_t BucketIndex(std::uint64_t us) {
+    if (us < kSubBuckets) {
+      return us;
+    }
+    const std::size_t msb = 63 - __builtin_clzll(us);
+    const std::size_t sub_bucket =
+        (us >> (msb - kSubBucketBits)) & (kSubBuckets - 1);
+    const std::size_t index =
+        (msb - kSubBucketBits + 1) * kSubBuckets + sub_bucket;
+    return index < kBucketCount ? index : kBucketCount - 1;
+  }
+
+  static std::uint64_t BucketUpperBound(std::size_t index) {
+    if (index < kSubBuckets) {
+      return index;
+    }
+    const std::size_t msb = index / kSubBuckets + kSubBucketBits - 1;
+    const std::uint64_t sub_bucket = index % kSubBuckets;
+    return ((kSubBuckets + sub_bucket + 1) << (msb - kSubBucketBits)) - 1;
+  }
+
+  std::array<std::atomic<std::uint64_t>, kBucketCount> buckets_{};
+};
+
+}  // namespace cuttlefish
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <chrono>
+
+#include <gtest/gtest.h>
+
+#include "common/libs/utils/latency_histogram.h"
+
+namespace cuttlefish {
+
+using std::chrono::microseconds;
+
+TEST(LatencyHistogramTest, Empty) {
+  LatencyHistogram histogram;
+  ASSERT_EQ(histogram.Count(), 0);
+  ASSERT_EQ(histogram.Percentile(50), microseconds(0));
+}
+
+TEST(LatencyHistogramTest, SmallValuesAreExact) {
+  LatencyHistogram histogram;
+  for (int i = 0; i < 8; i++) {
+    histogram.Record(microseconds(i));
+  }
+  ASSERT_EQ(histogram.Count(), 8);
+  ASSERT_EQ(histogram.Percentile(0), microseconds(0));
+  ASSERT_EQ(histogram.Percentile(50), microseconds(3));
+  ASSERT_EQ(histogram.Percentile(100), microseconds(7));
+}
+
+TEST(LatencyHistogramTest, PercentilesAreUpperBounds) {
+  LatencyHistogram histogram;
+  for (int i = 1; i <= 1000; i++) {
+    histogram.Record(microseconds(i * 10));
+  }
+  const auto p50 = histogram.Percentile(50);
+  ASSERT_GE(p50, microseconds(5000));
+  ASSERT_LE(p50, microseconds(5000 * 5 / 4));
+  const auto p99 = histogram.Percentile(99);
+  ASSERT_GE(p99, microseconds(9900));
+  ASSERT_LE(p99, microseconds(9900 * 5 / 4));
+}
+
+TEST(LatencyHistogramTest, NegativeDurationsCountAsZero) {
+  LatencyHistogram histogram;
+  histogram.Record(microseconds(-5));
+  ASSERT_EQ(histogram.Percentile(100), microseconds(0));
+}
+
+TEST(LatencyHistogramTest, Reset) {
+  LatencyHistogram histogram;
+  histogram.Record(microseconds(42));
+  histogram.Reset();
+  ASSERT_EQ(histogram.Count(), 0);
+}
+
+}  // namespace cuttlefish
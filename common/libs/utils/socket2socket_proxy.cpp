@@ -16,14 +16,20 @@
 
 #include "common/libs/utils/socket2socket_proxy.h"
 
+#include <fcntl.h>
 #include <poll.h>
+#include <sys/epoll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <cstring>
 #include <functional>
-#include <list>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <utility>
@@ -31,82 +37,279 @@
 
 #include <android-base/logging.h>
 
+#include "common/libs/fs/epoll.h"
+#include "common/libs/utils/result.h"
+
 namespace cuttlefish {
 namespace {
 
-class ProxyPair {
+// Every proxied connection is serviced by one of a small, fixed set of worker
+// threads instead of a pair of threads of its own.
+constexpr size_t kMaxProxyWorkers = 4;
+// Bytes buffered per direction of each connection. A side isn't read from
+// while the buffer towards its peer is full, so a slow reader throttles the
+// writer on the other end instead of growing memory use.
+constexpr size_t kProxyBufferSize = 64 * 1024;
+// Ready descriptors returned by a single wait.
+constexpr size_t kMaxProxyEvents = 64;
+// Connection descriptors are watched edge-triggered for everything, so a side
+// that can't be serviced yet, like one that hung up while its peer's buffer is
+// full, isn't reported over and over again.
+constexpr uint32_t kConnectionEvents =
+    EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+
+bool WouldBlock(const FileInstance& fd) {
+  return fd.GetErrno() == EAGAIN || fd.GetErrno() == EWOULDBLOCK;
+}
+
+bool SetNonBlocking(SharedFD fd) {
+  int flags = fd->Fcntl(F_GETFL, 0);
+  if (flags < 0) {
+    return false;
+  }
+  return fd->Fcntl(F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// One direction of a proxied connection, data flows from `from` to `to`.
+class ProxyDirection {
  public:
-  ProxyPair()
-      : stop_fd_(SharedFD::Event()) {
-    if (!stop_fd_->IsOpen()) {
-      LOG(FATAL) << "Failed to open eventfd: " << stop_fd_->StrError();
-      return;
+  ProxyDirection(std::string label, SharedFD from, SharedFD to)
+      : label_(std::move(label)),
+        from_(std::move(from)),
+        to_(std::move(to)),
+        buffer_(kProxyBufferSize) {}
+
+  // Moves as much data as possible without blocking.
+  void Pump() {
+    bool progress = true;
+    while (progress && !Done()) {
+      progress = false;
+      if (WantsRead()) {
+        auto read = from_->Read(buffer_.data() + end_, buffer_.size() - end_);
+        if (read > 0) {
+          end_ += read;
+          progress = true;
+        } else if (read == 0) {
+          read_eof_ = true;
+        } else if (!WouldBlock(*from_)) {
+          LOG(ERROR) << label_ << ": Error reading: " << from_->StrError();
+          Finish();
+          return;
+        }
+      }
+      if (WantsWrite()) {
+        auto written = to_->Write(buffer_.data() + begin_, end_ - begin_);
+        if (written > 0) {
+          begin_ += written;
+          if (begin_ == end_) {
+            begin_ = end_ = 0;
+          }
+          progress = true;
+        } else if (written < 0 && !WouldBlock(*to_)) {
+          LOG(ERROR) << label_ << ": Error writing: " << to_->StrError();
+          Finish();
+          return;
+        }
+      }
+    }
+    if (read_eof_ && !WantsWrite()) {
+      Finish();
     }
   }
 
-  ProxyPair(ProxyPair&& other)
-      : started_(other.started_),
-        stop_fd_(std::move(other.stop_fd_)),
-        c2t_running_(other.c2t_running_.load()),
-        t2c_running_(other.t2c_running_.load()) {
-    if (other.started_) {
-      LOG(FATAL) << "ProxyPair cannot be moved after Start() being executed";
+  // The receiving side hung up and can't take the pending data anymore.
+  void Abort() { Finish(); }
+
+  bool WantsRead() const { return !Done() && !read_eof_ && end_ < buffer_.size(); }
+  bool WantsWrite() const { return !Done() && begin_ < end_; }
+  bool ReadEof() const { return read_eof_; }
+  bool Done() const { return done_; }
+
+ private:
+  void Finish() {
+    if (done_) {
+      return;
     }
+    done_ = true;
+    begin_ = end_ = 0;
+    to_->Shutdown(SHUT_WR);
+    LOG(DEBUG) << label_ << ": Proxy direction completed";
   }
 
-  ~ProxyPair() {
-    if (stop_fd_->IsOpen() && stop_fd_->EventfdWrite(1) != 0) {
-      LOG(ERROR) << "Failed to stop proxy thread: " << stop_fd_->StrError();
-    }
-    if (c2t_.joinable()) {
-      c2t_.join();
+  std::string label_;
+  SharedFD from_;
+  SharedFD to_;
+  std::vector<char> buffer_;
+  // Pending data lives in buffer_[begin_, end_).
+  size_t begin_ = 0;
+  size_t end_ = 0;
+  bool read_eof_ = false;
+  bool done_ = false;
+};
+
+struct ProxyConnection {
+  ProxyConnection(SharedFD client, SharedFD target)
+      : client(client),
+        target(target),
+        c2t("c2t", client, target),
+        t2c("t2c", target, client) {}
+
+  // Called on any event of either descriptor, which is fine as they're watched
+  // edge-triggered: a direction only stops once it would block or its buffer
+  // is full, and then the next edge, or the peer direction draining the
+  // buffer, resumes it.
+  void Pump() {
+    c2t.Pump();
+    t2c.Pump();
+    // A side that hung up can't take pending data anymore. Give up on it once
+    // everything it sent was read, there's no further hangup event to wait for.
+    if (client_hung_up && (c2t.ReadEof() || c2t.Done())) {
+      t2c.Abort();
     }
-    if (t2c_.joinable()) {
-      t2c_.join();
+    if (target_hung_up && (t2c.ReadEof() || t2c.Done())) {
+      c2t.Abort();
     }
   }
 
-  void Start(SharedFD from, SharedFD to) {
-    if (started_) {
-      LOG(FATAL) << "ProxyPair cannot be started second time";
+  bool Done() const { return c2t.Done() && t2c.Done(); }
+
+  SharedFD client;
+  SharedFD target;
+  ProxyDirection c2t;
+  ProxyDirection t2c;
+  bool client_hung_up = false;
+  bool target_hung_up = false;
+};
+
+// Runs an epoll loop over the connections assigned to it. Connections are only
+// ever touched by the worker thread, new ones are handed over through a queue.
+class ProxyWorker {
+ public:
+  static Result<std::unique_ptr<ProxyWorker>> Create() {
+    SharedFD wakeup_fd = SharedFD::Event();
+    CF_EXPECTF(wakeup_fd->IsOpen(), "Failed to open eventfd: {}",
+               wakeup_fd->StrError());
+    Epoll epoll = CF_EXPECT(Epoll::Create());
+    CF_EXPECT(epoll.Add(wakeup_fd, EPOLLIN), "Failed to watch eventfd");
+    return std::unique_ptr<ProxyWorker>(
+        new ProxyWorker(std::move(wakeup_fd), std::move(epoll)));
+  }
+
+  ~ProxyWorker() {
+    stopping_ = true;
+    Wakeup();
+    if (thread_.joinable()) {
+      thread_.join();
     }
-    started_ = true;
-    c2t_running_ = true;
-    t2c_running_ = true;
-    c2t_ = std::thread(&ProxyPair::Forward, this, "c2t", from, to, stop_fd_,
-                       std::ref(c2t_running_));
-    t2c_ = std::thread(&ProxyPair::Forward, this, "t2c", to, from, stop_fd_,
-                       std::ref(t2c_running_));
   }
 
-  bool Running() {
-    return c2t_running_ || t2c_running_;
+  void Add(SharedFD client, SharedFD target) {
+    {
+      std::lock_guard lock(pending_mutex_);
+      pending_.emplace_back(std::move(client), std::move(target));
+    }
+    connections_++;
+    Wakeup();
   }
 
+  size_t Connections() const { return connections_; }
+
  private:
-  void Forward(const std::string& label, SharedFD from, SharedFD to,
-               SharedFD stop, std::atomic<bool>& running) {
-    LOG(DEBUG) << label << ": Proxy thread started. Starting copying data";
-    auto success = to->CopyAllFrom(*from, &(*stop));
-    if (!success) {
-      if (from->GetErrno()) {
-        LOG(ERROR) << label << ": Error reading: " << from->StrError();
+  ProxyWorker(SharedFD wakeup_fd, Epoll epoll)
+      : wakeup_fd_(std::move(wakeup_fd)), epoll_(std::move(epoll)) {
+    thread_ = std::thread(&ProxyWorker::Loop, this);
+  }
+
+  void Wakeup() {
+    if (wakeup_fd_->EventfdWrite(1) != 0) {
+      LOG(ERROR) << "Failed to wake up proxy worker: " << wakeup_fd_->StrError();
+    }
+  }
+
+  void Loop() {
+    while (!stopping_) {
+      auto ready = epoll_.Wait(kMaxProxyEvents);
+      if (!ready.ok()) {
+        LOG(ERROR) << "Proxy worker failed to wait: "
+                   << ready.error().FormatForEnv();
+        break;
       }
-      if (to->GetErrno()) {
-        LOG(ERROR) << label << ": Error writing: " << to->StrError();
+      for (const auto& [fd, events] : *ready) {
+        if (fd == wakeup_fd_) {
+          eventfd_t value;
+          wakeup_fd_->EventfdRead(&value);
+          AcceptPending();
+          continue;
+        }
+        auto it = connections_by_fd_.find(fd);
+        if (it == connections_by_fd_.end()) {
+          // Removed while handling an earlier event of the same batch.
+          continue;
+        }
+        auto connection = it->second;
+        if (events & EPOLLERR) {
+          // The descriptor is unusable in both directions.
+          connection->c2t.Abort();
+          connection->t2c.Abort();
+        } else if (events & EPOLLHUP) {
+          (fd == connection->client ? connection->client_hung_up
+                                    : connection->target_hung_up) = true;
+        }
+        connection->Pump();
+        if (connection->Done()) {
+          Remove(connection);
+        }
       }
     }
-    to->Shutdown(SHUT_WR);
-    running = false;
-    LOG(DEBUG) << label << ": Proxy thread completed";
+    // Dropping the connections closes the file descriptors.
+    connections_by_fd_.clear();
   }
 
-  bool started_;
-  SharedFD stop_fd_;
-  std::atomic<bool> c2t_running_;
-  std::atomic<bool> t2c_running_;
-  std::thread c2t_;
-  std::thread t2c_;
+  void AcceptPending() {
+    std::vector<std::pair<SharedFD, SharedFD>> pending;
+    {
+      std::lock_guard lock(pending_mutex_);
+      pending.swap(pending_);
+    }
+    for (auto& [client, target] : pending) {
+      if (!SetNonBlocking(client) || !SetNonBlocking(target)) {
+        LOG(ERROR) << "Failed to make proxied connection non-blocking";
+        connections_--;
+        continue;
+      }
+      auto connection = std::make_shared<ProxyConnection>(client, target);
+      connections_by_fd_[client] = connection;
+      connections_by_fd_[target] = connection;
+      auto client_added = epoll_.Add(client, kConnectionEvents);
+      auto target_added = epoll_.Add(target, kConnectionEvents);
+      if (!client_added.ok() || !target_added.ok()) {
+        LOG(ERROR) << "Failed to watch proxied connection";
+        Remove(connection);
+        continue;
+      }
+      LOG(DEBUG) << "Proxy is launched. Amount of currently tracked proxy "
+                 << "connections: " << connections_;
+    }
+  }
+
+  void Remove(const std::shared_ptr<ProxyConnection>& connection) {
+    for (const auto& fd : {connection->client, connection->target}) {
+      // Fails harmlessly when the descriptor was never added.
+      epoll_.Delete(fd);
+      connections_by_fd_.erase(fd);
+    }
+    connections_--;
+    LOG(DEBUG) << "Proxy connection completed";
+  }
+
+  SharedFD wakeup_fd_;
+  Epoll epoll_;
+  std::atomic<bool> stopping_ = false;
+  std::atomic<size_t> connections_ = 0;
+  std::mutex pending_mutex_;
+  std::vector<std::pair<SharedFD, SharedFD>> pending_;
+  std::map<SharedFD, std::shared_ptr<ProxyConnection>> connections_by_fd_;
+  std::thread thread_;
 };
 
 }  // namespace
@@ -121,7 +324,23 @@ ProxyServer::ProxyServer(SharedFD server, std::function<SharedFD()> clients_fact
                             clients_factory = std::move(clients_factory)]() {
     constexpr ssize_t SERVER = 0;
     constexpr ssize_t STOP = 1;
-    std::list<ProxyPair> watched;
+
+    const size_t worker_count = std::clamp<size_t>(
+        std::thread::hardware_concurrency(), 1, kMaxProxyWorkers);
+    std::vector<std::unique_ptr<ProxyWorker>> workers;
+    for (size_t i = 0; i < worker_count; i++) {
+      auto worker = ProxyWorker::Create();
+      if (!worker.ok()) {
+        LOG(ERROR) << "Failed to create proxy worker: "
+                   << worker.error().FormatForEnv();
+        continue;
+      }
+      workers.emplace_back(std::move(*worker));
+    }
+    if (workers.empty()) {
+      LOG(ERROR) << "No proxy worker, not accepting connections";
+      return;
+    }
 
     std::vector<PollSharedFd> server_poll = {
       {.fd = server_fd, .events = POLLIN},
@@ -155,22 +374,20 @@ ProxyServer::ProxyServer(SharedFD server, std::function<SharedFD()> clients_fact
       }
       auto target = clients_factory();
       if (target->IsOpen()) {
-        LOG(DEBUG) << "Launching proxy threads";
-        watched.push_back(ProxyPair());
-        watched.back().Start(client, target);
-        LOG(DEBUG) << "Proxy is launched. Amount of currently tracked proxy pairs: "
-                   << watched.size();
+        auto& worker = *std::min_element(
+            workers.begin(), workers.end(), [](const auto& a, const auto& b) {
+              return a->Connections() < b->Connections();
+            });
+        worker->Add(client, target);
       } else {
         LOG(ERROR) << "Cannot connect to the target to setup proxying: " << target->StrError();
       }
-      // Unwatch completed proxy pairs
-      watched.remove_if([](ProxyPair& proxy) { return !proxy.Running(); });
     }
 
-    // Making sure all launched proxy pairs are finished by triggering their destructor
-    LOG(DEBUG) << "Waiting for proxy threads to turn down";
-    watched.clear();
-    LOG(DEBUG) << "Proxy threads are successfully turned down";
+    // Making sure all proxied connections are closed by stopping the workers
+    LOG(DEBUG) << "Waiting for proxy workers to turn down";
+    workers.clear();
+    LOG(DEBUG) << "Proxy workers are successfully turned down";
   });
 }
 
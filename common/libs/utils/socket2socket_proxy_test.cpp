@@ -0,0 +1,163 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/libs/utils/socket2socket_proxy.h"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "common/libs/fs/shared_buf.h"
+#include "common/libs/fs/shared_fd.h"
+
+namespace cuttlefish {
+namespace {
+
+using std::chrono::milliseconds;
+
+std::chrono::nanoseconds ProcessCpuTime() {
+  timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+// Proxies connections to a local socket server to the ends of socket pairs,
+// whose other ends stand in for the target.
+class Socket2SocketProxyTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    static std::atomic<int> counter = 0;
+    name_ = "socket2socket_proxy_test_" + std::to_string(getpid()) + "_" +
+            std::to_string(counter++);
+    auto server = SharedFD::SocketLocalServer(name_, true, SOCK_STREAM, 0666);
+    ASSERT_TRUE(server->IsOpen()) << server->StrError();
+    proxy_ = ProxyAsync(server, [this]() {
+      SharedFD proxy_end, target_end;
+      if (!SharedFD::SocketPair(AF_UNIX, SOCK_STREAM, 0, &proxy_end,
+                                &target_end)) {
+        return SharedFD();
+      }
+      std::lock_guard lock(mutex_);
+      targets_.push(target_end);
+      target_available_.notify_all();
+      return proxy_end;
+    });
+  }
+
+  // Connects a client and returns it with the target it is proxied to.
+  std::pair<SharedFD, SharedFD> Connect() {
+    auto client = SharedFD::SocketLocalClient(name_, true, SOCK_STREAM);
+    EXPECT_TRUE(client->IsOpen()) << client->StrError();
+    std::unique_lock lock(mutex_);
+    EXPECT_TRUE(target_available_.wait_for(
+        lock, std::chrono::seconds(10), [this]() { return !targets_.empty(); }));
+    if (targets_.empty()) {
+      return {client, SharedFD()};
+    }
+    auto target = targets_.front();
+    targets_.pop();
+    return {client, target};
+  }
+
+  std::string name_;
+  std::unique_ptr<ProxyServer> proxy_;
+  std::mutex mutex_;
+  std::condition_variable target_available_;
+  std::queue<SharedFD> targets_;
+};
+
+TEST_F(Socket2SocketProxyTest, ForwardsBothWays) {
+  auto [client, target] = Connect();
+  ASSERT_TRUE(target->IsOpen());
+
+  ASSERT_EQ(WriteAll(client, "ping"), 4);
+  std::string request(4, '\0');
+  ASSERT_EQ(ReadExact(target, &request), 4);
+  ASSERT_EQ(WriteAll(target, "pong"), 4);
+  std::string response(4, '\0');
+  ASSERT_EQ(ReadExact(client, &response), 4);
+
+  EXPECT_EQ(request, "ping");
+  EXPECT_EQ(response, "pong");
+}
+
+TEST_F(Socket2SocketProxyTest, ForwardsHalfClose) {
+  auto [client, target] = Connect();
+  ASSERT_TRUE(target->IsOpen());
+
+  ASSERT_EQ(WriteAll(client, "request"), 7);
+  ASSERT_EQ(client->Shutdown(SHUT_WR), 0);
+  std::string request;
+  ASSERT_EQ(ReadAll(target, &request), 7);
+  // The other direction still works after the target saw the end of the
+  // request.
+  ASSERT_EQ(WriteAll(target, "response"), 8);
+  target->Close();
+  std::string response;
+  ASSERT_EQ(ReadAll(client, &response), 8);
+
+  EXPECT_EQ(request, "request");
+  EXPECT_EQ(response, "response");
+}
+
+TEST_F(Socket2SocketProxyTest, SlowReaderThrottlesWriter) {
+  auto [client, target] = Connect();
+  ASSERT_TRUE(target->IsOpen());
+  ASSERT_EQ(client->Fcntl(F_SETFL, client->Fcntl(F_GETFL, 0) | O_NONBLOCK), 0);
+
+  // The target doesn't read, so the client can only write until the socket
+  // and proxy buffers in between are full.
+  const std::string block(4096, 'x');
+  std::size_t written = 0;
+  auto stalled_since = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - stalled_since < milliseconds(200)) {
+    auto ret = client->Write(block.data(), block.size());
+    if (ret > 0) {
+      written += ret;
+      stalled_since = std::chrono::steady_clock::now();
+    } else {
+      ASSERT_EQ(client->GetErrno(), EAGAIN) << client->StrError();
+      std::this_thread::sleep_for(milliseconds(10));
+    }
+  }
+  EXPECT_GT(written, 0u);
+  EXPECT_LT(written, 16u << 20);
+
+  // Hanging up while the proxy can't take any more data from the client
+  // leaves nothing for the proxy to do until the target reads.
+  client->Close();
+  const auto cpu_time_before = ProcessCpuTime();
+  std::this_thread::sleep_for(milliseconds(300));
+  EXPECT_LT(ProcessCpuTime() - cpu_time_before, milliseconds(100));
+
+  std::string received;
+  ASSERT_EQ(ReadAll(target, &received), (ssize_t)written);
+  EXPECT_EQ(received, std::string(written, 'x'));
+}
+
+}  // namespace
+}  // namespace cuttlefish
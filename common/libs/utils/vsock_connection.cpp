@@ -16,10 +16,13 @@
 
 #include "common/libs/utils/vsock_connection.h"
 
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 
+#include <algorithm>
 #include <functional>
 #include <future>
 #include <memory>
@@ -38,6 +41,40 @@
 #include "common/libs/fs/shared_select.h"
 
 namespace cuttlefish {
+namespace {
+
+// Adds a buffer to `iov`, extending the last one instead if the buffer
+// directly follows it in memory.
+void AppendBuffer(std::vector<struct iovec>& iov, const void* data,
+                  size_t size) {
+  if (size == 0) {
+    return;
+  }
+  if (!iov.empty()) {
+    auto& last = iov.back();
+    if (static_cast<const char*>(last.iov_base) + last.iov_len == data) {
+      last.iov_len += size;
+      return;
+    }
+  }
+  iov.push_back({.iov_base = const_cast<void*>(data), .iov_len = size});
+}
+
+// Consumes `bytes` from the vectors starting at `index`, returning the index
+// of the first one with anything left.
+size_t Advance(std::vector<struct iovec>& iov, size_t index, size_t bytes) {
+  for (; index < iov.size(); index++) {
+    if (bytes < iov[index].iov_len) {
+      iov[index].iov_base = static_cast<char*>(iov[index].iov_base) + bytes;
+      iov[index].iov_len -= bytes;
+      break;
+    }
+    bytes -= iov[index].iov_len;
+  }
+  return index;
+}
+
+}  // namespace
 
 VsockConnection::~VsockConnection() { Disconnect(); }
 
@@ -141,6 +178,36 @@ bool VsockConnection::ReadMessage(std::vector<char>& data) {
   return Read(data);
 }
 
+ssize_t VsockConnection::ReadMessage(const std::vector<struct iovec>& buffers) {
+  std::lock_guard<std::recursive_mutex> lock(read_mutex_);
+  int32_t size;
+  std::vector<struct iovec> header = {
+      {.iov_base = &size, .iov_len = sizeof(size)}};
+  if (!ReadVectored(header)) {
+    return -1;
+  }
+  if (size < 0) {
+    Disconnect();
+    return -1;
+  }
+  std::vector<struct iovec> iov;
+  size_t remaining = size;
+  for (const auto& buffer : buffers) {
+    size_t chunk = std::min(buffer.iov_len, remaining);
+    AppendBuffer(iov, buffer.iov_base, chunk);
+    remaining -= chunk;
+  }
+  if (remaining > 0) {
+    LOG(ERROR) << "A message of " << size << " bytes doesn't fit the buffers";
+    Disconnect();
+    return -1;
+  }
+  if (!ReadVectored(iov)) {
+    return -1;
+  }
+  return size;
+}
+
 std::future<std::vector<char>> VsockConnection::ReadMessageAsync() {
   return std::async(std::launch::async, [this]() { return ReadMessage(); });
 }
@@ -185,12 +252,19 @@ bool VsockConnection::Write(const std::vector<char>& data) {
 
 // Message format is buffer size followed by buffer data
 bool VsockConnection::WriteMessage(const std::string& data) {
-  return Write(data.size()) && Write(data.c_str(), data.length());
+  int32_t size = data.size();
+  std::vector<struct iovec> iov;
+  AppendBuffer(iov, &size, sizeof(size));
+  AppendBuffer(iov, data.data(), data.size());
+  return WriteVectored(iov);
 }
 
 bool VsockConnection::WriteMessage(const std::vector<char>& data) {
-  std::lock_guard<std::recursive_mutex> lock(write_mutex_);
-  return Write(data.size()) && Write(data);
+  int32_t size = data.size();
+  std::vector<struct iovec> iov;
+  AppendBuffer(iov, &size, sizeof(size));
+  AppendBuffer(iov, data.data(), data.size());
+  return WriteVectored(iov);
 }
 
 bool VsockConnection::WriteMessage(const Json::Value& data) {
@@ -201,11 +275,63 @@ bool VsockConnection::WriteMessage(const Json::Value& data) {
 
 bool VsockConnection::WriteStrides(const char* data, unsigned int size,
                                    unsigned int num_strides, int stride_size) {
+  std::vector<struct iovec> iov;
+  iov.reserve(num_strides);
   const char* src = data;
   for (unsigned int i = 0; i < num_strides; ++i, src += stride_size) {
-    if (!Write(src, size)) {
+    AppendBuffer(iov, src, size);
+  }
+  return WriteVectored(iov);
+}
+
+bool VsockConnection::WriteStridedMessage(
+    const std::vector<StridedBuffer>& buffers) {
+  int32_t size = 0;
+  size_t rows = 0;
+  for (const auto& buffer : buffers) {
+    size += buffer.row_size * buffer.rows;
+    rows += buffer.rows;
+  }
+  std::vector<struct iovec> iov;
+  iov.reserve(rows + 1);
+  AppendBuffer(iov, &size, sizeof(size));
+  for (const auto& buffer : buffers) {
+    const char* src = buffer.data;
+    for (unsigned int i = 0; i < buffer.rows; ++i, src += buffer.stride) {
+      AppendBuffer(iov, src, buffer.row_size);
+    }
+  }
+  return WriteVectored(iov);
+}
+
+bool VsockConnection::WriteVectored(std::vector<struct iovec>& iov) {
+  std::lock_guard<std::recursive_mutex> lock(write_mutex_);
+  for (size_t index = Advance(iov, 0, 0); index < iov.size();) {
+    struct msghdr msg = {};
+    msg.msg_iov = iov.data() + index;
+    msg.msg_iovlen = std::min<size_t>(iov.size() - index, IOV_MAX);
+    ssize_t written = fd_->SendMsg(&msg, 0);
+    if (written <= 0) {
+      Disconnect();
+      return false;
+    }
+    index = Advance(iov, index, written);
+  }
+  return true;
+}
+
+bool VsockConnection::ReadVectored(std::vector<struct iovec>& iov) {
+  std::lock_guard<std::recursive_mutex> lock(read_mutex_);
+  for (size_t index = Advance(iov, 0, 0); index < iov.size();) {
+    struct msghdr msg = {};
+    msg.msg_iov = iov.data() + index;
+    msg.msg_iovlen = std::min<size_t>(iov.size() - index, IOV_MAX);
+    ssize_t bytes_read = fd_->RecvMsg(&msg, MSG_WAITALL);
+    if (bytes_read <= 0) {
+      Disconnect();
       return false;
     }
+    index = Advance(iov, index, bytes_read);
   }
   return true;
 }
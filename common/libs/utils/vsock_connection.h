@@ -15,6 +15,9 @@
  */
 #pragma once
 
+#include <sys/types.h>
+#include <sys/uio.h>
+
 #include <cstddef>
 #include <cstdint>
 #include <functional>
@@ -29,6 +32,15 @@
 
 namespace cuttlefish {
 
+// `rows` rows of `row_size` bytes each, the first at `data` and each following
+// one `stride` bytes after the previous, like a plane of an image.
+struct StridedBuffer {
+  const char* data;
+  unsigned int row_size;
+  unsigned int rows;
+  int stride;
+};
+
 class VsockConnection {
  public:
   virtual ~VsockConnection();
@@ -47,6 +59,10 @@ class VsockConnection {
   std::future<std::vector<char>> ReadAsync(size_t size);
 
   bool ReadMessage(std::vector<char>& data);
+  // Reads the payload of a message straight into `buffers`, filling them in
+  // order. Returns the size of the message, or -1 if it couldn't be read or
+  // didn't fit, which also disconnects.
+  ssize_t ReadMessage(const std::vector<struct iovec>& buffers);
   std::vector<char> ReadMessage();
   std::future<std::vector<char>> ReadMessageAsync();
   Json::Value ReadJsonMessage();
@@ -60,8 +76,16 @@ class VsockConnection {
   bool WriteMessage(const Json::Value& data);
   bool WriteStrides(const char* data, unsigned int size,
                     unsigned int num_strides, int stride_size);
+  // Writes a message made of the rows of all the buffers, in order, with as
+  // few system calls as possible.
+  bool WriteStridedMessage(const std::vector<StridedBuffer>& buffers);
 
  protected:
+  // Write and read all the bytes covered by the vectors, resuming after
+  // partial transfers.
+  bool WriteVectored(std::vector<struct iovec>& iov);
+  bool ReadVectored(std::vector<struct iovec>& iov);
+
   std::recursive_mutex read_mutex_;
   std::recursive_mutex write_mutex_;
   std::function<void()> disconnect_callback_;
@@ -0,0 +1,127 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/libs/utils/vsock_connection.h"
+
+#include <sys/socket.h>
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "common/libs/fs/shared_fd.h"
+
+namespace cuttlefish {
+namespace {
+
+// Connected to the other end of a socket pair rather than over vsock.
+class SocketPairConnection : public VsockConnection {
+ public:
+  SocketPairConnection(SharedFD fd) { fd_ = fd; }
+
+  bool Connect(unsigned int, unsigned int, std::optional<int>) override {
+    return fd_->IsOpen();
+  }
+};
+
+class VsockConnectionTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    SharedFD fd0, fd1;
+    ASSERT_TRUE(SharedFD::SocketPair(AF_UNIX, SOCK_STREAM, 0, &fd0, &fd1));
+    writer_ = std::make_unique<SocketPairConnection>(fd0);
+    reader_ = std::make_unique<SocketPairConnection>(fd1);
+  }
+
+  std::unique_ptr<SocketPairConnection> writer_;
+  std::unique_ptr<SocketPairConnection> reader_;
+};
+
+TEST_F(VsockConnectionTest, WriteMessageThenReadMessage) {
+  ASSERT_TRUE(writer_->WriteMessage(std::string("hello")));
+  ASSERT_TRUE(writer_->WriteMessage(std::vector<char>{'a', 'b'}));
+
+  auto first = reader_->ReadMessage();
+  EXPECT_EQ(std::string(first.begin(), first.end()), "hello");
+  EXPECT_EQ(reader_->ReadMessage(), (std::vector<char>{'a', 'b'}));
+}
+
+TEST_F(VsockConnectionTest, StridedMessageSkipsPadding) {
+  // Two planes of 3 byte rows, padded to 4 and 5 bytes.
+  const std::string first = "abc_def_";
+  const std::string second = "ghi__jkl__mno__";
+
+  ASSERT_TRUE(writer_->WriteStridedMessage({
+      {.data = first.data(), .row_size = 3, .rows = 2, .stride = 4},
+      {.data = second.data(), .row_size = 3, .rows = 3, .stride = 5},
+  }));
+
+  auto message = reader_->ReadMessage();
+  EXPECT_EQ(std::string(message.begin(), message.end()), "abcdefghijklmno");
+}
+
+TEST_F(VsockConnectionTest, LargeStridedMessage) {
+  // More rows than fit in a single sendmsg call.
+  constexpr unsigned int kRows = 3000;
+  constexpr unsigned int kRowSize = 100;
+  std::vector<char> plane(kRows * (kRowSize + 28));
+  for (size_t i = 0; i < plane.size(); i++) {
+    plane[i] = i % 251;
+  }
+  std::vector<char> expected;
+  for (unsigned int row = 0; row < kRows; row++) {
+    auto start = plane.begin() + row * (kRowSize + 28);
+    expected.insert(expected.end(), start, start + kRowSize);
+  }
+
+  std::thread writer([this, &plane]() {
+    EXPECT_TRUE(writer_->WriteStridedMessage({{.data = plane.data(),
+                                               .row_size = kRowSize,
+                                               .rows = kRows,
+                                               .stride = kRowSize + 28}}));
+  });
+  auto message = reader_->ReadMessage();
+  writer.join();
+
+  EXPECT_EQ(message, expected);
+}
+
+TEST_F(VsockConnectionTest, ReadMessageIntoBuffers) {
+  ASSERT_TRUE(writer_->WriteMessage(std::string("0123456789")));
+  char first[4];
+  char second[16];
+
+  ssize_t size = reader_->ReadMessage({{.iov_base = first, .iov_len = 4},
+                                       {.iov_base = second, .iov_len = 16}});
+
+  ASSERT_EQ(size, 10);
+  EXPECT_EQ(std::string(first, 4), "0123");
+  EXPECT_EQ(std::string(second, 6), "456789");
+}
+
+TEST_F(VsockConnectionTest, ReadMessageTooLargeForBuffers) {
+  ASSERT_TRUE(writer_->WriteMessage(std::string("0123456789")));
+  char buffer[4];
+
+  EXPECT_EQ(reader_->ReadMessage({{.iov_base = buffer, .iov_len = 4}}), -1);
+  EXPECT_FALSE(reader_->IsConnected());
+}
+
+}  // namespace
+}  // namespace cuttlefish
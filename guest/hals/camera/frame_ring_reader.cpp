@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "frame_ring_reader.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstring>
+#define LOG_TAG "FrameRingReader"
+#include <log/log.h>
+
+namespace cuttlefish {
+
+namespace {
+size_t roundUpToPage(size_t size) {
+  return (size + kFrameRingPageSize - 1) / kFrameRingPageSize *
+         kFrameRingPageSize;
+}
+
+bool preadFully(int fd, char* dst, size_t size, off_t offset) {
+  while (size > 0) {
+    ssize_t read = TEMP_FAILURE_RETRY(pread(fd, dst, size, offset));
+    if (read <= 0) {
+      return false;
+    }
+    dst += read;
+    size -= read;
+    offset += read;
+  }
+  return true;
+}
+}  // namespace
+
+bool AlignedBuffer::reserve(size_t capacity) {
+  if (capacity <= capacity_) {
+    return true;
+  }
+  void* data = nullptr;
+  if (posix_memalign(&data, kFrameRingPageSize, capacity) != 0) {
+    return false;
+  }
+  data_.reset(static_cast<char*>(data));
+  capacity_ = capacity;
+  return true;
+}
+
+std::unique_ptr<FrameRingReader> FrameRingReader::open(
+    const std::string& path) {
+  android::base::unique_fd fd(
+      TEMP_FAILURE_RETRY(::open(path.c_str(), O_RDONLY | O_DIRECT | O_CLOEXEC)));
+  if (fd.get() < 0) {
+    ALOGI("%s: No frame ring at %s: %s", __FUNCTION__, path.c_str(),
+          strerror(errno));
+    return nullptr;
+  }
+  off_t size = lseek(fd.get(), 0, SEEK_END);
+  AlignedBuffer page;
+  FrameRingHeader header;
+  if (size < 0 || !page.reserve(kFrameRingPageSize) ||
+      !preadFully(fd.get(), page.data(), kFrameRingPageSize, 0)) {
+    ALOGE("%s: Failed to read %s: %s", __FUNCTION__, path.c_str(),
+          strerror(errno));
+    return nullptr;
+  }
+  std::memcpy(&header, page.data(), sizeof(header));
+  if (!FrameRingHeaderIsValid(header, size)) {
+    ALOGI("%s: %s doesn't hold a frame ring", __FUNCTION__, path.c_str());
+    return nullptr;
+  }
+  auto reader = std::unique_ptr<FrameRingReader>(
+      new FrameRingReader(std::move(fd), header));
+  reader->page_.swap(page);
+  return reader;
+}
+
+FrameRingReader::FrameRingReader(android::base::unique_fd fd,
+                                 FrameRingHeader header)
+    : fd_(std::move(fd)), header_(header) {}
+
+bool FrameRingReader::readSlotHeader(uint32_t slot,
+                                     FrameRingSlotHeader& slot_header) {
+  if (!preadFully(fd_.get(), page_.data(), kFrameRingPageSize,
+                  FrameRingSlotOffset(header_, slot))) {
+    ALOGE("%s: Failed to read slot %u: %s", __FUNCTION__, slot,
+          strerror(errno));
+    return false;
+  }
+  std::memcpy(&slot_header, page_.data(), sizeof(slot_header));
+  return true;
+}
+
+// The slot's sequence number is checked again once the frame is copied, like
+// for a seqlock. It only ever changes to an odd number before the host writes
+// anything else to the slot.
+bool FrameRingReader::read(const FrameRingMessage& message,
+                           RingFrame& frame) {
+  if (message.slot >= header_.slot_count) {
+    ALOGE("%s: No slot %u", __FUNCTION__, message.slot);
+    return false;
+  }
+  FrameRingSlotHeader slot_header;
+  if (!readSlotHeader(message.slot, slot_header)) {
+    return false;
+  }
+  if (slot_header.sequence != message.sequence ||
+      slot_header.size > FrameRingSlotCapacity(header_)) {
+    return false;
+  }
+  size_t size = roundUpToPage(slot_header.size);
+  if (!frame.buffer.reserve(size) ||
+      !preadFully(fd_.get(), frame.buffer.data(), size,
+                  FrameRingSlotOffset(header_, message.slot) +
+                      kFrameRingPageSize)) {
+    ALOGE("%s: Failed to read slot %u: %s", __FUNCTION__, message.slot,
+          strerror(errno));
+    return false;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (!readSlotHeader(message.slot, slot_header) ||
+      slot_header.sequence != message.sequence) {
+    return false;
+  }
+  frame.size = slot_header.size;
+  return true;
+}
+
+}  // namespace cuttlefish
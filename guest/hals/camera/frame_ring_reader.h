@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+#include <android-base/unique_fd.h>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <utility>
+#include "common/libs/utils/frame_ring.h"
+
+namespace cuttlefish {
+
+// Page aligned memory, as direct I/O requires.
+class AlignedBuffer {
+ public:
+  char* data() { return data_.get(); }
+  const char* data() const { return data_.get(); }
+  size_t capacity() const { return capacity_; }
+  bool reserve(size_t capacity);
+  void swap(AlignedBuffer& other) {
+    data_.swap(other.data_);
+    std::swap(capacity_, other.capacity_);
+  }
+
+ private:
+  struct Free {
+    void operator()(char* p) const { free(p); }
+  };
+  std::unique_ptr<char, Free> data_;
+  size_t capacity_ = 0;
+};
+
+// A frame copied out of a frame ring slot.
+struct RingFrame {
+  AlignedBuffer buffer;
+  size_t size = 0;
+
+  void swap(RingFrame& other) {
+    buffer.swap(other.buffer);
+    std::swap(size, other.size);
+  }
+};
+
+// Reads the frames the host puts in a frame ring on a pmem block device. The
+// device is read with O_DIRECT, as mapping it would go through the guest page
+// cache and miss what the host writes.
+class FrameRingReader {
+ public:
+  // Returns nullptr if there's no frame ring at `path`.
+  static std::unique_ptr<FrameRingReader> open(const std::string& path);
+
+  // Copies the frame `message` refers to into `frame`. Fails if the host
+  // reused the slot for a newer frame before it could be copied.
+  bool read(const FrameRingMessage& message, RingFrame& frame);
+
+ private:
+  FrameRingReader(android::base::unique_fd fd, FrameRingHeader header);
+  bool readSlotHeader(uint32_t slot, FrameRingSlotHeader& slot_header);
+
+  android::base::unique_fd fd_;
+  FrameRingHeader header_;
+  AlignedBuffer page_;
+};
+
+}  // namespace cuttlefish
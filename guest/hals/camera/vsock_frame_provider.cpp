@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 #include "vsock_frame_provider.h"
+#include <cutils/properties.h>
 #include <hardware/camera3.h>
 #include <libyuv.h>
 #include <cstring>
@@ -25,11 +26,21 @@ namespace cuttlefish {
 namespace {
 bool writeJsonEventMessage(
     std::shared_ptr<cuttlefish::VsockConnection> connection,
-    const std::string& message) {
-  Json::Value json_message;
+    const std::string& message,
+    Json::Value json_message = Json::Value(Json::objectValue)) {
   json_message["event"] = message;
   return connection && connection->WriteMessage(json_message);
 }
+
+// Only set when the host attached the frame ring, the device name depends on
+// which other pmem devices there are.
+std::unique_ptr<FrameRingReader> openFrameRing() {
+  char path[PROPERTY_VALUE_MAX];
+  if (property_get("ro.boot.vsock_camera_pmem", path, "") <= 0) {
+    return nullptr;
+  }
+  return FrameRingReader::open(path);
+}
 }  // namespace
 
 VsockFrameProvider::~VsockFrameProvider() { stop(); }
@@ -40,7 +51,12 @@ void VsockFrameProvider::start(
   stop();
   running_ = true;
   connection_ = connection;
-  writeJsonEventMessage(connection, "VIRTUAL_DEVICE_START_CAMERA_SESSION");
+  frame_ring_ = openFrameRing();
+  // The host only uses the frame ring if told the guest can read it
+  Json::Value capabilities;
+  capabilities["frame_ring"] = frame_ring_ != nullptr;
+  writeJsonEventMessage(connection, "VIRTUAL_DEVICE_START_CAMERA_SESSION",
+                        capabilities);
   reader_thread_ =
       std::thread([this, width, height] { VsockReadLoop(width, height); });
 }
@@ -75,18 +91,20 @@ bool VsockFrameProvider::copyYUVFrame(uint32_t w, uint32_t h, YCbCrLayout dst) {
   size_t cbcr_size = (w / 2) * (h / 2);
   size_t total_size = y_size + 2 * cbcr_size;
   std::lock_guard<std::mutex> lock(frame_mutex_);
-  if (frame_.size() < total_size) {
-    ALOGE("%s: %zu is too little for %ux%u frame", __FUNCTION__, frame_.size(),
-          w, h);
+  char* frame = frame_from_ring_ ? ring_frame_.buffer.data() : frame_.data();
+  size_t frame_size = frame_from_ring_ ? ring_frame_.size : frame_.size();
+  if (frame_size < total_size) {
+    ALOGE("%s: %zu is too little for %ux%u frame", __FUNCTION__, frame_size, w,
+          h);
     return false;
   }
   if (dst.y == nullptr) {
     ALOGE("%s: Destination is nullptr!", __FUNCTION__);
     return false;
   }
-  YCbCrLayout src{.y = static_cast<void*>(frame_.data()),
-                  .cb = static_cast<void*>(frame_.data() + y_size),
-                  .cr = static_cast<void*>(frame_.data() + y_size + cbcr_size),
+  YCbCrLayout src{.y = static_cast<void*>(frame),
+                  .cb = static_cast<void*>(frame + y_size),
+                  .cr = static_cast<void*>(frame + y_size + cbcr_size),
                   .yStride = w,
                   .cStride = w / 2,
                   .chromaStep = 1};
@@ -148,17 +166,39 @@ bool VsockFrameProvider::isBlob(const std::vector<char>& blob) {
 }
 
 bool VsockFrameProvider::framesizeMatches(uint32_t width, uint32_t height,
-                                          const std::vector<char>& data) {
-  return data.size() == 3 * width * height / 2;
+                                          size_t size) {
+  return size == 3 * width * height / 2;
+}
+
+void VsockFrameProvider::readRingFrame(const FrameRingMessage& message,
+                                       uint32_t width, uint32_t height) {
+  if (!frame_ring_ || !frame_ring_->read(message, next_ring_frame_)) {
+    // Overwritten before it could be copied, a newer frame is on its way
+    ALOGW("%s: Dropped frame in slot %u", __FUNCTION__, message.slot);
+    return;
+  }
+  if (!framesizeMatches(width, height, next_ring_frame_.size)) {
+    ALOGE("%s: Unexpected frame of %zu bytes", __FUNCTION__,
+          next_ring_frame_.size);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(frame_mutex_);
+  timestamp_ = systemTime();
+  ring_frame_.swap(next_ring_frame_);
+  frame_from_ring_ = true;
+  yuv_frame_updated_.notify_one();
 }
 
 void VsockFrameProvider::VsockReadLoop(uint32_t width, uint32_t height) {
   jpeg_pending_ = false;
   while (running_.load() && connection_->ReadMessage(next_frame_)) {
-    if (framesizeMatches(width, height, next_frame_)) {
+    if (auto message = ParseFrameRingMessage(next_frame_)) {
+      readRingFrame(*message, width, height);
+    } else if (framesizeMatches(width, height, next_frame_.size())) {
       std::lock_guard<std::mutex> lock(frame_mutex_);
       timestamp_ = systemTime();
       frame_.swap(next_frame_);
+      frame_from_ring_ = false;
       yuv_frame_updated_.notify_one();
     } else if (isBlob(next_frame_)) {
       std::lock_guard<std::mutex> lock(jpeg_mutex_);
@@ -19,6 +19,7 @@
 #include <mutex>
 #include <thread>
 #include <vector>
+#include "frame_ring_reader.h"
 #include "utils/Timers.h"
 #include "vsock_connection.h"
 
@@ -27,6 +28,8 @@ namespace cuttlefish {
 using ::android::hardware::graphics::mapper::V2_0::YCbCrLayout;
 
 // VsockFrameProvider reads data from vsock
+// YUV frames come either over vsock or, when both sides support it, through a
+// frame ring in shared memory with only the slot sent over vsock.
 // Users can get the data by using copyYUVFrame/copyJpegData methods
 class VsockFrameProvider {
  public:
@@ -49,8 +52,9 @@ class VsockFrameProvider {
 
  private:
   bool isBlob(const std::vector<char>& blob);
-  bool framesizeMatches(uint32_t width, uint32_t height,
-                        const std::vector<char>& data);
+  bool framesizeMatches(uint32_t width, uint32_t height, size_t size);
+  void readRingFrame(const FrameRingMessage& message, uint32_t width,
+                     uint32_t height);
   void VsockReadLoop(uint32_t expected_width, uint32_t expected_height);
   std::thread reader_thread_;
   std::mutex frame_mutex_;
@@ -60,6 +64,11 @@ class VsockFrameProvider {
   std::atomic<bool> jpeg_pending_;
   std::vector<char> frame_;
   std::vector<char> next_frame_;
+  std::unique_ptr<FrameRingReader> frame_ring_;
+  // Whether the latest frame is ring_frame_ rather than frame_
+  bool frame_from_ring_ = false;
+  RingFrame ring_frame_;
+  RingFrame next_ring_frame_;
   std::vector<char> cached_jpeg_;
   std::condition_variable yuv_frame_updated_;
   std::shared_ptr<cuttlefish::VsockConnection> connection_;
@@ -36,6 +36,7 @@
 #include "host/commands/assemble_cvd/flags.h"
 #include "host/commands/assemble_cvd/flags_defaults.h"
 #include "host/commands/assemble_cvd/touchpad.h"
+#include "host/libs/command_util/snapshot_store.h"
 #include "host/libs/command_util/snapshot_utils.h"
 #include "host/libs/config/adb/adb.h"
 #include "host/libs/config/config_flag.h"
@@ -173,18 +174,31 @@ Result<void> CreateLegacySymlinks(
   return {};
 }
 
-Result<void> RestoreHostFiles(const std::string& cuttlefish_root_dir,
+Result<void> RestoreHostFiles(CuttlefishConfig& config,
                               const std::string& snapshot_dir_path) {
   const auto meta_json_path = SnapshotMetaJsonPath(snapshot_dir_path);
+  // A snapshot taken with --snapshot_store_path has its large files in the
+  // store. It's recreated in the runtime directory, which crosvm then restores
+  // from, so the stored snapshot stays packed.
+  std::string restore_path = snapshot_dir_path;
+  if (IsPackedSnapshot(snapshot_dir_path)) {
+    restore_path = config.root_dir() + "/" + kUnpackedSnapshotDir;
+    if (DirectoryExists(restore_path, /* follow_symlinks */ false)) {
+      CF_EXPECTF(RecursivelyRemoveDirectory(restore_path),
+                 "Failed to remove \"{}\"", restore_path);
+    }
+    CF_EXPECT(UnpackSnapshot(snapshot_dir_path, restore_path),
+              "Failed to recreate the snapshot files from the snapshot store");
+    config.set_snapshot_path(restore_path);
+  }
 
-  auto guest_snapshot_dirs =
-      CF_EXPECT(GuestSnapshotDirectories(snapshot_dir_path));
+  auto guest_snapshot_dirs = CF_EXPECT(GuestSnapshotDirectories(restore_path));
   auto filter_guest_dir =
       [&guest_snapshot_dirs](const std::string& src_dir) -> bool {
     return !Contains(guest_snapshot_dirs, src_dir);
   };
-  // cp -r snapshot_dir_path HOME
-  CF_EXPECT(CopyDirectoryRecursively(snapshot_dir_path, cuttlefish_root_dir,
+  // cp -r restore_path HOME
+  CF_EXPECT(CopyDirectoryRecursively(restore_path, config.root_dir(),
                                      /* delete destination first */ false,
                                      filter_guest_dir));
 
@@ -230,6 +244,7 @@ Result<std::set<std::string>> PreservingOnResume(
   preserving.insert("NVChip");
   preserving.insert("gatekeeper_secure");
   preserving.insert("gatekeeper_insecure");
+  preserving.insert("gatekeeper_insecure.log");
   preserving.insert("keymint_secure_deletion_data");
   preserving.insert("modem_nvram.json");
   preserving.insert("recording");
@@ -245,6 +260,7 @@ Result<std::set<std::string>> PreservingOnResume(
   preserving.insert("vbmeta.img");
   preserving.insert("oemlock_secure");
   preserving.insert("oemlock_insecure");
+  preserving.insert("oemlock_insecure.log");
   for (int i = 0; i < modem_simulator_count; i++) {
     std::stringstream ss;
     ss << "iccprofile_for_sim" << i << ".xml";
@@ -287,7 +303,7 @@ Result<const CuttlefishConfig*> InitFilesystemAndCreateConfig(
 
     const std::string snapshot_path = FLAGS_snapshot_path;
     if (!snapshot_path.empty()) {
-      CF_EXPECT(RestoreHostFiles(config.root_dir(), snapshot_path));
+      CF_EXPECT(RestoreHostFiles(config, snapshot_path));
     }
 
     // take the max value of modem_simulator_instance_number in each instance
@@ -20,6 +20,7 @@
 
 #include "common/libs/utils/files.h"
 #include "host/commands/assemble_cvd/boot_image_utils.h"
+#include "host/commands/assemble_cvd/shared_inputs.h"
 #include "host/libs/vm_manager/gem5_manager.h"
 
 namespace cuttlefish {
@@ -46,6 +47,20 @@ class Gem5ImageUnpacker : public SetupFeature {
 
  protected:
   Result<void> ResultSetup() override {
+    // Every instance unpacks the same images into the assembly directory,
+    // which other instances also use as scratch space.
+    const std::string unpack_dir = config_.assembly_dir();
+    auto unpack_once = [this, &unpack_dir]() -> Result<void> {
+      CF_EXPECT(PrepareSharedInput(unpack_dir + "/gem5",
+                                   [this]() { return Unpack(); }));
+      return {};
+    };
+    CF_EXPECT(WithExclusivePath(unpack_dir, unpack_once));
+    return {};
+  }
+
+ private:
+  Result<void> Unpack() {
     const CuttlefishConfig::InstanceSpecific& instance_ =
         config_.ForDefaultInstance();
 
@@ -102,7 +117,6 @@ class Gem5ImageUnpacker : public SetupFeature {
     return {};
   }
 
- private:
   const CuttlefishConfig& config_;
   KernelRamdiskRepacker& bir_;
 };
@@ -23,6 +23,8 @@
 
 #include "common/libs/utils/files.h"
 #include "host/commands/assemble_cvd/boot_image_utils.h"
+#include "host/commands/assemble_cvd/shared_inputs.h"
+#include "host/commands/assemble_cvd/super_image_mixer.h"
 #include "host/commands/assemble_cvd/vendor_dlkm_utils.h"
 #include "host/libs/avb/avb.h"
 #include "host/libs/config/cuttlefish_config.h"
@@ -38,12 +40,20 @@ class KernelRamdiskRepackerImpl : public KernelRamdiskRepacker {
   INJECT(KernelRamdiskRepackerImpl(
       const CuttlefishConfig& config,
       const CuttlefishConfig::InstanceSpecific& instance,
-      const Avb& avb))
-      : config_(config), instance_(instance), avb_(avb) {}
+      const Avb& avb, SuperImageRebuilder& super_image_rebuilder))
+      : config_(config),
+        instance_(instance),
+        avb_(avb),
+        super_image_rebuilder_(super_image_rebuilder) {}
 
   // SetupFeature
   std::string Name() const override { return "KernelRamdiskRepacker"; }
-  std::unordered_set<SetupFeature*> Dependencies() const override { return {}; }
+  std::unordered_set<SetupFeature*> Dependencies() const override {
+    // Both write the instance's new super image.
+    return {
+        static_cast<SetupFeature*>(&super_image_rebuilder_),
+    };
+  }
   bool Enabled() const override {
     // If we are booting a protected VM, for now, assume that image repacking
     // isn't trusted. Repacking requires resigning the image and keys from an
@@ -158,23 +168,29 @@ class KernelRamdiskRepackerImpl : public KernelRamdiskRepacker {
         CF_EXPECT(
             RepackSuperAndVbmeta(superimg_build_dir, vendor_dlkm_build_dir,
                                  system_dlkm_build_dir, ramdisk_repacked));
-        bool success = RepackVendorBootImage(
-            ramdisk_repacked, instance_.vendor_boot_image(),
-            new_vendor_boot_image_path, config_.assembly_dir(),
-            instance_.bootconfig_supported());
-        if (!success) {
-          LOG(ERROR) << "Failed to regenerate the vendor boot image with the "
-                        "new ramdisk";
-        } else {
-          // This control flow implies a kernel with all configs built in.
-          // If it's just the kernel, repack the vendor boot image without a
-          // ramdisk.
-          CF_EXPECT(
-              RepackVendorBootImageWithEmptyRamdisk(
-                  instance_.vendor_boot_image(), new_vendor_boot_image_path,
-                  config_.assembly_dir(), instance_.bootconfig_supported()),
-              "Failed to regenerate the vendor boot image without a ramdisk");
-        }
+        // The vendor boot image is unpacked into the assembly directory, which
+        // is shared with the other instances.
+        auto repack_vendor_boot = [&]() -> Result<void> {
+          bool success = RepackVendorBootImage(
+              ramdisk_repacked, instance_.vendor_boot_image(),
+              new_vendor_boot_image_path, config_.assembly_dir(),
+              instance_.bootconfig_supported());
+          if (!success) {
+            LOG(ERROR) << "Failed to regenerate the vendor boot image with the "
+                          "new ramdisk";
+          } else {
+            // This control flow implies a kernel with all configs built in.
+            // If it's just the kernel, repack the vendor boot image without a
+            // ramdisk.
+            CF_EXPECT(
+                RepackVendorBootImageWithEmptyRamdisk(
+                    instance_.vendor_boot_image(), new_vendor_boot_image_path,
+                    config_.assembly_dir(), instance_.bootconfig_supported()),
+                "Failed to regenerate the vendor boot image without a ramdisk");
+          }
+          return {};
+        };
+        CF_EXPECT(WithExclusivePath(config_.assembly_dir(), repack_vendor_boot));
       }
     }
     return {};
@@ -184,11 +200,12 @@ class KernelRamdiskRepackerImpl : public KernelRamdiskRepacker {
   const CuttlefishConfig& config_;
   const CuttlefishConfig::InstanceSpecific& instance_;
   const Avb& avb_;
+  SuperImageRebuilder& super_image_rebuilder_;
 };
 
 fruit::Component<fruit::Required<const CuttlefishConfig,
                                  const CuttlefishConfig::InstanceSpecific,
-                                 const Avb>,
+                                 const Avb, SuperImageRebuilder>,
                  KernelRamdiskRepacker>
 KernelRamdiskRepackerComponent() {
   return fruit::createComponent()
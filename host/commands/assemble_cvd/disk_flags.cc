@@ -24,8 +24,15 @@
 #include <gflags/gflags.h>
 #include <sys/statvfs.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <fstream>
+#include <functional>
+#include <thread>
+#include <vector>
 
+#include "common/libs/concurrency/worker_pool.h"
 #include "common/libs/fs/shared_buf.h"
 #include "common/libs/utils/files.h"
 #include "common/libs/utils/flag_parser.h"
@@ -124,6 +131,13 @@ DEFINE_string(blank_metadata_image_mb, CF_DEFAULTS_BLANK_METADATA_IMAGE_MB,
 DEFINE_string(
     blank_sdcard_image_mb, CF_DEFAULTS_BLANK_SDCARD_IMAGE_MB,
     "If enabled, the size of the blank sdcard image to generate, MB.");
+DEFINE_int32(parallel_disk_instances, CF_DEFAULTS_PARALLEL_DISK_INSTANCES,
+             "How many instances to prepare disks for at the same time. 0 "
+             "picks a number based on the available CPUs.");
+DEFINE_int32(parallel_disk_features, CF_DEFAULTS_PARALLEL_DISK_FEATURES,
+             "How many independent disk setup steps of an instance to run at "
+             "the same time. 0 splits the available CPUs between the "
+             "instances prepared at the same time.");
 
 DECLARE_string(ap_rootfs_image);
 DECLARE_string(bootloader);
@@ -594,6 +608,19 @@ Result<void> InitializeHwcomposerPmemImage(
   return {};
 }
 
+// Frame slots shared by the webrtc camera streamer and the guest camera HAL.
+// Room for three 1080p YUV frames.
+Result<void> InitializeCameraPmemImage(
+    const CuttlefishConfig::InstanceSpecific& instance) {
+  if (!instance.camera_server_port() ||
+      FileExists(instance.camera_pmem_path())) {
+    return {};
+  }
+  CF_EXPECT(CreateBlankImage(instance.camera_pmem_path(), 16 /* mb */, "none"),
+            "Failed creating \"" << instance.camera_pmem_path() << "\"");
+  return {};
+}
+
 Result<void> InitializePstore(
     const CuttlefishConfig::InstanceSpecific& instance) {
   if (FileExists(instance.pstore_path())) {
@@ -685,6 +712,7 @@ static fruit::Component<> DiskChangesPerInstanceComponent(
       .bindInstance(*instance)
       .install(AutoSetup<InitializeAccessKregistryImage>::Component)
       .install(AutoSetup<InitializeHwcomposerPmemImage>::Component)
+      .install(AutoSetup<InitializeCameraPmemImage>::Component)
       .install(AutoSetup<InitializePstore>::Component)
       .install(AutoSetup<InitializeSdCard>::Component)
       .install(InitializeFactoryResetProtectedComponent)
@@ -983,86 +1011,147 @@ Result<void> DiskImageFlagsVectorization(CuttlefishConfig& config, const Fetcher
   return {};
 }
 
-Result<void> CreateDynamicDiskFiles(const FetcherConfig& fetcher_config,
-                                    const CuttlefishConfig& config) {
-  for (const auto& instance : config.Instances()) {
-    // TODO(schuffelen): Unify this with the other injector created in
-    // assemble_cvd.cpp
-    fruit::Injector<> injector(DiskChangesComponent, &fetcher_config, &config,
-                               &instance);
-    for (auto& late_injected : injector.getMultibindings<LateInjected>()) {
-      CF_EXPECT(late_injected->LateInject(injector));
-    }
+static Result<void> CreateInstanceDiskFiles(
+    const FetcherConfig& fetcher_config, const CuttlefishConfig& config,
+    const CuttlefishConfig::InstanceSpecific& instance,
+    std::size_t concurrency) {
+  // TODO(schuffelen): Unify this with the other injector created in
+  // assemble_cvd.cpp
+  fruit::Injector<> injector(DiskChangesComponent, &fetcher_config, &config,
+                             &instance);
+  for (auto& late_injected : injector.getMultibindings<LateInjected>()) {
+    CF_EXPECT(late_injected->LateInject(injector));
+  }
 
-    const auto& features = injector.getMultibindings<SetupFeature>();
-    CF_EXPECT(SetupFeature::RunSetup(features));
-    fruit::Injector<> instance_injector(DiskChangesPerInstanceComponent,
-                                        &fetcher_config, &config, &instance);
-    for (auto& late_injected :
-         instance_injector.getMultibindings<LateInjected>()) {
-      CF_EXPECT(late_injected->LateInject(instance_injector));
-    }
+  // Disk features don't touch process-wide state. Those writing the same files
+  // depend on each other, so the others can run alongside them.
+  const auto& features = injector.getMultibindings<SetupFeature>();
+  CF_EXPECT(SetupFeature::RunSetup(features, concurrency));
+  fruit::Injector<> instance_injector(DiskChangesPerInstanceComponent,
+                                      &fetcher_config, &config, &instance);
+  for (auto& late_injected :
+       instance_injector.getMultibindings<LateInjected>()) {
+    CF_EXPECT(late_injected->LateInject(instance_injector));
+  }
 
-    const auto& instance_features =
-        instance_injector.getMultibindings<SetupFeature>();
-    CF_EXPECT(SetupFeature::RunSetup(instance_features),
-              "instance = \"" << instance.instance_name() << "\"");
-
-    // Check if filling in the sparse image would run out of disk space.
-    auto existing_sizes = SparseFileSizes(instance.data_image());
-    CF_EXPECT(existing_sizes.sparse_size > 0 || existing_sizes.disk_size > 0,
-              "Unable to determine size of \"" << instance.data_image()
-                                               << "\". Does this file exist?");
-    auto available_space = AvailableSpaceAtPath(instance.data_image());
-    if (available_space <
-        existing_sizes.sparse_size - existing_sizes.disk_size) {
-      // TODO(schuffelen): Duplicate this check in run_cvd when it can run on a
-      // separate machine
-      return CF_ERR("Not enough space remaining in fs containing \""
-                    << instance.data_image() << "\", wanted "
-                    << (existing_sizes.sparse_size - existing_sizes.disk_size)
-                    << ", got " << available_space);
-    } else {
-      LOG(DEBUG) << "Available space: " << available_space;
-      LOG(DEBUG) << "Sparse size of \"" << instance.data_image()
-                 << "\": " << existing_sizes.sparse_size;
-      LOG(DEBUG) << "Disk size of \"" << instance.data_image()
-                 << "\": " << existing_sizes.disk_size;
-    }
+  const auto& instance_features =
+      instance_injector.getMultibindings<SetupFeature>();
+  CF_EXPECT(SetupFeature::RunSetup(instance_features, concurrency));
+
+  // Check if filling in the sparse image would run out of disk space.
+  auto existing_sizes = SparseFileSizes(instance.data_image());
+  CF_EXPECT(existing_sizes.sparse_size > 0 || existing_sizes.disk_size > 0,
+            "Unable to determine size of \"" << instance.data_image()
+                                             << "\". Does this file exist?");
+  auto available_space = AvailableSpaceAtPath(instance.data_image());
+  if (available_space <
+      existing_sizes.sparse_size - existing_sizes.disk_size) {
+    // TODO(schuffelen): Duplicate this check in run_cvd when it can run on a
+    // separate machine
+    return CF_ERR("Not enough space remaining in fs containing \""
+                  << instance.data_image() << "\", wanted "
+                  << (existing_sizes.sparse_size - existing_sizes.disk_size)
+                  << ", got " << available_space);
+  } else {
+    LOG(DEBUG) << "Available space: " << available_space;
+    LOG(DEBUG) << "Sparse size of \"" << instance.data_image()
+               << "\": " << existing_sizes.sparse_size;
+    LOG(DEBUG) << "Disk size of \"" << instance.data_image()
+               << "\": " << existing_sizes.disk_size;
+  }
 
-    auto os_disk_builder = OsCompositeDiskBuilder(config, instance);
-    const auto os_built_composite = CF_EXPECT(os_disk_builder.BuildCompositeDiskIfNecessary());
+  auto os_disk_builder = OsCompositeDiskBuilder(config, instance);
+  const auto os_built_composite = CF_EXPECT(os_disk_builder.BuildCompositeDiskIfNecessary());
 
-    auto ap_disk_builder = ApCompositeDiskBuilder(config, instance);
-    if (instance.ap_boot_flow() != APBootFlow::None) {
-      CF_EXPECT(ap_disk_builder.BuildCompositeDiskIfNecessary());
+  auto ap_disk_builder = ApCompositeDiskBuilder(config, instance);
+  if (instance.ap_boot_flow() != APBootFlow::None) {
+    CF_EXPECT(ap_disk_builder.BuildCompositeDiskIfNecessary());
+  }
+
+  if (os_built_composite) {
+    if (FileExists(instance.access_kregistry_path())) {
+      CF_EXPECT(CreateBlankImage(instance.access_kregistry_path(), 2 /* mb */,
+                                 "none"),
+                "Failed for \"" << instance.access_kregistry_path() << "\"");
     }
+    if (FileExists(instance.hwcomposer_pmem_path())) {
+      CF_EXPECT(CreateBlankImage(instance.hwcomposer_pmem_path(), 2 /* mb */,
+                                 "none"),
+                "Failed for \"" << instance.hwcomposer_pmem_path() << "\"");
+    }
+    if (FileExists(instance.pstore_path())) {
+      CF_EXPECT(CreateBlankImage(instance.pstore_path(), 2 /* mb */, "none"),
+                "Failed for\"" << instance.pstore_path() << "\"");
+    }
+  }
 
-    if (os_built_composite) {
-      if (FileExists(instance.access_kregistry_path())) {
-        CF_EXPECT(CreateBlankImage(instance.access_kregistry_path(), 2 /* mb */,
-                                   "none"),
-                  "Failed for \"" << instance.access_kregistry_path() << "\"");
-      }
-      if (FileExists(instance.hwcomposer_pmem_path())) {
-        CF_EXPECT(CreateBlankImage(instance.hwcomposer_pmem_path(), 2 /* mb */,
-                                   "none"),
-                  "Failed for \"" << instance.hwcomposer_pmem_path() << "\"");
-      }
-      if (FileExists(instance.pstore_path())) {
-        CF_EXPECT(CreateBlankImage(instance.pstore_path(), 2 /* mb */, "none"),
-                  "Failed for\"" << instance.pstore_path() << "\"");
-      }
+  if (!instance.protected_vm()) {
+    os_disk_builder.OverlayPath(instance.PerInstancePath("overlay.img"));
+    CF_EXPECT(os_disk_builder.BuildOverlayIfNecessary());
+    if (instance.ap_boot_flow() != APBootFlow::None) {
+      ap_disk_builder.OverlayPath(instance.PerInstancePath("ap_overlay.img"));
+      CF_EXPECT(ap_disk_builder.BuildOverlayIfNecessary());
     }
+  }
+  return {};
+}
 
-    if (!instance.protected_vm()) {
-      os_disk_builder.OverlayPath(instance.PerInstancePath("overlay.img"));
-      CF_EXPECT(os_disk_builder.BuildOverlayIfNecessary());
-      if (instance.ap_boot_flow() != APBootFlow::None) {
-        ap_disk_builder.OverlayPath(instance.PerInstancePath("ap_overlay.img"));
-        CF_EXPECT(ap_disk_builder.BuildOverlayIfNecessary());
+Result<void> CreateDynamicDiskFiles(const FetcherConfig& fetcher_config,
+                                    const CuttlefishConfig& config) {
+  const auto instances = config.Instances();
+  CF_EXPECT(FLAGS_parallel_disk_instances >= 0,
+            "--parallel_disk_instances must not be negative");
+  CF_EXPECT(FLAGS_parallel_disk_features >= 0,
+            "--parallel_disk_features must not be negative");
+  const std::size_t cpus =
+      std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+  std::size_t parallel_instances = FLAGS_parallel_disk_instances == 0
+                                       ? cpus
+                                       : FLAGS_parallel_disk_instances;
+  parallel_instances =
+      std::max<std::size_t>(std::min(parallel_instances, instances.size()), 1);
+  // Split the CPUs between the instances being prepared at the same time.
+  const std::size_t feature_concurrency =
+      FLAGS_parallel_disk_features == 0
+          ? std::max<std::size_t>(cpus / parallel_instances, 1)
+          : FLAGS_parallel_disk_features;
+
+  std::vector<Result<void>> results(instances.size());
+  std::vector<std::chrono::steady_clock::duration> durations(instances.size());
+  std::atomic<bool> failed = false;
+  std::vector<std::function<void()>> tasks;
+  for (std::size_t i = 0; i < instances.size(); i++) {
+    tasks.emplace_back([&, i]() {
+      if (failed) {
+        return;  // Don't start on more instances after a failure.
       }
-    }
+      auto start = std::chrono::steady_clock::now();
+      results[i] = CreateInstanceDiskFiles(fetcher_config, config,
+                                           instances[i], feature_concurrency);
+      durations[i] = std::chrono::steady_clock::now() - start;
+      if (!results[i].ok()) {
+        failed = true;
+      }
+    });
+  }
+  auto start = std::chrono::steady_clock::now();
+  WorkerPool(parallel_instances).Run(tasks);
+  auto duration = std::chrono::steady_clock::now() - start;
+
+  auto millis = [](std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(duration)
+        .count();
+  };
+  LOG(DEBUG) << "Prepared disks for " << instances.size() << " instances, "
+             << parallel_instances << " at a time, in " << millis(duration)
+             << "ms";
+  for (std::size_t i = 0; i < instances.size(); i++) {
+    LOG(DEBUG) << "  instance \"" << instances[i].instance_name()
+               << "\": " << millis(durations[i]) << "ms";
+  }
+  for (std::size_t i = 0; i < instances.size(); i++) {
+    CF_EXPECT(std::move(results[i]),
+              "instance = \"" << instances[i].instance_name() << "\"");
   }
 
   for (auto instance : config.Instances()) {
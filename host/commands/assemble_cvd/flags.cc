@@ -61,6 +61,7 @@
 #include "host/libs/config/host_tools_version.h"
 #include "host/libs/config/instance_nums.h"
 #include "host/libs/config/touchpad.h"
+#include "host/libs/config/video_codecs.h"
 #include "host/libs/vm_manager/crosvm_manager.h"
 #include "host/libs/vm_manager/gem5_manager.h"
 #include "host/libs/vm_manager/qemu_manager.h"
@@ -260,6 +261,18 @@ DEFINE_vec(udp_port_range, CF_DEFAULTS_UDP_PORT_RANGE,
               "The minimum and maximum UDP port numbers to allocate for ICE "
               "candidates as 'min:max'. To use any port just specify '0:0'");
 
+DEFINE_vec(webrtc_video_codecs, CF_DEFAULTS_WEBRTC_VIDEO_CODECS,
+           "The video codecs the webrtc process may offer to clients, most "
+           "preferred first, as 'codec1:codec2:...'. Supported codecs are "
+           "vp8, vp9, h264 and av1. Codecs the host's encoder doesn't support "
+           "are skipped.");
+
+DEFINE_vec(webrtc_screen_content,
+           fmt::format("{}", CF_DEFAULTS_WEBRTC_SCREEN_CONTENT),
+           "Encode displays with settings tuned for screen content: favor "
+           "sharpness over frame rate and use the codecs' screen sharing "
+           "modes.");
+
 DEFINE_string(webrtc_sig_server_path, CF_DEFAULTS_WEBRTC_SIG_SERVER_PATH,
               "The path section of the URL where the device should be "
               "registered with the signaling server.");
@@ -311,6 +324,14 @@ DEFINE_vec(gem5_debug_file, CF_DEFAULTS_GEM5_DEBUG_FILE,
 DEFINE_string(gem5_debug_flags, CF_DEFAULTS_GEM5_DEBUG_FLAGS,
               "The debug flags gem5 uses to print debugs to file");
 
+DEFINE_int32(log_rotate_size_mb, CF_DEFAULTS_LOG_ROTATE_SIZE_MB,
+             "Rotate the logcat and kernel log files before they grow past "
+             "this many MiB. Zero disables rotation.");
+DEFINE_int32(log_rotate_files, CF_DEFAULTS_LOG_ROTATE_FILES,
+             "How many rotated log files to keep.");
+DEFINE_bool(log_compress_rotated, CF_DEFAULTS_LOG_COMPRESS_ROTATED,
+            "Whether to gzip rotated log files.");
+
 DEFINE_vec(restart_subprocesses,
            fmt::format("{}", CF_DEFAULTS_RESTART_SUBPROCESSES),
            "Restart any crashed host process");
@@ -957,6 +978,14 @@ Result<CuttlefishConfig> InitializeCuttlefishConfiguration(
 
   tmp_config_obj.set_gem5_debug_flags(FLAGS_gem5_debug_flags);
 
+  CF_EXPECT_GE(FLAGS_log_rotate_size_mb, 0,
+               "--log_rotate_size_mb must not be negative");
+  CF_EXPECT_GE(FLAGS_log_rotate_files, 0,
+               "--log_rotate_files must not be negative");
+  tmp_config_obj.set_log_rotate_size_mb(FLAGS_log_rotate_size_mb);
+  tmp_config_obj.set_log_rotate_files(FLAGS_log_rotate_files);
+  tmp_config_obj.set_log_compress_rotated(FLAGS_log_compress_rotated);
+
   // streaming, webrtc setup
   tmp_config_obj.set_webrtc_certs_dir(FLAGS_webrtc_certs_dir);
   tmp_config_obj.set_sig_server_secure(FLAGS_webrtc_sig_server_secure);
@@ -1085,6 +1114,10 @@ Result<CuttlefishConfig> InitializeCuttlefishConfiguration(
       CF_EXPECT(GET_FLAG_STR_VALUE(tcp_port_range));
   std::vector<std::string> udp_port_range_vec =
       CF_EXPECT(GET_FLAG_STR_VALUE(udp_port_range));
+  std::vector<std::string> webrtc_video_codecs_vec =
+      CF_EXPECT(GET_FLAG_STR_VALUE(webrtc_video_codecs));
+  std::vector<bool> webrtc_screen_content_vec =
+      CF_EXPECT(GET_FLAG_BOOL_VALUE(webrtc_screen_content));
   std::vector<bool> vhost_net_vec = CF_EXPECT(GET_FLAG_BOOL_VALUE(
       vhost_net));
   std::vector<std::string> vhost_user_vsock_vec =
@@ -1616,6 +1649,11 @@ Result<CuttlefishConfig> InitializeCuttlefishConfiguration(
     auto udp_range  = ParsePortRange(udp_port_range_vec[instance_index]);
     instance.set_webrtc_udp_port_range(udp_range);
 
+    instance.set_webrtc_video_codecs(
+        CF_EXPECT(ParseVideoCodecs(webrtc_video_codecs_vec[instance_index])));
+    instance.set_webrtc_screen_content(
+        webrtc_screen_content_vec[instance_index]);
+
     // end of streaming, webrtc setup
 
     instance.set_start_webrtc_signaling_server(false);
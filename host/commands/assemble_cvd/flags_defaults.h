@@ -76,6 +76,11 @@
 #define CF_DEFAULTS_GEM5_DEBUG_FILE CF_DEFAULTS_DYNAMIC_STRING
 #define CF_DEFAULTS_GEM5_DEBUG_FLAGS CF_DEFAULTS_DYNAMIC_STRING
 
+// Guest log file default parameters
+#define CF_DEFAULTS_LOG_ROTATE_SIZE_MB 0
+#define CF_DEFAULTS_LOG_ROTATE_FILES 4
+#define CF_DEFAULTS_LOG_COMPRESS_ROTATED false
+
 // Boot default parameters
 #define CF_DEFAULTS_BOOT_SLOT CF_DEFAULTS_DYNAMIC_STRING
 #define CF_DEFAULTS_BOOTLOADER CF_DEFAULTS_DYNAMIC_STRING
@@ -105,6 +110,8 @@
 // Disk default parameters
 #define CF_DEFAULTS_BLANK_METADATA_IMAGE_MB "64"
 #define CF_DEFAULTS_BLANK_SDCARD_IMAGE_MB "2048"
+#define CF_DEFAULTS_PARALLEL_DISK_INSTANCES 1
+#define CF_DEFAULTS_PARALLEL_DISK_FEATURES 1
 #define CF_DEFAULTS_BOOT_IMAGE CF_DEFAULTS_DYNAMIC_STRING
 #define CF_DEFAULTS_DATA_IMAGE CF_DEFAULTS_DYNAMIC_STRING
 #define CF_DEFAULTS_INIT_BOOT_IMAGE CF_DEFAULTS_DYNAMIC_STRING
@@ -209,6 +216,8 @@
 #define CF_DEFAULTS_WEBRTC_SIG_SERVER_SECURE true
 #define CF_DEFAULTS_TCP_PORT_RANGE "15550:15599"
 #define CF_DEFAULTS_UDP_PORT_RANGE "15550:15599"
+#define CF_DEFAULTS_WEBRTC_VIDEO_CODECS "vp8"
+#define CF_DEFAULTS_WEBRTC_SCREEN_CONTENT false
 
 // Adb default parameters
 // TODO : Replaceconstants with these flags, they're currently defined throug
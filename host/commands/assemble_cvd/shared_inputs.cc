@@ -0,0 +1,87 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/commands/assemble_cvd/shared_inputs.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <android-base/logging.h>
+
+#include "common/libs/utils/result.h"
+
+namespace cuttlefish {
+namespace {
+
+struct SharedEntry {
+  std::mutex mutex;
+  bool prepared = false;
+};
+
+// Entries are never removed, so references to them stay valid after the
+// registry lock is released.
+class SharedEntries {
+ public:
+  SharedEntry& Get(const std::string& key) {
+    std::lock_guard lock(mutex_);
+    auto& entry = entries_[key];
+    if (!entry) {
+      entry = std::make_unique<SharedEntry>();
+    }
+    return *entry;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::map<std::string, std::unique_ptr<SharedEntry>> entries_;
+};
+
+SharedEntries& SharedInputs() {
+  static auto* entries = new SharedEntries();
+  return *entries;
+}
+
+SharedEntries& ExclusivePaths() {
+  static auto* entries = new SharedEntries();
+  return *entries;
+}
+
+}  // namespace
+
+Result<void> PrepareSharedInput(const std::string& key,
+                                const std::function<Result<void>()>& prepare) {
+  auto& entry = SharedInputs().Get(key);
+  std::lock_guard lock(entry.mutex);
+  if (entry.prepared) {
+    LOG(DEBUG) << "Reusing shared input \"" << key << "\"";
+    return {};
+  }
+  CF_EXPECT(prepare(), "Failed to prepare shared input \"" << key << "\"");
+  entry.prepared = true;
+  return {};
+}
+
+Result<void> WithExclusivePath(const std::string& path,
+                               const std::function<Result<void>()>& use) {
+  auto& entry = ExclusivePaths().Get(path);
+  std::lock_guard lock(entry.mutex);
+  CF_EXPECT(use());
+  return {};
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,39 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "common/libs/utils/result.h"
+
+namespace cuttlefish {
+
+// The disks of several instances may be prepared at the same time, these
+// coordinate the work on files shared between them.
+
+// Runs `prepare` only once for `key` in this process. Concurrent callers with
+// the same key wait for the first one to finish, if it fails the next caller
+// tries again.
+Result<void> PrepareSharedInput(const std::string& key,
+                                const std::function<Result<void>()>& prepare);
+
+// Runs `use` while no other caller is using `path`, for steps that keep
+// scratch files in a directory shared by all instances.
+Result<void> WithExclusivePath(const std::string& path,
+                               const std::function<Result<void>()>& use);
+
+}  // namespace cuttlefish
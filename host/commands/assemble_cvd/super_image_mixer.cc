@@ -30,6 +30,7 @@
 #include "common/libs/utils/files.h"
 #include "common/libs/utils/subprocess.h"
 #include "host/commands/assemble_cvd/misc_info.h"
+#include "host/commands/assemble_cvd/shared_inputs.h"
 #include "host/libs/config/cuttlefish_config.h"
 #include "host/libs/config/fetcher_config.h"
 
@@ -281,9 +282,15 @@ Result<void> RebuildSuperImage(const FetcherConfig& fetcher_config,
   // TODO(schuffelen): Use cuttlefish_assembly
   std::string combined_target_path = instance.PerInstanceInternalPath("target_combined");
   // TODO(schuffelen): Use otatools/bin/merge_target_files
-  CF_EXPECT(CombineTargetZipFiles(default_target_zip, system_target_zip,
-                                  combined_target_path),
-            "Could not combine target zip files.");
+  // Every instance combines the default instance's target files into the
+  // same path, so the work is shared.
+  auto combine = [&]() -> Result<void> {
+    CF_EXPECT(CombineTargetZipFiles(default_target_zip, system_target_zip,
+                                    combined_target_path),
+              "Could not combine target zip files.");
+    return {};
+  };
+  CF_EXPECT(PrepareSharedInput(combined_target_path, combine));
 
   CF_EXPECT(BuildSuperImage(combined_target_path, output_path),
             "Could not write the final output super image.");
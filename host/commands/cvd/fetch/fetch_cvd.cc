@@ -16,15 +16,23 @@
 #include "host/commands/cvd/fetch/fetch_cvd.h"
 
 #include <sys/stat.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <fstream>
+#include <functional>
 #include <future>
 #include <iostream>
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <android-base/logging.h>
@@ -42,6 +50,7 @@
 #include "host/libs/config/fetcher_config.h"
 #include "host/libs/web/android_build_api.h"
 #include "host/libs/web/android_build_string.h"
+#include "host/libs/web/artifact_cache.h"
 #include "host/libs/web/credential_source.h"
 #include "host/libs/web/http_client/http_client.h"
 
@@ -232,9 +241,18 @@ Result<BuildApi> GetBuildApi(const BuildApiFlags& flags) {
           flags.credential_flags.credential_filepath,
           flags.credential_flags.service_account_filepath));
 
+  std::unique_ptr<ArtifactCache> artifact_cache;
+  if (!flags.artifact_cache_directory.empty()) {
+    CF_EXPECT_GE(flags.artifact_cache_max_size_gb, 0);
+    artifact_cache = CF_EXPECT(ArtifactCache::Create(
+        flags.artifact_cache_directory,
+        std::uint64_t(flags.artifact_cache_max_size_gb) << 30));
+  }
+
   return BuildApi(std::move(retrying_http_client), std::move(curl),
                   std::move(credential_source), flags.api_key,
-                  flags.wait_retry_period, flags.api_base_url);
+                  flags.wait_retry_period, flags.api_base_url,
+                  std::move(artifact_cache));
 }
 
 Result<std::optional<Build>> GetBuildHelper(
@@ -314,19 +332,299 @@ Result<void> SaveConfig(FetcherConfig& config,
   return {};
 }
 
+// Artifacts downloaded by `DownloadScheduler` into a directory of their own.
+// They only replace any files of the same name in the target directory once
+// they are consumed, so the artifacts still override each other in the order
+// they are consumed.
+class PendingDownload {
+ public:
+  PendingDownload() = default;
+  PendingDownload(std::future<Result<std::vector<std::string>>> future,
+                  std::string staging_directory, std::string target_directory,
+                  std::function<void()> cancel)
+      : future_(std::move(future)),
+        staging_directory_(std::move(staging_directory)),
+        target_directory_(std::move(target_directory)),
+        cancel_(std::move(cancel)) {}
+  PendingDownload(PendingDownload&&) = default;
+  PendingDownload& operator=(PendingDownload&&) = default;
+
+  // A download is only left unconsumed when the fetch failed before getting
+  // to it, in which case none of the other downloads are needed either. The
+  // staging directory is kept when it holds a partial download, repeating
+  // the fetch resumes it.
+  ~PendingDownload() {
+    if (!future_.valid()) {
+      return;
+    }
+    cancel_();
+    future_.wait();
+    rmdir(staging_directory_.c_str());
+  }
+
+  Result<std::string> Get() {
+    std::vector<std::string> paths = CF_EXPECT(GetAll());
+    CF_EXPECT_EQ(paths.size(), 1u);
+    return paths.front();
+  }
+
+  Result<std::vector<std::string>> GetAll() {
+    CF_EXPECT(future_.valid(), "Download was not started or already consumed");
+    Result<std::vector<std::string>> download_result = future_.get();
+    if (!download_result.ok()) {
+      // Only succeeds without a partial download that could be resumed.
+      rmdir(staging_directory_.c_str());
+    }
+    std::vector<std::string> staged_paths =
+        CF_EXPECT(std::move(download_result));
+    // Also moves what the download leaves next to the returned files, like
+    // kept archives.
+    for (const auto& name : CF_EXPECT(DirectoryContents(staging_directory_))) {
+      if (name == "." || name == "..") {
+        continue;
+      }
+      CF_EXPECT(RenameFile(staging_directory_ + "/" + name,
+                           target_directory_ + "/" + name));
+    }
+    CF_EXPECTF(RecursivelyRemoveDirectory(staging_directory_),
+               "Failed to remove \"{}\"", staging_directory_);
+    std::vector<std::string> paths;
+    for (const auto& staged_path : staged_paths) {
+      paths.emplace_back(target_directory_ +
+                         staged_path.substr(staging_directory_.size()));
+    }
+    return paths;
+  }
+
+ private:
+  std::future<Result<std::vector<std::string>>> future_;
+  std::string staging_directory_;
+  std::string target_directory_;
+  std::function<void()> cancel_;
+};
+
+// Starts the artifact downloads of a target in the background, with at most a
+// fixed number of them transferring at once, so the artifacts are consumed in
+// order while later ones are already on their way. The staging directories
+// only depend on the order of the calls, so an interrupted fetch repeated
+// with the same arguments resumes its partial downloads. They are only
+// removed once the fetch succeeded, see `RemoveStagingDirectories`.
+class DownloadScheduler {
+ public:
+  DownloadScheduler(BuildApi& build_api, const int max_parallel_downloads)
+      : build_api_(build_api),
+        max_parallel_downloads_(std::max(max_parallel_downloads, 1)) {}
+
+  // Downloads the first of `artifact_names` available in `build`.
+  PendingDownload Start(const Build& build, const std::string& target_directory,
+                        const std::vector<std::string>& artifact_names) {
+    return Schedule(
+        target_directory,
+        [this, build, artifact_names](const std::string& directory)
+            -> Result<std::vector<std::string>> {
+          std::string path =
+              artifact_names.size() > 1
+                  ? CF_EXPECT(build_api_.DownloadFileWithBackup(
+                        build, directory, artifact_names[0],
+                        artifact_names[1]))
+                  : CF_EXPECT(build_api_.DownloadFile(build, directory,
+                                                      artifact_names[0]));
+          return std::vector<std::string>{path};
+        });
+  }
+
+  // Removes what's left of the staging directories, the partial downloads of
+  // artifacts whose failure the fetch tolerated. Only called once the fetch
+  // succeeded, so nothing that could be resumed is lost.
+  Result<void> RemoveStagingDirectories() {
+    for (const auto& directory : staging_directories_) {
+      if (DirectoryExists(directory, /* follow_symlinks */ false)) {
+        CF_EXPECTF(RecursivelyRemoveDirectory(directory),
+                   "Failed to remove \"{}\"", directory);
+      }
+    }
+    return {};
+  }
+
+  // Extracts `files` from the archive, or all of its contents when empty.
+  PendingDownload StartExtraction(const Build& build,
+                                  const std::string& target_directory,
+                                  const std::string& archive_name,
+                                  const std::vector<std::string>& files,
+                                  const bool keep_archive) {
+    return Schedule(target_directory, [this, build, archive_name, files,
+                                       keep_archive](
+                                          const std::string& directory) {
+      return build_api_.DownloadAndExtract(build, directory, archive_name,
+                                           files, keep_archive);
+    });
+  }
+
+ private:
+  using Download = std::function<Result<std::vector<std::string>>(
+      const std::string& directory)>;
+
+  PendingDownload Schedule(const std::string& target_directory,
+                           Download download) {
+    std::string staging_directory =
+        target_directory + "/.download_" + std::to_string(started_++);
+    staging_directories_.push_back(staging_directory);
+    auto future = std::async(std::launch::async,
+                             [this, staging_directory, download]() {
+                               return TimedDownload(staging_directory,
+                                                    download);
+                             });
+    return PendingDownload(std::move(future), std::move(staging_directory),
+                           target_directory, [this]() { Cancel(); });
+  }
+
+  // Fails the downloads in progress and the ones still waiting to start.
+  void Cancel() {
+    if (!cancelled_.exchange(true)) {
+      build_api_.CancelDownloads();
+    }
+  }
+
+  Result<std::vector<std::string>> TimedDownload(const std::string& directory,
+                                                 const Download& download) {
+    CF_EXPECT(EnsureDirectoryExists(directory));
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      slot_available_.wait(lock, [this]() {
+        return running_downloads_ < max_parallel_downloads_;
+      });
+      running_downloads_++;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    Result<std::vector<std::string>> paths =
+        CF_ERR("Download into \"" << directory << "\" was cancelled");
+    if (!cancelled_) {
+      paths = download(directory);
+    }
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      running_downloads_--;
+    }
+    slot_available_.notify_one();
+
+    if (paths.ok()) {
+      double megabytes = 0;
+      for (const auto& path : *paths) {
+        megabytes += FileSize(path) / double(1 << 20);
+      }
+      LOG(INFO) << "Fetched " << paths->size() << " file(s) into \""
+                << directory << "\" (" << megabytes << " MiB) in "
+                << elapsed.count() << " s, "
+                << megabytes / std::max(elapsed.count(), 0.001) << " MiB/s";
+    }
+    return paths;
+  }
+
+  BuildApi& build_api_;
+  const int max_parallel_downloads_;
+  int started_ = 0;
+  std::vector<std::string> staging_directories_;
+  std::mutex mutex_;
+  std::condition_variable slot_available_;
+  int running_downloads_ = 0;
+  std::atomic<bool> cancelled_ = false;
+};
+
 Result<void> FetchTarget(BuildApi& build_api, const Builds& builds,
                          const TargetDirectories& target_directories,
                          const DownloadFlags& flags,
                          const bool keep_downloaded_archives,
+                         const int max_parallel_downloads,
                          FetcherConfig& config) {
+  // Start every download up front, the artifacts are then processed in order
+  // as they arrive.
+  DownloadScheduler downloads(build_api, max_parallel_downloads);
+  PendingDownload misc_info_download;
+  PendingDownload default_img_zip_download;
+  PendingDownload default_target_files_download;
+  if (builds.default_build) {
+    misc_info_download = downloads.Start(
+        *builds.default_build, target_directories.root, {"misc_info.txt"});
+    if (flags.download_img_zip) {
+      default_img_zip_download = downloads.StartExtraction(
+          *builds.default_build, target_directories.root,
+          GetBuildZipName(*builds.default_build, "img"), {},
+          keep_downloaded_archives);
+    }
+    if (builds.system || flags.download_target_files_zip) {
+      default_target_files_download =
+          downloads.Start(*builds.default_build,
+                          target_directories.default_target_files,
+                          {GetBuildZipName(*builds.default_build,
+                                           "target_files")});
+    }
+  }
+  PendingDownload system_target_files_download;
+  PendingDownload system_img_zip_download;
+  if (builds.system) {
+    system_target_files_download = downloads.Start(
+        *builds.system, target_directories.system_target_files,
+        {GetBuildZipName(*builds.system, "target_files")});
+    if (flags.download_img_zip) {
+      system_img_zip_download = downloads.StartExtraction(
+          *builds.system, target_directories.root,
+          GetBuildZipName(*builds.system, "img"), {"system.img", "product.img"},
+          keep_downloaded_archives);
+    }
+  }
+  PendingDownload kernel_download;
+  PendingDownload initramfs_download;
+  if (builds.kernel) {
+    // If the kernel is from an arm/aarch64 build, the artifact will be called
+    // Image.
+    kernel_download = downloads.Start(*builds.kernel, target_directories.root,
+                                      {"bzImage", "Image"});
+    initramfs_download = downloads.Start(
+        *builds.kernel, target_directories.root, {"initramfs.img"});
+  }
+  PendingDownload boot_download;
+  if (builds.boot) {
+    std::string boot_img_zip_name = GetBuildZipName(*builds.boot, "img");
+    std::optional<std::string> boot_filepath = GetFilepath(*builds.boot);
+    if (boot_filepath) {
+      boot_download = downloads.Start(*builds.boot, target_directories.root,
+                                      {*boot_filepath, boot_img_zip_name});
+    } else {
+      boot_download = downloads.Start(*builds.boot, target_directories.root,
+                                      {boot_img_zip_name});
+    }
+  }
+  PendingDownload bootloader_download;
+  if (builds.bootloader) {
+    // If the bootloader is from an arm/aarch64 build, the artifact will be of
+    // filetype bin.
+    bootloader_download =
+        downloads.Start(*builds.bootloader, target_directories.root,
+                        {"u-boot.rom", "u-boot.bin"});
+  }
+  PendingDownload android_efi_loader_download;
+  if (builds.android_efi_loader) {
+    std::optional<std::string> android_efi_loader_filepath =
+        GetFilepath(*builds.android_efi_loader);
+    android_efi_loader_download = downloads.Start(
+        *builds.android_efi_loader, target_directories.root,
+        {android_efi_loader_filepath.value_or("gbl_x86_64.efi")});
+  }
+  PendingDownload otatools_download;
+  if (builds.otatools) {
+    otatools_download = downloads.Start(
+        *builds.otatools, target_directories.root, {"otatools.zip"});
+  }
+
   if (builds.default_build) {
     const auto [default_build_id, default_build_target] =
         GetBuildIdAndTarget(*builds.default_build);
 
     // Some older builds might not have misc_info.txt, so permit errors on
     // fetching misc_info.txt
-    Result<std::string> misc_info_result = build_api.DownloadFile(
-        *builds.default_build, target_directories.root, "misc_info.txt");
+    Result<std::string> misc_info_result = misc_info_download.Get();
     if (misc_info_result.ok()) {
       CF_EXPECT(config.AddFilesToConfig(
           FileSource::DEFAULT_BUILD, default_build_id, default_build_target,
@@ -335,12 +633,8 @@ Result<void> FetchTarget(BuildApi& build_api, const Builds& builds,
     }
 
     if (flags.download_img_zip) {
-      std::string img_zip_name = GetBuildZipName(*builds.default_build, "img");
-      std::string default_img_zip_filepath = CF_EXPECT(build_api.DownloadFile(
-          *builds.default_build, target_directories.root, img_zip_name));
-      std::vector<std::string> image_files = CF_EXPECT(ExtractArchiveContents(
-          default_img_zip_filepath, target_directories.root,
-          keep_downloaded_archives));
+      std::vector<std::string> image_files =
+          CF_EXPECT(default_img_zip_download.GetAll());
       LOG(INFO) << "Adding img-zip files for default build";
       for (auto& file : image_files) {
         LOG(VERBOSE) << file;
@@ -351,11 +645,8 @@ Result<void> FetchTarget(BuildApi& build_api, const Builds& builds,
     }
 
     if (builds.system || flags.download_target_files_zip) {
-      std::string target_files_name =
-          GetBuildZipName(*builds.default_build, "target_files");
-      std::string target_files = CF_EXPECT(build_api.DownloadFile(
-          *builds.default_build, target_directories.default_target_files,
-          target_files_name));
+      std::string target_files =
+          CF_EXPECT(default_target_files_download.Get());
       LOG(INFO) << "Adding target files for default build";
       CF_EXPECT(config.AddFilesToConfig(
           FileSource::DEFAULT_BUILD, default_build_id, default_build_target,
@@ -364,33 +655,21 @@ Result<void> FetchTarget(BuildApi& build_api, const Builds& builds,
   }
 
   if (builds.system) {
-    std::string target_files_name =
-        GetBuildZipName(*builds.system, "target_files");
-    std::string target_files = CF_EXPECT(build_api.DownloadFile(
-        *builds.system, target_directories.system_target_files,
-        target_files_name));
+    std::string target_files = CF_EXPECT(system_target_files_download.Get());
     const auto [system_id, system_target] = GetBuildIdAndTarget(*builds.system);
     CF_EXPECT(config.AddFilesToConfig(FileSource::SYSTEM_BUILD, system_id,
                                       system_target, {target_files},
                                       target_directories.root));
 
     if (flags.download_img_zip) {
-      std::string system_img_zip_name = GetBuildZipName(*builds.system, "img");
-      Result<std::string> system_img_zip_result = build_api.DownloadFile(
-          *builds.system, target_directories.root, system_img_zip_name);
-      Result<std::vector<std::string>> extract_result;
-      if (system_img_zip_result.ok()) {
-        extract_result = ExtractImages(
-            system_img_zip_result.value(), target_directories.root,
-            {"system.img", "product.img"}, keep_downloaded_archives);
-        if (extract_result.ok()) {
-          CF_EXPECT(config.AddFilesToConfig(
-              FileSource::SYSTEM_BUILD, system_id, system_target,
-              extract_result.value(), target_directories.root,
-              kOverrideEntries));
-        }
-      }
-      if (!system_img_zip_result.ok() || !extract_result.ok()) {
+      Result<std::vector<std::string>> extract_result =
+          system_img_zip_download.GetAll();
+      if (extract_result.ok()) {
+        CF_EXPECT(config.AddFilesToConfig(
+            FileSource::SYSTEM_BUILD, system_id, system_target,
+            extract_result.value(), target_directories.root,
+            kOverrideEntries));
+      } else {
         std::string extracted_system = CF_EXPECT(ExtractImage(
             target_files, target_directories.root, "IMAGES/system.img"));
         CF_EXPECT(RenameFile(extracted_system,
@@ -428,11 +707,7 @@ Result<void> FetchTarget(BuildApi& build_api, const Builds& builds,
 
   if (builds.kernel) {
     std::string kernel_filepath = target_directories.root + "/kernel";
-    // If the kernel is from an arm/aarch64 build, the artifact will be called
-    // Image.
-    std::string downloaded_kernel_filepath =
-        CF_EXPECT(build_api.DownloadFileWithBackup(
-            *builds.kernel, target_directories.root, "bzImage", "Image"));
+    std::string downloaded_kernel_filepath = CF_EXPECT(kernel_download.Get());
     CF_EXPECT(RenameFile(downloaded_kernel_filepath, kernel_filepath));
     const auto [kernel_id, kernel_target] = GetBuildIdAndTarget(*builds.kernel);
     CF_EXPECT(config.AddFilesToConfig(FileSource::KERNEL_BUILD, kernel_id,
@@ -440,8 +715,7 @@ Result<void> FetchTarget(BuildApi& build_api, const Builds& builds,
                                       target_directories.root));
 
     // Certain kernel builds do not have corresponding ramdisks.
-    Result<std::string> initramfs_img_result = build_api.DownloadFile(
-        *builds.kernel, target_directories.root, "initramfs.img");
+    Result<std::string> initramfs_img_result = initramfs_download.Get();
     if (initramfs_img_result.ok()) {
       CF_EXPECT(config.AddFilesToConfig(
           FileSource::KERNEL_BUILD, kernel_id, kernel_target,
@@ -451,16 +725,8 @@ Result<void> FetchTarget(BuildApi& build_api, const Builds& builds,
 
   if (builds.boot) {
     std::string boot_img_zip_name = GetBuildZipName(*builds.boot, "img");
-    std::string downloaded_boot_filepath;
     std::optional<std::string> boot_filepath = GetFilepath(*builds.boot);
-    if (boot_filepath) {
-      downloaded_boot_filepath = CF_EXPECT(build_api.DownloadFileWithBackup(
-          *builds.boot, target_directories.root, *boot_filepath,
-          boot_img_zip_name));
-    } else {
-      downloaded_boot_filepath = CF_EXPECT(build_api.DownloadFile(
-          *builds.boot, target_directories.root, boot_img_zip_name));
-    }
+    std::string downloaded_boot_filepath = CF_EXPECT(boot_download.Get());
 
     std::vector<std::string> boot_files;
     // downloaded a zip that needs to be extracted
@@ -491,12 +757,8 @@ Result<void> FetchTarget(BuildApi& build_api, const Builds& builds,
 
   if (builds.bootloader) {
     std::string bootloader_filepath = target_directories.root + "/bootloader";
-    // If the bootloader is from an arm/aarch64 build, the artifact will be of
-    // filetype bin.
     std::string downloaded_bootloader_filepath =
-        CF_EXPECT(build_api.DownloadFileWithBackup(*builds.bootloader,
-                                                   target_directories.root,
-                                                   "u-boot.rom", "u-boot.bin"));
+        CF_EXPECT(bootloader_download.Get());
     CF_EXPECT(RenameFile(downloaded_bootloader_filepath, bootloader_filepath));
     const auto [bootloader_id, bootloader_target] =
         GetBuildIdAndTarget(*builds.bootloader);
@@ -508,13 +770,8 @@ Result<void> FetchTarget(BuildApi& build_api, const Builds& builds,
   if (builds.android_efi_loader) {
     std::string android_efi_loader_target_filepath =
         target_directories.root + "/android_efi_loader.efi";
-    std::optional<std::string> android_efi_loader_filepath =
-        GetFilepath(*builds.android_efi_loader);
-
     std::string downloaded_android_efi_loader_filepath =
-        CF_EXPECT(build_api.DownloadFile(
-            *builds.android_efi_loader, target_directories.root,
-            android_efi_loader_filepath.value_or("gbl_x86_64.efi")));
+        CF_EXPECT(android_efi_loader_download.Get());
     CF_EXPECT(RenameFile(downloaded_android_efi_loader_filepath,
                          android_efi_loader_target_filepath));
 
@@ -527,8 +784,7 @@ Result<void> FetchTarget(BuildApi& build_api, const Builds& builds,
   }
 
   if (builds.otatools) {
-    std::string otatools_filepath = CF_EXPECT(build_api.DownloadFile(
-        *builds.otatools, target_directories.root, "otatools.zip"));
+    std::string otatools_filepath = CF_EXPECT(otatools_download.Get());
     std::vector<std::string> ota_tools_files = CF_EXPECT(
         ExtractArchiveContents(otatools_filepath, target_directories.otatools,
                                keep_downloaded_archives));
@@ -538,6 +794,7 @@ Result<void> FetchTarget(BuildApi& build_api, const Builds& builds,
         FileSource::DEFAULT_BUILD, otatools_build_id, otatools_build_target,
         ota_tools_files, target_directories.root));
   }
+  CF_EXPECT(downloads.RemoveStagingDirectories());
   return {};
 }
 
@@ -570,11 +827,17 @@ Result<void> Fetch(const FetchFlags& flags, HostToolsTarget& host_target,
       FetcherConfig config;
       CF_EXPECT(FetchTarget(build_api, target.builds, target.directories,
                             target.download_flags,
-                            flags.keep_downloaded_archives, config));
+                            flags.keep_downloaded_archives,
+                            flags.max_parallel_downloads, config));
       CF_EXPECT(SaveConfig(config, target.directories.root));
       LOG(INFO) << "Completed fetch to \"" << target.directories.root << "\"";
     }
     CF_EXPECT(host_package_future.get());
+    if (auto stats = build_api.CacheStats(); stats) {
+      LOG(INFO) << "Artifact cache: " << stats->hits << " hits ("
+                << stats->hit_bytes << " bytes), " << stats->misses
+                << " misses (" << stats->miss_bytes << " bytes)";
+    }
   }
   curl_global_cleanup();
 
@@ -69,6 +69,10 @@ std::vector<Flag> GetFlagsVector(FetchFlags& fetch_flags,
   flags.emplace_back(GflagsCompatFlag("keep_downloaded_archives",
                                       fetch_flags.keep_downloaded_archives)
                          .Help("Keep downloaded zip/tar."));
+  flags.emplace_back(GflagsCompatFlag("max_parallel_downloads",
+                                      fetch_flags.max_parallel_downloads)
+                         .Help("Maximum number of artifacts of a target to "
+                               "download at the same time."));
   flags.emplace_back(VerbosityFlag(fetch_flags.verbosity));
   flags.emplace_back(
       GflagsCompatFlag("target_subdirectory", fetch_flags.target_subdirectory)
@@ -97,6 +101,16 @@ std::vector<Flag> GetFlagsVector(FetchFlags& fetch_flags,
   flags.emplace_back(
       GflagsCompatFlag("api_base_url", build_api_flags.api_base_url)
           .Help("The base url for API requests to download artifacts from"));
+  flags.emplace_back(
+      GflagsCompatFlag("artifact_cache_directory",
+                       build_api_flags.artifact_cache_directory)
+          .Help("Directory of an artifact cache shared with other fetches. "
+                "Artifacts are downloaded directly when empty."));
+  flags.emplace_back(
+      GflagsCompatFlag("artifact_cache_max_size_gb",
+                       build_api_flags.artifact_cache_max_size_gb)
+          .Help("Size in GiB past which the least recently used artifacts "
+                "are evicted from the artifact cache."));
 
   CredentialFlags& credential_flags = build_api_flags.credential_flags;
   flags.emplace_back(
@@ -41,11 +41,14 @@ inline constexpr bool kDefaultExternalDnsResolver =
 #else
     false;
 #endif
+inline constexpr char kDefaultArtifactCacheDirectory[] = "";
+inline constexpr int kDefaultArtifactCacheMaxSizeGb = 100;
 inline constexpr char kDefaultBuildString[] = "";
 inline constexpr bool kDefaultDownloadImgZip = true;
 inline constexpr bool kDefaultDownloadTargetFilesZip = false;
 inline constexpr char kDefaultTargetDirectory[] = "";
 inline constexpr bool kDefaultKeepDownloadedArchives = false;
+inline constexpr int kDefaultMaxParallelDownloads = 4;
 
 inline constexpr char kDefaultBuildTarget[] =
     "aosp_cf_x86_64_phone-trunk_staging-userdebug";
@@ -63,6 +66,8 @@ struct BuildApiFlags {
   std::chrono::seconds wait_retry_period = kDefaultWaitRetryPeriod;
   bool external_dns_resolver = kDefaultExternalDnsResolver;
   std::string api_base_url = kAndroidBuildServiceUrl;
+  std::string artifact_cache_directory = kDefaultArtifactCacheDirectory;
+  int artifact_cache_max_size_gb = kDefaultArtifactCacheMaxSizeGb;
 };
 
 struct VectorFlags {
@@ -83,6 +88,7 @@ struct FetchFlags {
   std::vector<std::string> target_subdirectory;
   std::optional<BuildString> host_package_build;
   bool keep_downloaded_archives = kDefaultKeepDownloadedArchives;
+  int max_parallel_downloads = kDefaultMaxParallelDownloads;
   android::base::LogSeverity verbosity = android::base::INFO;
   bool helpxml = false;
   BuildApiFlags build_api_flags;
@@ -17,8 +17,10 @@
 #include "host/commands/kernel_log_monitor/kernel_log_server.h"
 
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include <android-base/logging.h>
 #include <android-base/strings.h>
@@ -66,14 +68,27 @@ constexpr struct {
      monitor::Event::DisplayPowerModeChanged, kKeyValuePair},
 };
 
+// The patterns of kInformationalPatterns followed by the stages of
+// kStageTable, in order.
+std::vector<std::string_view> MatcherPatterns() {
+  std::vector<std::string_view> patterns;
+  for (const auto& [match, prefix] : kInformationalPatterns) {
+    patterns.push_back(match);
+  }
+  for (const auto& [stage, event, format] : kStageTable) {
+    patterns.push_back(stage);
+  }
+  return patterns;
+}
+
 void ProcessSubscriptions(
-    Json::Value message,
+    const monitor::KernelLogEvent& event,
     std::vector<monitor::EventCallback>* subscribers) {
   auto active_subscription_count = subscribers->size();
   std::size_t idx = 0;
   while (idx < active_subscription_count) {
     // Call the callback
-    auto action = (*subscribers)[idx](message);
+    auto action = (*subscribers)[idx](event);
     if (action == monitor::SubscriptionAction::ContinueSubscription) {
       ++idx;
     } else {
@@ -89,11 +104,12 @@ void ProcessSubscriptions(
 }  // namespace
 
 namespace monitor {
-KernelLogServer::KernelLogServer(cuttlefish::SharedFD pipe_fd,
-                                 const std::string& log_name)
+KernelLogServer::KernelLogServer(
+    cuttlefish::SharedFD pipe_fd,
+    std::unique_ptr<cuttlefish::BufferedLogSink> log_sink)
     : pipe_fd_(pipe_fd),
-      log_fd_(cuttlefish::SharedFD::Open(log_name.c_str(),
-                                         O_CREAT | O_RDWR | O_APPEND, 0666)) {}
+      log_sink_(std::move(log_sink)),
+      matcher_(MatcherPatterns()) {}
 
 void KernelLogServer::BeforeSelect(cuttlefish::SharedFDSet* fd_read) const {
   fd_read->Set(pipe_fd_);
@@ -110,69 +126,73 @@ void KernelLogServer::SubscribeToEvents(monitor::EventCallback callback) {
 }
 
 bool KernelLogServer::HandleIncomingMessage() {
-  const size_t buf_len = 256;
-  char buf[buf_len];
-  ssize_t ret = pipe_fd_->Read(buf, buf_len);
-  if (ret < 0) {
-    LOG(ERROR) << "Could not read kernel logs: " << pipe_fd_->StrError();
-    return false;
-  }
-  if (ret == 0) return false;
-  // Write the log to a file
-  if (log_fd_->Write(buf, ret) < 0) {
-    LOG(ERROR) << "Could not write kernel log to file: " << log_fd_->StrError();
+  // Also writes the log to a file
+  auto data = log_sink_->ReadFrom(pipe_fd_);
+  if (!data.ok()) {
+    LOG(ERROR) << "Could not copy kernel logs: "
+               << data.error().FormatForEnv();
     return false;
   }
+  if (data->empty()) return false;
 
   // Detect VIRTUAL_DEVICE_BOOT_*
-  for (ssize_t i=0; i<ret; i++) {
-    if ('\n' == buf[i]) {
-      for (auto& [match, prefix] : kInformationalPatterns) {
-        auto pos = line_.find(match);
-        if (std::string::npos != pos) {
-          LOG(INFO) << prefix << line_.substr(pos + match.size());
-        }
-      }
-      for (const auto& [stage, event, format] : kStageTable) {
-        auto pos = line_.find(stage);
-        if (std::string::npos != pos) {
-          // Log the stage
-          LOG(INFO) << stage;
-
-          Json::Value message;
-          message["event"] = event;
-          Json::Value metadata;
-
-          if (format == kKeyValuePair) {
-            // Expect space-separated key=value pairs in the log message.
-            const auto& fields =
-                android::base::Split(line_.substr(pos + stage.size()), " ");
-            for (std::string field : fields) {
-              field = android::base::Trim(field);
-              if (field.empty()) {
-                // Expected; android::base::Split() always returns at least
-                // one (possibly empty) string.
-                LOG(DEBUG) << "Empty field for line: " << line_;
-                continue;
-              }
-              const auto& keyvalue = android::base::Split(field, "=");
-              if (keyvalue.size() != 2) {
-                LOG(WARNING) << "Field is not in key=value format: " << field;
-                continue;
-              }
-              metadata[keyvalue[0]] = keyvalue[1];
-            }
-          }
-          message["metadata"] = metadata;
-          ProcessSubscriptions(message, &subscribers_);
-        }
-      }
+  std::string_view rest = *data;
+  for (auto newline = rest.find('\n'); newline != std::string_view::npos;
+       newline = rest.find('\n')) {
+    if (line_.empty()) {
+      HandleLine(rest.substr(0, newline));
+    } else {
+      line_.append(rest.substr(0, newline));
+      HandleLine(line_);
       line_.clear();
     }
-    line_.append(1, buf[i]);
+    rest.remove_prefix(newline + 1);
   }
+  line_.append(rest);
 
   return true;
 }
 
+void KernelLogServer::HandleLine(std::string_view line) {
+  matcher_.FirstMatches(line, match_positions_);
+  std::size_t pattern = 0;
+  for (const auto& [match, prefix] : kInformationalPatterns) {
+    auto pos = match_positions_[pattern++];
+    if (std::string_view::npos != pos) {
+      LOG(INFO) << prefix << line.substr(pos + match.size());
+    }
+  }
+  for (const auto& [stage, event, format] : kStageTable) {
+    auto pos = match_positions_[pattern++];
+    if (std::string_view::npos == pos) {
+      continue;
+    }
+    // Log the stage
+    LOG(INFO) << stage;
+
+    KernelLogEvent message{.event = event};
+    if (format == kKeyValuePair) {
+      // Expect space-separated key=value pairs in the log message.
+      const auto& fields = android::base::Split(
+          std::string(line.substr(pos + stage.size())), " ");
+      for (std::string field : fields) {
+        field = android::base::Trim(field);
+        if (field.empty()) {
+          // Expected; android::base::Split() always returns at least
+          // one (possibly empty) string.
+          LOG(DEBUG) << "Empty field for line: " << line;
+          continue;
+        }
+        const auto& keyvalue = android::base::Split(field, "=");
+        if (keyvalue.size() != 2) {
+          LOG(WARNING) << "Field is not in key=value format: " << field;
+          continue;
+        }
+        message.metadata[keyvalue[0]] = keyvalue[1];
+      }
+    }
+    ProcessSubscriptions(message, &subscribers_);
+  }
+}
+
 }  // namespace monitor
@@ -17,14 +17,18 @@
 
 #include <stdint.h>
 
+#include <cstddef>
 #include <functional>
+#include <map>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
-#include <json/json.h>
-
 #include "common/libs/fs/shared_fd.h"
 #include "common/libs/fs/shared_select.h"
+#include "host/commands/kernel_log_monitor/multi_pattern_matcher.h"
+#include "host/libs/log_sink/buffered_log_sink.h"
 
 namespace monitor {
 
@@ -50,13 +54,21 @@ enum class SubscriptionAction {
   CancelSubscription,
 };
 
-using EventCallback = std::function<SubscriptionAction(Json::Value)>;
+// An event found in the kernel log.
+struct KernelLogEvent {
+  Event event;
+  // The key=value pairs that follow the message of events that have them.
+  std::map<std::string, std::string> metadata;
+};
+
+using EventCallback = std::function<SubscriptionAction(const KernelLogEvent&)>;
 
 // KernelLogServer manages an incoming kernel log connection from the VMM.
 // Only accept one connection.
 class KernelLogServer {
  public:
-  KernelLogServer(cuttlefish::SharedFD pipe_fd, const std::string& log_name);
+  KernelLogServer(cuttlefish::SharedFD pipe_fd,
+                  std::unique_ptr<cuttlefish::BufferedLogSink> log_sink);
 
   ~KernelLogServer() = default;
 
@@ -74,10 +86,14 @@ class KernelLogServer {
   // Respond to message from remote client.
   // Returns false, if client disconnected.
   bool HandleIncomingMessage();
+  void HandleLine(std::string_view line);
 
   cuttlefish::SharedFD pipe_fd_;
-  cuttlefish::SharedFD log_fd_;
+  std::unique_ptr<cuttlefish::BufferedLogSink> log_sink_;
+  // Holds the start of a line split between reads.
   std::string line_;
+  MultiPatternMatcher matcher_;
+  std::vector<std::size_t> match_positions_;
   std::vector<EventCallback> subscribers_;
 
   KernelLogServer(const KernelLogServer&) = delete;
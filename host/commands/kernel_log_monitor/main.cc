@@ -17,6 +17,7 @@
 #include <signal.h>
 #include <unistd.h>
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -31,6 +32,8 @@
 #include <host/libs/config/logging.h>
 #include "host/commands/kernel_log_monitor/kernel_log_server.h"
 #include "host/commands/kernel_log_monitor/utils.h"
+#include "host/libs/log_sink/buffered_log_sink.h"
+#include "host/libs/log_sink/log_sink_options.h"
 
 DEFINE_int32(log_pipe_fd, -1,
              "A file descriptor representing a (UNIX) socket from which to "
@@ -94,13 +97,22 @@ int main(int argc, char** argv) {
     return 2;
   }
 
-  monitor::KernelLogServer klog{pipe,
-                                instance.PerInstanceLogPath("kernel.log")};
+  auto log_sink = cuttlefish::BufferedLogSink::Create(
+      instance.PerInstanceLogPath("kernel.log"),
+      cuttlefish::LogSinkOptionsFromConfig(*config));
+  if (!log_sink.ok()) {
+    LOG(ERROR) << "Error opening kernel log file: "
+               << log_sink.error().FormatForEnv();
+    return 2;
+  }
+
+  monitor::KernelLogServer klog{pipe, std::move(*log_sink)};
 
   for (auto subscriber_fd: subscriber_fds) {
     if (subscriber_fd->IsOpen()) {
-      klog.SubscribeToEvents([subscriber_fd](Json::Value message) {
-        if (!monitor::WriteEvent(subscriber_fd, message)) {
+      klog.SubscribeToEvents([subscriber_fd](
+                                 const monitor::KernelLogEvent& event) {
+        if (!monitor::WriteEvent(subscriber_fd, event)) {
           if (subscriber_fd->GetErrno() != EPIPE) {
             LOG(ERROR) << "Error while writing to pipe: "
                        << subscriber_fd->StrError();
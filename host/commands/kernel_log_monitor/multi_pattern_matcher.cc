@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/commands/kernel_log_monitor/multi_pattern_matcher.h"
+
+#include <queue>
+
+namespace monitor {
+namespace {
+
+constexpr std::uint32_t kNoState = UINT32_MAX;
+constexpr std::uint32_t kHasOutput = 1u << 31;
+
+}  // namespace
+
+MultiPatternMatcher::MultiPatternMatcher(
+    const std::vector<std::string_view>& patterns) {
+  byte_classes_.fill(0);
+  first_bytes_.fill(false);
+  class_count_ = 1;
+  for (const auto& pattern : patterns) {
+    if (!pattern.empty()) {
+      first_bytes_[static_cast<unsigned char>(pattern[0])] = true;
+    }
+    for (unsigned char c : pattern) {
+      if (byte_classes_[c] == 0) {
+        byte_classes_[c] = class_count_++;
+      }
+    }
+  }
+
+  // Builds the trie, with missing transitions left as kNoState.
+  transitions_.assign(class_count_, kNoState);
+  outputs_.resize(1);
+  for (std::uint32_t i = 0; i < patterns.size(); i++) {
+    std::uint32_t state = 0;
+    for (unsigned char c : patterns[i]) {
+      const std::size_t index = state * class_count_ + byte_classes_[c];
+      if (transitions_[index] == kNoState) {
+        transitions_[index] = outputs_.size();
+        outputs_.emplace_back();
+        transitions_.resize(transitions_.size() + class_count_, kNoState);
+      }
+      state = transitions_[index];
+    }
+    outputs_[state].push_back(i);
+    pattern_sizes_.push_back(patterns[i].size());
+  }
+
+  // Turns the trie into a DFA breadth first, so the state a failed transition
+  // falls back to is always complete by the time it's needed.
+  std::vector<std::uint32_t> fallback(outputs_.size(), 0);
+  std::queue<std::uint32_t> queue;
+  for (std::size_t c = 0; c < class_count_; c++) {
+    auto& next = transitions_[c];
+    if (next == kNoState) {
+      next = 0;
+    } else {
+      queue.push(next);
+    }
+  }
+  while (!queue.empty()) {
+    const std::uint32_t state = queue.front();
+    queue.pop();
+    const auto& inherited = outputs_[fallback[state]];
+    outputs_[state].insert(outputs_[state].end(), inherited.begin(),
+                           inherited.end());
+    for (std::size_t c = 0; c < class_count_; c++) {
+      auto& next = transitions_[state * class_count_ + c];
+      const std::uint32_t fallback_next =
+          transitions_[fallback[state] * class_count_ + c];
+      if (next == kNoState) {
+        next = fallback_next;
+      } else {
+        fallback[next] = fallback_next;
+        queue.push(next);
+      }
+    }
+  }
+
+  // Switches from state numbers to row offsets, so the scan does no
+  // multiplication, and flags the transitions that complete a pattern.
+  for (auto& next : transitions_) {
+    const bool has_output = !outputs_[next].empty();
+    next *= class_count_;
+    if (has_output) {
+      next |= kHasOutput;
+    }
+  }
+}
+
+void MultiPatternMatcher::FirstMatches(
+    std::string_view text, std::vector<std::size_t>& positions) const {
+  positions.assign(pattern_sizes_.size(), std::string_view::npos);
+  std::uint32_t row = 0;
+  for (std::size_t i = 0; i < text.size(); i++) {
+    if (row == 0) {
+      while (i < text.size() &&
+             !first_bytes_[static_cast<unsigned char>(text[i])]) {
+        i++;
+      }
+      if (i == text.size()) {
+        break;
+      }
+    }
+    const unsigned char c = text[i];
+    row = transitions_[row + byte_classes_[c]];
+    if (row & kHasOutput) {
+      row &= ~kHasOutput;
+      for (const auto pattern : outputs_[row / class_count_]) {
+        if (positions[pattern] == std::string_view::npos) {
+          positions[pattern] = i + 1 - pattern_sizes_[pattern];
+        }
+      }
+    }
+  }
+}
+
+}  // namespace monitor
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace monitor {
+
+// Finds any of a fixed set of substrings in a single pass over the text, with
+// an Aho-Corasick automaton built once up front.
+class MultiPatternMatcher {
+ public:
+  MultiPatternMatcher(const std::vector<std::string_view>& patterns);
+
+  // Sets `positions[i]` to where the first occurrence of pattern `i` in
+  // `text` starts, or to std::string_view::npos if there is none.
+  void FirstMatches(std::string_view text,
+                    std::vector<std::size_t>& positions) const;
+
+ private:
+  // Bytes that appear in no pattern all share a class, which keeps the
+  // transition table small.
+  std::array<std::uint8_t, 256> byte_classes_;
+  std::size_t class_count_;
+  // Bytes that leave the initial state. Most of a line is skipped over by
+  // looking only for these.
+  std::array<bool, 256> first_bytes_;
+  // Indexed by the row of the current state plus the byte class. Entries are
+  // the row of the next state, with kHasOutput set if patterns end there.
+  std::vector<std::uint32_t> transitions_;
+  // The patterns that end at each state, including through suffixes, indexed
+  // by row / class_count_.
+  std::vector<std::vector<std::uint32_t>> outputs_;
+  std::vector<std::size_t> pattern_sizes_;
+};
+
+}  // namespace monitor
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/commands/kernel_log_monitor/multi_pattern_matcher.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+namespace monitor {
+namespace {
+
+using ::testing::ElementsAre;
+
+constexpr auto npos = std::string_view::npos;
+
+TEST(MultiPatternMatcherTest, FindsFirstOccurrences) {
+  MultiPatternMatcher matcher({"he", "she", "his", "hers"});
+  std::vector<std::size_t> positions;
+
+  matcher.FirstMatches("ushers and she", positions);
+
+  EXPECT_THAT(positions, ElementsAre(2, 1, npos, 2));
+}
+
+TEST(MultiPatternMatcherTest, NoMatches) {
+  MultiPatternMatcher matcher({"VIRTUAL_DEVICE_BOOT_STARTED"});
+  std::vector<std::size_t> positions;
+
+  matcher.FirstMatches("[    1.234] VIRTUAL_DEVICE_BOOT_START", positions);
+  EXPECT_THAT(positions, ElementsAre(npos));
+
+  matcher.FirstMatches("", positions);
+  EXPECT_THAT(positions, ElementsAre(npos));
+}
+
+TEST(MultiPatternMatcherTest, MatchesAfterPartialMatch) {
+  MultiPatternMatcher matcher({"aab", "ab"});
+  std::vector<std::size_t> positions;
+
+  matcher.FirstMatches("aaab", positions);
+
+  EXPECT_THAT(positions, ElementsAre(1, 2));
+}
+
+TEST(MultiPatternMatcherTest, AgreesWithFind) {
+  const std::vector<std::string_view> patterns = {
+      "U-Boot ", "] Linux version ", "VIRTUAL_DEVICE_BOOT_STARTED",
+      "VIRTUAL_DEVICE_BOOT_COMPLETED", "VIRTUAL_DEVICE_SCREEN_CHANGED"};
+  MultiPatternMatcher matcher(patterns);
+  const std::string lines[] = {
+      "[    0.000000] Linux version 6.1.0 (build@host)",
+      "U-Boot 2023.04",
+      "VIRTUAL_DEVICE_BOOT_STARTED VIRTUAL_DEVICE_BOOT_STARTED",
+      "init: VIRTUAL_DEVICE_SCREEN_CHANGED width=720 height=1280",
+      "\xff\x01VIRTUAL_DEVICE_BOOT_COMPLETEDU-Boot U-Boo",
+  };
+  std::vector<std::size_t> positions;
+  for (const auto& line : lines) {
+    matcher.FirstMatches(line, positions);
+    for (std::size_t i = 0; i < patterns.size(); i++) {
+      EXPECT_EQ(positions[i], line.find(patterns[i]))
+          << "\"" << patterns[i] << "\" in \"" << line << "\"";
+    }
+  }
+}
+
+}  // namespace
+}  // namespace monitor
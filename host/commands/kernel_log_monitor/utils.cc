@@ -52,7 +52,15 @@ std::optional<ReadEventResult> ReadEvent(cuttlefish::SharedFD fd) {
   return result;
 }
 
-bool WriteEvent(cuttlefish::SharedFD fd, const Json::Value& event_message) {
+bool WriteEvent(cuttlefish::SharedFD fd, const KernelLogEvent& event) {
+  Json::Value event_message;
+  event_message["event"] = event.event;
+  Json::Value metadata;
+  for (const auto& [key, value] : event.metadata) {
+    metadata[key] = value;
+  }
+  event_message["metadata"] = metadata;
+
   Json::StreamWriterBuilder factory;
   std::string message_string = Json::writeString(factory, event_message);
   size_t length = message_string.length();
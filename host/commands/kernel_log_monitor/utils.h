@@ -32,6 +32,6 @@ struct ReadEventResult {
 std::optional<ReadEventResult> ReadEvent(cuttlefish::SharedFD fd);
 
 // Writes a kernel log event to the fd, in a format expected by ReadEvent.
-bool WriteEvent(cuttlefish::SharedFD fd, const Json::Value& event_message);
+bool WriteEvent(cuttlefish::SharedFD fd, const KernelLogEvent& event);
 
 }  // namespace monitor
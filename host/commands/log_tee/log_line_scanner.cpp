@@ -0,0 +1,168 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/commands/log_tee/log_line_scanner.h"
+
+#include <cctype>
+#include <utility>
+
+#include <android-base/strings.h>
+
+namespace cuttlefish {
+namespace {
+
+using android::base::LogSeverity;
+
+// Consumes characters off the front of a line, leaving it untouched when
+// they don't match.
+class Scanner {
+ public:
+  Scanner(std::string_view input) : input_(input) {}
+
+  bool Char(char c) {
+    if (input_.empty() || input_.front() != c) {
+      return false;
+    }
+    input_.remove_prefix(1);
+    return true;
+  }
+
+  bool Digits(std::size_t count) {
+    if (input_.size() < count) {
+      return false;
+    }
+    for (std::size_t i = 0; i < count; i++) {
+      if (input_[i] < '0' || input_[i] > '9') {
+        return false;
+      }
+    }
+    input_.remove_prefix(count);
+    return true;
+  }
+
+  bool Space() {
+    if (input_.empty() || !isspace(static_cast<unsigned char>(input_[0]))) {
+      return false;
+    }
+    input_.remove_prefix(1);
+    return true;
+  }
+
+  bool Prefix(std::string_view prefix) {
+    if (!android::base::StartsWith(input_, prefix)) {
+      return false;
+    }
+    input_.remove_prefix(prefix.size());
+    return true;
+  }
+
+ private:
+  std::string_view input_;
+};
+
+bool TimeZone(Scanner& scanner) {
+  if (scanner.Char('Z')) {
+    return true;
+  }
+  if (!scanner.Char('+') && !scanner.Char('-')) {
+    return false;
+  }
+  if (!scanner.Digits(2)) {
+    return false;
+  }
+  // The minutes are optional, and may or may not follow a colon.
+  if (scanner.Char(':')) {
+    return scanner.Digits(2);
+  }
+  scanner.Digits(2);
+  return true;
+}
+
+}  // namespace
+
+std::optional<LogSeverity> CrosvmLogSeverity(std::string_view line) {
+  Scanner scanner(line);
+  const bool timestamp =
+      scanner.Char('[') && scanner.Digits(4) && scanner.Char('-') &&
+      scanner.Digits(2) && scanner.Char('-') && scanner.Digits(2) &&
+      scanner.Char('T') && scanner.Digits(2) && scanner.Char(':') &&
+      scanner.Digits(2) && scanner.Char(':') && scanner.Digits(2) &&
+      scanner.Char('.') && scanner.Digits(9) && TimeZone(scanner) &&
+      scanner.Space();
+  if (!timestamp) {
+    return std::nullopt;
+  }
+  static constexpr std::pair<std::string_view, LogSeverity> kLevels[] = {
+      {"ERROR", android::base::ERROR}, {"WARN", android::base::WARNING},
+      {"INFO", android::base::INFO},   {"DEBUG", android::base::DEBUG},
+      {"TRACE", android::base::VERBOSE},
+  };
+  for (const auto& [level, severity] : kLevels) {
+    if (scanner.Prefix(level)) {
+      return severity;
+    }
+  }
+  return std::nullopt;
+}
+
+LogSeverity LogLineSeverity(std::string_view line) {
+  if (android::base::StartsWith(line, "[INFO")) {
+    return android::base::DEBUG;
+  } else if (android::base::StartsWith(line, "[ERROR")) {
+    return android::base::ERROR;
+  } else if (android::base::StartsWith(line, "[WARNING")) {
+    return android::base::WARNING;
+  } else if (android::base::StartsWith(line, "[VERBOSE")) {
+    return android::base::VERBOSE;
+  }
+  return CrosvmLogSeverity(line).value_or(android::base::DEBUG);
+}
+
+LogLineSplitter::LogLineSplitter(LineCallback callback)
+    : callback_(std::move(callback)) {}
+
+void LogLineSplitter::Append(std::string_view data) {
+  while (!data.empty()) {
+    const auto newline = data.find('\n');
+    if (newline == std::string_view::npos) {
+      break;
+    }
+    if (partial_line_.empty()) {
+      callback_(data.substr(0, newline));
+    } else {
+      partial_line_.append(data.substr(0, newline));
+      callback_(partial_line_);
+      partial_line_.clear();
+    }
+    data.remove_prefix(newline + 1);
+  }
+  while (partial_line_.size() + data.size() >= kMaxLineLength) {
+    const std::size_t piece = kMaxLineLength - partial_line_.size();
+    partial_line_.append(data.substr(0, piece));
+    callback_(partial_line_);
+    partial_line_.clear();
+    data.remove_prefix(piece);
+  }
+  partial_line_.append(data);
+}
+
+void LogLineSplitter::Flush() {
+  if (!partial_line_.empty()) {
+    callback_(partial_line_);
+    partial_line_.clear();
+  }
+}
+
+}  // namespace cuttlefish
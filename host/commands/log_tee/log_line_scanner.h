@@ -0,0 +1,60 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <android-base/logging.h>
+
+namespace cuttlefish {
+
+// The severity crosvm gave a line, if it starts with crosvm's local ISO 8601
+// timestamp and log level (based on external/crosvm/base/src/syslog.rs), e.g.
+// "[2024-01-02T03:04:05.123456789+01:00 ERROR crosvm] ...". Runs in a single
+// pass over the prefix of the line.
+std::optional<android::base::LogSeverity> CrosvmLogSeverity(
+    std::string_view line);
+
+// The severity to log a line of subprocess output with. Lines that aren't
+// recognized are logged at DEBUG.
+android::base::LogSeverity LogLineSeverity(std::string_view line);
+
+// Splits the output of a subprocess into lines, however the reads happen to
+// divide it.
+class LogLineSplitter {
+ public:
+  using LineCallback = std::function<void(std::string_view)>;
+
+  // Lines longer than this are passed on in pieces rather than buffered
+  // without a limit.
+  static constexpr std::size_t kMaxLineLength = 1 << 16;
+
+  LogLineSplitter(LineCallback callback);
+
+  void Append(std::string_view data);
+  // Passes on a trailing line that never got its newline.
+  void Flush();
+
+ private:
+  LineCallback callback_;
+  std::string partial_line_;
+};
+
+}  // namespace cuttlefish
@@ -0,0 +1,112 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/commands/log_tee/log_line_scanner.h"
+
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+namespace cuttlefish {
+namespace {
+
+using android::base::DEBUG;
+using android::base::ERROR;
+using android::base::INFO;
+using android::base::VERBOSE;
+using android::base::WARNING;
+using ::testing::ElementsAre;
+using ::testing::Optional;
+
+TEST(LogLineScannerTest, CrosvmLevels) {
+  EXPECT_THAT(CrosvmLogSeverity(
+                  "[2024-01-02T03:04:05.123456789Z ERROR crosvm] failed"),
+              Optional(ERROR));
+  EXPECT_THAT(CrosvmLogSeverity(
+                  "[2024-01-02T03:04:05.123456789+01:00 WARN crosvm] slow"),
+              Optional(WARNING));
+  EXPECT_THAT(CrosvmLogSeverity(
+                  "[2024-01-02T03:04:05.123456789-0800 INFO devices] up"),
+              Optional(INFO));
+  EXPECT_THAT(
+      CrosvmLogSeverity("[2024-01-02T03:04:05.123456789+05 DEBUG vm] hi"),
+      Optional(DEBUG));
+  EXPECT_THAT(CrosvmLogSeverity(
+                  "[2024-01-02T03:04:05.123456789Z\tTRACE base] detail"),
+              Optional(VERBOSE));
+}
+
+TEST(LogLineScannerTest, CrosvmRejectsMalformedPrefixes) {
+  EXPECT_EQ(CrosvmLogSeverity(""), std::nullopt);
+  EXPECT_EQ(CrosvmLogSeverity("2024-01-02T03:04:05.123456789Z ERROR x"),
+            std::nullopt);
+  // Milliseconds rather than nanoseconds.
+  EXPECT_EQ(CrosvmLogSeverity("[2024-01-02T03:04:05.123Z ERROR x"),
+            std::nullopt);
+  EXPECT_EQ(CrosvmLogSeverity("[2024-01-02T03:04:05.123456789 ERROR x"),
+            std::nullopt);
+  EXPECT_EQ(CrosvmLogSeverity("[2024-01-02T03:04:05.123456789+01: ERROR x"),
+            std::nullopt);
+  EXPECT_EQ(CrosvmLogSeverity("[2024-01-02T03:04:05.123456789Z FATAL x"),
+            std::nullopt);
+  EXPECT_EQ(CrosvmLogSeverity("[2024-01-02T03:04:05.12345678"), std::nullopt);
+}
+
+TEST(LogLineScannerTest, LineSeverity) {
+  EXPECT_EQ(LogLineSeverity("[INFO] starting"), DEBUG);
+  EXPECT_EQ(LogLineSeverity("[ERROR] failed"), ERROR);
+  EXPECT_EQ(LogLineSeverity("[WARNING] slow"), WARNING);
+  EXPECT_EQ(LogLineSeverity("[VERBOSE] detail"), VERBOSE);
+  EXPECT_EQ(LogLineSeverity("[2024-01-02T03:04:05.123456789Z ERROR x] y"),
+            ERROR);
+  EXPECT_EQ(LogLineSeverity("anything else"), DEBUG);
+}
+
+TEST(LogLineScannerTest, SplitsLinesAcrossReads) {
+  std::vector<std::string> lines;
+  LogLineSplitter splitter(
+      [&lines](std::string_view line) { lines.emplace_back(line); });
+
+  splitter.Append("first\nsec");
+  splitter.Append("ond");
+  splitter.Append("\n\nthird\nfou");
+  EXPECT_THAT(lines, ElementsAre("first", "second", "", "third"));
+
+  splitter.Flush();
+  EXPECT_THAT(lines, ElementsAre("first", "second", "", "third", "fou"));
+  splitter.Flush();
+  EXPECT_EQ(lines.size(), 5u);
+}
+
+TEST(LogLineScannerTest, SplitsOverlongLines) {
+  std::vector<std::string> lines;
+  LogLineSplitter splitter(
+      [&lines](std::string_view line) { lines.emplace_back(line); });
+
+  splitter.Append(std::string(LogLineSplitter::kMaxLineLength - 1, 'a'));
+  EXPECT_TRUE(lines.empty());
+  splitter.Append(std::string(LogLineSplitter::kMaxLineLength + 2, 'b'));
+  splitter.Append("\n");
+
+  ASSERT_EQ(lines.size(), 3u);
+  EXPECT_EQ(lines[0].size(), LogLineSplitter::kMaxLineLength);
+  EXPECT_EQ(lines[1].size(), LogLineSplitter::kMaxLineLength);
+  EXPECT_EQ(lines[2], "b");
+}
+
+}  // namespace
+}  // namespace cuttlefish
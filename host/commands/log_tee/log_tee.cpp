@@ -18,7 +18,7 @@
 #include <sys/signalfd.h>
 #endif
 
-#include <regex>
+#include <string_view>
 
 #include <android-base/logging.h>
 #include <android-base/strings.h>
@@ -26,32 +26,12 @@
 
 #include "common/libs/fs/shared_fd.h"
 #include "common/libs/utils/tee_logging.h"
+#include "host/commands/log_tee/log_line_scanner.h"
 #include "host/libs/config/cuttlefish_config.h"
 
 DEFINE_string(process_name, "", "The process to credit log messages to");
 DEFINE_int32(log_fd_in, -1, "The file descriptor to read logs from.");
 
-// Crosvm formats logs starting with a local ISO 8601 timestamp and then a
-// log level (based on external/crosvm/base/src/syslog.rs).
-const std::regex kCrosvmLogPattern(
-    "^\\["
-    "\\d{4}" /* year */
-    "-"
-    "\\d{2}" /* month */
-    "-"
-    "\\d{2}" /* day */
-    "T"
-    "\\d{2}" /* hour */
-    ":"
-    "\\d{2}" /* minute*/
-    ":"
-    "\\d{2}" /* second */
-    "\\."
-    "\\d{9}"                          /* millisecond */
-    "(Z|[+-]\\d{2}(:\\d{2}|\\d{2})?)" /* timezone */
-    "\\s"
-    "(ERROR|WARN|INFO|DEBUG|TRACE)");
-
 int main(int argc, char** argv) {
   ::android::base::InitLogging(argv, android::base::StderrLogger);
   google::ParseCommandLineFlags(&argc, &argv, /* remove_flags */ true);
@@ -110,6 +90,13 @@ int main(int argc, char** argv) {
 
   LOG(DEBUG) << "Starting to read from process " << FLAGS_process_name;
 
+  cuttlefish::LogLineSplitter splitter([](std::string_view line) {
+    auto trimmed = android::base::Trim(line);
+    if (trimmed.empty()) {
+      return;
+    }
+    LOG(cuttlefish::LogLineSeverity(trimmed)) << trimmed;
+  });
   char buf[1 << 16];
   ssize_t chars_read = 0;
   for (;;) {
@@ -133,42 +120,7 @@ int main(int argc, char** argv) {
       if (chars_read == 0) {
         break;
       }
-      auto trimmed = android::base::Trim(std::string_view(buf, chars_read));
-      // Newlines inside `trimmed` are handled by the android logging code.
-      // These checks attempt to determine the log severity coming from crosvm.
-      // There is no guarantee of success all the time since log line boundaries
-      // could be out sync with the reads, but that's ok.
-      if (android::base::StartsWith(trimmed, "[INFO")) {
-        LOG(DEBUG) << trimmed;
-      } else if (android::base::StartsWith(trimmed, "[ERROR")) {
-        LOG(ERROR) << trimmed;
-      } else if (android::base::StartsWith(trimmed, "[WARNING")) {
-        LOG(WARNING) << trimmed;
-      } else if (android::base::StartsWith(trimmed, "[VERBOSE")) {
-        LOG(VERBOSE) << trimmed;
-      } else {
-        std::smatch match_result;
-        if (std::regex_search(trimmed, match_result, kCrosvmLogPattern)) {
-          if (match_result.size() == 4) {
-            const auto& level = match_result[3];
-            if (level == "ERROR") {
-              LOG(ERROR) << trimmed;
-            } else if (level == "WARN") {
-              LOG(WARNING) << trimmed;
-            } else if (level == "INFO") {
-              LOG(INFO) << trimmed;
-            } else if (level == "DEBUG") {
-              LOG(DEBUG) << trimmed;
-            } else if (level == "TRACE") {
-              LOG(VERBOSE) << trimmed;
-            } else {
-              LOG(DEBUG) << trimmed;
-            }
-          }
-        } else {
-          LOG(DEBUG) << trimmed;
-        }
-      }
+      splitter.Append(std::string_view(buf, chars_read));
 
       // Go back to polling immediately to see if there is more data, don't
       // handle any signals yet.
@@ -187,5 +139,7 @@ int main(int argc, char** argv) {
 #endif
   }
 
+  splitter.Flush();
+
   LOG(DEBUG) << "Finished reading from process " << FLAGS_process_name;
 }
@@ -23,6 +23,8 @@
 #include "common/libs/fs/shared_fd.h"
 #include "host/libs/config/cuttlefish_config.h"
 #include "host/libs/config/logging.h"
+#include "host/libs/log_sink/buffered_log_sink.h"
+#include "host/libs/log_sink/log_sink_options.h"
 
 DEFINE_int32(log_pipe_fd, -1,
              "A file descriptor representing a (UNIX) socket from which to "
@@ -60,23 +62,22 @@ int main(int argc, char** argv) {
     return 2;
   }
 
-  auto path = instance.logcat_path();
-  auto logcat_file =
-      cuttlefish::SharedFD::Open(path.c_str(), O_CREAT | O_APPEND | O_WRONLY, 0666);
+  auto logcat_sink = cuttlefish::BufferedLogSink::Create(
+      instance.logcat_path(), cuttlefish::LogSinkOptionsFromConfig(*config));
+  if (!logcat_sink.ok()) {
+    LOG(ERROR) << "Error opening logcat file: "
+               << logcat_sink.error().FormatForEnv();
+    return 2;
+  }
 
   bool first_iter = true;
   // Server loop
   while (true) {
-    char buff[1024];
-    auto read = pipe->Read(buff, sizeof(buff));
-    if (read < 0) {
-      LOG(ERROR) << "Could not read logcat: " << pipe->StrError();
+    auto read = (*logcat_sink)->ReadFrom(pipe);
+    if (!read.ok()) {
+      LOG(ERROR) << "Could not copy logcat: " << read.error().FormatForEnv();
       break;
     }
-    auto written = cuttlefish::WriteAll(logcat_file, buff, read);
-    CHECK(written == read)
-        << "Error writing to log file: " << logcat_file->StrError()
-        << ". This is unrecoverable.";
     if (first_iter) {
       first_iter = false;
       if (cuttlefish::IsRestoring(*config)) {
@@ -105,7 +106,9 @@ int main(int argc, char** argv) {
     }
   }
 
-  logcat_file->Close();
+  // The loop only ends once the logs can't be copied anymore, which used to
+  // abort the process and still has to be reported as a failure.
+  logcat_sink->reset();
   pipe->Close();
-  return 0;
+  return 1;
 }
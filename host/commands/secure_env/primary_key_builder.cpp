@@ -65,25 +65,39 @@ void PrimaryKeyBuilder::UniqueData(const std::string& data) {
 
 TpmObjectSlot PrimaryKeyBuilder::CreateKey(
     TpmResourceManager& resource_manager) {
-  TPM2B_AUTH authValue = {};
+  TPM2B_TEMPLATE public_template = {};
+  size_t offset = 0;
   auto rc =
-      Esys_TR_SetAuth(*resource_manager.Esys(), ESYS_TR_RH_OWNER, &authValue);
+      Tss2_MU_TPMT_PUBLIC_Marshal(&public_area_, &public_template.buffer[0],
+                                  sizeof(public_template.buffer), &offset);
   if (rc != TSS2_RC_SUCCESS) {
-    LOG(ERROR) << "Esys_TR_SetAuth failed with return code " << rc
+    LOG(ERROR) << "Tss2_MU_TPMT_PUBLIC_Marshal failed with return code " << rc
                << " (" << Tss2_RC_Decode(rc) << ")";
     return {};
   }
+  public_template.size = offset;
 
-  TPM2B_TEMPLATE public_template = {};
-  size_t offset = 0;
-  rc = Tss2_MU_TPMT_PUBLIC_Marshal(&public_area_, &public_template.buffer[0],
-                                   sizeof(public_template.buffer), &offset);
+  // Since this is a primary key, it's generated deterministically from the
+  // template, so the resource manager can hand out the same key again.
+  std::string key_template(
+      reinterpret_cast<const char*>(&public_template.buffer[0]),
+      public_template.size);
+  return resource_manager.PrimaryKey(key_template, [&]() {
+    return CreateLoaded(resource_manager, public_template);
+  });
+}
+
+TpmObjectSlot PrimaryKeyBuilder::CreateLoaded(
+    TpmResourceManager& resource_manager,
+    const TPM2B_TEMPLATE& public_template) {
+  TPM2B_AUTH authValue = {};
+  auto rc =
+      Esys_TR_SetAuth(*resource_manager.Esys(), ESYS_TR_RH_OWNER, &authValue);
   if (rc != TSS2_RC_SUCCESS) {
-    LOG(ERROR) << "Tss2_MU_TPMT_PUBLIC_Marshal failed with return code " << rc
+    LOG(ERROR) << "Esys_TR_SetAuth failed with return code " << rc
                << " (" << Tss2_RC_Decode(rc) << ")";
     return {};
   }
-  public_template.size = offset;
 
   TPM2B_SENSITIVE_CREATE in_sensitive = {};
 
@@ -94,8 +108,6 @@ TpmObjectSlot PrimaryKeyBuilder::CreateKey(
   }
   ESYS_TR raw_handle;
   // TODO(b/154956668): Define better ACLs on these keys.
-  // Since this is a primary key, it's generated deterministically. It would
-  // also be possible to generate this once and hold it in storage.
   rc = Esys_CreateLoaded(
       /* esysContext */ *resource_manager.Esys(),
       /* primaryHandle */ ESYS_TR_RH_OWNER,
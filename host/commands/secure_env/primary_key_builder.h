@@ -38,6 +38,9 @@ public:
                                         const std::string& unique_data);
 
  private:
+  static TpmObjectSlot CreateLoaded(TpmResourceManager& resource_manager,
+                                    const TPM2B_TEMPLATE& public_template);
+
   TPMT_PUBLIC public_area_;
 };
 
@@ -0,0 +1,270 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/commands/secure_env/storage/indexed_log_store.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <json/json.h>
+
+#include "common/libs/utils/base64.h"
+#include "common/libs/utils/files.h"
+#include "common/libs/utils/json.h"
+
+namespace cuttlefish {
+namespace secure_env {
+namespace {
+
+constexpr char kLogExtension[] = ".log";
+constexpr char kTemporaryExtension[] = ".tmp";
+// The log is never compacted while it's smaller than this, so small maps
+// aren't rewritten on every few writes.
+constexpr std::uint64_t kMinCompactionBytes = 64 << 10;
+
+// A log record is the key size and the value size as 32 bit integers, the key,
+// the value and a checksum of everything before it. The log only ever lives on
+// the host that wrote it, so integers are in host byte order.
+constexpr std::size_t kRecordHeaderSize = 2 * sizeof(std::uint32_t);
+constexpr std::size_t kRecordChecksumSize = sizeof(std::uint64_t);
+
+// FNV-1a, only meant to detect records torn by a crash.
+std::uint64_t Checksum(const char* data, std::size_t size) {
+  std::uint64_t hash = 0xcbf29ce484222325;
+  for (std::size_t i = 0; i < size; i++) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+std::string EncodeRecord(const std::string& key, const std::string& value) {
+  const std::uint32_t sizes[] = {static_cast<std::uint32_t>(key.size()),
+                                 static_cast<std::uint32_t>(value.size())};
+  std::string record(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+  record += key;
+  record += value;
+  const std::uint64_t checksum = Checksum(record.data(), record.size());
+  record.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+  return record;
+}
+
+Result<void> SyncDirectory(const std::string& path) {
+  android::base::unique_fd fd(
+      open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+  CF_EXPECTF(fd.get() >= 0, "Failed to open \"{}\": {}", path,
+             strerror(errno));
+  CF_EXPECTF(fsync(fd.get()) == 0, "Failed to sync \"{}\": {}", path,
+             strerror(errno));
+  return {};
+}
+
+}  // namespace
+
+IndexedLogStore::IndexedLogStore(std::string path)
+    : path_(std::move(path)), log_path_(path_ + kLogExtension) {}
+
+IndexedLogStore::~IndexedLogStore() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!loaded_ || log_size_ == 0) {
+    return;
+  }
+  auto compacted = Compact();
+  if (!compacted.ok()) {
+    LOG(WARNING) << "Failed to compact \"" << path_
+                 << "\": " << compacted.error().FormatForEnv();
+  }
+}
+
+Result<bool> IndexedLogStore::Contains(const std::string& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CF_EXPECT(Load());
+  return entries_.count(key) > 0;
+}
+
+Result<std::optional<std::string>> IndexedLogStore::Get(
+    const std::string& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CF_EXPECT(Load());
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+Result<bool> IndexedLogStore::Exists() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CF_EXPECT(Load());
+  return exists_;
+}
+
+Result<void> IndexedLogStore::Put(const std::string& key,
+                                  const std::string& value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CF_EXPECT(Load());
+
+  const std::string record = EncodeRecord(key, value);
+  const bool written =
+      android::base::WriteFully(log_fd_, record.data(), record.size());
+  if (!written || fdatasync(log_fd_.get()) != 0) {
+    const int error = errno;
+    // Drops what was written of the record. A partial record would only be
+    // discarded as torn on the next load, but a complete one would be
+    // replayed although the write failed and isn't in `entries_`.
+    if (ftruncate(log_fd_.get(), log_size_) != 0) {
+      PLOG(ERROR) << "Failed to truncate \"" << log_path_ << "\"";
+    }
+    return CF_ERRF("Failed to {} \"{}\": {}",
+                   written ? "sync" : "append to", log_path_,
+                   strerror(error));
+  }
+  log_size_ += record.size();
+  entries_[key] = value;
+  exists_ = true;
+
+  if (log_size_ > std::max(snapshot_size_, kMinCompactionBytes)) {
+    // The write is already durable, compacting can be retried later.
+    auto compacted = Compact();
+    if (!compacted.ok()) {
+      LOG(WARNING) << "Failed to compact \"" << path_
+                   << "\": " << compacted.error().FormatForEnv();
+    }
+  }
+  return {};
+}
+
+Result<void> IndexedLogStore::Load() {
+  if (loaded_) {
+    return {};
+  }
+  entries_.clear();
+  CF_EXPECT(LoadSnapshot());
+  CF_EXPECT(LoadLog());
+  exists_ = snapshot_size_ > 0 || log_size_ > 0;
+  loaded_ = true;
+  return {};
+}
+
+Result<void> IndexedLogStore::LoadSnapshot() {
+  snapshot_size_ = 0;
+  if (!FileHasContent(path_)) {
+    return {};
+  }
+  std::string json;
+  CF_EXPECTF(android::base::ReadFileToString(path_, &json),
+             "Failed to read \"{}\"", path_);
+  auto root = CF_EXPECT(ParseJson(json));
+  for (const auto& key : root.getMemberNames()) {
+    std::vector<std::uint8_t> value;
+    CF_EXPECT(DecodeBase64(root[key].asString(), &value),
+              "Failed to decode base64 to read key: " << key);
+    entries_[key] = std::string(value.begin(), value.end());
+  }
+  snapshot_size_ = json.size();
+  return {};
+}
+
+Result<void> IndexedLogStore::LoadLog() {
+  const bool created = !FileExists(log_path_);
+  log_fd_.reset(open(log_path_.c_str(),
+                     O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600));
+  CF_EXPECTF(log_fd_.get() >= 0, "Failed to open \"{}\": {}", log_path_,
+             strerror(errno));
+  if (created) {
+    CF_EXPECT(SyncDirectory(cpp_dirname(path_)));
+  }
+
+  std::string log;
+  CF_EXPECTF(android::base::ReadFdToString(log_fd_, &log),
+             "Failed to read \"{}\"", log_path_);
+  std::size_t pos = 0;
+  while (log.size() - pos >= kRecordHeaderSize + kRecordChecksumSize) {
+    std::uint32_t sizes[2];
+    memcpy(sizes, log.data() + pos, sizeof(sizes));
+    const std::uint64_t body_size =
+        std::uint64_t(kRecordHeaderSize) + sizes[0] + sizes[1];
+    if (log.size() - pos < body_size + kRecordChecksumSize) {
+      break;
+    }
+    std::uint64_t checksum;
+    memcpy(&checksum, log.data() + pos + body_size, sizeof(checksum));
+    if (checksum != Checksum(log.data() + pos, body_size)) {
+      break;
+    }
+    const char* key = log.data() + pos + kRecordHeaderSize;
+    entries_[std::string(key, sizes[0])] =
+        std::string(key + sizes[0], sizes[1]);
+    pos += body_size + kRecordChecksumSize;
+  }
+  if (pos < log.size()) {
+    LOG(WARNING) << "Dropping " << log.size() - pos
+                 << " bytes of incomplete records from \"" << log_path_
+                 << "\"";
+    CF_EXPECTF(ftruncate(log_fd_.get(), pos) == 0,
+               "Failed to truncate \"{}\": {}", log_path_, strerror(errno));
+  }
+  log_size_ = pos;
+  return {};
+}
+
+// Replays of the log over a newer snapshot are harmless, so the log is only
+// emptied once the new snapshot is durably in place.
+Result<void> IndexedLogStore::Compact() {
+  Json::Value root(Json::objectValue);
+  for (const auto& [key, value] : entries_) {
+    std::string value_base64;
+    CF_EXPECT(EncodeBase64(value.data(), value.size(), &value_base64),
+              "Failed to encode base64 to write key: " << key);
+    root[key] = value_base64;
+  }
+  Json::StreamWriterBuilder builder;
+  const std::string json = Json::writeString(builder, root);
+
+  const std::string temporary_path = path_ + kTemporaryExtension;
+  {
+    android::base::unique_fd fd(
+        open(temporary_path.c_str(),
+             O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600));
+    CF_EXPECTF(fd.get() >= 0, "Failed to create \"{}\": {}", temporary_path,
+               strerror(errno));
+    CF_EXPECTF(android::base::WriteFully(fd, json.data(), json.size()),
+               "Failed to write \"{}\": {}", temporary_path, strerror(errno));
+    CF_EXPECTF(fsync(fd.get()) == 0, "Failed to sync \"{}\": {}",
+               temporary_path, strerror(errno));
+  }
+  CF_EXPECT(RenameFile(temporary_path, path_));
+  CF_EXPECT(SyncDirectory(cpp_dirname(path_)));
+  snapshot_size_ = json.size();
+
+  CF_EXPECTF(ftruncate(log_fd_.get(), 0) == 0, "Failed to truncate \"{}\": {}",
+             log_path_, strerror(errno));
+  CF_EXPECTF(fdatasync(log_fd_.get()) == 0, "Failed to sync \"{}\": {}",
+             log_path_, strerror(errno));
+  log_size_ = 0;
+  return {};
+}
+
+}  // namespace secure_env
+}  // namespace cuttlefish
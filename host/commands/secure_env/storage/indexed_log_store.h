@@ -0,0 +1,72 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include <android-base/unique_fd.h>
+
+#include "common/libs/utils/result.h"
+
+namespace cuttlefish {
+namespace secure_env {
+
+/**
+ * A persistent map of binary values, held in memory and loaded on first use.
+ *
+ * The compacted state is a JSON object of base64 encoded values at `path`.
+ * Every write appends a checksummed record to `path` + ".log" and is synced
+ * before it returns, so a write costs the size of its record rather than the
+ * size of the map. Once the log outgrows the snapshot, the snapshot is
+ * replaced atomically and the log emptied, as it is when the store is
+ * destroyed. A record torn by a crash is dropped when the log is loaded again.
+ */
+class IndexedLogStore {
+ public:
+  IndexedLogStore(std::string path);
+  ~IndexedLogStore();
+
+  Result<bool> Contains(const std::string& key);
+  Result<std::optional<std::string>> Get(const std::string& key);
+  Result<void> Put(const std::string& key, const std::string& value);
+  // Whether the store was found on disk, even without entries, or was written
+  // to since.
+  Result<bool> Exists();
+
+ private:
+  Result<void> Load();
+  Result<void> LoadSnapshot();
+  Result<void> LoadLog();
+  Result<void> Compact();
+
+  const std::string path_;
+  const std::string log_path_;
+
+  std::mutex mutex_;
+  bool loaded_ = false;
+  bool exists_ = false;
+  std::map<std::string, std::string> entries_;
+  android::base::unique_fd log_fd_;
+  std::uint64_t log_size_ = 0;
+  std::uint64_t snapshot_size_ = 0;
+};
+
+}  // namespace secure_env
+}  // namespace cuttlefish
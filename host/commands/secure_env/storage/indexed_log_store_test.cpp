@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "host/commands/secure_env/storage/indexed_log_store.h"
+
+#include <unistd.h>
+
+#include <optional>
+#include <string>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "common/libs/utils/files.h"
+
+namespace cuttlefish {
+namespace secure_env {
+
+class IndexedLogStoreTest : public ::testing::Test {
+ protected:
+  std::string Path() const { return std::string(dir_.path) + "/storage"; }
+
+  std::string ReadLog() const {
+    std::string log;
+    EXPECT_TRUE(android::base::ReadFileToString(Path() + ".log", &log));
+    return log;
+  }
+
+  // Leaves only `log` behind, as a store that never compacted would if its
+  // process was killed rather than destroying it.
+  void SimulateKill(const std::string& log) const {
+    unlink(Path().c_str());
+    ASSERT_TRUE(android::base::WriteStringToFile(log, Path() + ".log"));
+  }
+
+  TemporaryDir dir_;
+};
+
+TEST_F(IndexedLogStoreTest, WritesSurviveReopening) {
+  {
+    IndexedLogStore store(Path());
+    ASSERT_FALSE(store.Exists().value());
+    ASSERT_TRUE(store.Put("a", std::string("\0\1", 2)).ok());
+    ASSERT_TRUE(store.Put("b", "second").ok());
+    ASSERT_TRUE(store.Put("a", "third").ok());
+    ASSERT_TRUE(store.Exists().value());
+  }
+  IndexedLogStore store(Path());
+
+  ASSERT_TRUE(store.Exists().value());
+  ASSERT_EQ(store.Get("a").value(), std::optional<std::string>("third"));
+  ASSERT_EQ(store.Get("b").value(), std::optional<std::string>("second"));
+  ASSERT_EQ(store.Get("c").value(), std::nullopt);
+  ASSERT_FALSE(store.Contains("c").value());
+}
+
+TEST_F(IndexedLogStoreTest, ReadsJsonSnapshot) {
+  // "dmFsdWU=" is "value" in base64.
+  ASSERT_TRUE(
+      android::base::WriteStringToFile("{\"key\": \"dmFsdWU=\"}", Path()));
+
+  IndexedLogStore store(Path());
+
+  ASSERT_EQ(store.Get("key").value(), std::optional<std::string>("value"));
+}
+
+TEST_F(IndexedLogStoreTest, EmptySnapshotExists) {
+  ASSERT_TRUE(android::base::WriteStringToFile("{}", Path()));
+
+  IndexedLogStore store(Path());
+
+  ASSERT_TRUE(store.Exists().value());
+  ASSERT_FALSE(store.Contains("key").value());
+}
+
+TEST_F(IndexedLogStoreTest, MalformedSnapshotFails) {
+  ASSERT_TRUE(android::base::WriteStringToFile("{\"key\": ", Path()));
+
+  IndexedLogStore store(Path());
+
+  ASSERT_FALSE(store.Exists().ok());
+}
+
+TEST_F(IndexedLogStoreTest, ReplaysLogWithoutSnapshot) {
+  std::string log;
+  {
+    IndexedLogStore store(Path());
+    ASSERT_TRUE(store.Put("a", "first").ok());
+    ASSERT_TRUE(store.Put("a", "second").ok());
+    log = ReadLog();
+  }
+  SimulateKill(log);
+
+  IndexedLogStore store(Path());
+
+  ASSERT_TRUE(store.Exists().value());
+  ASSERT_EQ(store.Get("a").value(), std::optional<std::string>("second"));
+}
+
+TEST_F(IndexedLogStoreTest, DestroyingCompactsLog) {
+  {
+    IndexedLogStore store(Path());
+    ASSERT_TRUE(store.Put("a", "first").ok());
+    ASSERT_FALSE(ReadLog().empty());
+  }
+
+  EXPECT_TRUE(ReadLog().empty());
+  IndexedLogStore store(Path());
+  ASSERT_EQ(store.Get("a").value(), std::optional<std::string>("first"));
+}
+
+TEST_F(IndexedLogStoreTest, DropsTornRecord) {
+  std::string log;
+  {
+    IndexedLogStore store(Path());
+    ASSERT_TRUE(store.Put("a", "first").ok());
+    ASSERT_TRUE(store.Put("b", "second").ok());
+    log = ReadLog();
+  }
+  SimulateKill(log.substr(0, log.size() - 3));
+  {
+    IndexedLogStore store(Path());
+    ASSERT_EQ(store.Get("a").value(), std::optional<std::string>("first"));
+    ASSERT_FALSE(store.Contains("b").value());
+    ASSERT_TRUE(store.Put("c", "third").ok());
+  }
+  IndexedLogStore store(Path());
+
+  ASSERT_EQ(store.Get("c").value(), std::optional<std::string>("third"));
+}
+
+TEST_F(IndexedLogStoreTest, CompactsIntoSnapshot) {
+  const std::string value(1024, 'x');
+  {
+    IndexedLogStore store(Path());
+    for (int i = 0; i < 200; i++) {
+      ASSERT_TRUE(store.Put(std::to_string(i % 10), value).ok());
+    }
+    // Compacted while writing, not only once destroyed.
+    ASSERT_LT(ReadLog().size(), 200 * value.size());
+  }
+
+  IndexedLogStore store(Path());
+  for (int i = 0; i < 10; i++) {
+    ASSERT_EQ(store.Get(std::to_string(i)).value(),
+              std::optional<std::string>(value));
+  }
+}
+
+// Gatekeeper and oemlock overwrite small values under a few keys, each of
+// those writes only appends its record to the log.
+TEST_F(IndexedLogStoreTest, SmallWritesOnlyAppend) {
+  constexpr std::size_t kWrites = 200;
+  const std::string value(16, 'x');
+  IndexedLogStore store(Path());
+
+  for (std::size_t i = 0; i < kWrites; i++) {
+    ASSERT_TRUE(store.Put(std::to_string(i % 10), value).ok());
+  }
+
+  // Two sizes, a one character key, the value and a checksum.
+  constexpr std::size_t kRecordSize = 4 + 4 + 1 + 16 + 8;
+  EXPECT_EQ(ReadLog().size(), kWrites * kRecordSize);
+  EXPECT_FALSE(FileExists(Path()));
+}
+
+}  // namespace secure_env
+}  // namespace cuttlefish
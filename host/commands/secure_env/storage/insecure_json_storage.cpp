@@ -15,72 +15,35 @@
 
 #include "host/commands/secure_env/storage/insecure_json_storage.h"
 
-#include <fstream>
-
-#include <android-base/file.h>
-#include <json/json.h>
-
-#include "common/libs/utils/base64.h"
-#include "common/libs/utils/files.h"
-#include "common/libs/utils/json.h"
+#include <cstring>
 
 namespace cuttlefish {
 namespace secure_env {
-namespace {
-
-Result<Json::Value> ReadJson(const std::string& path) {
-  std::string json;
-  CF_EXPECT(android::base::ReadFileToString(path, &json));
-  return CF_EXPECT(ParseJson(json));
-}
-
-Result<void> WriteJson(const std::string& path, const Json::Value& root) {
-  Json::StreamWriterBuilder builder;
-  auto json = Json::writeString(builder, root);
-  CF_EXPECT(android::base::WriteStringToFile(json, path));
-  return {};
-}
-
-} // namespace
 
-InsecureJsonStorage::InsecureJsonStorage(std::string path) : path_(std::move(path)) {}
+InsecureJsonStorage::InsecureJsonStorage(std::string path)
+    : path_(std::move(path)), store_(new IndexedLogStore(path_)) {}
 
 bool InsecureJsonStorage::Exists() const {
-  return ReadJson(path_).ok();
+  auto exists = store_->Exists();
+  return exists.ok() && *exists;
 }
 
 Result<bool> InsecureJsonStorage::HasKey(const std::string& key) const {
-  if (!FileHasContent(path_)) {
-    return false;
-  }
-  return CF_EXPECT(ReadJson(path_)).isMember(key);
+  return CF_EXPECT(store_->Contains(key));
 }
 
 Result<ManagedStorageData> InsecureJsonStorage::Read(const std::string& key) const {
-  auto root = CF_EXPECT(ReadJson(path_));
-  CF_EXPECT(root.isMember(key), "Key: " << key << " not found in " << path_);
+  auto value = CF_EXPECT(store_->Get(key));
+  CF_EXPECT(value.has_value(), "Key: " << key << " not found in " << path_);
 
-  std::vector<uint8_t> base64_buffer;
-  CF_EXPECT(DecodeBase64(root[key].asString(), &base64_buffer),
-            "Failed to decode base64 to read key: " << key);
-  auto storage_data = CF_EXPECT(CreateStorageData(base64_buffer.size()));
-  std::memcpy(storage_data->payload, reinterpret_cast<unsigned char *>(base64_buffer.data()),
-              base64_buffer.size());
+  auto storage_data = CF_EXPECT(CreateStorageData(value->size()));
+  std::memcpy(storage_data->payload, value->data(), value->size());
   return storage_data;
 }
 
 Result<void> InsecureJsonStorage::Write(const std::string& key, const StorageData& data) {
-  Json::Value root;
-  if (FileHasContent(path_)) {
-    root = CF_EXPECT(ReadJson(path_));
-  }
-
-  std::string value_base64;
-  CF_EXPECT(EncodeBase64(data.payload, data.size, &value_base64),
-            "Failed to encode base64 to write key: " << key);
-  root[key] = value_base64;
-
-  CF_EXPECT(WriteJson(path_, root));
+  CF_EXPECT(store_->Put(
+      key, std::string(reinterpret_cast<const char*>(data.payload), data.size)));
   return {};
 }
 
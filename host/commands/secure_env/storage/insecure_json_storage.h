@@ -15,11 +15,19 @@
 
 #pragma once
 
+#include <memory>
+#include <string>
+
+#include "host/commands/secure_env/storage/indexed_log_store.h"
 #include "host/commands/secure_env/storage/storage.h"
 
 namespace cuttlefish {
 namespace secure_env {
 
+/**
+ * Storage in a JSON file of base64 encoded values, updated through an
+ * `IndexedLogStore` so that writes don't rewrite the whole file.
+ */
 class InsecureJsonStorage : public secure_env::Storage {
  public:
   InsecureJsonStorage(std::string path);
@@ -31,6 +39,7 @@ class InsecureJsonStorage : public secure_env::Storage {
 
  private:
   std::string path_;
+  std::unique_ptr<IndexedLogStore> store_;
 };
 
 }  // namespace secure_env
@@ -43,11 +43,24 @@ TpmStorage::TpmStorage(TpmResourceManager& resource_manager, const std::string&
     index_[kEntries] = Json::Value(Json::arrayValue);
   } else {
     LOG(DEBUG) << "Restoring index from file";
+    persisted_ = true;
+  }
+  IndexHandles();
+}
+
+void TpmStorage::IndexHandles() {
+  for (const auto& entry : index_[kEntries]) {
+    if (!entry.isMember(kKey) || !entry.isMember(kHandle)) {
+      index_corrupted_ = true;
+      continue;
+    }
+    // The first entry of a key wins, as it did when searching the entries.
+    handles_.emplace(entry[kKey].asString(), entry[kHandle].asUInt());
   }
 }
 
 bool TpmStorage::Exists() const {
-  return ReadProtectedJsonFromFile(resource_manager_, index_file_).isMember(kEntries);
+  return persisted_;
 }
 
 Result<bool> TpmStorage::HasKey(const std::string& key) const {
@@ -162,15 +175,12 @@ TPM2_HANDLE TpmStorage::GenerateRandomHandle() {
 }
 
 Result<std::optional<TPM2_HANDLE>> TpmStorage::GetHandle(const std::string& key) const {
-  for (const auto& entry : index_[kEntries]) {
-    CF_EXPECT(entry.isMember(kKey), "Index was corrupted");
-    if (entry[kKey] != key) {
-      continue;
-    }
-    CF_EXPECT(entry.isMember(kHandle), "Index was corrupted");
-    return entry[kHandle].asUInt();
+  CF_EXPECT(!index_corrupted_, "Index was corrupted");
+  auto it = handles_.find(key);
+  if (it == handles_.end()) {
+    return std::nullopt;
   }
-  return std::nullopt;
+  return it->second;
 }
 
 Result<void> TpmStorage::Allocate(const std::string& key, uint16_t size) {
@@ -217,9 +227,11 @@ Result<void> TpmStorage::Allocate(const std::string& key, uint16_t size) {
   entry[kKey] = key;
   entry[kHandle] = handle;
   index_[kEntries].append(entry);
+  handles_.emplace(key, handle);
 
   CF_EXPECT(WriteProtectedJsonToFile(resource_manager_, index_file_, index_),
             "Failed to save changes to " << index_file_);
+  persisted_ = true;
 
   return {};
 }
@@ -17,6 +17,7 @@
 
 #include "host/commands/secure_env/storage/storage.h"
 
+#include <map>
 #include <memory>
 #include <optional>
 #include <string>
@@ -42,6 +43,9 @@ namespace secure_env {
  * added, but not change the contents that an index points to if it still
  * exists.
  *
+ * The index is also kept in memory as a map, so looking keys up doesn't go
+ * through the JSON entries or the protected file.
+ *
  * This class is not thread-safe, and should be synchronized externally if it
  * is going to be used from multiple threads.
  */
@@ -58,10 +62,15 @@ class TpmStorage : public secure_env::Storage {
   Result<std::optional<TPM2_HANDLE>> GetHandle(const std::string& key) const;
   TPM2_HANDLE GenerateRandomHandle();
   Result<void> Allocate(const std::string& key, uint16_t size);
+  void IndexHandles();
 
   TpmResourceManager& resource_manager_;
   std::string index_file_;
   Json::Value index_;
+  std::map<std::string, TPM2_HANDLE> handles_;
+  bool index_corrupted_ = false;
+  // Whether `index_file_` holds an index, as checked by `Exists`.
+  bool persisted_ = false;
 
   std::string path_;
 };
@@ -15,6 +15,7 @@
 
 #include "host/commands/secure_env/tpm_resource_manager.h"
 
+#include <iterator>
 #include <mutex>
 
 #include <android-base/logging.h>
@@ -59,12 +60,19 @@ void TpmResourceManager::ObjectSlot::set(ESYS_TR resource) {
 }
 
 TpmResourceManager::TpmResourceManager(ESYS_CONTEXT* esys)
-    : esys_(esys), maximum_object_slots_(3), used_slots_(0) {
+    : esys_(esys),
+      maximum_object_slots_(3),
+      used_slots_(0),
+      primary_key_hits_(0),
+      primary_key_misses_(0) {
   // TODO(b/158791154): Find maximum_object_slots dynamically using
   // TPM2_GetCapability. Now equal to MAX_LOADED_OBJECTS from TpmProfile.h.
 }
 
 TpmResourceManager::~TpmResourceManager() {
+  LOG(DEBUG) << "Primary key cache: " << primary_key_hits_ << " hits, "
+             << primary_key_misses_ << " misses";
+  primary_keys_.clear();
   if (used_slots_ > 0) {
     LOG(FATAL) << "Outstanding TpmResourceManager::ObjectSlot instances. "
                   "These hold a dangling pointer to this instance.";
@@ -76,12 +84,59 @@ EsysLock TpmResourceManager::Esys() {
 }
 
 TpmObjectSlot TpmResourceManager::ReserveSlot() {
-  auto slot_num = used_slots_.fetch_add(1);
-  if (slot_num >= maximum_object_slots_) {
-      used_slots_--;
+  while (true) {
+    auto slot_num = used_slots_.fetch_add(1);
+    if (slot_num < maximum_object_slots_) {
+      return TpmObjectSlot{new ObjectSlot(this)};
+    }
+    used_slots_--;
+    if (!EvictPrimaryKey()) {
       return nullptr;
+    }
+  }
+}
+
+TpmObjectSlot TpmResourceManager::PrimaryKey(
+    const std::string& key_template,
+    const std::function<TpmObjectSlot()>& create) {
+  {
+    std::lock_guard<std::mutex> lock(primary_keys_mu_);
+    for (auto it = primary_keys_.begin(); it != primary_keys_.end(); it++) {
+      if (it->first == key_template) {
+        primary_keys_.splice(primary_keys_.begin(), primary_keys_, it);
+        primary_key_hits_++;
+        return it->second;
+      }
+    }
+  }
+  primary_key_misses_++;
+  // Not holding the lock, creating the key may have to evict others.
+  auto key = create();
+  if (!key) {
+    return key;
+  }
+  std::lock_guard<std::mutex> lock(primary_keys_mu_);
+  for (const auto& [cached_template, cached_key] : primary_keys_) {
+    if (cached_template == key_template) {
+      return cached_key;  // Created concurrently by another caller
+    }
+  }
+  primary_keys_.emplace_front(key_template, key);
+  return key;
+}
+
+// Unloads the least recently used primary key that is only held by the cache.
+bool TpmResourceManager::EvictPrimaryKey() {
+  std::lock_guard<std::mutex> lock(primary_keys_mu_);
+  for (auto it = primary_keys_.rbegin(); it != primary_keys_.rend(); it++) {
+    // Other references are only handed out under the lock.
+    if (it->second.use_count() == 1) {
+      LOG(VERBOSE) << "Evicting a primary key";
+      primary_keys_.erase(std::next(it).base());
+      return true;
+    }
   }
-  return TpmObjectSlot{new ObjectSlot(this)};
+  return false;
 }
 
 }  // namespace cuttlefish
@@ -15,10 +15,15 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <list>
 #include <memory>
 #include <mutex>
 #include <set>
+#include <string>
+#include <utility>
 
 #include <tss2/tss2_esys.h>
 
@@ -42,9 +47,10 @@ class EsysLock {
  * objects at once. Some TPM operations are defined to consume slots either
  * temporarily or until the resource is explicitly unloaded.
  *
- * This implementation is intended for future extension, to track what objects
- * are resident if we run out of space, or implement optimizations like LRU
- * caching to avoid re-loading often-used resources.
+ * Primary keys are derived deterministically from their template, so they are
+ * kept resident once created and shared by every user of the same template.
+ * When no slot is left, the least recently used primary keys nobody else holds
+ * are unloaded to make room.
  */
 class TpmResourceManager {
  public:
@@ -73,11 +79,28 @@ class TpmResourceManager {
   EsysLock Esys();
   std::shared_ptr<ObjectSlot> ReserveSlot();
 
+  // Returns the primary key created from the marshaled `key_template`, calling
+  // `create` to derive it only if it isn't resident already.
+  std::shared_ptr<ObjectSlot> PrimaryKey(
+      const std::string& key_template,
+      const std::function<std::shared_ptr<ObjectSlot>()>& create);
+
+  std::uint64_t PrimaryKeyCacheHits() const { return primary_key_hits_; }
+  std::uint64_t PrimaryKeyCacheMisses() const { return primary_key_misses_; }
+
  private:
+  bool EvictPrimaryKey();
+
   std::mutex mu_;
   ESYS_CONTEXT* esys_;
   const std::uint32_t maximum_object_slots_;
   std::atomic<std::uint32_t> used_slots_;
+
+  // Most recently used first.
+  std::mutex primary_keys_mu_;
+  std::list<std::pair<std::string, std::shared_ptr<ObjectSlot>>> primary_keys_;
+  std::atomic<std::uint64_t> primary_key_hits_;
+  std::atomic<std::uint64_t> primary_key_misses_;
 };
 
 using TpmObjectSlot = std::shared_ptr<TpmResourceManager::ObjectSlot>;
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "host/commands/secure_env/tpm_resource_manager.h"
+
+#include <gtest/gtest.h>
+
+#include "host/commands/secure_env/primary_key_builder.h"
+#include "host/commands/secure_env/test_tpm.h"
+
+namespace cuttlefish {
+
+TEST(TpmResourceManager, PrimaryKeyIsReused) {
+  TestTpm tpm;
+  TpmResourceManager resource_manager(tpm.Esys());
+
+  auto first = ParentKeyCreator("test")(resource_manager);
+  auto second = ParentKeyCreator("test")(resource_manager);
+
+  ASSERT_NE(first, nullptr);
+  ASSERT_EQ(first, second);
+  ASSERT_EQ(resource_manager.PrimaryKeyCacheHits(), 1u);
+  ASSERT_EQ(resource_manager.PrimaryKeyCacheMisses(), 1u);
+}
+
+TEST(TpmResourceManager, PrimaryKeysDifferByTemplate) {
+  TestTpm tpm;
+  TpmResourceManager resource_manager(tpm.Esys());
+
+  auto parent = ParentKeyCreator("test")(resource_manager);
+  auto signing = SigningKeyCreator("test")(resource_manager);
+  auto other_parent = ParentKeyCreator("other")(resource_manager);
+
+  ASSERT_NE(parent, nullptr);
+  ASSERT_NE(signing, nullptr);
+  ASSERT_NE(other_parent, nullptr);
+  ASSERT_NE(parent, signing);
+  ASSERT_NE(parent, other_parent);
+  ASSERT_EQ(resource_manager.PrimaryKeyCacheMisses(), 3u);
+}
+
+TEST(TpmResourceManager, UnusedPrimaryKeysAreEvicted) {
+  TestTpm tpm;
+  TpmResourceManager resource_manager(tpm.Esys());
+
+  ASSERT_NE(ParentKeyCreator("a")(resource_manager), nullptr);
+  ASSERT_NE(ParentKeyCreator("b")(resource_manager), nullptr);
+  ASSERT_NE(ParentKeyCreator("c")(resource_manager), nullptr);
+  auto held = ParentKeyCreator("d")(resource_manager);
+  ASSERT_NE(held, nullptr);
+
+  // Every slot can still be reserved, other than the one of the held key.
+  auto slot_1 = resource_manager.ReserveSlot();
+  auto slot_2 = resource_manager.ReserveSlot();
+  ASSERT_NE(slot_1, nullptr);
+  ASSERT_NE(slot_2, nullptr);
+  ASSERT_EQ(resource_manager.ReserveSlot(), nullptr);
+
+  ASSERT_EQ(ParentKeyCreator("d")(resource_manager), held);
+  ASSERT_EQ(resource_manager.PrimaryKeyCacheHits(), 1u);
+}
+
+}  // namespace cuttlefish
@@ -30,6 +30,7 @@
 #include "host/commands/snapshot_util_cvd/parse.h"
 #include "host/commands/snapshot_util_cvd/snapshot_taker.h"
 #include "host/libs/command_util/runner/proto_utils.h"
+#include "host/libs/command_util/snapshot_store.h"
 #include "host/libs/command_util/util.h"
 #include "host/libs/config/cuttlefish_config.h"
 #include "run_cvd.pb.h"
@@ -155,6 +156,13 @@ Result<void> SnapshotCvdMain(std::vector<std::string> args) {
       delete_snapshot_on_fail.Disable();
     }
   }
+  if (parsed.cmd == SnapshotCmd::kSnapshotTake &&
+      !parsed.snapshot_store_path.empty()) {
+    // Packing is all or nothing until the packed files are removed, so a
+    // failure leaves a complete, unpacked snapshot behind.
+    CF_EXPECT(PackSnapshot(parsed.snapshot_path, parsed.snapshot_store_path),
+              "Failed to move the snapshot into the snapshot store");
+  }
   return {};
 }
 
@@ -46,6 +46,11 @@ constexpr char wait_for_launcher_help[] =
 constexpr char snapshot_path_help[] =
     "Path to the directory the taken snapshot files are saved";
 
+constexpr char snapshot_store_path_help[] =
+    "If set, the large files of the taken snapshot are moved into this "
+    "deduplicating chunk store, shared with other snapshots. assemble_cvd "
+    "recreates them when restoring.";
+
 Flag SnapshotCmdFlag(std::string& value_buf) {
   return GflagsCompatFlag("subcmd", value_buf).Help(snapshot_cmd_help);
 }
@@ -64,6 +69,11 @@ Flag SnapshotPathFlag(std::string& path_buf) {
   return GflagsCompatFlag("snapshot_path", path_buf).Help(snapshot_path_help);
 }
 
+Flag SnapshotStorePathFlag(std::string& path_buf) {
+  return GflagsCompatFlag("snapshot_store_path", path_buf)
+      .Help(snapshot_store_path_help);
+}
+
 Flag CleanupSnapshotPathFlag(bool& cleanup) {
   return GflagsCompatFlag("cleanup_snapshot_path", cleanup)
       .Help(cleanup_snapshot_path_help);
@@ -118,6 +128,7 @@ Result<Parsed> Parse(std::vector<std::string>& args) {
   flags.push_back(SnapshotCmdFlag(snapshot_op));
   flags.push_back(WaitForLauncherFlag(parsed.wait_for_launcher));
   flags.push_back(SnapshotPathFlag(snapshot_path));
+  flags.push_back(SnapshotStorePathFlag(parsed.snapshot_store_path));
   flags.push_back(CleanupSnapshotPathFlag(parsed.cleanup_snapshot_path));
   flags.push_back(HelpFlag(flags));
   flags.push_back(HelpXmlFlag(flags, std::cout, help_xml));
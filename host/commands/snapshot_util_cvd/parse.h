@@ -42,6 +42,7 @@ struct Parsed {
   int wait_for_launcher;
   std::string snapshot_path;
   bool cleanup_snapshot_path;
+  std::string snapshot_store_path;
   std::optional<android::base::LogSeverity> verbosity_level;
 };
 Result<Parsed> Parse(int argc, char** argv);
@@ -31,6 +31,7 @@
 #include "common/libs/utils/json.h"
 #include "common/libs/utils/result.h"
 #include "common/libs/utils/users.h"
+#include "host/libs/command_util/snapshot_store.h"
 #include "host/libs/command_util/snapshot_utils.h"
 #include "host/libs/config/cuttlefish_config.h"
 
@@ -62,11 +63,21 @@ Result<std::string> HandleHostGroupSnapshot(const std::string& path) {
              "is not subdirectory of cuttlefish home \"{}\".",
              cuttlefish_root, cuttlefish_home);
 
-  // cp -r HOME snapshot_path
-  auto always_true = [](const std::string&) -> bool { return true; };
+  // cp -r HOME snapshot_path, leaving out the snapshot this run was restored
+  // from if it had to be unpacked.
+  std::string real_cuttlefish_root;
+  if (!android::base::Realpath(cuttlefish_root, &real_cuttlefish_root)) {
+    real_cuttlefish_root = cuttlefish_root;
+  }
+  const std::string unpacked_snapshot_dir =
+      real_cuttlefish_root + "/" + kUnpackedSnapshotDir;
+  auto not_unpacked_snapshot =
+      [&unpacked_snapshot_dir](const std::string& path) -> bool {
+    return path != unpacked_snapshot_dir;
+  };
   CF_EXPECTF(CopyDirectoryRecursively(cuttlefish_root, snapshot_path,
                                       /* verify_dest_dir_empty */ true,
-                                      /* predicate */ std::move(always_true)),
+                                      /* predicate */ not_unpacked_snapshot),
              "\"cp -r {} {} failed.\"", cuttlefish_root, snapshot_path);
 
   const auto meta_json =
@@ -120,6 +120,15 @@ const virtio_snd_pcm_info STREAMS[] = {{
 }};
 constexpr uint32_t NUM_STREAMS = sizeof(STREAMS) / sizeof(STREAMS[0]);
 
+// Webrtc takes audio in chunks of this duration.
+constexpr auto kChunkDuration = std::chrono::milliseconds(10);
+// At most this many chunks of playback audio are queued for webrtc, anything
+// beyond that is dropped rather than letting the latency grow.
+constexpr size_t kMaxQueuedPlaybackChunks = 20;
+// Enough for kMaxQueuedPlaybackChunks in the largest supported format: 2
+// channels of 32 bit samples at 384kHz.
+constexpr size_t kPlaybackRingCapacity = 1 << 20;
+
 bool IsCapture(uint32_t stream_id) {
   CHECK(stream_id < NUM_STREAMS) << "Invalid stream id: " << stream_id;
   return STREAMS[stream_id].direction ==
@@ -284,10 +293,18 @@ AudioHandler::AudioHandler(
     : audio_sink_(audio_sink),
       audio_server_(std::move(audio_server)),
       stream_descs_(NUM_STREAMS),
-      audio_source_(audio_source) {}
+      audio_source_(audio_source) {
+  for (uint32_t stream_id = 0; stream_id < NUM_STREAMS; stream_id++) {
+    if (!IsCapture(stream_id)) {
+      stream_descs_[stream_id].ring =
+          std::make_unique<SpscRingBuffer>(kPlaybackRingCapacity);
+    }
+  }
+}
 
 void AudioHandler::Start() {
   server_thread_ = std::thread([this]() { Loop(); });
+  playback_sink_thread_ = std::thread([this]() { PlaybackSinkLoop(); });
 }
 
 [[noreturn]] void AudioHandler::Loop() {
@@ -346,7 +363,12 @@ void AudioHandler::SetStreamParameters(StreamSetParamsCommand& cmd) {
     stream_descs_[cmd.stream_id()].channels = channels;
     auto len10ms = (channels * (sample_rate / 100) * bits_per_sample) / 8;
     stream_descs_[cmd.stream_id()].buffer.Reset(len10ms);
+    if (stream_descs_[cmd.stream_id()].ring) {
+      stream_descs_[cmd.stream_id()].flush_position =
+          stream_descs_[cmd.stream_id()].ring->WritePosition();
+    }
   }
+  WakePlaybackSink();
   cmd.Reply(AudioStatus::VIRTIO_SND_S_OK);
 }
 
@@ -380,7 +402,18 @@ void AudioHandler::StopStream(StreamControlCommand& cmd) {
     cmd.Reply(AudioStatus::VIRTIO_SND_S_BAD_MSG);
     return;
   }
-  stream_descs_[cmd.stream_id()].active = false;
+  auto& stream_desc = stream_descs_[cmd.stream_id()];
+  stream_desc.active = false;
+  if (!IsCapture(cmd.stream_id())) {
+    // Up to kMaxQueuedPlaybackChunks of audio may still be queued, which the
+    // guest already got back as played, so it's sent rather than dropped.
+    stream_desc.drain_requested = true;
+    WakePlaybackSink();
+    LOG(VERBOSE) << "Playback stream " << cmd.stream_id() << ": "
+                 << stream_desc.underruns << " underruns, "
+                 << stream_desc.overruns << " overruns dropping "
+                 << stream_desc.overrun_bytes << " bytes";
+  }
   cmd.Reply(AudioStatus::VIRTIO_SND_S_OK);
 }
 
@@ -408,62 +441,164 @@ void AudioHandler::JacksInfo(JackInfoCommand& cmd) {
 
 void AudioHandler::OnPlaybackBuffer(TxBuffer buffer) {
   auto stream_id = buffer.stream_id();
+  // Invalid or capture streams shouldn't send tx buffers
+  if (stream_id >= NUM_STREAMS || IsCapture(stream_id)) {
+    buffer.SendStatus(AudioStatus::VIRTIO_SND_S_BAD_MSG, 0, 0);
+    return;
+  }
   auto& stream_desc = stream_descs_[stream_id];
+  // A buffer may be received for an inactive stream if we were slow to
+  // process it and the other side stopped the stream. Quitely ignore it in
+  // that case
+  if (!stream_desc.active) {
+    buffer.SendStatus(AudioStatus::VIRTIO_SND_S_OK, 0, buffer.len());
+    return;
+  }
+  size_t frame_len;
+  size_t max_queued_len;
   {
     std::lock_guard<std::mutex> lock(stream_desc.mtx);
-    auto& holding_buffer = stream_descs_[stream_id].buffer;
-    // Invalid or capture streams shouldn't send tx buffers
-    if (stream_id >= NUM_STREAMS || IsCapture(stream_id)) {
-      buffer.SendStatus(AudioStatus::VIRTIO_SND_S_BAD_MSG, 0, 0);
-      return;
+    frame_len = stream_desc.channels * stream_desc.bits_per_sample / 8;
+    max_queued_len =
+        stream_desc.buffer.buffer.size() * kMaxQueuedPlaybackChunks;
+  }
+  // The audio is only copied into the ring here, the playback sink thread
+  // splits it into the 10ms chunks webrtc expects and hands them over. That
+  // way the buffer is returned to the guest without waiting for webrtc.
+  auto& ring = *stream_desc.ring;
+  const size_t queued_len = ring.Size();
+  size_t len = 0;
+  if (frame_len > 0 && max_queued_len > queued_len) {
+    len = std::min<size_t>(buffer.len(), max_queued_len - queued_len);
+    // Only whole frames, so the samples of all channels stay together.
+    len -= len % frame_len;
+  }
+  // This casts away volatility of the pointer, necessary because memcpy
+  // doesn't take volatile memory. This should be safe though because the
+  // guest doesn't touch the buffer until it's released below.
+  const size_t written =
+      ring.Write(const_cast<const uint8_t*>(buffer.get()), len);
+  if (written < buffer.len()) {
+    stream_desc.overruns++;
+    stream_desc.overrun_bytes += buffer.len() - written;
+  }
+  buffer.SendStatus(AudioStatus::VIRTIO_SND_S_OK, 0, buffer.len());
+  WakePlaybackSink();
+}
+
+void AudioHandler::WakePlaybackSink() {
+  // Taking the lock guarantees the sink thread is either already waiting or
+  // hasn't checked for pending audio yet, so the notification isn't lost.
+  { std::lock_guard<std::mutex> lock(playback_sink_mtx_); }
+  playback_sink_cv_.notify_one();
+}
+
+bool AudioHandler::HasPendingPlayback() {
+  for (uint32_t stream_id = 0; stream_id < NUM_STREAMS; stream_id++) {
+    auto& stream_desc = stream_descs_[stream_id];
+    if (!stream_desc.ring) {
+      continue;
     }
-    // A buffer may be received for an inactive stream if we were slow to
-    // process it and the other side stopped the stream. Quitely ignore it in
-    // that case
-    if (!stream_desc.active) {
-      buffer.SendStatus(AudioStatus::VIRTIO_SND_S_OK, 0, buffer.len());
-      return;
+    if (stream_desc.drain_requested) {
+      return true;
     }
-    // Webrtc will silently ignore any buffer with a length different than 10ms,
-    // so we must split any buffer bigger than that and temporarily store any
-    // remaining frames that are less than that size.
-    auto current_time = rtc::TimeMillis();
-    // The timestamp of the first 10ms chunk to be sent so that the last one
-    // will have the current time
-    auto base_time =
-        current_time - ((buffer.len() - 1) / holding_buffer.buffer.size()) * 10;
-    // number of frames in a 10 ms buffer
-    const int frames = stream_desc.sample_rate / 100;
-    size_t pos = 0;
-    while (pos < buffer.len()) {
-      if (holding_buffer.empty() &&
-          buffer.len() - pos >= holding_buffer.buffer.size()) {
-        // Avoid the extra copy into holding buffer
-        // This casts away volatility of the pointer, necessary because the
-        // webrtc api doesn't expect volatile memory. This should be safe though
-        // because webrtc will use the contents of the buffer before returning
-        // and only then we release it.
-        CvdAudioFrameBuffer audio_frame_buffer(
-            const_cast<const uint8_t*>(&buffer.get()[pos]),
-            stream_desc.bits_per_sample, stream_desc.sample_rate,
-            stream_desc.channels, frames);
-        audio_sink_->OnFrame(audio_frame_buffer, base_time);
-        pos += holding_buffer.buffer.size();
-      } else {
-        pos += holding_buffer.Add(buffer.get() + pos, buffer.len() - pos);
-        if (holding_buffer.full()) {
-          auto buffer_ptr = const_cast<const uint8_t*>(holding_buffer.data());
-          CvdAudioFrameBuffer audio_frame_buffer(
-              buffer_ptr, stream_desc.bits_per_sample, stream_desc.sample_rate,
-              stream_desc.channels, frames);
-          audio_sink_->OnFrame(audio_frame_buffer, base_time);
-          holding_buffer.count = 0;
-        }
+    std::lock_guard<std::mutex> lock(stream_desc.mtx);
+    if (stream_desc.flush_position) {
+      return true;
+    }
+    const auto chunk_len = stream_desc.buffer.buffer.size();
+    if (chunk_len > 0 && stream_desc.ring->Size() >= chunk_len) {
+      return true;
+    }
+  }
+  return false;
+}
+
+[[noreturn]] void AudioHandler::PlaybackSinkLoop() {
+  std::vector<uint8_t> chunk;
+  for (;;) {
+    bool delivered = false;
+    for (uint32_t stream_id = 0; stream_id < NUM_STREAMS; stream_id++) {
+      if (stream_descs_[stream_id].ring) {
+        delivered |= DeliverPlayback(stream_id, chunk);
       }
-      base_time += 10;
+    }
+    if (!delivered) {
+      // Wake up at least once per chunk to notice when streams run dry.
+      std::unique_lock<std::mutex> lock(playback_sink_mtx_);
+      playback_sink_cv_.wait_for(lock, kChunkDuration,
+                                 [this]() { return HasPendingPlayback(); });
     }
   }
-  buffer.SendStatus(AudioStatus::VIRTIO_SND_S_OK, 0, buffer.len());
+}
+
+bool AudioHandler::DeliverPlayback(uint32_t stream_id,
+                                   std::vector<uint8_t>& chunk) {
+  auto& stream_desc = stream_descs_[stream_id];
+  auto& ring = *stream_desc.ring;
+  const bool drain = stream_desc.drain_requested.exchange(false);
+  int bits_per_sample;
+  int sample_rate;
+  int channels;
+  size_t chunk_len;
+  size_t queued_len;
+  {
+    // The parameters can't change while the lock is held, so after dropping
+    // the audio written before the last change everything in the ring is in
+    // the format read here.
+    std::lock_guard<std::mutex> lock(stream_desc.mtx);
+    if (stream_desc.flush_position) {
+      ring.DiscardUntil(*stream_desc.flush_position);
+      stream_desc.flush_position.reset();
+      stream_desc.last_delivery.reset();
+      stream_desc.in_underrun = false;
+    }
+    bits_per_sample = stream_desc.bits_per_sample;
+    sample_rate = stream_desc.sample_rate;
+    channels = stream_desc.channels;
+    chunk_len = stream_desc.buffer.buffer.size();
+    queued_len = ring.Size();
+  }
+  if (chunk_len == 0) {
+    return false;
+  }
+  const auto now = std::chrono::steady_clock::now();
+  // When draining, an incomplete last chunk is sent too, padded with silence.
+  const size_t partial_len = drain ? queued_len % chunk_len : 0;
+  const size_t chunks = queued_len / chunk_len + (partial_len > 0 ? 1 : 0);
+  if (chunks == 0) {
+    // Guests keep feeding active streams, even if only with silence. Being
+    // late by more than a chunk means there will be a gap in the audio.
+    if (stream_desc.active && stream_desc.last_delivery &&
+        !stream_desc.in_underrun &&
+        now - *stream_desc.last_delivery > 2 * kChunkDuration) {
+      stream_desc.underruns++;
+      stream_desc.in_underrun = true;
+    }
+    return false;
+  }
+  // The timestamp of the first chunk to be sent so that the last one will
+  // have the current time
+  auto base_time = rtc::TimeMillis() -
+                   static_cast<int64_t>(chunks - 1) * kChunkDuration.count();
+  chunk.resize(chunk_len);
+  for (size_t i = 0; i < chunks; i++) {
+    if (i + 1 == chunks && partial_len > 0) {
+      // All supported formats are signed, zeroes are silence.
+      ring.Read(chunk.data(), partial_len);
+      std::fill(chunk.begin() + partial_len, chunk.end(), 0);
+    } else {
+      ring.Read(chunk.data(), chunk_len);
+    }
+    CvdAudioFrameBuffer audio_frame_buffer(chunk.data(), bits_per_sample,
+                                           sample_rate, channels,
+                                           sample_rate / 100);
+    audio_sink_->OnFrame(audio_frame_buffer, base_time);
+    base_time += kChunkDuration.count();
+  }
+  stream_desc.last_delivery = now;
+  stream_desc.in_underrun = false;
+  return true;
 }
 
 void AudioHandler::OnCaptureBuffer(RxBuffer buffer) {
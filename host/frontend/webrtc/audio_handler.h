@@ -16,11 +16,16 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <thread>
 #include <vector>
 
+#include "common/libs/concurrency/spsc_ring_buffer.h"
 #include "host/frontend/webrtc/libdevice/audio_sink.h"
 #include "host/frontend/webrtc/libcommon/audio_source.h"
 #include "host/libs/audio_connector/server.h"
@@ -47,8 +52,29 @@ class AudioHandler : public AudioServerExecutor {
     int bits_per_sample = -1;
     int sample_rate = -1;
     int channels = -1;
-    bool active = false;
+    std::atomic<bool> active = false;
     HoldingBuffer buffer;
+    // Playback streams only. Guest audio waiting to be sent to webrtc, written
+    // by the playback thread and read by the playback sink thread.
+    std::unique_ptr<SpscRingBuffer> ring;
+    // Set when the parameters change, asks the sink thread to drop what was
+    // written to the ring before that point: it may be in the wrong format or
+    // hold an incomplete 10ms chunk. Audio written since is in the new format
+    // and kept. Guarded by mtx.
+    std::optional<size_t> flush_position;
+    // Asks the sink thread to send everything in the ring, including a last
+    // incomplete chunk padded with silence. The guest considers the audio
+    // played as soon as it's queued, so none of it may be lost on stop.
+    std::atomic<bool> drain_requested = false;
+    // The guest didn't provide audio fast enough and the stream ran dry.
+    std::atomic<uint64_t> underruns = 0;
+    // Audio dropped because the ring was full, webrtc was too slow.
+    std::atomic<uint64_t> overruns = 0;
+    std::atomic<uint64_t> overrun_bytes = 0;
+    // Sink thread only. When the last chunk was sent to webrtc and whether
+    // the stream is known to have run dry since.
+    std::optional<std::chrono::steady_clock::time_point> last_delivery;
+    bool in_underrun = false;
   };
 
  public:
@@ -74,10 +100,19 @@ class AudioHandler : public AudioServerExecutor {
 
  private:
   [[noreturn]] void Loop();
+  // Sends the guest's playback audio to webrtc in 10ms chunks.
+  [[noreturn]] void PlaybackSinkLoop();
+  // Returns whether any audio was sent.
+  bool DeliverPlayback(uint32_t stream_id, std::vector<uint8_t>& chunk);
+  bool HasPendingPlayback();
+  void WakePlaybackSink();
 
   std::shared_ptr<webrtc_streaming::AudioSink> audio_sink_;
   std::unique_ptr<AudioServer> audio_server_;
   std::thread server_thread_;
+  std::thread playback_sink_thread_;
+  std::mutex playback_sink_mtx_;
+  std::condition_variable playback_sink_cv_;
   std::vector<StreamDesc> stream_descs_ = {};
   std::shared_ptr<webrtc_streaming::AudioSource> audio_source_;
 };
@@ -80,12 +80,14 @@ class ConnectionObserverImpl : public webrtc_streaming::ConnectionObserver {
 
   void OnTouchEvent(const std::string &device_label, int x, int y,
                     bool down) override {
+    NotifyInputEvent();
     input_events_sink_->SendTouchEvent(device_label, x, y, down);
   }
 
   void OnMultiTouchEvent(const std::string &device_label, Json::Value id,
                          Json::Value slot, Json::Value x, Json::Value y,
                          bool down, int size) {
+    NotifyInputEvent();
     std::vector<MultitouchSlot> slots(size);
     for (int i = 0; i < size; i++) {
       slots[i].id = id[i].asInt();
@@ -96,10 +98,12 @@ class ConnectionObserverImpl : public webrtc_streaming::ConnectionObserver {
   }
 
   void OnKeyboardEvent(uint16_t code, bool down) override {
+    NotifyInputEvent();
     input_events_sink_->SendKeyboardEvent(code, down);
   }
 
   void OnWheelEvent(int pixels) {
+    NotifyInputEvent();
     input_events_sink_->SendRotaryEvent(pixels);
   }
 
@@ -120,6 +124,7 @@ class ConnectionObserverImpl : public webrtc_streaming::ConnectionObserver {
   void OnControlChannelOpen(
       std::function<bool(const Json::Value)> control_message_sender) override {
     LOG(VERBOSE) << "Control Channel open";
+    control_message_sender_ = control_message_sender;
     if (camera_controller_) {
       camera_controller_->SetMessageSender(control_message_sender);
     }
@@ -284,6 +289,12 @@ class ConnectionObserverImpl : public webrtc_streaming::ConnectionObserver {
 
   void OnDisplayControlMsg(const Json::Value &msg) override {
     static constexpr const char kRefreshDisplay[] = "refresh_display";
+    static constexpr const char kGetFramePipelineStats[] =
+        "get_frame_pipeline_stats";
+    if (msg.isMember(kGetFramePipelineStats)) {
+      SendFramePipelineStats();
+      return;
+    }
     if (!msg.isMember(kRefreshDisplay)) {
       LOG(ERROR) << "Unknown display control command.";
       return;
@@ -309,6 +320,25 @@ class ConnectionObserverImpl : public webrtc_streaming::ConnectionObserver {
   }
 
  private:
+  void NotifyInputEvent() {
+    auto display_handler = weak_display_handler_.lock();
+    if (display_handler) {
+      display_handler->OnInputEvent();
+    }
+  }
+
+  void SendFramePipelineStats() {
+    auto display_handler = weak_display_handler_.lock();
+    if (!display_handler || !control_message_sender_) {
+      LOG(VERBOSE) << "Frame pipeline stats requested but unavailable";
+      return;
+    }
+    Json::Value message;
+    message["event"] = "FRAME_PIPELINE_STATS";
+    message["metadata"] = display_handler->FramePipelineStats();
+    control_message_sender_(message);
+  }
+
   void SendLastFrameAsync(std::optional<uint32_t> display_number) {
     auto display_handler = weak_display_handler_.lock();
     if (display_handler) {
@@ -342,6 +372,7 @@ class ConnectionObserverImpl : public webrtc_streaming::ConnectionObserver {
   std::shared_ptr<webrtc_streaming::GpxLocationsHandler> gpx_locations_handler_;
   std::map<std::string, SharedFD> commands_to_custom_action_servers_;
   std::weak_ptr<DisplayHandler> weak_display_handler_;
+  std::function<bool(const Json::Value)> control_message_sender_;
   CameraController *camera_controller_;
   std::shared_ptr<webrtc_streaming::SensorsHandler> sensors_handler_;
   std::shared_ptr<webrtc_streaming::LightsObserver> lights_observer_;
@@ -16,9 +16,11 @@
 
 #include "host/frontend/webrtc/cvd_video_frame_buffer.h"
 
-#include <map>
-#include <mutex>
-#include <vector>
+#include <algorithm>
+#include <cstring>
+
+#include <android-base/logging.h>
+
 #include "common/libs/utils/size_utils.h"
 
 namespace cuttlefish {
@@ -31,41 +33,112 @@ inline int AlignStride(int width) {
   return AlignToPowerOf2(width, kLogAlignment);
 }
 
-std::multimap<int, std::vector<uint8_t>> pool;
-std::mutex pool_mutex;
-std::vector<uint8_t> FromPool(int size) {
+inline std::size_t PlaneSize(int stride, int height) {
+  return AlignToPowerOf2(stride * height + kPlanePadding, kLogAlignment);
+}
+
+CvdVideoFrameBufferPool::Block AllocateBlock(std::size_t size) {
+  // size is always a multiple of the alignment, as aligned_alloc requires.
+  auto block = static_cast<std::uint8_t*>(
+      std::aligned_alloc(std::size_t{1} << kLogAlignment, size));
+  CHECK(block != nullptr) << "Failed to allocate " << size << " bytes";
+  return CvdVideoFrameBufferPool::Block(block);
+}
+
+}  // namespace
+
+CvdVideoFrameBufferPool::CvdVideoFrameBufferPool(std::size_t max_bytes)
+    : max_bytes_(max_bytes) {}
+
+CvdVideoFrameBufferPool::Block CvdVideoFrameBufferPool::Acquire(
+    std::size_t size) {
   {
-    std::lock_guard<std::mutex> lock(pool_mutex);
-    auto it = pool.find(size);
-    if (it != pool.end()) {
-      auto ret = std::move(it->second);
-      pool.erase(it);
-      return ret;
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Prefer the most recently released block, it's the likeliest to still be
+    // in cache.
+    auto it = std::find_if(
+        idle_blocks_.rbegin(), idle_blocks_.rend(),
+        [size](const IdleBlock& idle) { return idle.size == size; });
+    if (it != idle_blocks_.rend()) {
+      auto block = std::move(it->block);
+      idle_blocks_.erase(std::next(it).base());
+      bytes_held_ -= size;
+      hits_++;
+      return block;
+    }
+    misses_++;
+  }
+  return AllocateBlock(size);
+}
+
+void CvdVideoFrameBufferPool::Release(Block block, std::size_t size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (size > max_bytes_) {
+    return;
+  }
+  // Blocks of a different size belong to a previous resolution and are
+  // evicted first, then the least recently released ones.
+  auto it = idle_blocks_.begin();
+  while (bytes_held_ + size > max_bytes_ && it != idle_blocks_.end()) {
+    if (it->size != size) {
+      bytes_held_ -= it->size;
+      it = idle_blocks_.erase(it);
+    } else {
+      it++;
     }
   }
-  return std::vector<uint8_t>(size);
+  while (bytes_held_ + size > max_bytes_ && !idle_blocks_.empty()) {
+    bytes_held_ -= idle_blocks_.front().size;
+    idle_blocks_.erase(idle_blocks_.begin());
+  }
+  idle_blocks_.push_back(IdleBlock{.block = std::move(block), .size = size});
+  bytes_held_ += size;
 }
 
-void BackToPool(std::vector<uint8_t> item) {
-  std::lock_guard<std::mutex> lock(pool_mutex);
-  pool.insert({item.size(), std::move(item)});
+void CvdVideoFrameBufferPool::Trim() {
+  std::vector<IdleBlock> idle_blocks;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_blocks = std::move(idle_blocks_);
+    idle_blocks_.clear();
+    bytes_held_ = 0;
+  }
 }
 
-}  // namespace
+CvdVideoFrameBufferPool::Stats CvdVideoFrameBufferPool::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return Stats{.hits = hits_, .misses = misses_, .bytes_held = bytes_held_};
+}
 
-CvdVideoFrameBuffer::CvdVideoFrameBuffer(int width, int height)
+CvdVideoFrameBuffer::CvdVideoFrameBuffer(
+    int width, int height, std::shared_ptr<CvdVideoFrameBufferPool> pool)
     : width_(width),
       height_(height),
-      y_(FromPool(AlignStride(width) * height + kPlanePadding)),
-      u_(FromPool(AlignStride((width + 1) / 2) * ((height + 1) / 2) +
-                  kPlanePadding)),
-      v_(FromPool(AlignStride((width + 1) / 2) * ((height + 1) / 2) +
-                  kPlanePadding)) {}
+      pool_(std::move(pool)),
+      u_offset_(PlaneSize(AlignStride(width), height)),
+      v_offset_(u_offset_ +
+                PlaneSize(AlignStride((width + 1) / 2), (height + 1) / 2)),
+      size_(v_offset_ +
+            PlaneSize(AlignStride((width + 1) / 2), (height + 1) / 2)),
+      data_(pool_ ? pool_->Acquire(size_) : AllocateBlock(size_)) {}
+
+CvdVideoFrameBuffer::CvdVideoFrameBuffer(
+    const CvdVideoFrameBuffer& cvd_frame_buf)
+    : width_(cvd_frame_buf.width_),
+      height_(cvd_frame_buf.height_),
+      pool_(cvd_frame_buf.pool_),
+      u_offset_(cvd_frame_buf.u_offset_),
+      v_offset_(cvd_frame_buf.v_offset_),
+      size_(cvd_frame_buf.size_),
+      data_(pool_ ? pool_->Acquire(size_) : AllocateBlock(size_)) {
+  std::memcpy(data_.get(), cvd_frame_buf.data_.get(), size_);
+}
 
 CvdVideoFrameBuffer::~CvdVideoFrameBuffer() {
-  BackToPool(std::move(y_));
-  BackToPool(std::move(u_));
-  BackToPool(std::move(v_));
+  // Moved from buffers don't own any memory.
+  if (pool_ && data_) {
+    pool_->Release(std::move(data_), size_);
+  }
 }
 
 int CvdVideoFrameBuffer::width() const { return width_; }
@@ -79,8 +152,12 @@ int CvdVideoFrameBuffer::StrideV() const {
   return AlignStride((width_ + 1) / 2);
 }
 
-const uint8_t *CvdVideoFrameBuffer::DataY() const { return y_.data(); }
-const uint8_t *CvdVideoFrameBuffer::DataU() const { return u_.data(); }
-const uint8_t *CvdVideoFrameBuffer::DataV() const { return v_.data(); }
+const uint8_t *CvdVideoFrameBuffer::DataY() const { return data_.get(); }
+const uint8_t *CvdVideoFrameBuffer::DataU() const {
+  return data_.get() + u_offset_;
+}
+const uint8_t *CvdVideoFrameBuffer::DataV() const {
+  return data_.get() + v_offset_;
+}
 
 }  // namespace cuttlefish
@@ -16,17 +16,65 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include "host/frontend/webrtc/libdevice/video_frame_buffer.h"
 
 namespace cuttlefish {
 
+// Recycles the memory of the frame buffers of a single display. Each frame
+// is one contiguous allocation holding the Y, U and V planes. Released blocks
+// are kept for reuse as long as the pool holds less than max_bytes of them.
+class CvdVideoFrameBufferPool {
+ public:
+  struct Stats {
+    std::uint64_t hits;
+    std::uint64_t misses;
+    std::size_t bytes_held;
+  };
+
+  struct BlockDeleter {
+    void operator()(std::uint8_t* block) const { std::free(block); }
+  };
+  using Block = std::unique_ptr<std::uint8_t[], BlockDeleter>;
+
+  explicit CvdVideoFrameBufferPool(std::size_t max_bytes);
+
+  Block Acquire(std::size_t size);
+  void Release(Block block, std::size_t size);
+
+  // Frees all the blocks currently held by the pool.
+  void Trim();
+
+  Stats GetStats() const;
+
+ private:
+  struct IdleBlock {
+    Block block;
+    std::size_t size;
+  };
+
+  const std::size_t max_bytes_;
+  mutable std::mutex mutex_;
+  // Least recently released first.
+  std::vector<IdleBlock> idle_blocks_;
+  std::size_t bytes_held_ = 0;
+  std::uint64_t hits_ = 0;
+  std::uint64_t misses_ = 0;
+};
+
 class CvdVideoFrameBuffer : public webrtc_streaming::VideoFrameBuffer {
  public:
-  CvdVideoFrameBuffer(int width, int height);
+  // A null pool makes the buffer allocate and free its memory directly.
+  CvdVideoFrameBuffer(int width, int height,
+                      std::shared_ptr<CvdVideoFrameBufferPool> pool = nullptr);
   CvdVideoFrameBuffer(CvdVideoFrameBuffer&& cvd_frame_buf) = default;
-  CvdVideoFrameBuffer(const CvdVideoFrameBuffer& cvd_frame_buf) = default;
+  CvdVideoFrameBuffer(const CvdVideoFrameBuffer& cvd_frame_buf);
   CvdVideoFrameBuffer& operator=(CvdVideoFrameBuffer&& cvd_frame_buf) = delete;
   CvdVideoFrameBuffer& operator=(const CvdVideoFrameBuffer& cvd_frame_buf) =
       delete;
@@ -45,16 +93,18 @@ class CvdVideoFrameBuffer : public webrtc_streaming::VideoFrameBuffer {
   const uint8_t *DataU() const override;
   const uint8_t *DataV() const override;
 
-  uint8_t *DataY() { return y_.data(); }
-  uint8_t *DataU() { return u_.data(); }
-  uint8_t *DataV() { return v_.data(); }
+  uint8_t *DataY() { return data_.get(); }
+  uint8_t *DataU() { return data_.get() + u_offset_; }
+  uint8_t *DataV() { return data_.get() + v_offset_; }
 
  private:
   const int width_;
   const int height_;
-  std::vector<std::uint8_t> y_;
-  std::vector<std::uint8_t> u_;
-  std::vector<std::uint8_t> v_;
+  std::shared_ptr<CvdVideoFrameBufferPool> pool_;
+  std::size_t u_offset_;
+  std::size_t v_offset_;
+  std::size_t size_;
+  CvdVideoFrameBufferPool::Block data_;
 };
 
 }
@@ -16,18 +16,222 @@
 
 #include "host/frontend/webrtc/display_handler.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstddef>
+#include <cstring>
 #include <functional>
 #include <memory>
+#include <vector>
 
 #include <libyuv.h>
 
 #include "host/frontend/webrtc/libdevice/streamer.h"
 
 namespace cuttlefish {
+namespace {
+
+// Damage is tracked at the granularity of square tiles of this many pixels.
+// It must be even so tiles don't split the 2x2 pixel blocks that share chroma
+// samples in I420.
+constexpr std::uint32_t kTileSize = 64;
+static_assert(kTileSize % 2 == 0);
+
+// Upper bound of the memory kept for reuse by the frame buffer pool of each
+// display, enough for a few 4K frames.
+constexpr std::size_t kMaxPooledBytesPerDisplay = 64 * 1024 * 1024;
+
+// Log conversion statistics every this many frames of a display.
+constexpr std::uint64_t kStatsLogPeriod = 1000;
+
+// Frames of each display are sent at up to kActiveFrameRate while the user
+// interacts with the device. After kIdleTimeout without input the rate is
+// halved every second, down to kIdleFrameRate.
+constexpr std::uint32_t kActiveFrameRate = 60;
+constexpr std::uint32_t kIdleFrameRate = 15;
+constexpr auto kIdleTimeout = std::chrono::seconds(2);
+
+// An area of a frame converted by a single libyuv call.
+struct ConversionSpan {
+  std::uint32_t x;
+  std::uint32_t y;
+  std::uint32_t width;
+  std::uint32_t height;
+};
+
+// Returns a flag per tile of the frame, in row major order, telling whether
+// the tile is touched by the damage. Bytes rather than bools so that workers
+// can update different tiles concurrently.
+std::vector<std::uint8_t> DamagedTiles(std::uint32_t frame_width,
+                                       std::uint32_t frame_height,
+                                       const FrameDamage& frame_damage) {
+  const std::uint32_t tiles_x = (frame_width + kTileSize - 1) / kTileSize;
+  const std::uint32_t tiles_y = (frame_height + kTileSize - 1) / kTileSize;
+  std::vector<std::uint8_t> dirty(tiles_x * tiles_y, false);
+  for (const auto& rect : frame_damage) {
+    if (rect.width == 0 || rect.height == 0 || rect.x >= frame_width ||
+        rect.y >= frame_height) {
+      continue;
+    }
+    const std::uint32_t x1 = std::min(rect.x + rect.width, frame_width);
+    const std::uint32_t y1 = std::min(rect.y + rect.height, frame_height);
+    for (std::uint32_t ty = rect.y / kTileSize; ty <= (y1 - 1) / kTileSize;
+         ty++) {
+      for (std::uint32_t tx = rect.x / kTileSize; tx <= (x1 - 1) / kTileSize;
+           tx++) {
+        dirty[ty * tiles_x + tx] = true;
+      }
+    }
+  }
+  return dirty;
+}
+
+// Clears the flags of the damaged tiles whose pixels are the same as in the
+// previous frame, and copies the rows that changed into previous_pixels, which
+// holds the previous frame tightly packed. Guests often damage more than they
+// actually change, or commit identical frames. Rows of tiles are compared
+// concurrently by the worker pool.
+void DiscardUnchangedTiles(const std::uint8_t* frame_pixels,
+                           std::uint32_t frame_stride_bytes,
+                           std::uint32_t frame_width,
+                           std::uint32_t frame_height,
+                           std::vector<std::uint8_t>& dirty,
+                           std::uint8_t* previous_pixels,
+                           WorkerPool& worker_pool) {
+  const std::uint32_t bytes_per_pixel = ScreenConnectorInfo::BytesPerPixel();
+  const std::uint32_t previous_stride_bytes = frame_width * bytes_per_pixel;
+  const std::uint32_t tiles_x = (frame_width + kTileSize - 1) / kTileSize;
+  const std::uint32_t tiles_y = (frame_height + kTileSize - 1) / kTileSize;
+
+  auto compare_tile_rows = [=, &dirty](std::uint32_t ty_begin,
+                                       std::uint32_t ty_end) {
+    for (std::uint32_t ty = ty_begin; ty < ty_end; ty++) {
+      const std::uint32_t y0 = ty * kTileSize;
+      const std::uint32_t y1 = std::min(y0 + kTileSize, frame_height);
+      for (std::uint32_t tx = 0; tx < tiles_x; tx++) {
+        if (!dirty[ty * tiles_x + tx]) {
+          continue;
+        }
+        const std::uint32_t x0 = tx * kTileSize;
+        const std::size_t row_bytes =
+            (std::min(x0 + kTileSize, frame_width) - x0) * bytes_per_pixel;
+        bool changed = false;
+        for (std::uint32_t y = y0; y < y1; y++) {
+          const std::uint8_t* src =
+              frame_pixels + y * frame_stride_bytes + x0 * bytes_per_pixel;
+          std::uint8_t* previous = previous_pixels +
+                                   y * previous_stride_bytes +
+                                   x0 * bytes_per_pixel;
+          if (memcmp(src, previous, row_bytes) != 0) {
+            memcpy(previous, src, row_bytes);
+            changed = true;
+          }
+        }
+        dirty[ty * tiles_x + tx] = changed;
+      }
+    }
+  };
+
+  const std::uint32_t stripe_count =
+      std::min<std::uint32_t>(worker_pool.Concurrency(), tiles_y);
+  std::vector<std::function<void()>> stripes;
+  for (std::uint32_t i = 0; i < stripe_count; i++) {
+    stripes.emplace_back([=]() {
+      compare_tile_rows(tiles_y * i / stripe_count,
+                        tiles_y * (i + 1) / stripe_count);
+    });
+  }
+  worker_pool.Run(stripes);
+}
+
+// Merges horizontally adjacent dirty tiles into spans, in row major order.
+std::vector<ConversionSpan> DirtySpans(std::uint32_t frame_width,
+                                       std::uint32_t frame_height,
+                                       const std::vector<std::uint8_t>& dirty) {
+  const std::uint32_t tiles_x = (frame_width + kTileSize - 1) / kTileSize;
+  const std::uint32_t tiles_y = (frame_height + kTileSize - 1) / kTileSize;
+  std::vector<ConversionSpan> spans;
+  for (std::uint32_t ty = 0; ty < tiles_y; ty++) {
+    const std::uint32_t y = ty * kTileSize;
+    const std::uint32_t h = std::min(kTileSize, frame_height - y);
+    std::uint32_t tx = 0;
+    while (tx < tiles_x) {
+      if (!dirty[ty * tiles_x + tx]) {
+        tx++;
+        continue;
+      }
+      const std::uint32_t run_start = tx;
+      while (tx < tiles_x && dirty[ty * tiles_x + tx]) {
+        tx++;
+      }
+      const std::uint32_t x = run_start * kTileSize;
+      const std::uint32_t w = std::min(tx * kTileSize, frame_width) - x;
+      spans.push_back(ConversionSpan{.x = x, .y = y, .width = w, .height = h});
+    }
+  }
+  return spans;
+}
+
+void ConvertSpan(const std::uint8_t* frame_pixels,
+                 std::uint32_t frame_stride_bytes, const ConversionSpan& span,
+                 CvdVideoFrameBuffer& dst) {
+  const auto x = span.x;
+  const auto y = span.y;
+  libyuv::ABGRToI420(
+      frame_pixels + y * frame_stride_bytes +
+          x * ScreenConnectorInfo::BytesPerPixel(),
+      frame_stride_bytes, dst.DataY() + y * dst.StrideY() + x, dst.StrideY(),
+      dst.DataU() + (y / 2) * dst.StrideU() + x / 2, dst.StrideU(),
+      dst.DataV() + (y / 2) * dst.StrideV() + x / 2, dst.StrideV(),
+      span.width, span.height);
+}
+
+// Converts the spans of the frame into dst. Spans don't overlap, so they are
+// split in stripes of roughly the same number of pixels that are converted
+// concurrently by the worker pool. Returns the number of converted pixels.
+std::uint64_t ConvertSpans(const std::uint8_t* frame_pixels,
+                           std::uint32_t frame_stride_bytes,
+                           const std::vector<ConversionSpan>& spans,
+                           CvdVideoFrameBuffer& dst, WorkerPool& worker_pool) {
+  std::uint64_t converted_pixels = 0;
+  for (const auto& span : spans) {
+    converted_pixels += std::uint64_t{span.width} * span.height;
+  }
+
+  const std::uint64_t stripe_count =
+      std::min<std::uint64_t>(worker_pool.Concurrency(), spans.size());
+  std::vector<std::function<void()>> stripes;
+  auto stripe_begin = spans.begin();
+  std::uint64_t cumulative_pixels = 0;
+  for (auto it = spans.begin(); it != spans.end(); it++) {
+    cumulative_pixels += std::uint64_t{it->width} * it->height;
+    const bool is_last = std::next(it) == spans.end();
+    if (is_last || cumulative_pixels * stripe_count >=
+                       converted_pixels * (stripes.size() + 1)) {
+      stripes.emplace_back([frame_pixels, frame_stride_bytes, &dst,
+                            begin = stripe_begin, end = std::next(it)]() {
+        for (auto span = begin; span != end; span++) {
+          ConvertSpan(frame_pixels, frame_stride_bytes, *span, dst);
+        }
+      });
+      stripe_begin = std::next(it);
+    }
+  }
+  worker_pool.Run(stripes);
+  return converted_pixels;
+}
+
+}  // namespace
+
 DisplayHandler::DisplayHandler(webrtc_streaming::Streamer& streamer,
-                               ScreenConnector& screen_connector)
-    : streamer_(streamer), screen_connector_(screen_connector) {
+                               ScreenConnector& screen_connector,
+                               std::size_t conversion_threads)
+    : streamer_(streamer),
+      screen_connector_(screen_connector),
+      conversion_pool_(std::max<std::size_t>(conversion_threads, 1)),
+      last_input_time_(
+          std::chrono::steady_clock::now().time_since_epoch().count()) {
+  pacing_thread_ = std::thread([this]() { PacingLoop(); });
   screen_connector_.SetCallback(std::move(GetScreenConnectorCallback()));
   screen_connector_.SetDisplayEventCallback([this](const DisplayEvent& event) {
     std::visit(
@@ -57,6 +261,30 @@ DisplayHandler::DisplayHandler(webrtc_streaming::Streamer& streamer,
                 "display_" + std::to_string(e.display_number);
             streamer_.RemoveDisplay(display_id);
             display_sinks_.erase(display_number);
+            {
+              std::lock_guard<std::mutex> lock(pacing_mutex_);
+              display_pacing_.erase(display_number);
+            }
+
+            std::lock_guard<std::mutex> lock(frame_cache_mutex_);
+            auto cache_it = display_frame_caches_.find(display_number);
+            if (cache_it != display_frame_caches_.end()) {
+              auto& cache = cache_it->second;
+              LOG(INFO) << "Display:" << display_number << " converted "
+                        << cache.converted_pixels << " pixels, skipped "
+                        << cache.skipped_pixels << " unchanged pixels over "
+                        << cache.frames << " frames, "
+                        << cache.suppressed_frames
+                        << " of them identical to the previous one";
+              const auto pool_stats = cache.pool->GetStats();
+              LOG(INFO) << "Display:" << display_number << " buffer pool hits "
+                        << pool_stats.hits << ", misses " << pool_stats.misses
+                        << ", " << pool_stats.bytes_held << " bytes held";
+              // Buffers still referenced by the encoder keep the pool alive,
+              // but it doesn't need to hang on to the idle ones anymore.
+              cache.pool->Trim();
+              display_frame_caches_.erase(cache_it);
+            }
           } else {
             static_assert("Unhandled display event.");
           }
@@ -65,30 +293,117 @@ DisplayHandler::DisplayHandler(webrtc_streaming::Streamer& streamer,
   });
 }
 
+DisplayHandler::~DisplayHandler() {
+  {
+    std::lock_guard<std::mutex> lock(pacing_mutex_);
+    pacing_stopped_ = true;
+  }
+  pacing_cv_.notify_all();
+  pacing_thread_.join();
+}
+
 DisplayHandler::GenerateProcessedFrameCallback DisplayHandler::GetScreenConnectorCallback() {
     // only to tell the producer how to create a ProcessedFrame to cache into the queue
     DisplayHandler::GenerateProcessedFrameCallback callback =
-        [](std::uint32_t display_number, std::uint32_t frame_width,
-           std::uint32_t frame_height, std::uint32_t frame_stride_bytes,
-           std::uint8_t* frame_pixels,
-           WebRtcScProcessedFrame& processed_frame) {
+        [this](std::uint32_t display_number, std::uint32_t frame_width,
+               std::uint32_t frame_height, std::uint32_t frame_stride_bytes,
+               std::uint8_t* frame_pixels, const FrameDamage& frame_damage,
+               WebRtcScProcessedFrame& processed_frame) {
+          // This runs synchronously from the guest's commit.
+          processed_frame.commit_time_ = std::chrono::steady_clock::now();
           processed_frame.display_number_ = display_number;
           processed_frame.buf_ =
-              std::make_unique<CvdVideoFrameBuffer>(frame_width, frame_height);
-          libyuv::ABGRToI420(
-              frame_pixels, frame_stride_bytes, processed_frame.buf_->DataY(),
-              processed_frame.buf_->StrideY(), processed_frame.buf_->DataU(),
-              processed_frame.buf_->StrideU(), processed_frame.buf_->DataV(),
-              processed_frame.buf_->StrideV(), frame_width, frame_height);
+              ConvertFrame(display_number, frame_width, frame_height,
+                           frame_stride_bytes, frame_pixels, frame_damage);
           processed_frame.is_success_ = true;
+          processed_frame.is_unchanged_ = !processed_frame.buf_;
+          convert_latency_.Record(std::chrono::steady_clock::now() -
+                                  processed_frame.commit_time_);
         };
     return callback;
 }
 
+std::unique_ptr<CvdVideoFrameBuffer> DisplayHandler::ConvertFrame(
+    std::uint32_t display_number, std::uint32_t frame_width,
+    std::uint32_t frame_height, std::uint32_t frame_stride_bytes,
+    const std::uint8_t* frame_pixels, const FrameDamage& frame_damage) {
+  std::lock_guard<std::mutex> lock(frame_cache_mutex_);
+  auto& cache = display_frame_caches_[display_number];
+  if (!cache.pool) {
+    cache.pool =
+        std::make_shared<CvdVideoFrameBufferPool>(kMaxPooledBytesPerDisplay);
+  }
+  const std::uint64_t frame_pixel_count =
+      std::uint64_t{frame_width} * frame_height;
+
+  FrameDamage damage = frame_damage;
+  const bool is_new_frame_size =
+      !cache.buffer || cache.buffer->width() != static_cast<int>(frame_width) ||
+      cache.buffer->height() != static_cast<int>(frame_height);
+  if (is_new_frame_size) {
+    // The damage is relative to a frame that isn't cached, convert everything.
+    cache.buffer = std::make_unique<CvdVideoFrameBuffer>(
+        frame_width, frame_height, cache.pool);
+    const std::uint32_t row_bytes =
+        frame_width * ScreenConnectorInfo::BytesPerPixel();
+    cache.pixels.resize(std::size_t{row_bytes} * frame_height);
+    libyuv::CopyPlane(frame_pixels, frame_stride_bytes, cache.pixels.data(),
+                      row_bytes, row_bytes, frame_height);
+    damage = {FrameDamageRect{
+        .x = 0, .y = 0, .width = frame_width, .height = frame_height}};
+  }
+  auto dirty = DamagedTiles(frame_width, frame_height, damage);
+  if (!is_new_frame_size) {
+    DiscardUnchangedTiles(frame_pixels, frame_stride_bytes, frame_width,
+                          frame_height, dirty, cache.pixels.data(),
+                          conversion_pool_);
+  }
+  const auto spans = DirtySpans(frame_width, frame_height, dirty);
+  const std::uint64_t converted_pixels = ConvertSpans(
+      frame_pixels, frame_stride_bytes, spans, *cache.buffer, conversion_pool_);
+
+  cache.frames++;
+  cache.converted_pixels += converted_pixels;
+  cache.skipped_pixels += frame_pixel_count - converted_pixels;
+  if (cache.frames % kStatsLogPeriod == 0) {
+    LOG(VERBOSE) << "Display:" << display_number << " converted "
+                 << cache.converted_pixels << " pixels, skipped "
+                 << cache.skipped_pixels << " unchanged pixels over "
+                 << cache.frames << " frames, " << cache.suppressed_frames
+                 << " of them identical to the previous one";
+  }
+  if (spans.empty()) {
+    // Nothing changed, encoding the frame again would be wasted work.
+    cache.suppressed_frames++;
+    suppressed_frames_++;
+    return nullptr;
+  }
+
+  // The encoder may still be reading previously sent buffers, so the cached
+  // frame is never handed out directly.
+  auto frame = std::make_unique<CvdVideoFrameBuffer>(frame_width,
+                                                     frame_height, cache.pool);
+  libyuv::I420Copy(cache.buffer->DataY(), cache.buffer->StrideY(),
+                   cache.buffer->DataU(), cache.buffer->StrideU(),
+                   cache.buffer->DataV(), cache.buffer->StrideV(),
+                   frame->DataY(), frame->StrideY(), frame->DataU(),
+                   frame->StrideU(), frame->DataV(), frame->StrideV(),
+                   frame_width, frame_height);
+  return frame;
+}
+
 [[noreturn]] void DisplayHandler::Loop() {
-  for (;;) {
+  for (std::uint64_t frame_count = 1;; frame_count++) {
     auto processed_frame = screen_connector_.OnNextFrame();
+    const auto pop_time = std::chrono::steady_clock::now();
+    if (frame_count % kStatsLogPeriod == 0) {
+      LogFrameQueueStats();
+    }
 
+    if (processed_frame.is_unchanged_) {
+      // Identical to the last frame of the display, which was already sent.
+      continue;
+    }
     std::shared_ptr<CvdVideoFrameBuffer> buffer =
         std::move(processed_frame.buf_);
 
@@ -98,10 +413,149 @@ DisplayHandler::GenerateProcessedFrameCallback DisplayHandler::GetScreenConnecto
       display_last_buffers_[display_number] =
           std::static_pointer_cast<webrtc_streaming::VideoFrameBuffer>(buffer);
     }
-    if (processed_frame.is_success_) {
+    if (processed_frame.is_success_ &&
+        PaceFrame(display_number, processed_frame.commit_time_)) {
       SendLastFrame(display_number);
+      const auto sink_time = std::chrono::steady_clock::now();
+      dispatch_latency_.Record(sink_time - pop_time);
+      commit_to_sink_latency_.Record(sink_time - processed_frame.commit_time_);
+    }
+  }
+}
+
+void DisplayHandler::OnInputEvent() {
+  const auto now = std::chrono::steady_clock::now();
+  const auto previous_input_time = std::chrono::steady_clock::time_point(
+      std::chrono::steady_clock::duration(
+          last_input_time_.exchange(now.time_since_epoch().count())));
+  if (now - previous_input_time > kIdleTimeout) {
+    // Frames waiting for their turn at the idle rate may be due now.
+    pacing_cv_.notify_all();
+  }
+}
+
+std::chrono::steady_clock::duration DisplayHandler::FrameInterval(
+    std::chrono::steady_clock::time_point now) const {
+  const auto last_input_time = std::chrono::steady_clock::time_point(
+      std::chrono::steady_clock::duration(last_input_time_.load()));
+  std::uint32_t frame_rate = kActiveFrameRate;
+  if (now - last_input_time > kIdleTimeout) {
+    const auto idle_seconds = std::chrono::duration_cast<std::chrono::seconds>(
+                                  now - last_input_time - kIdleTimeout)
+                                  .count();
+    frame_rate = std::max(
+        kActiveFrameRate >> std::min<std::int64_t>(idle_seconds + 1, 31),
+        kIdleFrameRate);
+  }
+  return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+             std::chrono::seconds(1)) /
+         frame_rate;
+}
+
+bool DisplayHandler::PaceFrame(
+    std::uint32_t display_number,
+    std::chrono::steady_clock::time_point commit_time) {
+  const auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(pacing_mutex_);
+  auto& pacing = display_pacing_[display_number];
+  if (now - pacing.last_sent >= FrameInterval(now)) {
+    pacing.pending = false;
+    pacing.last_sent = now;
+    return true;
+  }
+  if (pacing.pending) {
+    // Only the newest frame is kept in display_last_buffers_.
+    coalesced_frames_++;
+  }
+  pacing.pending = true;
+  pacing.pending_commit_time = commit_time;
+  pacing_cv_.notify_all();
+  return false;
+}
+
+void DisplayHandler::PacingLoop() {
+  std::unique_lock<std::mutex> lock(pacing_mutex_);
+  while (!pacing_stopped_) {
+    const auto now = std::chrono::steady_clock::now();
+    const auto interval = FrameInterval(now);
+    std::optional<std::chrono::steady_clock::time_point> next_due;
+    std::vector<std::pair<std::uint32_t, std::chrono::steady_clock::time_point>>
+        due_frames;
+    for (auto& [display_number, pacing] : display_pacing_) {
+      if (!pacing.pending) {
+        continue;
+      }
+      const auto due = pacing.last_sent + interval;
+      if (due <= now) {
+        pacing.pending = false;
+        pacing.last_sent = now;
+        due_frames.emplace_back(display_number, pacing.pending_commit_time);
+      } else if (!next_due || due < *next_due) {
+        next_due = due;
+      }
     }
+    if (!due_frames.empty()) {
+      lock.unlock();
+      for (const auto& [display_number, commit_time] : due_frames) {
+        SendLastFrame(display_number);
+        commit_to_sink_latency_.Record(std::chrono::steady_clock::now() -
+                                       commit_time);
+      }
+      lock.lock();
+    } else if (next_due) {
+      pacing_cv_.wait_until(lock, *next_due);
+    } else {
+      pacing_cv_.wait(lock);
+    }
+  }
+}
+
+Json::Value DisplayHandler::FramePipelineStats() const {
+  auto histogram_json = [](const LatencyHistogram& histogram) {
+    Json::Value json(Json::objectValue);
+    json["count"] = static_cast<Json::UInt64>(histogram.Count());
+    json["p50_us"] =
+        static_cast<Json::Int64>(histogram.Percentile(50).count());
+    json["p99_us"] =
+        static_cast<Json::Int64>(histogram.Percentile(99).count());
+    return json;
+  };
+  const auto queue_stats = screen_connector_.FrameQueueStats();
+  Json::UInt64 overwritten_frames = 0;
+  for (const auto& [display_number, count] : queue_stats.overwritten_frames) {
+    overwritten_frames += count;
+  }
+
+  Json::Value stats(Json::objectValue);
+  stats["convert"] = histogram_json(convert_latency_);
+  stats["queue"] = histogram_json(screen_connector_.FrameQueueWaitHistogram());
+  stats["dispatch"] = histogram_json(dispatch_latency_);
+  stats["encode"] = histogram_json(streamer_.EncodeLatencyHistogram());
+  stats["commit_to_sink"] = histogram_json(commit_to_sink_latency_);
+  stats["queue_dropped_frames"] =
+      static_cast<Json::UInt64>(queue_stats.dropped_frames);
+  stats["queue_overwritten_frames"] = overwritten_frames;
+  stats["suppressed_frames"] =
+      static_cast<Json::UInt64>(suppressed_frames_.load());
+  stats["coalesced_frames"] =
+      static_cast<Json::UInt64>(coalesced_frames_.load());
+  stats["target_frame_rate"] = static_cast<Json::UInt>(
+      std::chrono::seconds(1) / FrameInterval(std::chrono::steady_clock::now()));
+  return stats;
+}
+
+void DisplayHandler::LogFrameQueueStats() {
+  const auto stats = screen_connector_.FrameQueueStats();
+  const auto& wait_histogram = screen_connector_.FrameQueueWaitHistogram();
+  std::uint64_t overwritten_frames = 0;
+  for (const auto& [display_number, count] : stats.overwritten_frames) {
+    overwritten_frames += count;
   }
+  LOG(VERBOSE) << "Frame queue: pushed " << stats.pushed_frames << ", popped "
+               << stats.popped_frames << ", dropped " << stats.dropped_frames
+               << ", overwritten " << overwritten_frames << ", wait p50 "
+               << wait_histogram.Percentile(50).count() << "us, p99 "
+               << wait_histogram.Percentile(99).count() << "us";
 }
 
 void DisplayHandler::SendLastFrame(std::optional<uint32_t> display_number) {
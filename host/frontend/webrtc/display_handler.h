@@ -16,11 +16,22 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <thread>
 #include <vector>
 
+#include <json/json.h>
+
+#include "common/libs/concurrency/worker_pool.h"
+#include "common/libs/utils/latency_histogram.h"
 #include "host/frontend/webrtc/cvd_video_frame_buffer.h"
 #include "host/frontend/webrtc/libdevice/video_sink.h"
 #include "host/libs/screen_connector/screen_connector.h"
@@ -38,6 +49,8 @@ namespace cuttlefish {
 struct WebRtcScProcessedFrame : public ScreenConnectorFrameInfo {
   // must support move semantic
   std::unique_ptr<CvdVideoFrameBuffer> buf_;
+  // when the guest committed the frame
+  std::chrono::steady_clock::time_point commit_time_;
   std::unique_ptr<WebRtcScProcessedFrame> Clone() {
     // copy internal buffer, not move
     CvdVideoFrameBuffer* new_buffer = new CvdVideoFrameBuffer(*(buf_.get()));
@@ -58,17 +71,62 @@ class DisplayHandler {
   using GenerateProcessedFrameCallback = ScreenConnector::GenerateProcessedFrameCallback;
   using WebRtcScProcessedFrame = cuttlefish::WebRtcScProcessedFrame;
 
+  // Frames are converted to I420 by up to conversion_threads threads,
+  // including the one delivering them.
   DisplayHandler(webrtc_streaming::Streamer& streamer,
-                 ScreenConnector& screen_connector);
-  ~DisplayHandler() = default;
+                 ScreenConnector& screen_connector,
+                 std::size_t conversion_threads = 1);
+  ~DisplayHandler();
 
   [[noreturn]] void Loop();
 
   // If std::nullopt, send last frame for all displays.
   void SendLastFrame(std::optional<uint32_t> display_number);
 
+  // Frames are sent at a lower rate while the user is idle, an input event
+  // brings the displays back to the full frame rate.
+  void OnInputEvent();
+
+  // Latency percentiles of each stage frames go through between the guest
+  // committing them and the encoder producing their output.
+  Json::Value FramePipelineStats() const;
+
  private:
+  // The I420 version of the last Android frame of a display. Only the damaged
+  // parts of new frames are converted into it.
+  struct DisplayFrameCache {
+    std::shared_ptr<CvdVideoFrameBufferPool> pool;
+    std::unique_ptr<CvdVideoFrameBuffer> buffer;
+    // The last Android frame, to tell which damaged tiles actually changed.
+    std::vector<std::uint8_t> pixels;
+    std::uint64_t frames = 0;
+    std::uint64_t converted_pixels = 0;
+    std::uint64_t skipped_pixels = 0;
+    std::uint64_t suppressed_frames = 0;
+  };
+
+  // When frames of a display were last sent and whether one is waiting for
+  // its turn to be sent.
+  struct DisplayPacing {
+    std::chrono::steady_clock::time_point last_sent;
+    bool pending = false;
+    std::chrono::steady_clock::time_point pending_commit_time;
+  };
+
   GenerateProcessedFrameCallback GetScreenConnectorCallback();
+  void LogFrameQueueStats();
+  std::chrono::steady_clock::duration FrameInterval(
+      std::chrono::steady_clock::time_point now) const;
+  // Returns whether a new frame of the display can be sent right away,
+  // otherwise the pacing thread sends it when it's the display's turn.
+  bool PaceFrame(std::uint32_t display_number,
+                 std::chrono::steady_clock::time_point commit_time);
+  void PacingLoop();
+  std::unique_ptr<CvdVideoFrameBuffer> ConvertFrame(
+      std::uint32_t display_number, std::uint32_t frame_width,
+      std::uint32_t frame_height, std::uint32_t frame_stride_bytes,
+      const std::uint8_t* frame_pixels, const FrameDamage& frame_damage);
+
   std::map<uint32_t, std::shared_ptr<webrtc_streaming::VideoSink>>
       display_sinks_;
   webrtc_streaming::Streamer& streamer_;
@@ -77,5 +135,24 @@ class DisplayHandler {
       display_last_buffers_;
   std::mutex last_buffer_mutex_;
   std::mutex next_frame_mutex_;
+  std::map<uint32_t, DisplayFrameCache> display_frame_caches_;
+  std::mutex frame_cache_mutex_;
+  WorkerPool conversion_pool_;
+  // from the guest commit to the end of the I420 conversion
+  LatencyHistogram convert_latency_;
+  // from leaving the frame queue to being handed to the video sinks
+  LatencyHistogram dispatch_latency_;
+  // from the guest commit to being handed to the video sinks
+  LatencyHistogram commit_to_sink_latency_;
+  // frames identical to the previous one of their display, never sent
+  std::atomic<std::uint64_t> suppressed_frames_ = 0;
+  // frames replaced by a newer one while waiting for their turn to be sent
+  std::atomic<std::uint64_t> coalesced_frames_ = 0;
+  std::atomic<std::chrono::steady_clock::rep> last_input_time_;
+  std::map<uint32_t, DisplayPacing> display_pacing_;
+  std::mutex pacing_mutex_;
+  std::condition_variable pacing_cv_;
+  bool pacing_stopped_ = false;
+  std::thread pacing_thread_;
 };
 }  // namespace cuttlefish
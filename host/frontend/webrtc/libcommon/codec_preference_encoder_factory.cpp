@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/frontend/webrtc/libcommon/codec_preference_encoder_factory.h"
+
+#include <chrono>
+#include <map>
+#include <mutex>
+
+#include <absl/strings/match.h>
+#include <android-base/logging.h>
+
+namespace cuttlefish {
+namespace webrtc_streaming {
+namespace {
+
+// Frames that never produce an encoded image (i.e dropped by the encoder)
+// are forgotten after this many newer frames.
+constexpr size_t kMaxPendingFrames = 32;
+
+// Forwards everything to the inner encoder, recording how long it takes for
+// each frame to come out encoded.
+class LatencyRecordingEncoder : public webrtc::VideoEncoder,
+                                public webrtc::EncodedImageCallback {
+ public:
+  LatencyRecordingEncoder(std::unique_ptr<webrtc::VideoEncoder> inner,
+                          std::shared_ptr<LatencyHistogram> encode_latency)
+      : inner_(std::move(inner)), encode_latency_(std::move(encode_latency)) {}
+
+  // webrtc::VideoEncoder
+  void SetFecControllerOverride(
+      webrtc::FecControllerOverride* fec_controller_override) override {
+    inner_->SetFecControllerOverride(fec_controller_override);
+  }
+  int InitEncode(const webrtc::VideoCodec* codec_settings,
+                 const webrtc::VideoEncoder::Settings& settings) override {
+    return inner_->InitEncode(codec_settings, settings);
+  }
+  int32_t RegisterEncodeCompleteCallback(
+      webrtc::EncodedImageCallback* callback) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      callback_ = callback;
+    }
+    return inner_->RegisterEncodeCompleteCallback(callback ? this : nullptr);
+  }
+  int32_t Release() override { return inner_->Release(); }
+  int32_t Encode(
+      const webrtc::VideoFrame& frame,
+      const std::vector<webrtc::VideoFrameType>* frame_types) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_frames_[frame.timestamp()] = std::chrono::steady_clock::now();
+      if (pending_frames_.size() > kMaxPendingFrames) {
+        pending_frames_.erase(pending_frames_.begin());
+      }
+    }
+    return inner_->Encode(frame, frame_types);
+  }
+  void SetRates(const RateControlParameters& parameters) override {
+    inner_->SetRates(parameters);
+  }
+  void OnPacketLossRateUpdate(float packet_loss_rate) override {
+    inner_->OnPacketLossRateUpdate(packet_loss_rate);
+  }
+  void OnRttUpdate(int64_t rtt_ms) override { inner_->OnRttUpdate(rtt_ms); }
+  void OnLossNotification(const LossNotification& loss_notification) override {
+    inner_->OnLossNotification(loss_notification);
+  }
+  EncoderInfo GetEncoderInfo() const override {
+    return inner_->GetEncoderInfo();
+  }
+
+  // webrtc::EncodedImageCallback
+  Result OnEncodedImage(
+      const webrtc::EncodedImage& encoded_image,
+      const webrtc::CodecSpecificInfo* codec_specific_info) override {
+    webrtc::EncodedImageCallback* callback;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      // Only the first image of a frame is counted when there are several
+      // spatial layers.
+      auto it = pending_frames_.find(encoded_image.Timestamp());
+      if (it != pending_frames_.end()) {
+        encode_latency_->Record(std::chrono::steady_clock::now() - it->second);
+        pending_frames_.erase(it);
+      }
+      callback = callback_;
+    }
+    return callback->OnEncodedImage(encoded_image, codec_specific_info);
+  }
+  void OnDroppedFrame(DropReason reason) override {
+    webrtc::EncodedImageCallback* callback;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      callback = callback_;
+    }
+    callback->OnDroppedFrame(reason);
+  }
+
+ private:
+  std::unique_ptr<webrtc::VideoEncoder> inner_;
+  std::shared_ptr<LatencyHistogram> encode_latency_;
+  std::mutex mutex_;
+  webrtc::EncodedImageCallback* callback_ = nullptr;
+  // When each frame still being encoded was received, by RTP timestamp.
+  std::map<uint32_t, std::chrono::steady_clock::time_point> pending_frames_;
+};
+
+}  // namespace
+
+CodecPreferenceEncoderFactory::CodecPreferenceEncoderFactory(
+    std::unique_ptr<webrtc::VideoEncoderFactory> inner,
+    const std::vector<std::string>& codecs,
+    std::shared_ptr<LatencyHistogram> encode_latency)
+    : inner_(std::move(inner)), encode_latency_(std::move(encode_latency)) {
+  auto inner_formats = inner_->GetSupportedFormats();
+  auto append_formats = [this, &inner_formats](const std::string& codec) {
+    bool found = false;
+    // A codec may come in several formats, e.g. the H264 profiles.
+    for (const auto& format : inner_formats) {
+      if (absl::EqualsIgnoreCase(format.name, codec)) {
+        formats_.push_back(format);
+        found = true;
+      }
+    }
+    return found;
+  };
+  for (const auto& codec : codecs) {
+    if (!append_formats(codec)) {
+      LOG(WARNING) << "Video codec " << codec
+                   << " is not supported by the encoder, skipping it";
+    }
+  }
+  if (formats_.empty()) {
+    LOG(WARNING) << "None of the requested video codecs is supported, "
+                 << "falling back to VP8";
+    append_formats("VP8");
+  }
+}
+
+std::vector<webrtc::SdpVideoFormat>
+CodecPreferenceEncoderFactory::GetSupportedFormats() const {
+  // The order of the formats here determines their order in the SDP offer,
+  // which is the order the client prefers them in.
+  return formats_;
+}
+
+std::unique_ptr<webrtc::VideoEncoder>
+CodecPreferenceEncoderFactory::CreateVideoEncoder(
+    const webrtc::SdpVideoFormat& format) {
+  auto encoder = inner_->CreateVideoEncoder(format);
+  if (!encoder || !encode_latency_) {
+    return encoder;
+  }
+  return std::make_unique<LatencyRecordingEncoder>(std::move(encoder),
+                                                   encode_latency_);
+}
+
+std::unique_ptr<webrtc::VideoEncoderFactory::EncoderSelectorInterface>
+CodecPreferenceEncoderFactory::GetEncoderSelector() const {
+  return inner_->GetEncoderSelector();
+}
+
+}  // namespace webrtc_streaming
+}  // namespace cuttlefish
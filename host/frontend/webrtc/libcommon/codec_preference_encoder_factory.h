@@ -16,15 +16,30 @@
 
 #pragma once
 
+#include <memory>
+#include <string>
+#include <vector>
+
 #include <api/video_codecs/video_encoder_factory.h>
 #include <api/video_codecs/video_encoder.h>
 
+#include "common/libs/utils/latency_histogram.h"
+
 namespace cuttlefish {
 namespace webrtc_streaming {
 
-class VP8OnlyEncoderFactory : public webrtc::VideoEncoderFactory {
+// Restricts the formats offered by another encoder factory to the given
+// codecs, listed in the order of preference. Codecs are named as in SDP ("VP8",
+// "VP9", "H264", "AV1"), ignoring case. Codecs the inner factory doesn't
+// support are skipped, if none is left VP8 is used.
+class CodecPreferenceEncoderFactory : public webrtc::VideoEncoderFactory {
  public:
-  VP8OnlyEncoderFactory(std::unique_ptr<webrtc::VideoEncoderFactory> inner);
+  // If encode_latency is given, the time between a frame being handed to an
+  // encoder and the encoder producing its output is recorded in it.
+  CodecPreferenceEncoderFactory(
+      std::unique_ptr<webrtc::VideoEncoderFactory> inner,
+      const std::vector<std::string>& codecs,
+      std::shared_ptr<LatencyHistogram> encode_latency = nullptr);
 
   std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override;
 
@@ -35,6 +50,8 @@ class VP8OnlyEncoderFactory : public webrtc::VideoEncoderFactory {
 
  private:
   std::unique_ptr<webrtc::VideoEncoderFactory> inner_;
+  std::vector<webrtc::SdpVideoFormat> formats_;
+  std::shared_ptr<LatencyHistogram> encode_latency_;
 };
 
 }  // namespace webrtc_streaming
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/frontend/webrtc/libcommon/codec_preference_encoder_factory.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+namespace cuttlefish {
+namespace webrtc_streaming {
+namespace {
+
+using ::testing::ElementsAre;
+
+const webrtc::SdpVideoFormat kVp8("VP8");
+const webrtc::SdpVideoFormat kVp9("VP9");
+const webrtc::SdpVideoFormat kH264Baseline("H264",
+                                           {{"profile-level-id", "42e01f"}});
+const webrtc::SdpVideoFormat kH264High("H264",
+                                       {{"profile-level-id", "640c1f"}});
+
+// Supports VP8, VP9 and two H264 profiles, but creates no encoders. Remembers
+// the formats encoders were requested for.
+class FakeEncoderFactory : public webrtc::VideoEncoderFactory {
+ public:
+  FakeEncoderFactory(std::vector<webrtc::SdpVideoFormat>* requested)
+      : requested_(requested) {}
+
+  std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override {
+    return {kVp8, kVp9, kH264Baseline, kH264High};
+  }
+
+  std::unique_ptr<webrtc::VideoEncoder> CreateVideoEncoder(
+      const webrtc::SdpVideoFormat& format) override {
+    requested_->push_back(format);
+    return nullptr;
+  }
+
+ private:
+  std::vector<webrtc::SdpVideoFormat>* requested_;
+};
+
+class CodecPreferenceEncoderFactoryTest : public ::testing::Test {
+ protected:
+  CodecPreferenceEncoderFactory Factory(
+      const std::vector<std::string>& codecs) {
+    return CodecPreferenceEncoderFactory(
+        std::make_unique<FakeEncoderFactory>(&requested_), codecs);
+  }
+
+  std::vector<webrtc::SdpVideoFormat> requested_;
+};
+
+TEST_F(CodecPreferenceEncoderFactoryTest, OffersCodecsInPreferenceOrder) {
+  auto factory = Factory({"vp9", "h264", "vp8"});
+
+  EXPECT_THAT(factory.GetSupportedFormats(),
+              ElementsAre(kVp9, kH264Baseline, kH264High, kVp8));
+}
+
+TEST_F(CodecPreferenceEncoderFactoryTest, OffersOnlyRequestedCodecs) {
+  auto factory = Factory({"vp9"});
+
+  EXPECT_THAT(factory.GetSupportedFormats(), ElementsAre(kVp9));
+}
+
+TEST_F(CodecPreferenceEncoderFactoryTest, IgnoresCase) {
+  auto factory = Factory({"h264", "Vp8"});
+
+  EXPECT_THAT(factory.GetSupportedFormats(),
+              ElementsAre(kH264Baseline, kH264High, kVp8));
+}
+
+TEST_F(CodecPreferenceEncoderFactoryTest, SkipsUnsupportedCodecs) {
+  auto factory = Factory({"av1", "vp9"});
+
+  EXPECT_THAT(factory.GetSupportedFormats(), ElementsAre(kVp9));
+}
+
+TEST_F(CodecPreferenceEncoderFactoryTest, FallsBackToVp8) {
+  auto factory = Factory({"av1"});
+
+  EXPECT_THAT(factory.GetSupportedFormats(), ElementsAre(kVp8));
+}
+
+TEST_F(CodecPreferenceEncoderFactoryTest, CreatesEncodersWithInnerFactory) {
+  auto factory = Factory({"vp9", "vp8"});
+
+  EXPECT_EQ(factory.CreateVideoEncoder(kVp9), nullptr);
+
+  EXPECT_THAT(requested_, ElementsAre(kVp9));
+}
+
+}  // namespace
+}  // namespace webrtc_streaming
+}  // namespace cuttlefish
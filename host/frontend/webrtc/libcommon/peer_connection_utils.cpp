@@ -28,7 +28,7 @@
 #include <api/video_codecs/video_encoder_factory.h>
 
 #include "host/frontend/webrtc/libcommon/audio_device.h"
-#include "host/frontend/webrtc/libcommon/vp8only_encoder_factory.h"
+#include "host/frontend/webrtc/libcommon/codec_preference_encoder_factory.h"
 
 namespace cuttlefish {
 namespace webrtc_streaming {
@@ -46,14 +46,16 @@ Result<rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface>>
 CreatePeerConnectionFactory(
     rtc::Thread* network_thread, rtc::Thread* worker_thread,
     rtc::Thread* signal_thread,
-    rtc::scoped_refptr<webrtc::AudioDeviceModule> audio_device_module) {
+    rtc::scoped_refptr<webrtc::AudioDeviceModule> audio_device_module,
+    const std::vector<std::string>& video_codecs,
+    std::shared_ptr<LatencyHistogram> encode_latency) {
   auto peer_connection_factory = webrtc::CreatePeerConnectionFactory(
       network_thread, worker_thread, signal_thread, audio_device_module,
       webrtc::CreateBuiltinAudioEncoderFactory(),
       webrtc::CreateBuiltinAudioDecoderFactory(),
-      // Only VP8 is supported
-      std::make_unique<VP8OnlyEncoderFactory>(
-          webrtc::CreateBuiltinVideoEncoderFactory()),
+      std::make_unique<CodecPreferenceEncoderFactory>(
+          webrtc::CreateBuiltinVideoEncoderFactory(), video_codecs,
+          encode_latency),
       webrtc::CreateBuiltinVideoDecoderFactory(), nullptr /* audio_mixer */,
       nullptr /* audio_processing */);
   CF_EXPECT(peer_connection_factory.get(),
@@ -17,8 +17,12 @@
 #pragma once
 
 // TODO review includes
+#include <string>
+#include <vector>
+
 #include <api/peer_connection_interface.h>
 
+#include "common/libs/utils/latency_histogram.h"
 #include "common/libs/utils/result.h"
 
 namespace cuttlefish {
@@ -27,11 +31,14 @@ namespace webrtc_streaming {
 Result<std::unique_ptr<rtc::Thread>> CreateAndStartThread(
     const std::string& name);
 
+// video_codecs lists the video codecs to offer, most preferred first.
 Result<rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface>>
 CreatePeerConnectionFactory(
     rtc::Thread* network_thread, rtc::Thread* worker_thread,
     rtc::Thread* signal_thread,
-    rtc::scoped_refptr<webrtc::AudioDeviceModule> audio_device_module);
+    rtc::scoped_refptr<webrtc::AudioDeviceModule> audio_device_module,
+    const std::vector<std::string>& video_codecs,
+    std::shared_ptr<LatencyHistogram> encode_latency = nullptr);
 
 // TODO(b/263528313): Use a packet socket factory instead of a port range.
 Result<rtc::scoped_refptr<webrtc::PeerConnectionInterface>>
@@ -22,12 +22,33 @@
 namespace cuttlefish {
 namespace webrtc_streaming {
 
+namespace {
+
+// Enough for a frame in the ring while the guest copies the previous one out
+// of another slot.
+constexpr std::uint32_t kFrameRingSlots = 3;
+
+}  // namespace
+
 CameraStreamer::CameraStreamer(unsigned int port, unsigned int cid,
-                               bool vhost_user)
+                               bool vhost_user,
+                               const std::string& frame_ring_path)
     : cid_(cid),
       port_(port),
       vhost_user_(vhost_user),
-      camera_session_active_(false) {}
+      camera_session_active_(false),
+      guest_reads_frame_ring_(false) {
+  if (frame_ring_path.empty()) {
+    return;
+  }
+  auto frame_ring = FrameRingWriter::Create(frame_ring_path, kFrameRingSlots);
+  if (!frame_ring.ok()) {
+    LOG(ERROR) << "Sending camera frames over vsock only: "
+               << frame_ring.error().FormatForEnv();
+    return;
+  }
+  frame_ring_ = std::move(*frame_ring);
+}
 
 CameraStreamer::~CameraStreamer() { Disconnect(); }
 
@@ -71,7 +92,7 @@ void CameraStreamer::OnFrame(const webrtc::VideoFrame& client_frame) {
     scaled_frame_->CropAndScaleFrom(*frame);
     frame = scaled_frame_.get();
   }
-  if (!VsockSendYUVFrame(frame)) {
+  if (!SendYUVFrame(frame)) {
     LOG(ERROR) << "Sending frame over vsock failed";
   }
 }
@@ -110,21 +131,60 @@ CameraStreamer::Resolution CameraStreamer::GetResolutionFromSettings(
 
 bool CameraStreamer::VsockSendYUVFrame(
     const webrtc::I420BufferInterface* frame) {
-  int32_t size = frame->width() * frame->height() +
-                 2 * frame->ChromaWidth() * frame->ChromaHeight();
   const char* y = reinterpret_cast<const char*>(frame->DataY());
   const char* u = reinterpret_cast<const char*>(frame->DataU());
   const char* v = reinterpret_cast<const char*>(frame->DataV());
-  auto chroma_width = frame->ChromaWidth();
-  auto chroma_height = frame->ChromaHeight();
+  unsigned int width = frame->width();
+  unsigned int height = frame->height();
+  unsigned int chroma_width = frame->ChromaWidth();
+  unsigned int chroma_height = frame->ChromaHeight();
   std::lock_guard<std::mutex> lock(frame_mutex_);
-  return cvd_connection_.Write(size) &&
-         cvd_connection_.WriteStrides(y, frame->width(), frame->height(),
-                                      frame->StrideY()) &&
-         cvd_connection_.WriteStrides(u, chroma_width, chroma_height,
-                                      frame->StrideU()) &&
-         cvd_connection_.WriteStrides(v, chroma_width, chroma_height,
-                                      frame->StrideV());
+  return cvd_connection_.WriteStridedMessage({
+      {.data = y,
+       .row_size = width,
+       .rows = height,
+       .stride = frame->StrideY()},
+      {.data = u,
+       .row_size = chroma_width,
+       .rows = chroma_height,
+       .stride = frame->StrideU()},
+      {.data = v,
+       .row_size = chroma_width,
+       .rows = chroma_height,
+       .stride = frame->StrideV()},
+  });
+}
+
+// Puts the frame in the ring and only sends the guest where it is, if the guest
+// can read it from there.
+bool CameraStreamer::SendYUVFrame(const webrtc::I420BufferInterface* frame) {
+  if (!frame_ring_ || !guest_reads_frame_ring_.load()) {
+    return VsockSendYUVFrame(frame);
+  }
+  unsigned int width = frame->width();
+  unsigned int height = frame->height();
+  unsigned int chroma_width = frame->ChromaWidth();
+  unsigned int chroma_height = frame->ChromaHeight();
+  std::lock_guard<std::mutex> lock(frame_mutex_);
+  auto message = frame_ring_->Write({
+      {.data = reinterpret_cast<const char*>(frame->DataY()),
+       .row_size = width,
+       .rows = height,
+       .stride = frame->StrideY()},
+      {.data = reinterpret_cast<const char*>(frame->DataU()),
+       .row_size = chroma_width,
+       .rows = chroma_height,
+       .stride = frame->StrideU()},
+      {.data = reinterpret_cast<const char*>(frame->DataV()),
+       .row_size = chroma_width,
+       .rows = chroma_height,
+       .stride = frame->StrideV()},
+  });
+  if (!message) {
+    // Too large for a slot
+    return VsockSendYUVFrame(frame);
+  }
+  return cvd_connection_.WriteMessage(SerializeFrameRingMessage(*message));
 }
 
 bool CameraStreamer::IsConnectionReady() {
@@ -152,11 +212,14 @@ void CameraStreamer::StartReadLoop() {
       static constexpr auto kMessageStart =
           "VIRTUAL_DEVICE_START_CAMERA_SESSION";
       static constexpr auto kMessageStop = "VIRTUAL_DEVICE_STOP_CAMERA_SESSION";
+      static constexpr auto kFrameRingKey = "frame_ring";
       auto json_value = cvd_connection_.ReadJsonMessage();
       if (json_value[kEventKey] == kMessageStart) {
+        guest_reads_frame_ring_ = json_value[kFrameRingKey].asBool();
         camera_session_active_ = true;
       } else if (json_value[kEventKey] == kMessageStop) {
         camera_session_active_ = false;
+        guest_reads_frame_ring_ = false;
       }
       if (!json_value.empty()) {
         SendMessage(json_value);
@@ -167,6 +230,7 @@ void CameraStreamer::StartReadLoop() {
 }
 
 void CameraStreamer::Disconnect() {
+  guest_reads_frame_ring_ = false;
   cvd_connection_.Disconnect();
   if (reader_thread_.joinable()) {
     reader_thread_.join();
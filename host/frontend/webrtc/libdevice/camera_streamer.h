@@ -20,11 +20,14 @@
 #include <api/video/video_sink_interface.h>
 #include <json/json.h>
 
+#include "common/libs/utils/frame_ring_writer.h"
 #include "common/libs/utils/vsock_connection.h"
 #include "host/frontend/webrtc/libdevice/camera_controller.h"
 
 #include <atomic>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -34,7 +37,8 @@ namespace webrtc_streaming {
 class CameraStreamer : public rtc::VideoSinkInterface<webrtc::VideoFrame>,
                        public CameraController {
  public:
-  CameraStreamer(unsigned int port, unsigned int cid, bool vhost_user);
+  CameraStreamer(unsigned int port, unsigned int cid, bool vhost_user,
+                 const std::string& frame_ring_path);
   ~CameraStreamer();
 
   CameraStreamer(const CameraStreamer& other) = delete;
@@ -53,6 +57,7 @@ class CameraStreamer : public rtc::VideoSinkInterface<webrtc::VideoFrame>,
   bool ForwardClientMessage(const Json::Value& message);
   Resolution GetResolutionFromSettings(const Json::Value& settings);
   bool VsockSendYUVFrame(const webrtc::I420BufferInterface* frame);
+  bool SendYUVFrame(const webrtc::I420BufferInterface* frame);
   bool IsConnectionReady();
   void StartReadLoop();
   void Disconnect();
@@ -69,6 +74,9 @@ class CameraStreamer : public rtc::VideoSinkInterface<webrtc::VideoFrame>,
   bool vhost_user_;
   std::thread reader_thread_;
   std::atomic<bool> camera_session_active_;
+  // Set when the guest started a session able to read frames from the ring.
+  std::atomic<bool> guest_reads_frame_ring_;
+  std::unique_ptr<FrameRingWriter> frame_ring_;
 };
 
 }  // namespace webrtc_streaming
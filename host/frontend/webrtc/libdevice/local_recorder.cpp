@@ -23,6 +23,7 @@
 #include <thread>
 #include <vector>
 
+#include <absl/strings/match.h>
 #include <android-base/logging.h>
 #include <api/media_stream_interface.h>
 #include <api/rtp_parameters.h>
@@ -42,6 +43,46 @@ constexpr double kRtpTicksPerMs = kRtpTicksPerSecond / 1000.;
 constexpr double kRtpTicksPerUs = kRtpTicksPerMs / 1000.;
 constexpr double kRtpTicksPerNs = kRtpTicksPerUs / 1000.;
 
+namespace {
+
+struct RecordingCodec {
+  const char* sdp_name;
+  webrtc::VideoCodecType type;
+  const char* webm_codec_id;
+};
+
+// The codecs that can be stored in a webm file.
+const RecordingCodec kRecordingCodecs[] = {
+    {"VP8", webrtc::kVideoCodecVP8, mkvmuxer::Tracks::kVp8CodecId},
+    {"VP9", webrtc::kVideoCodecVP9, mkvmuxer::Tracks::kVp9CodecId},
+    {"AV1", webrtc::kVideoCodecAV1, mkvmuxer::Tracks::kAv1CodecId},
+};
+
+const RecordingCodec& SelectRecordingCodec(
+    webrtc::VideoEncoderFactory& encoder_factory,
+    const std::vector<std::string>& video_codecs) {
+  auto supported_formats = encoder_factory.GetSupportedFormats();
+  auto is_supported = [&supported_formats](const RecordingCodec& codec) {
+    for (const auto& format : supported_formats) {
+      if (format.name == codec.sdp_name) {
+        return true;
+      }
+    }
+    return false;
+  };
+  for (const auto& name : video_codecs) {
+    for (const auto& codec : kRecordingCodecs) {
+      if (absl::EqualsIgnoreCase(name, codec.sdp_name) &&
+          is_supported(codec)) {
+        return codec;
+      }
+    }
+  }
+  return kRecordingCodecs[0];
+}
+
+}  // namespace
+
 class LocalRecorder::Display
     : public webrtc::EncodedImageCallback
     , public rtc::VideoSinkInterface<webrtc::VideoFrame> {
@@ -80,13 +121,15 @@ public:
   mkvmuxer::MkvWriter file_writer_;
   mkvmuxer::Segment segment_;
   std::unique_ptr<webrtc::VideoEncoderFactory> encoder_factory_;
+  const RecordingCodec* codec_ = nullptr;
   std::mutex mkv_mutex_;
   std::map<std::string, std::unique_ptr<Display>> displays_;
 };
 
 /* static */
 std::unique_ptr<LocalRecorder> LocalRecorder::Create(
-    const std::string& filename) {
+    const std::string& filename,
+    const std::vector<std::string>& video_codecs) {
   std::unique_ptr<Impl> impl(new Impl());
 
   if (!impl->file_writer_.Open(filename.c_str())) {
@@ -107,6 +150,7 @@ std::unique_ptr<LocalRecorder> LocalRecorder::Create(
     LOG(ERROR) << "Failed to create webRTC built-in video encoder factory";
     return {};
   }
+  impl->codec_ = &SelectRecordingCodec(*impl->encoder_factory_, video_codecs);
 
   return std::unique_ptr<LocalRecorder>(new LocalRecorder(std::move(impl)));
 }
@@ -141,11 +185,14 @@ void LocalRecorder::AddDisplay(
     LOG(ERROR) << "Failed to add video track to webm muxer";
     return;
   }
+  auto track = impl_->segment_.GetTrackByNumber(display->video_track_number_);
+  track->set_codec_id(impl_->codec_->webm_codec_id);
 
-  display->video_encoder_ =
-      impl_->encoder_factory_->CreateVideoEncoder(webrtc::SdpVideoFormat("VP8"));
+  display->video_encoder_ = impl_->encoder_factory_->CreateVideoEncoder(
+      webrtc::SdpVideoFormat(impl_->codec_->sdp_name));
   if (!display->video_encoder_) {
-    LOG(ERROR) << "Could not create vp8 video encoder";
+    LOG(ERROR) << "Could not create " << impl_->codec_->sdp_name
+               << " video encoder";
     return;
   }
   auto rc =
@@ -158,7 +205,7 @@ void LocalRecorder::AddDisplay(
 
   webrtc::VideoCodec codec {};
   memset(&codec, 0, sizeof(codec));
-  codec.codecType = webrtc::kVideoCodecVP8;
+  codec.codecType = impl_->codec_->type;
   codec.width = width;
   codec.height = height;
   codec.startBitrate = 1000; // kilobits/sec
@@ -169,7 +216,11 @@ void LocalRecorder::AddDisplay(
   codec.qpMax = 56; // kDefaultMaxQp from simulcast_encoder_adapter.cc
   codec.mode = webrtc::VideoCodecMode::kScreensharing;
   codec.expect_encode_from_texture = false;
-  *codec.VP8() = webrtc::VideoEncoder::GetDefaultVp8Settings();
+  if (codec.codecType == webrtc::kVideoCodecVP8) {
+    *codec.VP8() = webrtc::VideoEncoder::GetDefaultVp8Settings();
+  } else if (codec.codecType == webrtc::kVideoCodecVP9) {
+    *codec.VP9() = webrtc::VideoEncoder::GetDefaultVp9Settings();
+  }
 
   webrtc::VideoEncoder::Capabilities capabilities(false);
   webrtc::VideoEncoder::Settings settings(capabilities, 1, 1 << 20);
@@ -18,6 +18,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace webrtc {
 class VideoTrackSourceInterface;
@@ -32,7 +33,11 @@ class LocalRecorder {
 public:
   ~LocalRecorder();
 
-  static std::unique_ptr<LocalRecorder> Create(const std::string& filename);
+  // The recording is encoded with the first of video_codecs that can be stored
+  // in a webm file and is supported by the encoder, or VP8 if there is none.
+  static std::unique_ptr<LocalRecorder> Create(
+      const std::string& filename,
+      const std::vector<std::string>& video_codecs = {});
 
   void AddDisplay(const std::string& name, size_t width, size_t height,
                   std::shared_ptr<webrtc::VideoTrackSourceInterface> video);
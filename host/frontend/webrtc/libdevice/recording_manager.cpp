@@ -37,6 +37,7 @@ RecordingManager::RecordingManager() {
 
   instance_name_ = instance.instance_name();
   recording_directory_ = instance.PerInstancePath("recording/");
+  video_codecs_ = instance.webrtc_video_codecs();
   recording_ = false;
 }
 
@@ -120,7 +121,7 @@ void RecordingManager::StartSingleRecorder(const std::string& label) {
   std::string recording_path = fmt::format("{}recording_{}_{}_{}.webm", recording_directory_,
                                            instance_name_, label, recording_time);
   std::unique_ptr<cuttlefish::webrtc_streaming::LocalRecorder> local_recorder =
-      LocalRecorder::Create(recording_path);
+      LocalRecorder::Create(recording_path, video_codecs_);
   CHECK(local_recorder) << "Could not create local recorder";
   local_recorder->AddDisplay(label, existing_source->second->width_,
                              existing_source->second->height_, existing_source->second->video_);
@@ -56,6 +56,7 @@ private:
   bool recording_;
   std::string recording_directory_;
   std::string instance_name_;
+  std::vector<std::string> video_codecs_;
   std::mutex mutex_;
   std::condition_variable video_source_ready_signal_;
   std::map<std::string, std::unique_ptr<Source>> sources_;
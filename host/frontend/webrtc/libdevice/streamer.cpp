@@ -34,10 +34,10 @@
 
 #include "common/libs/fs/shared_fd.h"
 #include "host/frontend/webrtc/libcommon/audio_device.h"
+#include "host/frontend/webrtc/libcommon/codec_preference_encoder_factory.h"
 #include "host/frontend/webrtc/libcommon/peer_connection_utils.h"
 #include "host/frontend/webrtc/libcommon/port_range_socket_factory.h"
 #include "host/frontend/webrtc/libcommon/utils.h"
-#include "host/frontend/webrtc/libcommon/vp8only_encoder_factory.h"
 #include "host/frontend/webrtc/libdevice/audio_track_source_impl.h"
 #include "host/frontend/webrtc/libdevice/camera_streamer.h"
 #include "host/frontend/webrtc/libdevice/client_handler.h"
@@ -187,6 +187,8 @@ class Streamer::Impl : public ServerConnectionObserver,
   int registration_retries_left_ = kRegistrationRetries;
   int retry_interval_ms_ = kRetryFirstIntervalMs;
   RecordingManager* recording_manager_ = nullptr;
+  std::shared_ptr<LatencyHistogram> encode_latency_ =
+      std::make_shared<LatencyHistogram>();
 };
 
 Streamer::Streamer(std::unique_ptr<Streamer::Impl> impl)
@@ -230,7 +232,8 @@ std::unique_ptr<Streamer> Streamer::Create(
 
   auto result = CreatePeerConnectionFactory(
       impl->network_thread_.get(), impl->worker_thread_.get(),
-      impl->signal_thread_.get(), impl->audio_device_module_->device_module());
+      impl->signal_thread_.get(), impl->audio_device_module_->device_module(),
+      cfg.video_codecs, impl->encode_latency_);
 
   if (!result.ok()) {
     LOG(ERROR) << result.error().FormatForEnv();
@@ -241,6 +244,10 @@ std::unique_ptr<Streamer> Streamer::Create(
   return std::unique_ptr<Streamer>(new Streamer(std::move(impl)));
 }
 
+const LatencyHistogram& Streamer::EncodeLatencyHistogram() const {
+  return *impl_->encode_latency_;
+}
+
 std::shared_ptr<VideoSink> Streamer::AddDisplay(const std::string& label,
                                                 int width, int height, int dpi,
                                                 bool touch_enabled) {
@@ -253,7 +260,8 @@ std::shared_ptr<VideoSink> Streamer::AddDisplay(const std::string& label,
           return nullptr;
         }
         rtc::scoped_refptr<VideoTrackSourceImpl> source(
-            new rtc::RefCountedObject<VideoTrackSourceImpl>(width, height));
+            new rtc::RefCountedObject<VideoTrackSourceImpl>(
+                width, height, impl_->config_.screen_content));
         impl_->displays_[label] = {width, height, dpi, touch_enabled, source};
 
         auto video_track = impl_->peer_connection_factory_->CreateVideoTrack(
@@ -332,9 +340,10 @@ std::shared_ptr<AudioSource> Streamer::GetAudioSource() {
 }
 
 CameraController* Streamer::AddCamera(unsigned int port, unsigned int cid,
-                                      bool vhost_user) {
-  impl_->camera_streamer_ =
-      std::make_unique<CameraStreamer>(port, cid, vhost_user);
+                                      bool vhost_user,
+                                      const std::string& frame_ring_path) {
+  impl_->camera_streamer_ = std::make_unique<CameraStreamer>(
+      port, cid, vhost_user, frame_ring_path);
   return impl_->camera_streamer_.get();
 }
 
@@ -24,6 +24,7 @@
 #include <utility>
 #include <vector>
 
+#include "common/libs/utils/latency_histogram.h"
 #include "host/libs/config/custom_actions.h"
 
 #include "host/frontend/webrtc/libcommon/audio_source.h"
@@ -59,6 +60,11 @@ struct StreamerConfig {
   std::string openwrt_addr;
   // Path of ControlEnvProxyServer for serving Rest API in WebUI.
   std::string control_env_proxy_server_path;
+  // The video codecs to offer to clients, most preferred first.
+  std::vector<std::string> video_codecs = {"vp8"};
+  // Whether to encode the displays as screen content rather than as
+  // camera-like video.
+  bool screen_content = false;
 };
 
 class OperatorObserver {
@@ -103,8 +109,11 @@ class Streamer {
   // stream here.
   std::shared_ptr<AudioSource> GetAudioSource();
 
+  // Frames are handed over through the frame ring at `frame_ring_path`, if
+  // not empty, when the guest supports it.
   CameraController* AddCamera(unsigned int port, unsigned int cid,
-                              bool vhost_user);
+                              bool vhost_user,
+                              const std::string& frame_ring_path);
 
   // Add a custom button to the control panel.
   void AddCustomControlPanelButton(const std::string& command,
@@ -118,6 +127,9 @@ class Streamer {
       const std::string& icon_name,
       const std::vector<DeviceState>& device_states);
 
+  // Time taken by the video encoders to encode each frame.
+  const LatencyHistogram& EncodeLatencyHistogram() const;
+
   // Register with the operator.
   void Register(std::weak_ptr<OperatorObserver> operator_observer);
   void Unregister();
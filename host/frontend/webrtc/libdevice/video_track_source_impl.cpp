@@ -51,8 +51,12 @@ class VideoFrameWrapper : public webrtc::I420BufferInterface {
 
 }  // namespace
 
-VideoTrackSourceImpl::VideoTrackSourceImpl(int width, int height)
-    : webrtc::VideoTrackSource(false), width_(width), height_(height) {}
+VideoTrackSourceImpl::VideoTrackSourceImpl(int width, int height,
+                                           bool is_screencast)
+    : webrtc::VideoTrackSource(false),
+      width_(width),
+      height_(height),
+      is_screencast_(is_screencast) {}
 
 void VideoTrackSourceImpl::OnFrame(std::shared_ptr<VideoFrameBuffer> frame,
                                    int64_t timestamp_us) {
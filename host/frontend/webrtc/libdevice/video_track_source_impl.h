@@ -26,7 +26,9 @@ namespace webrtc_streaming {
 
 class VideoTrackSourceImpl : public webrtc::VideoTrackSource {
  public:
-  VideoTrackSourceImpl(int width, int height);
+  // A screencast source is encoded with settings tuned for screen content,
+  // favoring sharpness over frame rate.
+  VideoTrackSourceImpl(int width, int height, bool is_screencast = false);
 
   void OnFrame(std::shared_ptr<VideoFrameBuffer> frame, int64_t timestamp_us);
 
@@ -36,6 +38,8 @@ class VideoTrackSourceImpl : public webrtc::VideoTrackSource {
   // Implementation should avoid blocking.
   bool GetStats(Stats* stats) override;
 
+  bool is_screencast() const override { return is_screencast_; }
+
   bool SupportsEncodedOutput() const override;
   void GenerateKeyFrame() override {}
   void AddEncodedSink(
@@ -48,6 +52,7 @@ class VideoTrackSourceImpl : public webrtc::VideoTrackSource {
  private:
   int width_;
   int height_;
+  bool is_screencast_;
   rtc::VideoBroadcaster broadcaster_;
 };
 
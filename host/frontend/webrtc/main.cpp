@@ -70,6 +70,13 @@ DEFINE_int32(audio_server_fd, -1, "An fd to listen on for audio frames");
 DEFINE_int32(camera_streamer_fd, -1, "An fd to send client camera frames");
 DEFINE_string(client_dir, "webrtc", "Location of the client files");
 DEFINE_string(group_id, "", "The group id of device");
+DEFINE_string(frame_queue_mode, "blocking",
+              "How display frames wait for the streamer. 'blocking' makes the "
+              "Wayland server wait while the queue is full, 'mailbox' replaces "
+              "the pending frame of a display with the newest one.");
+DEFINE_uint32(frame_conversion_threads, 1,
+              "Number of threads converting display frames to I420, "
+              "including the Wayland server thread.");
 
 using cuttlefish::AudioHandler;
 using cuttlefish::CfConnectionObserverFactory;
@@ -116,13 +123,18 @@ fruit::Component<
     cuttlefish::ScreenConnector<DisplayHandler::WebRtcScProcessedFrame>,
     cuttlefish::confui::HostServer, cuttlefish::confui::HostVirtualInput>
 CreateConfirmationUIComponent(
-    int* frames_fd, cuttlefish::confui::PipeConnectionPair* pipe_io_pair, cuttlefish::InputConnector* input_connector) {
+    int* frames_fd, cuttlefish::ScreenConnectorQueueMode* frame_queue_mode,
+    cuttlefish::confui::PipeConnectionPair* pipe_io_pair,
+    cuttlefish::InputConnector* input_connector) {
   using cuttlefish::ScreenConnectorFrameRenderer;
   using ScreenConnector = cuttlefish::DisplayHandler::ScreenConnector;
   return fruit::createComponent()
       .bindInstance<
           fruit::Annotated<cuttlefish::WaylandScreenConnector::FramesFd, int>>(
           *frames_fd)
+      .bindInstance<fruit::Annotated<ScreenConnector::FrameQueueMode,
+                                     cuttlefish::ScreenConnectorQueueMode>>(
+          *frame_queue_mode)
       .bindInstance(*pipe_io_pair)
       .bind<ScreenConnectorFrameRenderer, ScreenConnector>()
       .bindInstance(*input_connector);
@@ -190,11 +202,19 @@ int main(int argc, char** argv) {
   close(FLAGS_confui_out_fd);
 
   int frames_fd = FLAGS_frame_server_fd;
+  auto frame_queue_mode = cuttlefish::ScreenConnectorQueueMode::kBlocking;
+  if (FLAGS_frame_queue_mode == "blocking") {
+    frame_queue_mode = cuttlefish::ScreenConnectorQueueMode::kBlocking;
+  } else if (FLAGS_frame_queue_mode == "mailbox") {
+    frame_queue_mode = cuttlefish::ScreenConnectorQueueMode::kMailbox;
+  } else {
+    LOG(FATAL) << "Invalid frame queue mode: " << FLAGS_frame_queue_mode;
+  }
   fruit::Injector<
       cuttlefish::ScreenConnector<DisplayHandler::WebRtcScProcessedFrame>,
       cuttlefish::confui::HostServer, cuttlefish::confui::HostVirtualInput>
       conf_ui_components_injector(CreateConfirmationUIComponent,
-                                  std::addressof(frames_fd),
+                                  std::addressof(frames_fd), &frame_queue_mode,
                                   &conf_ui_comm_fd_pair, input_connector.get());
   auto& screen_connector =
       conf_ui_components_injector.get<DisplayHandler::ScreenConnector&>();
@@ -219,6 +239,8 @@ int main(int argc, char** argv) {
       cvd_config->Instances()[0])[kOpewnrtWanIpAddressName];
   streamer_config.control_env_proxy_server_path =
       instance.grpc_socket_path() + "/ControlEnvProxyServer.sock";
+  streamer_config.video_codecs = instance.webrtc_video_codecs();
+  streamer_config.screen_content = instance.webrtc_screen_content();
   streamer_config.operator_server.addr = cvd_config->sig_server_address();
   streamer_config.operator_server.port = cvd_config->sig_server_port();
   streamer_config.operator_server.path = cvd_config->sig_server_path();
@@ -253,12 +275,17 @@ int main(int argc, char** argv) {
   CHECK(streamer) << "Could not create streamer";
 
   auto display_handler =
-      std::make_shared<DisplayHandler>(*streamer, screen_connector);
+      std::make_shared<DisplayHandler>(*streamer, screen_connector,
+                                       FLAGS_frame_conversion_threads);
 
   if (instance.camera_server_port()) {
-    auto camera_controller = streamer->AddCamera(instance.camera_server_port(),
-                                                 instance.vsock_guest_cid(),
-                                                 instance.vhost_user_vsock());
+    std::string camera_frame_ring_path;
+    if (FileExists(instance.camera_pmem_path())) {
+      camera_frame_ring_path = instance.camera_pmem_path();
+    }
+    auto camera_controller = streamer->AddCamera(
+        instance.camera_server_port(), instance.vsock_guest_cid(),
+        instance.vhost_user_vsock(), camera_frame_ring_path);
     observer_factory->SetCameraHandler(camera_controller);
     streamer->SetHardwareSpec("camera_passthrough", true);
   }
@@ -0,0 +1,584 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/libs/command_util/snapshot_store.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
+#include <json/json.h>
+#include <openssl/sha.h>
+
+#include "common/libs/concurrency/worker_pool.h"
+#include "common/libs/utils/files.h"
+#include "common/libs/utils/json.h"
+#include "common/libs/utils/result.h"
+#include "host/libs/command_util/snapshot_utils.h"
+
+#if defined(__linux__) && !defined(FICLONERANGE)
+// Missing from older sysroot headers, supported by the kernels since 4.5.
+struct file_clone_range {
+  __s64 src_fd;
+  __u64 src_offset;
+  __u64 src_length;
+  __u64 dest_offset;
+};
+#define FICLONERANGE _IOW(0x94, 13, struct file_clone_range)
+#endif
+
+namespace cuttlefish {
+namespace {
+
+// Chunk boundaries only fall between blocks, so chunks can be reflinked back
+// into place on restore.
+constexpr std::size_t kBlockSize = 4096;
+constexpr std::size_t kMinChunkBlocks = 64;
+constexpr std::size_t kMaxChunkBlocks = 1024;
+// A chunk ends after a block whose hash has these bits clear, which makes
+// data chunks about 1.25 MiB on average.
+constexpr std::uint64_t kBoundaryMask = 255;
+constexpr std::size_t kReadBufferSize = 1 << 20;
+// Smaller files are left in the snapshot directory.
+constexpr off_t kMinPackedFileSize = 1 << 20;
+constexpr std::size_t kMaxParallelFiles = 4;
+
+constexpr char kStoreField[] = "store";
+constexpr char kFilesField[] = "files";
+constexpr char kPathField[] = "path";
+constexpr char kSizeField[] = "size";
+constexpr char kModeField[] = "mode";
+constexpr char kAtimeField[] = "atime";
+constexpr char kMtimeField[] = "mtime";
+// An array of [SHA-256 in hex, size] pairs. Runs of zeroes have no hash.
+constexpr char kChunksField[] = "chunks";
+
+struct AtomicStats {
+  std::atomic<std::uint64_t> files = 0;
+  std::atomic<std::uint64_t> logical_bytes = 0;
+  std::atomic<std::uint64_t> zero_bytes = 0;
+  std::atomic<std::uint64_t> stored_bytes = 0;
+  std::atomic<std::uint64_t> reused_bytes = 0;
+};
+
+struct Chunk {
+  std::string sha256;  // Empty for zeroes
+  std::uint64_t size;
+};
+
+struct PackedFile {
+  std::string relative_path;
+  struct stat info;
+  std::vector<Chunk> chunks;
+};
+
+bool IsZero(const char* data, std::size_t size) {
+  return std::all_of(data, data + size, [](char c) { return c == 0; });
+}
+
+std::uint64_t BlockHash(const char* data, std::size_t size) {
+  std::uint64_t hash = 0xcbf29ce484222325;
+  std::size_t i = 0;
+  for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t)) {
+    std::uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    hash = (hash ^ word) * 0x100000001b3;
+  }
+  for (; i < size; i++) {
+    hash = (hash ^ static_cast<unsigned char>(data[i])) * 0x100000001b3;
+  }
+  return hash ^ (hash >> 32);
+}
+
+std::string DigestToHex(
+    const unsigned char (&digest)[SHA256_DIGEST_LENGTH]) {
+  static constexpr char kHex[] = "0123456789abcdef";
+  std::string hex;
+  for (unsigned char byte : digest) {
+    hex += kHex[byte >> 4];
+    hex += kHex[byte & 0xf];
+  }
+  return hex;
+}
+
+std::string Sha256Hex(const char* data, std::size_t size) {
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  SHA256(reinterpret_cast<const unsigned char*>(data), size, digest);
+  return DigestToHex(digest);
+}
+
+std::string ChunkPath(const std::string& store_path, const std::string& hex) {
+  return store_path + "/chunks/" + hex.substr(0, 2) + "/" + hex;
+}
+
+Result<void> WriteChunk(const std::string& path, const char* data,
+                        std::size_t size) {
+  CF_EXPECT(EnsureDirectoryExists(android::base::Dirname(path)));
+  // Other snapshots may be writing the same chunk, so it only appears under
+  // its name once complete.
+  const std::string temporary_path =
+      path + ".tmp." + std::to_string(getpid()) + "." +
+      std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  {
+    android::base::unique_fd fd(open(temporary_path.c_str(),
+                                     O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                     S_IRUSR | S_IRGRP | S_IROTH));
+    CF_EXPECTF(fd.get() >= 0, "Failed to create \"{}\": {}", temporary_path,
+               strerror(errno));
+    CF_EXPECTF(android::base::WriteFully(fd, data, size),
+               "Failed to write \"{}\": {}", temporary_path, strerror(errno));
+  }
+  CF_EXPECTF(rename(temporary_path.c_str(), path.c_str()) == 0,
+             "Failed to rename \"{}\": {}", temporary_path, strerror(errno));
+  return {};
+}
+
+// Splits the blocks of a file into chunks and puts the new ones in the store.
+class Chunker {
+ public:
+  Chunker(const std::string& store_path, AtomicStats& stats)
+      : store_path_(store_path), stats_(stats) {}
+
+  Result<void> Zeroes(std::uint64_t size) {
+    CF_EXPECT(FlushData());
+    stats_.zero_bytes += size;
+    if (!chunks_.empty() && chunks_.back().sha256.empty()) {
+      chunks_.back().size += size;
+    } else {
+      chunks_.push_back(Chunk{.sha256 = "", .size = size});
+    }
+    return {};
+  }
+
+  Result<void> Block(const char* data, std::size_t size) {
+    if (IsZero(data, size)) {
+      CF_EXPECT(Zeroes(size));
+      return {};
+    }
+    data_.insert(data_.end(), data, data + size);
+    blocks_++;
+    if (blocks_ >= kMaxChunkBlocks ||
+        (blocks_ >= kMinChunkBlocks &&
+         (BlockHash(data, size) & kBoundaryMask) == 0)) {
+      CF_EXPECT(FlushData());
+    }
+    return {};
+  }
+
+  Result<std::vector<Chunk>> Finish() {
+    CF_EXPECT(FlushData());
+    return std::move(chunks_);
+  }
+
+ private:
+  Result<void> FlushData() {
+    if (data_.empty()) {
+      return {};
+    }
+    std::string hex = Sha256Hex(data_.data(), data_.size());
+    const std::string path = ChunkPath(store_path_, hex);
+    if (FileExists(path)) {
+      stats_.reused_bytes += data_.size();
+    } else {
+      CF_EXPECT(WriteChunk(path, data_.data(), data_.size()));
+      stats_.stored_bytes += data_.size();
+    }
+    chunks_.push_back(Chunk{.sha256 = std::move(hex), .size = data_.size()});
+    data_.clear();
+    blocks_ = 0;
+    return {};
+  }
+
+  const std::string& store_path_;
+  AtomicStats& stats_;
+  std::vector<char> data_;
+  std::size_t blocks_ = 0;
+  std::vector<Chunk> chunks_;
+};
+
+Result<std::vector<Chunk>> ChunkFile(const std::string& path, off_t size,
+                                     const std::string& store_path,
+                                     AtomicStats& stats) {
+  android::base::unique_fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  CF_EXPECTF(fd.get() >= 0, "Failed to open \"{}\": {}", path,
+             strerror(errno));
+  Chunker chunker(store_path, stats);
+  std::vector<char> buffer(kReadBufferSize);
+  off_t offset = 0;
+  while (offset < size) {
+    // Holes are skipped without reading them.
+    off_t data = lseek(fd.get(), offset, SEEK_DATA);
+    if (data == -1 && errno == ENXIO) {
+      data = size;
+    }
+    CF_EXPECTF(data != -1, "SEEK_DATA failed on \"{}\": {}", path,
+               strerror(errno));
+    if (data > offset) {
+      CF_EXPECT(chunker.Zeroes(data - offset));
+      offset = data;
+    }
+    if (offset >= size) {
+      break;
+    }
+    off_t hole = lseek(fd.get(), offset, SEEK_HOLE);
+    CF_EXPECTF(hole != -1, "SEEK_HOLE failed on \"{}\": {}", path,
+               strerror(errno));
+    hole = std::min(hole, size);
+    while (offset < hole) {
+      std::size_t to_read =
+          std::min<std::uint64_t>(buffer.size(), hole - offset);
+      ssize_t bytes_read =
+          TEMP_FAILURE_RETRY(pread(fd.get(), buffer.data(), to_read, offset));
+      CF_EXPECTF(bytes_read > 0, "Failed to read \"{}\": {}", path,
+                 bytes_read == 0 ? "unexpected end of file" : strerror(errno));
+      for (ssize_t pos = 0; pos < bytes_read; pos += kBlockSize) {
+        CF_EXPECT(chunker.Block(
+            buffer.data() + pos,
+            std::min<std::size_t>(kBlockSize, bytes_read - pos)));
+      }
+      offset += bytes_read;
+    }
+  }
+  return CF_EXPECT(chunker.Finish());
+}
+
+// Collects the files worth packing, without following symbolic links out of
+// the snapshot.
+Result<void> CollectFiles(const std::string& snapshot_path,
+                          const std::string& relative_dir,
+                          std::vector<PackedFile>& files) {
+  const std::string dir = snapshot_path + relative_dir;
+  for (const auto& name : CF_EXPECT(DirectoryContents(dir))) {
+    if (name == "." || name == "..") {
+      continue;
+    }
+    const std::string relative_path = relative_dir + "/" + name;
+    struct stat st;
+    CF_EXPECTF(lstat((dir + "/" + name).c_str(), &st) == 0,
+               "Failed in lstat({}/{})", dir, name);
+    if (S_ISDIR(st.st_mode)) {
+      CF_EXPECT(CollectFiles(snapshot_path, relative_path, files));
+    } else if (S_ISREG(st.st_mode) && st.st_size >= kMinPackedFileSize) {
+      files.push_back(PackedFile{.relative_path = relative_path, .info = st});
+    }
+  }
+  return {};
+}
+
+Json::Value TimeToJson(const struct timespec& time) {
+  Json::Value json(Json::arrayValue);
+  json.append(Json::Int64(time.tv_sec));
+  json.append(Json::Int64(time.tv_nsec));
+  return json;
+}
+
+struct timespec TimeFromJson(const Json::Value& json) {
+  return timespec{
+      .tv_sec = static_cast<time_t>(json[0].asInt64()),
+      .tv_nsec = static_cast<long>(json[1].asInt64()),
+  };
+}
+
+Json::Value FileToJson(const PackedFile& file) {
+  Json::Value json(Json::objectValue);
+  json[kPathField] = file.relative_path;
+  json[kSizeField] = Json::UInt64(file.info.st_size);
+  json[kModeField] = file.info.st_mode & 07777;
+#if defined(__APPLE__)
+  json[kAtimeField] = TimeToJson(file.info.st_atimespec);
+  json[kMtimeField] = TimeToJson(file.info.st_mtimespec);
+#else
+  json[kAtimeField] = TimeToJson(file.info.st_atim);
+  json[kMtimeField] = TimeToJson(file.info.st_mtim);
+#endif
+  Json::Value chunks(Json::arrayValue);
+  for (const auto& chunk : file.chunks) {
+    Json::Value chunk_json(Json::arrayValue);
+    chunk_json.append(chunk.sha256);
+    chunk_json.append(Json::UInt64(chunk.size));
+    chunks.append(chunk_json);
+  }
+  json[kChunksField] = chunks;
+  return json;
+}
+
+Result<void> SyncFilesystem(const std::string& path) {
+#if defined(__linux__)
+  android::base::unique_fd fd(
+      open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+  CF_EXPECTF(fd.get() >= 0, "Failed to open \"{}\": {}", path,
+             strerror(errno));
+  CF_EXPECTF(syncfs(fd.get()) == 0, "Failed to sync \"{}\": {}", path,
+             strerror(errno));
+#else
+  sync();
+#endif
+  return {};
+}
+
+// Reads the chunk at `chunk_path` through `fd`, checking that it still holds
+// the `size` bytes it was stored with. If `dest_fd` is valid, the data is also
+// written at `dest_offset` of it.
+Result<void> ReadChunk(const std::string& chunk_path, int fd,
+                       const std::string& hex, std::uint64_t size, int dest_fd,
+                       std::uint64_t dest_offset) {
+  SHA256_CTX sha256;
+  SHA256_Init(&sha256);
+  std::vector<char> buffer(std::min<std::uint64_t>(size, kReadBufferSize));
+  std::uint64_t offset = 0;
+  while (offset < size) {
+    std::size_t to_read =
+        std::min<std::uint64_t>(buffer.size(), size - offset);
+    ssize_t bytes_read =
+        TEMP_FAILURE_RETRY(pread(fd, buffer.data(), to_read, offset));
+    CF_EXPECTF(bytes_read > 0, "Failed to read chunk \"{}\": {}", chunk_path,
+               bytes_read == 0 ? "chunk is truncated" : strerror(errno));
+    SHA256_Update(&sha256, buffer.data(), bytes_read);
+    for (ssize_t written = 0; dest_fd >= 0 && written < bytes_read;) {
+      ssize_t result = TEMP_FAILURE_RETRY(
+          pwrite(dest_fd, buffer.data() + written, bytes_read - written,
+                 dest_offset + offset + written));
+      CF_EXPECTF(result > 0, "Failed to write: {}", strerror(errno));
+      written += result;
+    }
+    offset += bytes_read;
+  }
+  struct stat st;
+  CF_EXPECTF(fstat(fd, &st) == 0, "Failed to stat chunk \"{}\": {}",
+             chunk_path, strerror(errno));
+  CF_EXPECTF(std::uint64_t(st.st_size) == size,
+             "Chunk \"{}\" has {} bytes instead of {}", chunk_path, st.st_size,
+             size);
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  SHA256_Final(digest, &sha256);
+  CF_EXPECTF(DigestToHex(digest) == hex, "Chunk \"{}\" is corrupt",
+             chunk_path);
+  return {};
+}
+
+// Places the chunk with SHA-256 `hex` at `offset` of `dest_fd`, after checking
+// its contents. Returns whether the chunk was reflinked rather than copied.
+Result<bool> PlaceChunk(const std::string& store_path, const std::string& hex,
+                        std::uint64_t size, int dest_fd, std::uint64_t offset) {
+  const std::string chunk_path = ChunkPath(store_path, hex);
+  android::base::unique_fd src_fd(
+      open(chunk_path.c_str(), O_RDONLY | O_CLOEXEC));
+  CF_EXPECTF(src_fd.get() >= 0, "Failed to open chunk \"{}\": {}", chunk_path,
+             strerror(errno));
+#if defined(__linux__)
+  // Chunks are never modified once stored, so what was checked is what gets
+  // cloned.
+  CF_EXPECT(ReadChunk(chunk_path, src_fd.get(), hex, size, -1, 0));
+  struct file_clone_range range = {
+      .src_fd = src_fd.get(),
+      .src_offset = 0,
+      .src_length = size,
+      .dest_offset = offset,
+  };
+  if (ioctl(dest_fd, FICLONERANGE, &range) == 0) {
+    return true;
+  }
+  // The clone may have failed partway, so the whole range is rewritten.
+#endif
+  CF_EXPECT(ReadChunk(chunk_path, src_fd.get(), hex, size, dest_fd, offset));
+  return false;
+}
+
+Result<void> UnpackFile(const std::string& dest_path,
+                        const std::string& store_path, const Json::Value& file,
+                        std::atomic<std::uint64_t>& cloned_bytes,
+                        std::atomic<std::uint64_t>& copied_bytes) {
+  const std::string relative_path = file[kPathField].asString();
+  for (const auto& component : android::base::Split(relative_path, "/")) {
+    CF_EXPECTF(component != "..", "Unsafe path \"{}\" in the manifest",
+               relative_path);
+  }
+  const std::string path = dest_path + relative_path;
+  CF_EXPECT(EnsureDirectoryExists(android::base::Dirname(path)));
+  android::base::unique_fd fd(open(path.c_str(),
+                                   O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                                   file[kModeField].asUInt()));
+  CF_EXPECTF(fd.get() >= 0, "Failed to create \"{}\": {}", path,
+             strerror(errno));
+  CF_EXPECTF(ftruncate(fd.get(), file[kSizeField].asUInt64()) == 0,
+             "Failed to truncate \"{}\": {}", path, strerror(errno));
+  std::uint64_t offset = 0;
+  for (const auto& chunk : file[kChunksField]) {
+    const std::string hex = chunk[0].asString();
+    const std::uint64_t size = chunk[1].asUInt64();
+    if (!hex.empty()) {
+      const bool cloned =
+          CF_EXPECT(PlaceChunk(store_path, hex, size, fd.get(), offset));
+      (cloned ? cloned_bytes : copied_bytes) += size;
+    }
+    offset += size;
+  }
+  CF_EXPECTF(offset == file[kSizeField].asUInt64(),
+             "Chunks of \"{}\" don't add up to its size", relative_path);
+  const struct timespec times[2] = {TimeFromJson(file[kAtimeField]),
+                                    TimeFromJson(file[kMtimeField])};
+  CF_EXPECTF(futimens(fd.get(), times) == 0, "futimens(\"{}\") failed: {}",
+             path, strerror(errno));
+  return {};
+}
+
+// Runs the jobs a few at a time, stopping early after a failure. The results
+// of jobs that never ran are left default constructed.
+template <typename T>
+std::vector<Result<T>> RunInParallel(
+    std::vector<std::function<Result<T>()>>& jobs) {
+  std::vector<Result<T>> results(jobs.size());
+  std::atomic<bool> failed = false;
+  std::vector<std::function<void()>> tasks;
+  for (std::size_t i = 0; i < jobs.size(); i++) {
+    tasks.emplace_back([&, i]() {
+      if (failed) {
+        return;
+      }
+      results[i] = jobs[i]();
+      if (!results[i].ok()) {
+        failed = true;
+      }
+    });
+  }
+  const std::size_t concurrency = std::clamp<std::size_t>(
+      std::thread::hardware_concurrency(), 1, kMaxParallelFiles);
+  WorkerPool(concurrency).Run(tasks);
+  return results;
+}
+
+}  // namespace
+
+Result<SnapshotStoreStats> PackSnapshot(const std::string& snapshot_path,
+                                        const std::string& store_path) {
+  const std::string manifest_path =
+      snapshot_path + "/" + kSnapshotManifestFileName;
+  CF_EXPECTF(!FileExists(manifest_path), "\"{}\" is already packed",
+             snapshot_path);
+  const std::string store = AbsolutePath(store_path);
+  CF_EXPECTF(!store.empty(), "Invalid snapshot store path \"{}\"", store_path);
+  CF_EXPECT(EnsureDirectoryExists(store + "/chunks"));
+
+  std::vector<PackedFile> files;
+  CF_EXPECT(CollectFiles(snapshot_path, "", files));
+  AtomicStats stats;
+  std::vector<std::function<Result<std::vector<Chunk>>()>> jobs;
+  for (const auto& file : files) {
+    jobs.emplace_back([&snapshot_path, &store, &file, &stats]() {
+      stats.files++;
+      stats.logical_bytes += file.info.st_size;
+      return ChunkFile(snapshot_path + file.relative_path, file.info.st_size,
+                       store, stats);
+    });
+  }
+  auto results = RunInParallel(jobs);
+  for (std::size_t i = 0; i < files.size(); i++) {
+    files[i].chunks = CF_EXPECT(std::move(results[i]));
+  }
+
+  // The chunks have to be durable before the only other copy of their data is
+  // removed.
+  CF_EXPECT(SyncFilesystem(store));
+  Json::Value manifest(Json::objectValue);
+  manifest[kStoreField] = store;
+  manifest[kFilesField] = Json::Value(Json::arrayValue);
+  for (const auto& file : files) {
+    manifest[kFilesField].append(FileToJson(file));
+  }
+  const std::string temporary_manifest_path = manifest_path + ".tmp";
+  CF_EXPECTF(android::base::WriteStringToFile(manifest.toStyledString(),
+                                              temporary_manifest_path),
+             "Failed to write \"{}\"", temporary_manifest_path);
+  CF_EXPECT(RenameFile(temporary_manifest_path, manifest_path));
+  CF_EXPECT(SyncFilesystem(snapshot_path));
+  for (const auto& file : files) {
+    const std::string path = snapshot_path + file.relative_path;
+    CF_EXPECTF(RemoveFile(path), "Failed to remove \"{}\"", path);
+  }
+
+  SnapshotStoreStats result{
+      .files = stats.files,
+      .logical_bytes = stats.logical_bytes,
+      .zero_bytes = stats.zero_bytes,
+      .stored_bytes = stats.stored_bytes,
+      .reused_bytes = stats.reused_bytes,
+  };
+  const std::uint64_t data_bytes = result.stored_bytes + result.reused_bytes;
+  LOG(INFO) << "Packed " << result.files << " files of \"" << snapshot_path
+            << "\" (" << result.logical_bytes << " bytes, "
+            << result.zero_bytes << " of them zeroes): " << result.stored_bytes
+            << " bytes stored, " << result.reused_bytes
+            << " bytes already in the store, dedup ratio "
+            << (result.stored_bytes == 0
+                    ? 0.0
+                    : double(data_bytes) / result.stored_bytes);
+  return result;
+}
+
+bool IsPackedSnapshot(const std::string& snapshot_path) {
+  return FileExists(snapshot_path + "/" + kSnapshotManifestFileName);
+}
+
+Result<void> UnpackSnapshot(const std::string& snapshot_path,
+                            const std::string& dest_path) {
+  const std::string manifest_path =
+      snapshot_path + "/" + kSnapshotManifestFileName;
+  const Json::Value manifest = CF_EXPECT(LoadFromFile(manifest_path));
+  CF_EXPECTF(manifest.isMember(kStoreField) && manifest.isMember(kFilesField),
+             "\"{}\" is not a snapshot manifest", manifest_path);
+  const std::string store = manifest[kStoreField].asString();
+
+  CF_EXPECT(CopyDirectoryRecursively(
+      snapshot_path, dest_path, /* verify_dest_dir_empty */ true,
+      [](const std::string& path) {
+        return android::base::Basename(path) != kSnapshotManifestFileName;
+      }));
+  std::atomic<std::uint64_t> cloned_bytes = 0;
+  std::atomic<std::uint64_t> copied_bytes = 0;
+  std::vector<std::function<Result<void>()>> jobs;
+  for (const auto& file : manifest[kFilesField]) {
+    jobs.emplace_back([&, file]() {
+      return UnpackFile(dest_path, store, file, cloned_bytes, copied_bytes);
+    });
+  }
+  for (auto& result : RunInParallel(jobs)) {
+    CF_EXPECT(std::move(result));
+  }
+  LOG(INFO) << "Unpacked " << jobs.size() << " files of \"" << snapshot_path
+            << "\" into \"" << dest_path << "\": " << cloned_bytes
+            << " bytes reflinked, " << copied_bytes << " bytes copied";
+  return {};
+}
+
+}  // namespace cuttlefish
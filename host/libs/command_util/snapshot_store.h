@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "common/libs/utils/result.h"
+
+namespace cuttlefish {
+
+struct SnapshotStoreStats {
+  std::uint64_t files = 0;
+  // Sizes of the packed files.
+  std::uint64_t logical_bytes = 0;
+  // Holes and runs of zeroes, which aren't stored at all.
+  std::uint64_t zero_bytes = 0;
+  // Chunks that were new to the store.
+  std::uint64_t stored_bytes = 0;
+  // Chunks that an earlier snapshot already put in the store.
+  std::uint64_t reused_bytes = 0;
+};
+
+/*
+ * Moves the large files of the snapshot at `snapshot_path` into the chunk
+ * store at `store_path`, which can be shared by any number of snapshots.
+ *
+ * Files are split into chunks at content defined, block aligned boundaries,
+ * and each chunk is stored once under its SHA-256, so successive snapshots of
+ * the same device only add the chunks that changed. The packed files are
+ * replaced by a manifest in the snapshot directory.
+ */
+Result<SnapshotStoreStats> PackSnapshot(const std::string& snapshot_path,
+                                        const std::string& store_path);
+
+// Whether the snapshot at `snapshot_path` was packed by `PackSnapshot`.
+bool IsPackedSnapshot(const std::string& snapshot_path);
+
+/*
+ * Recreates the snapshot packed by `PackSnapshot` at `snapshot_path` in the
+ * new directory `dest_path`, reflinking the chunks where the filesystem allows
+ * it. The packed snapshot is only read, so it can be restored any number of
+ * times, even concurrently. Fails if a chunk is missing or doesn't match its
+ * SHA-256.
+ */
+Result<void> UnpackSnapshot(const std::string& snapshot_path,
+                            const std::string& dest_path);
+
+inline constexpr const char kSnapshotManifestFileName[] =
+    "snapshot_chunks.json";
+// Where a packed snapshot is recreated in the runtime directory to be
+// restored. It isn't part of the snapshots taken afterwards.
+inline constexpr const char kUnpackedSnapshotDir[] = "unpacked_snapshot";
+
+}  // namespace cuttlefish
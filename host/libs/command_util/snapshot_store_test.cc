@@ -0,0 +1,175 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/libs/command_util/snapshot_store.h"
+
+#include <sys/stat.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "common/libs/utils/files.h"
+
+namespace cuttlefish {
+namespace {
+
+constexpr std::size_t kLargeFileSize = 3 << 20;
+
+std::string RandomData(std::size_t size, unsigned int seed) {
+  std::mt19937 generator(seed);
+  std::string data(size, '\0');
+  for (auto& c : data) {
+    c = static_cast<char>(generator());
+  }
+  return data;
+}
+
+std::string ReadFile(const std::string& path) {
+  std::string contents;
+  EXPECT_TRUE(android::base::ReadFileToString(path, &contents)) << path;
+  return contents;
+}
+
+// The paths of the entries of `dir`.
+std::vector<std::string> Entries(const std::string& dir) {
+  std::vector<std::string> entries;
+  auto contents = DirectoryContents(dir);
+  EXPECT_TRUE(contents.ok()) << contents.error().FormatForEnv();
+  if (!contents.ok()) {
+    return entries;
+  }
+  for (const auto& name : *contents) {
+    if (name != "." && name != "..") {
+      entries.push_back(dir + "/" + name);
+    }
+  }
+  return entries;
+}
+
+std::vector<std::string> ChunkFiles(const std::string& store_path) {
+  std::vector<std::string> chunks;
+  for (const auto& prefix_dir : Entries(store_path + "/chunks")) {
+    for (const auto& chunk : Entries(prefix_dir)) {
+      chunks.push_back(chunk);
+    }
+  }
+  return chunks;
+}
+
+class SnapshotStoreTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    store_path_ = std::string(dir_.path) + "/store";
+    // Data, then a run of zeroes, then data again.
+    large_contents_ = RandomData(kLargeFileSize, 1);
+    std::fill(large_contents_.begin() + (1 << 20),
+              large_contents_.begin() + (2 << 20), '\0');
+  }
+
+  std::string MakeSnapshot(const std::string& name) {
+    const std::string path = std::string(dir_.path) + "/" + name;
+    EXPECT_TRUE(EnsureDirectoryExists(path + "/guest").ok());
+    EXPECT_TRUE(android::base::WriteStringToFile("small", path + "/small"));
+    EXPECT_TRUE(android::base::WriteStringToFile(large_contents_,
+                                                 path + "/guest/large"));
+    return path;
+  }
+
+  TemporaryDir dir_;
+  std::string store_path_;
+  std::string large_contents_;
+};
+
+TEST_F(SnapshotStoreTest, RoundTrip) {
+  const std::string snapshot = MakeSnapshot("snapshot");
+
+  auto stats = PackSnapshot(snapshot, store_path_);
+
+  ASSERT_TRUE(stats.ok()) << stats.error().FormatForEnv();
+  EXPECT_EQ(stats->files, 1);
+  EXPECT_EQ(stats->logical_bytes, kLargeFileSize);
+  EXPECT_EQ(stats->zero_bytes, 1 << 20);
+  EXPECT_EQ(stats->stored_bytes, 2 << 20);
+  EXPECT_TRUE(IsPackedSnapshot(snapshot));
+  EXPECT_FALSE(FileExists(snapshot + "/guest/large"));
+
+  // The packed snapshot can be restored more than once.
+  for (const std::string restored : {"restored1", "restored2"}) {
+    const std::string dest = std::string(dir_.path) + "/" + restored;
+    auto result = UnpackSnapshot(snapshot, dest);
+
+    ASSERT_TRUE(result.ok()) << result.error().FormatForEnv();
+    EXPECT_EQ(ReadFile(dest + "/small"), "small");
+    EXPECT_EQ(ReadFile(dest + "/guest/large"), large_contents_);
+    EXPECT_FALSE(IsPackedSnapshot(dest));
+    EXPECT_TRUE(IsPackedSnapshot(snapshot));
+  }
+}
+
+TEST_F(SnapshotStoreTest, SharesChunksBetweenSnapshots) {
+  auto first = PackSnapshot(MakeSnapshot("first"), store_path_);
+  ASSERT_TRUE(first.ok()) << first.error().FormatForEnv();
+  const std::size_t chunk_count = ChunkFiles(store_path_).size();
+
+  auto second = PackSnapshot(MakeSnapshot("second"), store_path_);
+
+  ASSERT_TRUE(second.ok()) << second.error().FormatForEnv();
+  EXPECT_EQ(second->stored_bytes, 0);
+  EXPECT_EQ(second->reused_bytes, first->stored_bytes);
+  EXPECT_EQ(ChunkFiles(store_path_).size(), chunk_count);
+}
+
+TEST_F(SnapshotStoreTest, CorruptChunk) {
+  const std::string snapshot = MakeSnapshot("snapshot");
+  ASSERT_TRUE(PackSnapshot(snapshot, store_path_).ok());
+  const auto chunks = ChunkFiles(store_path_);
+  ASSERT_FALSE(chunks.empty());
+  std::string contents = ReadFile(chunks[0]);
+  contents[0] ^= 1;
+  ASSERT_EQ(chmod(chunks[0].c_str(), 0644), 0);
+  ASSERT_TRUE(android::base::WriteStringToFile(contents, chunks[0]));
+
+  EXPECT_FALSE(UnpackSnapshot(snapshot, std::string(dir_.path) + "/restored")
+                   .ok());
+}
+
+TEST_F(SnapshotStoreTest, TruncatedChunk) {
+  const std::string snapshot = MakeSnapshot("snapshot");
+  ASSERT_TRUE(PackSnapshot(snapshot, store_path_).ok());
+  const auto chunks = ChunkFiles(store_path_);
+  ASSERT_FALSE(chunks.empty());
+  ASSERT_EQ(truncate(chunks[0].c_str(), 4096), 0);
+
+  EXPECT_FALSE(UnpackSnapshot(snapshot, std::string(dir_.path) + "/restored")
+                   .ok());
+}
+
+TEST_F(SnapshotStoreTest, MissingChunk) {
+  const std::string snapshot = MakeSnapshot("snapshot");
+  ASSERT_TRUE(PackSnapshot(snapshot, store_path_).ok());
+  const auto chunks = ChunkFiles(store_path_);
+  ASSERT_FALSE(chunks.empty());
+  ASSERT_TRUE(RemoveFile(chunks[0]));
+
+  EXPECT_FALSE(UnpackSnapshot(snapshot, std::string(dir_.path) + "/restored")
+                   .ok());
+}
+
+}  // namespace
+}  // namespace cuttlefish
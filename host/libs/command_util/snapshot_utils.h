@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <string>
 
@@ -35,6 +36,28 @@ Result<void> CopyDirectoryRecursively(
       return true;
     });
 
+struct CopiedBytes {
+  // Shared with the source through a reflink rather than copied.
+  std::uint64_t cloned = 0;
+  // Data actually copied, holes excluded.
+  std::uint64_t copied = 0;
+};
+
+enum class CopyMode {
+  // Reflinks the file, or else copies its data ranges with copy_file_range.
+  // Falls back to Copy() where copy_file_range isn't supported.
+  kBest,
+  // Only uses Copy().
+  kFallback,
+};
+
+/*
+ * Copies the regular file src_path to dest_path, leaving holes in place.
+ */
+Result<CopiedBytes> CopyRegularFile(const std::string& src_path,
+                                    const std::string& dest_path,
+                                    CopyMode mode = CopyMode::kBest);
+
 Result<Json::Value> CreateMetaInfo(const CuttlefishConfig& config,
                                    const std::string& snapshot_path);
 
@@ -0,0 +1,167 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/libs/command_util/snapshot_utils.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <gtest/gtest.h>
+
+#include "common/libs/utils/files.h"
+
+namespace cuttlefish {
+namespace {
+
+constexpr off_t kSparseFileSize = 4 << 20;
+constexpr off_t kSecondDataOffset = 1 << 20;
+constexpr std::size_t kDataSize = 4096;
+
+std::string ReadFile(const std::string& path) {
+  std::string contents;
+  EXPECT_TRUE(android::base::ReadFileToString(path, &contents)) << path;
+  return contents;
+}
+
+// Two blocks of data with holes around the second one.
+std::string MakeSparseFile(const std::string& path) {
+  android::base::unique_fd fd(
+      open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+  EXPECT_GE(fd.get(), 0) << strerror(errno);
+  const std::string data(kDataSize, 'x');
+  EXPECT_EQ(pwrite(fd.get(), data.data(), data.size(), 0),
+            ssize_t(data.size()));
+  EXPECT_EQ(pwrite(fd.get(), data.data(), data.size(), kSecondDataOffset),
+            ssize_t(data.size()));
+  EXPECT_EQ(ftruncate(fd.get(), kSparseFileSize), 0);
+
+  std::string contents(kSparseFileSize, '\0');
+  contents.replace(0, kDataSize, data);
+  contents.replace(kSecondDataOffset, kDataSize, data);
+  return contents;
+}
+
+off_t AllocatedBytes(const std::string& path) {
+  struct stat st;
+  EXPECT_EQ(stat(path.c_str(), &st), 0) << strerror(errno);
+  return st.st_blocks * 512;
+}
+
+TEST(CopyRegularFileTest, PreservesHoles) {
+  TemporaryDir dir;
+  const std::string src = std::string(dir.path) + "/src";
+  const std::string dest = std::string(dir.path) + "/dest";
+  const std::string contents = MakeSparseFile(src);
+
+  auto bytes = CopyRegularFile(src, dest);
+
+  ASSERT_TRUE(bytes.ok()) << bytes.error().FormatForEnv();
+  EXPECT_EQ(ReadFile(dest), contents);
+  EXPECT_LT(AllocatedBytes(dest), kSparseFileSize / 2);
+  // Depending on the filesystem the file is either reflinked or only its data
+  // is copied.
+  if (bytes->cloned > 0) {
+    EXPECT_EQ(bytes->cloned, std::uint64_t{kSparseFileSize});
+    EXPECT_EQ(bytes->copied, 0u);
+  } else {
+    EXPECT_EQ(bytes->copied, 2 * kDataSize);
+  }
+}
+
+TEST(CopyRegularFileTest, FallbackPreservesHoles) {
+  TemporaryDir dir;
+  const std::string src = std::string(dir.path) + "/src";
+  const std::string dest = std::string(dir.path) + "/dest";
+  const std::string contents = MakeSparseFile(src);
+
+  auto bytes = CopyRegularFile(src, dest, CopyMode::kFallback);
+
+  ASSERT_TRUE(bytes.ok()) << bytes.error().FormatForEnv();
+  EXPECT_EQ(ReadFile(dest), contents);
+  EXPECT_LT(AllocatedBytes(dest), kSparseFileSize / 2);
+  // Only the data counts, not the size of the file.
+  EXPECT_EQ(bytes->cloned, 0u);
+  EXPECT_EQ(bytes->copied, 2 * kDataSize);
+}
+
+TEST(CopyRegularFileTest, ReplacesExistingFile) {
+  TemporaryDir dir;
+  const std::string src = std::string(dir.path) + "/src";
+  const std::string dest = std::string(dir.path) + "/dest";
+  ASSERT_TRUE(android::base::WriteStringToFile("new", src));
+
+  for (auto mode : {CopyMode::kBest, CopyMode::kFallback}) {
+    ASSERT_TRUE(android::base::WriteStringToFile("old contents", dest));
+
+    auto bytes = CopyRegularFile(src, dest, mode);
+
+    ASSERT_TRUE(bytes.ok()) << bytes.error().FormatForEnv();
+    EXPECT_EQ(ReadFile(dest), "new");
+  }
+}
+
+TEST(CopyRegularFileTest, MissingSourceFails) {
+  TemporaryDir dir;
+
+  for (auto mode : {CopyMode::kBest, CopyMode::kFallback}) {
+    EXPECT_FALSE(CopyRegularFile(std::string(dir.path) + "/missing",
+                                 std::string(dir.path) + "/dest", mode)
+                     .ok());
+  }
+}
+
+TEST(CopyDirectoryRecursivelyTest, CopiesTree) {
+  TemporaryDir dir;
+  const std::string src = std::string(dir.path) + "/src";
+  const std::string dest = std::string(dir.path) + "/dest";
+  ASSERT_TRUE(EnsureDirectoryExists(src + "/sub").ok());
+  const std::string sparse = MakeSparseFile(src + "/sparse.img");
+  for (int i = 0; i < 20; i++) {
+    ASSERT_TRUE(android::base::WriteStringToFile(
+        std::to_string(i), src + "/sub/" + std::to_string(i)));
+  }
+  ASSERT_EQ(symlink("sparse.img", (src + "/link").c_str()), 0);
+  // Disk overlays are checked to be newer than their components, so the copy
+  // keeps the modification time.
+  const struct timespec times[2] = {{.tv_sec = 1000, .tv_nsec = 0},
+                                    {.tv_sec = 2000, .tv_nsec = 0}};
+  ASSERT_EQ(utimensat(AT_FDCWD, (src + "/sparse.img").c_str(), times, 0), 0);
+
+  auto result = CopyDirectoryRecursively(src, dest);
+
+  ASSERT_TRUE(result.ok()) << result.error().FormatForEnv();
+  EXPECT_EQ(ReadFile(dest + "/sparse.img"), sparse);
+  for (int i = 0; i < 20; i++) {
+    EXPECT_EQ(ReadFile(dest + "/sub/" + std::to_string(i)),
+              std::to_string(i));
+  }
+  std::string target;
+  ASSERT_TRUE(android::base::Readlink(dest + "/link", &target));
+  EXPECT_EQ(target, "sparse.img");
+  struct stat st;
+  ASSERT_EQ(stat((dest + "/sparse.img").c_str(), &st), 0);
+  EXPECT_EQ(st.st_mtim.tv_sec, 2000);
+}
+
+}  // namespace
+}  // namespace cuttlefish
@@ -172,6 +172,30 @@ void CuttlefishConfig::set_gem5_debug_flags(const std::string& gem5_debug_flags)
   (*dictionary_)[kGem5DebugFlags] = gem5_debug_flags;
 }
 
+static constexpr char kLogRotateSizeMb[] = "log_rotate_size_mb";
+void CuttlefishConfig::set_log_rotate_size_mb(int log_rotate_size_mb) {
+  (*dictionary_)[kLogRotateSizeMb] = log_rotate_size_mb;
+}
+int CuttlefishConfig::log_rotate_size_mb() const {
+  return (*dictionary_)[kLogRotateSizeMb].asInt();
+}
+
+static constexpr char kLogRotateFiles[] = "log_rotate_files";
+void CuttlefishConfig::set_log_rotate_files(int log_rotate_files) {
+  (*dictionary_)[kLogRotateFiles] = log_rotate_files;
+}
+int CuttlefishConfig::log_rotate_files() const {
+  return (*dictionary_)[kLogRotateFiles].asInt();
+}
+
+static constexpr char kLogCompressRotated[] = "log_compress_rotated";
+void CuttlefishConfig::set_log_compress_rotated(bool log_compress_rotated) {
+  (*dictionary_)[kLogCompressRotated] = log_compress_rotated;
+}
+bool CuttlefishConfig::log_compress_rotated() const {
+  return (*dictionary_)[kLogCompressRotated].asBool();
+}
+
 static constexpr char kWebRTCCertsDir[] = "webrtc_certs_dir";
 void CuttlefishConfig::set_webrtc_certs_dir(const std::string& certs_dir) {
   (*dictionary_)[kWebRTCCertsDir] = certs_dir;
@@ -126,6 +126,15 @@ class CuttlefishConfig {
   void set_gem5_debug_flags(const std::string& gem5_debug_flags);
   std::string gem5_debug_flags() const;
 
+  // Rotation of the logcat and kernel log files, which is off while the size
+  // is zero.
+  void set_log_rotate_size_mb(int log_rotate_size_mb);
+  int log_rotate_size_mb() const;
+  void set_log_rotate_files(int log_rotate_files);
+  int log_rotate_files() const;
+  void set_log_compress_rotated(bool log_compress_rotated);
+  bool log_compress_rotated() const;
+
   void set_enable_host_uwb(bool enable_host_uwb);
   bool enable_host_uwb() const;
 
@@ -379,6 +388,8 @@ class CuttlefishConfig {
 
     std::string hwcomposer_pmem_path() const;
 
+    std::string camera_pmem_path() const;
+
     std::string pstore_path() const;
 
     std::string console_path() const;
@@ -588,6 +599,13 @@ class CuttlefishConfig {
     // The range of UDP ports available for webrtc sessions.
     std::pair<uint16_t, uint16_t> webrtc_udp_port_range() const;
 
+    // The video codecs webrtc is allowed to use, most preferred first.
+    std::vector<std::string> webrtc_video_codecs() const;
+
+    // Whether the displays should be encoded with settings tuned for screen
+    // content rather than camera-like video.
+    bool webrtc_screen_content() const;
+
     bool smt() const;
     std::string crosvm_binary() const;
     std::string seccomp_policy_dir() const;
@@ -779,6 +797,8 @@ class CuttlefishConfig {
 
     void set_enable_webrtc(bool enable_webrtc);
     void set_webrtc_assets_dir(const std::string& webrtc_assets_dir);
+    void set_webrtc_video_codecs(const std::vector<std::string>& codecs);
+    void set_webrtc_screen_content(bool screen_content);
 
     // The range of TCP ports available for webrtc sessions.
     void set_webrtc_tcp_port_range(std::pair<uint16_t, uint16_t> range);
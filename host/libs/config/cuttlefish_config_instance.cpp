@@ -922,6 +922,33 @@ std::pair<uint16_t, uint16_t> CuttlefishConfig::InstanceSpecific::webrtc_udp_por
   return ret;
 }
 
+static constexpr char kWebrtcVideoCodecs[] = "webrtc_video_codecs";
+void CuttlefishConfig::MutableInstanceSpecific::set_webrtc_video_codecs(
+    const std::vector<std::string>& codecs) {
+  Json::Value arr(Json::ValueType::arrayValue);
+  for (const auto& codec : codecs) {
+    arr.append(codec);
+  }
+  (*Dictionary())[kWebrtcVideoCodecs] = arr;
+}
+std::vector<std::string>
+CuttlefishConfig::InstanceSpecific::webrtc_video_codecs() const {
+  std::vector<std::string> ret;
+  for (const auto& codec : (*Dictionary())[kWebrtcVideoCodecs]) {
+    ret.push_back(codec.asString());
+  }
+  return ret;
+}
+
+static constexpr char kWebrtcScreenContent[] = "webrtc_screen_content";
+void CuttlefishConfig::MutableInstanceSpecific::set_webrtc_screen_content(
+    bool screen_content) {
+  (*Dictionary())[kWebrtcScreenContent] = screen_content;
+}
+bool CuttlefishConfig::InstanceSpecific::webrtc_screen_content() const {
+  return (*Dictionary())[kWebrtcScreenContent].asBool();
+}
+
 static constexpr char kGrpcConfig[] = "grpc_config";
 std::string CuttlefishConfig::InstanceSpecific::grpc_socket_path() const {
   return (*Dictionary())[kGrpcConfig].asString();
@@ -1152,6 +1179,10 @@ std::string CuttlefishConfig::InstanceSpecific::hwcomposer_pmem_path() const {
   return AbsolutePath(PerInstancePath("hwcomposer-pmem"));
 }
 
+std::string CuttlefishConfig::InstanceSpecific::camera_pmem_path() const {
+  return AbsolutePath(PerInstancePath("camera-pmem"));
+}
+
 std::string CuttlefishConfig::InstanceSpecific::pstore_path() const {
   return AbsolutePath(PerInstancePath("pstore"));
 }
@@ -16,7 +16,20 @@
 
 #include "host/libs/config/feature.h"
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include <android-base/strings.h>
 
@@ -26,8 +39,132 @@ namespace cuttlefish {
 
 SetupFeature::~SetupFeature() {}
 
+namespace {
+
+using SetupClock = std::chrono::steady_clock;
+
+struct SetupNode {
+  SetupFeature* feature;
+  std::vector<std::size_t> dependencies;
+  std::vector<std::size_t> dependents;
+  std::size_t pending_dependencies = 0;
+  SetupClock::duration duration{};
+};
+
+std::int64_t Millis(SetupClock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(duration)
+      .count();
+}
+
+// Runs every node once all of its dependencies are done, using up to
+// `concurrency` threads including the calling one. After a failure no further
+// nodes are started, the ones already running are waited for.
+Result<void> RunSetupGraph(
+    std::vector<SetupNode>& nodes, std::size_t concurrency,
+    const std::function<Result<void>(SetupFeature*)>& setup) {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<std::size_t> ready;
+  std::size_t running = 0;
+  std::optional<Result<void>> failure;
+  std::string failed_feature;
+  for (std::size_t i = 0; i < nodes.size(); i++) {
+    if (nodes[i].pending_dependencies == 0) {
+      ready.push_back(i);
+    }
+  }
+
+  auto worker = [&]() {
+    std::unique_lock lock(mutex);
+    for (;;) {
+      cv.wait(lock, [&]() { return !ready.empty() || failure || !running; });
+      if (failure || ready.empty()) {
+        return;
+      }
+      auto& node = nodes[ready.front()];
+      ready.pop_front();
+      running++;
+      lock.unlock();
+
+      LOG(DEBUG) << "Running setup for " << node.feature->Name();
+      auto start = SetupClock::now();
+      auto result = setup(node.feature);
+      auto duration = SetupClock::now() - start;
+      LOG(DEBUG) << "Setup for " << node.feature->Name() << " took "
+                 << Millis(duration) << "ms";
+
+      lock.lock();
+      running--;
+      node.duration = duration;
+      if (!result.ok()) {
+        if (!failure) {
+          failure = std::move(result);
+          failed_feature = node.feature->Name();
+        }
+      } else {
+        for (auto dependent : node.dependents) {
+          if (--nodes[dependent].pending_dependencies == 0) {
+            ready.push_back(dependent);
+          }
+        }
+      }
+      cv.notify_all();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < std::min(concurrency, nodes.size()); i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  if (failure) {
+    CF_EXPECT(std::move(*failure), "Setup failed for " << failed_feature);
+  }
+  return {};
+}
+
+// Logs the chain of dependent features with the largest total setup time,
+// which bounds how fast the setup can complete regardless of the concurrency.
+// `nodes` must be in dependency order.
+void LogCriticalPath(const std::vector<SetupNode>& nodes,
+                     SetupClock::duration wall_time) {
+  if (nodes.empty()) {
+    return;
+  }
+  std::vector<SetupClock::duration> path_time(nodes.size());
+  std::vector<std::optional<std::size_t>> path_previous(nodes.size());
+  std::size_t last = 0;
+  for (std::size_t i = 0; i < nodes.size(); i++) {
+    for (auto dependency : nodes[i].dependencies) {
+      if (path_time[dependency] > path_time[i]) {
+        path_time[i] = path_time[dependency];
+        path_previous[i] = dependency;
+      }
+    }
+    path_time[i] += nodes[i].duration;
+    if (path_time[i] > path_time[last]) {
+      last = i;
+    }
+  }
+  std::vector<std::string> path;
+  for (std::optional<std::size_t> i = last; i; i = path_previous[*i]) {
+    path.push_back(nodes[*i].feature->Name() + " (" +
+                   std::to_string(Millis(nodes[*i].duration)) + "ms)");
+  }
+  std::reverse(path.begin(), path.end());
+  LOG(DEBUG) << "Setup of " << nodes.size() << " features took "
+             << Millis(wall_time) << "ms, critical path of "
+             << Millis(path_time[last])
+             << "ms: " << android::base::Join(path, " -> ");
+}
+
+}  // namespace
+
 /* static */ Result<void> SetupFeature::RunSetup(
-    const std::vector<SetupFeature*>& features) {
+    const std::vector<SetupFeature*>& features, std::size_t concurrency) {
   std::unordered_set<SetupFeature*> enabled;
   for (const auto& feature : features) {
     CF_EXPECT(feature != nullptr, "Received null feature");
@@ -44,11 +181,26 @@ SetupFeature::~SetupFeature() {}
   };
   CF_EXPECT(Feature<SetupFeature>::TopologicalVisit(enabled, add_feature),
             "Dependency issue detected, not performing any setup.");
-  // TODO(b/189153501): This can potentially be parallelized.
+
+  std::unordered_map<SetupFeature*, std::size_t> indices;
+  std::vector<SetupNode> nodes;
   for (auto& feature : ordered_features) {
-    LOG(DEBUG) << "Running setup for " << feature->Name();
-    CF_EXPECT(feature->ResultSetup(), "Setup failed for " << feature->Name());
+    indices[feature] = nodes.size();
+    nodes.push_back(SetupNode{.feature = feature});
   }
+  for (std::size_t i = 0; i < nodes.size(); i++) {
+    for (auto& dependency : nodes[i].feature->Dependencies()) {
+      auto dependency_index = indices.at(dependency);
+      nodes[i].dependencies.push_back(dependency_index);
+      nodes[i].pending_dependencies++;
+      nodes[dependency_index].dependents.push_back(i);
+    }
+  }
+
+  auto start = SetupClock::now();
+  auto setup = [](SetupFeature* feature) { return feature->ResultSetup(); };
+  CF_EXPECT(RunSetupGraph(nodes, std::max<std::size_t>(concurrency, 1), setup));
+  LogCriticalPath(nodes, SetupClock::now() - start);
   return {};
 }
 
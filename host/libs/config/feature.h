@@ -15,6 +15,8 @@
  */
 #pragma once
 
+#include <cstddef>
+#include <functional>
 #include <ostream>
 #include <string>
 #include <type_traits>
@@ -41,7 +43,7 @@ class Feature {
       const std::unordered_set<Subclass*>& features,
       const std::function<Result<void>(Subclass*)>& callback);
 
- private:
+ protected:
   virtual std::unordered_set<Subclass*> Dependencies() const = 0;
 };
 
@@ -49,7 +51,13 @@ class SetupFeature : public virtual Feature<SetupFeature> {
  public:
   virtual ~SetupFeature();
 
-  static Result<void> RunSetup(const std::vector<SetupFeature*>& features);
+  // Runs the setup of every enabled feature after the setup of its
+  // dependencies. Up to `concurrency` features whose dependencies are done run
+  // at the same time, the default keeps everything on the calling thread.
+  // Features that affect the whole process, e.g. by forking, must only be run
+  // with a concurrency of 1.
+  static Result<void> RunSetup(const std::vector<SetupFeature*>& features,
+                               std::size_t concurrency = 1);
 
   virtual bool Enabled() const = 0;
 
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/libs/config/feature.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "common/libs/utils/result_matchers.h"
+
+namespace cuttlefish {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+class TestFeature : public SetupFeature {
+ public:
+  TestFeature(std::string name, std::function<Result<void>()> setup)
+      : name_(std::move(name)), setup_(std::move(setup)) {}
+
+  void DependOn(TestFeature& dependency) { dependencies_.insert(&dependency); }
+  void Disable() { enabled_ = false; }
+
+  std::string Name() const override { return name_; }
+  bool Enabled() const override { return enabled_; }
+
+ private:
+  std::unordered_set<SetupFeature*> Dependencies() const override {
+    return dependencies_;
+  }
+  Result<void> ResultSetup() override { return setup_(); }
+
+  std::string name_;
+  std::function<Result<void>()> setup_;
+  std::unordered_set<SetupFeature*> dependencies_;
+  bool enabled_ = true;
+};
+
+class RunSetupTest : public ::testing::Test {
+ protected:
+  // Adds a feature that records its name once its setup runs.
+  TestFeature& Add(const std::string& name) {
+    return Add(name, [this, name]() -> Result<void> {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ran_.push_back(name);
+      return {};
+    });
+  }
+
+  TestFeature& Add(const std::string& name,
+                   std::function<Result<void>()> setup) {
+    features_.push_back(std::make_unique<TestFeature>(name, std::move(setup)));
+    return *features_.back();
+  }
+
+  Result<void> Run(std::size_t concurrency) {
+    std::vector<SetupFeature*> features;
+    for (const auto& feature : features_) {
+      features.push_back(feature.get());
+    }
+    return SetupFeature::RunSetup(features, concurrency);
+  }
+
+  // Where `name` is in the order the features ran, or ran_.size() if it
+  // didn't run.
+  std::size_t Position(const std::string& name) {
+    return std::find(ran_.begin(), ran_.end(), name) - ran_.begin();
+  }
+
+  std::vector<std::unique_ptr<TestFeature>> features_;
+  std::mutex mutex_;
+  std::vector<std::string> ran_;
+};
+
+TEST_F(RunSetupTest, RunsDependenciesFirst) {
+  for (std::size_t concurrency : {1, 4}) {
+    features_.clear();
+    ran_.clear();
+    // A diamond below a chain: a -> b -> {c, d} -> e.
+    auto& e = Add("e");
+    auto& d = Add("d");
+    auto& c = Add("c");
+    auto& b = Add("b");
+    auto& a = Add("a");
+    b.DependOn(a);
+    c.DependOn(b);
+    d.DependOn(b);
+    e.DependOn(c);
+    e.DependOn(d);
+
+    EXPECT_THAT(Run(concurrency), IsOk());
+
+    ASSERT_EQ(ran_.size(), 5u) << "concurrency " << concurrency;
+    EXPECT_LT(Position("a"), Position("b"));
+    EXPECT_LT(Position("b"), Position("c"));
+    EXPECT_LT(Position("b"), Position("d"));
+    EXPECT_LT(Position("c"), Position("e"));
+    EXPECT_LT(Position("d"), Position("e"));
+  }
+}
+
+TEST_F(RunSetupTest, SkipsDisabledFeatures) {
+  Add("a");
+  Add("b").Disable();
+
+  EXPECT_THAT(Run(1), IsOk());
+
+  EXPECT_THAT(ran_, ElementsAre("a"));
+}
+
+TEST_F(RunSetupTest, DependencyOnDisabledFeatureFails) {
+  auto& a = Add("a");
+  a.Disable();
+  Add("b").DependOn(a);
+
+  EXPECT_THAT(Run(1), IsError());
+
+  EXPECT_THAT(ran_, IsEmpty());
+}
+
+TEST_F(RunSetupTest, DetectsCycles) {
+  auto& a = Add("a");
+  auto& b = Add("b");
+  auto& c = Add("c");
+  Add("d");
+  b.DependOn(a);
+  c.DependOn(b);
+  a.DependOn(c);
+
+  EXPECT_THAT(Run(4), IsError());
+
+  // Nothing runs, not even the features outside of the cycle.
+  EXPECT_THAT(ran_, IsEmpty());
+}
+
+TEST_F(RunSetupTest, FailureStopsDependents) {
+  for (std::size_t concurrency : {1, 4}) {
+    features_.clear();
+    ran_.clear();
+    auto& a = Add("a");
+    auto& failing =
+        Add("failing", []() -> Result<void> { return CF_ERR("failed"); });
+    auto& b = Add("b");
+    auto& c = Add("c");
+    failing.DependOn(a);
+    b.DependOn(failing);
+    c.DependOn(b);
+
+    EXPECT_THAT(Run(concurrency), IsError());
+
+    EXPECT_THAT(ran_, ElementsAre("a")) << "concurrency " << concurrency;
+  }
+}
+
+TEST_F(RunSetupTest, FailureIsReturnedAfterRunningFeaturesFinish) {
+  std::condition_variable cv;
+  bool slow_started = false;
+  std::atomic<bool> slow_done = false;
+  Add("slow", [&]() -> Result<void> {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      slow_started = true;
+    }
+    cv.notify_all();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    slow_done = true;
+    return {};
+  });
+  // Only fails once "slow" is running, otherwise it would never be started.
+  Add("failing", [&]() -> Result<void> {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv.wait_for(lock, std::chrono::seconds(10), [&]() { return slow_started; });
+    return CF_ERR("failed");
+  });
+
+  EXPECT_THAT(Run(2), IsError());
+
+  EXPECT_TRUE(slow_started);
+  EXPECT_TRUE(slow_done);
+}
+
+TEST_F(RunSetupTest, RunsIndependentFeaturesConcurrently) {
+  constexpr std::size_t kConcurrency = 3;
+  std::condition_variable cv;
+  std::size_t started = 0;
+  bool timed_out = false;
+  // Every feature waits for the others to start, which only happens when each
+  // of them is on a thread of its own.
+  for (std::size_t i = 0; i < kConcurrency; i++) {
+    Add(std::to_string(i), [&]() -> Result<void> {
+      std::unique_lock<std::mutex> lock(mutex_);
+      started++;
+      cv.notify_all();
+      if (!cv.wait_for(lock, std::chrono::seconds(10),
+                       [&]() { return started == kConcurrency; })) {
+        timed_out = true;
+      }
+      return {};
+    });
+  }
+
+  EXPECT_THAT(Run(kConcurrency), IsOk());
+
+  EXPECT_FALSE(timed_out);
+}
+
+TEST_F(RunSetupTest, RunsAtMostConcurrencyFeaturesAtOnce) {
+  constexpr std::size_t kConcurrency = 3;
+  std::size_t running = 0;
+  std::size_t max_running = 0;
+  for (int i = 0; i < 12; i++) {
+    Add(std::to_string(i), [&]() -> Result<void> {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running++;
+        max_running = std::max(max_running, running);
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      std::lock_guard<std::mutex> lock(mutex_);
+      running--;
+      return {};
+    });
+  }
+
+  EXPECT_THAT(Run(kConcurrency), IsOk());
+
+  EXPECT_GE(max_running, 1u);
+  EXPECT_LE(max_running, kConcurrency);
+}
+
+}  // namespace
+}  // namespace cuttlefish
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/libs/config/video_codecs.h"
+
+#include <algorithm>
+#include <cctype>
+#include <set>
+
+#include <android-base/strings.h>
+
+#include "common/libs/utils/contains.h"
+
+namespace cuttlefish {
+
+Result<std::vector<std::string>> ParseVideoCodecs(const std::string& flag) {
+  static const std::set<std::string> kSupportedCodecs = {"vp8", "vp9", "h264",
+                                                         "av1"};
+  std::vector<std::string> codecs;
+  for (const auto& codec : android::base::Tokenize(flag, ":")) {
+    std::string lower_codec = codec;
+    std::transform(lower_codec.begin(), lower_codec.end(), lower_codec.begin(),
+                   ::tolower);
+    CF_EXPECTF(Contains(kSupportedCodecs, lower_codec),
+               "Unsupported webrtc video codec: \"{}\"", codec);
+    CF_EXPECTF(std::find(codecs.begin(), codecs.end(), lower_codec) ==
+                   codecs.end(),
+               "Video codec \"{}\" given more than once", codec);
+    codecs.push_back(lower_codec);
+  }
+  CF_EXPECT(!codecs.empty(), "At least one webrtc video codec is required");
+  return codecs;
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common/libs/utils/result.h"
+
+namespace cuttlefish {
+
+// Parses a list of webrtc video codecs given as "codec1:codec2:...", most
+// preferred first, into their lower case names. Fails on unknown or repeated
+// codecs and on an empty list.
+Result<std::vector<std::string>> ParseVideoCodecs(const std::string& flag);
+
+}  // namespace cuttlefish
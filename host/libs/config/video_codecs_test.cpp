@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/libs/config/video_codecs.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "common/libs/utils/result_matchers.h"
+
+namespace cuttlefish {
+namespace {
+
+using ::testing::ElementsAre;
+
+TEST(ParseVideoCodecsTest, KeepsOrderOfPreference) {
+  EXPECT_THAT(ParseVideoCodecs("vp9:vp8:h264:av1"),
+              IsOkAndValue(ElementsAre("vp9", "vp8", "h264", "av1")));
+}
+
+TEST(ParseVideoCodecsTest, IgnoresCase) {
+  EXPECT_THAT(ParseVideoCodecs("VP9:H264"),
+              IsOkAndValue(ElementsAre("vp9", "h264")));
+}
+
+TEST(ParseVideoCodecsTest, RejectsUnknownCodec) {
+  EXPECT_THAT(ParseVideoCodecs("vp8:theora"), IsError());
+}
+
+TEST(ParseVideoCodecsTest, RejectsDuplicateCodec) {
+  EXPECT_THAT(ParseVideoCodecs("vp8:vp9:VP8"), IsError());
+}
+
+TEST(ParseVideoCodecsTest, RejectsEmptyList) {
+  EXPECT_THAT(ParseVideoCodecs(""), IsError());
+  EXPECT_THAT(ParseVideoCodecs("::"), IsError());
+}
+
+}  // namespace
+}  // namespace cuttlefish
@@ -0,0 +1,210 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/libs/log_sink/buffered_log_sink.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#include <android-base/logging.h>
+#include <zlib.h>
+
+#include "common/libs/utils/files.h"
+
+namespace cuttlefish {
+namespace {
+
+constexpr char kCompressedExtension[] = ".gz";
+// The buffer is written out before a read would get less than this much room.
+constexpr std::size_t kMinReadSize = 4096;
+
+Result<void> Compress(const std::string& path) {
+  const std::string compressed_path = path + kCompressedExtension;
+  const std::string temporary_path = compressed_path + ".tmp";
+  SharedFD input = SharedFD::Open(path, O_RDONLY);
+  CF_EXPECTF(input->IsOpen(), "Failed to open \"{}\": {}", path,
+             input->StrError());
+  gzFile output = gzopen(temporary_path.c_str(), "wb");
+  CF_EXPECTF(output != nullptr, "Failed to create \"{}\"", temporary_path);
+  std::vector<char> buffer(1 << 16);
+  for (;;) {
+    ssize_t bytes_read = input->Read(buffer.data(), buffer.size());
+    if (bytes_read < 0) {
+      gzclose(output);
+      return CF_ERRF("Failed to read \"{}\": {}", path, input->StrError());
+    }
+    if (bytes_read == 0) {
+      break;
+    }
+    if (gzwrite(output, buffer.data(), bytes_read) != bytes_read) {
+      gzclose(output);
+      return CF_ERRF("Failed to write \"{}\"", temporary_path);
+    }
+  }
+  CF_EXPECTF(gzclose(output) == Z_OK, "Failed to write \"{}\"",
+             temporary_path);
+  CF_EXPECT(RenameFile(temporary_path, compressed_path));
+  CF_EXPECTF(RemoveFile(path), "Failed to remove \"{}\"", path);
+  return {};
+}
+
+double PerMiB(std::uint64_t calls, std::uint64_t bytes) {
+  return bytes == 0 ? 0.0 : calls * double(1 << 20) / bytes;
+}
+
+}  // namespace
+
+BufferedLogSink::BufferedLogSink(const std::string& path,
+                                 const LogSinkOptions& options)
+    : path_(path),
+      options_(options),
+      buffer_(std::max(options.buffer_size, kMinReadSize)) {}
+
+Result<std::unique_ptr<BufferedLogSink>> BufferedLogSink::Create(
+    const std::string& path, const LogSinkOptions& options) {
+  std::unique_ptr<BufferedLogSink> sink(new BufferedLogSink(path, options));
+  CF_EXPECT(sink->Open());
+  return sink;
+}
+
+BufferedLogSink::~BufferedLogSink() {
+  auto flushed = Flush();
+  if (!flushed.ok()) {
+    LOG(ERROR) << flushed.error().FormatForEnv();
+  }
+  WaitForCompression();
+  LOG(DEBUG) << "Wrote " << stats_.bytes << " bytes to \"" << path_
+             << "\" with " << PerMiB(stats_.read_calls, stats_.bytes)
+             << " reads and " << PerMiB(stats_.write_calls, stats_.bytes)
+             << " writes per MiB, rotating " << stats_.rotations << " times";
+}
+
+Result<std::string_view> BufferedLogSink::ReadFrom(SharedFD input) {
+  if (buffer_.size() - buffered_ < kMinReadSize) {
+    CF_EXPECT(Flush());
+  }
+  const std::size_t space = buffer_.size() - buffered_;
+  ssize_t bytes_read = input->Read(buffer_.data() + buffered_, space);
+  CF_EXPECTF(bytes_read >= 0, "Failed to read logs: {}", input->StrError());
+  stats_.read_calls++;
+  std::string_view data(buffer_.data() + buffered_, bytes_read);
+  buffered_ += bytes_read;
+  // Flushing leaves the contents of the buffer alone, so `data` stays valid.
+  if (static_cast<std::size_t>(bytes_read) < space) {
+    CF_EXPECT(Flush());
+  }
+  return data;
+}
+
+Result<void> BufferedLogSink::Flush() {
+  if (buffered_ == 0) {
+    return {};
+  }
+  if (options_.rotate_size > 0 && file_size_ > 0 &&
+      file_size_ + buffered_ > rotate_at_) {
+    CF_EXPECT(Rotate());
+  }
+  for (std::size_t written = 0; written < buffered_;) {
+    ssize_t result =
+        file_->Write(buffer_.data() + written, buffered_ - written);
+    CF_EXPECTF(result > 0, "Failed to write to \"{}\": {}", path_,
+               file_->StrError());
+    stats_.write_calls++;
+    written += result;
+  }
+  file_size_ += buffered_;
+  stats_.bytes += buffered_;
+  buffered_ = 0;
+  return {};
+}
+
+Result<void> BufferedLogSink::Open() {
+  file_ = SharedFD::Open(path_, O_CREAT | O_WRONLY | O_APPEND, 0666);
+  CF_EXPECTF(file_->IsOpen(), "Failed to open \"{}\": {}", path_,
+             file_->StrError());
+  off_t size = file_->LSeek(0, SEEK_END);
+  CF_EXPECTF(size >= 0, "Failed to seek in \"{}\": {}", path_,
+             file_->StrError());
+  file_size_ = size;
+  rotate_at_ = options_.rotate_size;
+  return {};
+}
+
+Result<void> BufferedLogSink::Rotate() {
+  // Shifting the rotated files must not race with compressing the newest.
+  WaitForCompression();
+  file_->Close();
+  auto shifted = ShiftRotatedFiles();
+  // Whether or not the file was moved away, logging goes on in `path_`.
+  CF_EXPECT(Open());
+  if (!shifted.ok()) {
+    // Retrying on every write would only repeat the error.
+    rotate_at_ = file_size_ + options_.rotate_size;
+    LOG(ERROR) << "Failed to rotate \"" << path_
+               << "\": " << shifted.error().FormatForEnv();
+    return {};
+  }
+  stats_.rotations++;
+  LOG(DEBUG) << "Rotated \"" << path_ << "\" after " << stats_.bytes
+             << " bytes, " << PerMiB(stats_.read_calls, stats_.bytes)
+             << " reads and " << PerMiB(stats_.write_calls, stats_.bytes)
+             << " writes per MiB";
+
+  if (options_.compress_rotated && options_.rotated_files > 0) {
+    compression_ = std::thread([path = path_ + ".1"]() {
+      auto compressed = Compress(path);
+      if (!compressed.ok()) {
+        LOG(ERROR) << "Failed to compress \"" << path
+                   << "\": " << compressed.error().FormatForEnv();
+      }
+    });
+  }
+  return {};
+}
+
+Result<void> BufferedLogSink::ShiftRotatedFiles() {
+  if (options_.rotated_files == 0) {
+    CF_EXPECTF(RemoveFile(path_), "Failed to remove \"{}\"", path_);
+    return {};
+  }
+  const std::string extension =
+      options_.compress_rotated ? kCompressedExtension : "";
+  auto rotated_path = [this, &extension](std::size_t index) {
+    return path_ + "." + std::to_string(index) + extension;
+  };
+  const std::string oldest = rotated_path(options_.rotated_files);
+  if (FileExists(oldest)) {
+    CF_EXPECTF(RemoveFile(oldest), "Failed to remove \"{}\"", oldest);
+  }
+  for (std::size_t i = options_.rotated_files - 1; i > 0; i--) {
+    if (FileExists(rotated_path(i))) {
+      CF_EXPECT(RenameFile(rotated_path(i), rotated_path(i + 1)));
+    }
+  }
+  CF_EXPECT(RenameFile(path_, path_ + ".1"));
+  return {};
+}
+
+void BufferedLogSink::WaitForCompression() {
+  if (compression_.joinable()) {
+    compression_.join();
+  }
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,92 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "common/libs/fs/shared_fd.h"
+#include "common/libs/utils/result.h"
+
+namespace cuttlefish {
+
+struct LogSinkOptions {
+  // Reads go straight into a buffer of this size, which is written out once
+  // it's full or the input has been drained.
+  std::size_t buffer_size = 1 << 16;
+  // The log file is rotated before it would grow past this size. Zero keeps a
+  // single file that grows without a limit.
+  std::uint64_t rotate_size = 0;
+  // How many rotated files are kept, as `path`.1 (the newest) to `path`.N.
+  std::size_t rotated_files = 4;
+  // Whether rotated files are gzipped, in the background.
+  bool compress_rotated = false;
+};
+
+struct LogSinkStats {
+  std::uint64_t read_calls = 0;
+  std::uint64_t write_calls = 0;
+  std::uint64_t bytes = 0;
+  std::uint64_t rotations = 0;
+};
+
+/**
+ * Copies the output of a guest log pipe into a log file with few, large
+ * reads and writes.
+ *
+ * Data is never held back while the input is idle: a read that doesn't fill
+ * the buffer means the pipe was drained, and the buffer is written out right
+ * away. Under load, reads fill the buffer and each write covers many of them.
+ */
+class BufferedLogSink {
+ public:
+  static Result<std::unique_ptr<BufferedLogSink>> Create(
+      const std::string& path, const LogSinkOptions& options = {});
+  ~BufferedLogSink();
+
+  // Reads once from `input`. Returns the data read, which stays valid until
+  // the next call, or an empty view on end of file.
+  Result<std::string_view> ReadFrom(SharedFD input);
+  Result<void> Flush();
+
+  const LogSinkStats& Stats() const { return stats_; }
+
+ private:
+  BufferedLogSink(const std::string& path, const LogSinkOptions& options);
+
+  Result<void> Open();
+  Result<void> Rotate();
+  Result<void> ShiftRotatedFiles();
+  void WaitForCompression();
+
+  const std::string path_;
+  const LogSinkOptions options_;
+  SharedFD file_;
+  std::uint64_t file_size_ = 0;
+  // The file is rotated once it would grow past this size.
+  std::uint64_t rotate_at_ = 0;
+  std::vector<char> buffer_;
+  std::size_t buffered_ = 0;
+  LogSinkStats stats_;
+  std::thread compression_;
+};
+
+}  // namespace cuttlefish
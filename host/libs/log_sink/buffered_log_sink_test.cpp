@@ -0,0 +1,177 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/libs/log_sink/buffered_log_sink.h"
+
+#include <string>
+
+#include <android-base/file.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+#include "common/libs/fs/shared_buf.h"
+#include "common/libs/utils/files.h"
+#include "common/libs/utils/result_matchers.h"
+
+namespace cuttlefish {
+namespace {
+
+std::string ReadFile(const std::string& path) {
+  std::string contents;
+  android::base::ReadFileToString(path, &contents);
+  return contents;
+}
+
+std::string ReadGzipFile(const std::string& path) {
+  std::string contents;
+  gzFile file = gzopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return contents;
+  }
+  char buffer[4096];
+  int bytes_read;
+  while ((bytes_read = gzread(file, buffer, sizeof(buffer))) > 0) {
+    contents.append(buffer, bytes_read);
+  }
+  gzclose(file);
+  return contents;
+}
+
+class BufferedLogSinkTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(SharedFD::Pipe(&read_end_, &write_end_));
+    path_ = std::string(dir_.path) + "/kernel.log";
+  }
+
+  TemporaryDir dir_;
+  std::string path_;
+  SharedFD read_end_;
+  SharedFD write_end_;
+};
+
+TEST_F(BufferedLogSinkTest, WritesDrainedInputRightAway) {
+  auto sink = BufferedLogSink::Create(path_);
+  ASSERT_THAT(sink, IsOk());
+  ASSERT_EQ(WriteAll(write_end_, "hello\n"), 6);
+
+  auto data = (*sink)->ReadFrom(read_end_);
+
+  ASSERT_THAT(data, IsOk());
+  EXPECT_EQ(*data, "hello\n");
+  EXPECT_EQ(ReadFile(path_), "hello\n");
+}
+
+TEST_F(BufferedLogSinkTest, CoalescesFullReads) {
+  auto sink = BufferedLogSink::Create(path_, {.buffer_size = 8192});
+  ASSERT_THAT(sink, IsOk());
+  const std::string chunk(4096, 'a');
+  ASSERT_EQ(WriteAll(write_end_, chunk + chunk + "tail"), 8196);
+
+  ASSERT_THAT((*sink)->ReadFrom(read_end_), IsOk());
+  EXPECT_EQ(ReadFile(path_), "");
+  ASSERT_THAT((*sink)->ReadFrom(read_end_), IsOk());
+
+  EXPECT_EQ(ReadFile(path_), chunk + chunk + "tail");
+  EXPECT_EQ((*sink)->Stats().read_calls, 2u);
+  EXPECT_EQ((*sink)->Stats().write_calls, 2u);
+  EXPECT_EQ((*sink)->Stats().bytes, 8196u);
+}
+
+TEST_F(BufferedLogSinkTest, AppendsToExistingFile) {
+  ASSERT_TRUE(android::base::WriteStringToFile("old\n", path_));
+  auto sink = BufferedLogSink::Create(path_);
+  ASSERT_THAT(sink, IsOk());
+  ASSERT_EQ(WriteAll(write_end_, "new\n"), 4);
+
+  ASSERT_THAT((*sink)->ReadFrom(read_end_), IsOk());
+
+  EXPECT_EQ(ReadFile(path_), "old\nnew\n");
+}
+
+TEST_F(BufferedLogSinkTest, RotatesAndKeepsNewestFiles) {
+  auto sink = BufferedLogSink::Create(
+      path_, {.rotate_size = 10, .rotated_files = 2});
+  ASSERT_THAT(sink, IsOk());
+
+  for (const char* line : {"first\n", "second\n", "third\n", "fourth\n"}) {
+    ASSERT_GT(WriteAll(write_end_, line), 0);
+    ASSERT_THAT((*sink)->ReadFrom(read_end_), IsOk());
+  }
+
+  EXPECT_EQ(ReadFile(path_), "fourth\n");
+  EXPECT_EQ(ReadFile(path_ + ".1"), "third\n");
+  EXPECT_EQ(ReadFile(path_ + ".2"), "second\n");
+  EXPECT_FALSE(FileExists(path_ + ".3"));
+  EXPECT_EQ((*sink)->Stats().rotations, 3u);
+}
+
+TEST_F(BufferedLogSinkTest, CompressesRotatedFiles) {
+  auto sink = BufferedLogSink::Create(
+      path_, {.rotate_size = 10, .rotated_files = 2, .compress_rotated = true});
+  ASSERT_THAT(sink, IsOk());
+
+  for (const char* line : {"first\n", "second\n", "third\n"}) {
+    ASSERT_GT(WriteAll(write_end_, line), 0);
+    ASSERT_THAT((*sink)->ReadFrom(read_end_), IsOk());
+  }
+  sink->reset();
+
+  EXPECT_EQ(ReadFile(path_), "third\n");
+  EXPECT_EQ(ReadGzipFile(path_ + ".1.gz"), "second\n");
+  EXPECT_EQ(ReadGzipFile(path_ + ".2.gz"), "first\n");
+  EXPECT_FALSE(FileExists(path_ + ".1"));
+}
+
+TEST_F(BufferedLogSinkTest, KeepsLoggingWhenRotationFails) {
+  // A directory that isn't empty can't be removed to make room.
+  ASSERT_THAT(EnsureDirectoryExists(path_ + ".1/blocker"), IsOk());
+  auto sink = BufferedLogSink::Create(
+      path_, {.rotate_size = 10, .rotated_files = 1});
+  ASSERT_THAT(sink, IsOk());
+
+  for (const char* line : {"first\n", "second\n", "third\n"}) {
+    ASSERT_GT(WriteAll(write_end_, line), 0);
+    ASSERT_THAT((*sink)->ReadFrom(read_end_), IsOk());
+  }
+
+  EXPECT_EQ(ReadFile(path_), "first\nsecond\nthird\n");
+  EXPECT_EQ((*sink)->Stats().rotations, 0u);
+
+  // Rotation is retried once the file grew by another rotation size.
+  ASSERT_TRUE(RemoveFile(path_ + ".1/blocker"));
+  ASSERT_TRUE(RemoveFile(path_ + ".1"));
+  ASSERT_GT(WriteAll(write_end_, "fourth\n"), 0);
+  ASSERT_THAT((*sink)->ReadFrom(read_end_), IsOk());
+
+  EXPECT_EQ(ReadFile(path_), "fourth\n");
+  EXPECT_EQ(ReadFile(path_ + ".1"), "first\nsecond\nthird\n");
+  EXPECT_EQ((*sink)->Stats().rotations, 1u);
+}
+
+TEST_F(BufferedLogSinkTest, EndOfFileFlushes) {
+  auto sink = BufferedLogSink::Create(path_);
+  ASSERT_THAT(sink, IsOk());
+  write_end_->Close();
+
+  auto data = (*sink)->ReadFrom(read_end_);
+
+  ASSERT_THAT(data, IsOk());
+  EXPECT_TRUE(data->empty());
+}
+
+}  // namespace
+}  // namespace cuttlefish
@@ -0,0 +1,33 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/libs/log_sink/log_sink_options.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace cuttlefish {
+
+LogSinkOptions LogSinkOptionsFromConfig(const CuttlefishConfig& config) {
+  return LogSinkOptions{
+      .rotate_size = std::uint64_t(std::max(config.log_rotate_size_mb(), 0))
+                     << 20,
+      .rotated_files = std::size_t(std::max(config.log_rotate_files(), 0)),
+      .compress_rotated = config.log_compress_rotated(),
+  };
+}
+
+}  // namespace cuttlefish
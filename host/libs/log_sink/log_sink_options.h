@@ -0,0 +1,26 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "host/libs/config/cuttlefish_config.h"
+#include "host/libs/log_sink/buffered_log_sink.h"
+
+namespace cuttlefish {
+
+// The rotation settings assemble_cvd stored for the guest log files.
+LogSinkOptions LogSinkOptionsFromConfig(const CuttlefishConfig& config);
+
+}  // namespace cuttlefish
@@ -55,13 +55,16 @@ class ScreenConnector : public ScreenConnectorInfo,
 
   using FrameMultiplexer = ScreenConnectorInputMultiplexer<ProcessedFrameType>;
 
+  struct FrameQueueMode {};
   INJECT(ScreenConnector(WaylandScreenConnector& sc_android_src,
-                         HostModeCtrl& host_mode_ctrl))
+                         HostModeCtrl& host_mode_ctrl,
+                         ANNOTATED(FrameQueueMode, ScreenConnectorQueueMode)
+                             frame_queue_mode))
       : sc_android_src_(sc_android_src),
         host_mode_ctrl_{host_mode_ctrl},
         on_next_frame_cnt_{0},
         render_confui_cnt_{0},
-        sc_frame_multiplexer_{host_mode_ctrl_} {
+        sc_frame_multiplexer_{host_mode_ctrl_, frame_queue_mode} {
     auto config = cuttlefish::CuttlefishConfig::Get();
     if (!config) {
       LOG(FATAL) << "CuttlefishConfig is not available.";
@@ -84,11 +87,14 @@ class ScreenConnector : public ScreenConnectorInfo,
    * The callback function is how a raw bytes frame should be processed for
    * WebRTC
    *
+   * frame_damage lists the areas of the frame that changed since the previous
+   * frame passed to the callback for the same display; everything outside of
+   * it is guaranteed to be identical to that previous frame.
    */
   using GenerateProcessedFrameCallback = std::function<void(
       std::uint32_t /*display_number*/, std::uint32_t /*frame_width*/,
       std::uint32_t /*frame_height*/, std::uint32_t /*frame_stride_bytes*/,
-      std::uint8_t* /*frame_bytes*/,
+      std::uint8_t* /*frame_bytes*/, const FrameDamage& /*frame_damage*/,
       /* ScImpl enqueues this type into the Q */
       ProcessedFrameType& msg)>;
 
@@ -107,9 +113,12 @@ class ScreenConnector : public ScreenConnectorInfo,
     sc_android_src_.SetFrameCallback(
         [this](std::uint32_t display_number, std::uint32_t frame_w,
                std::uint32_t frame_h, std::uint32_t frame_stride_bytes,
-               std::uint8_t* frame_bytes) {
+               std::uint8_t* frame_bytes, const FrameDamage& frame_damage) {
           const bool is_confui_mode = host_mode_ctrl_.IsConfirmatioUiMode();
           if (is_confui_mode) {
+            // The damage of the dropped frame is lost.
+            std::lock_guard<std::mutex> lock(streamer_callback_mutex_);
+            displays_with_full_frame_.erase(display_number);
             return;
           }
 
@@ -117,9 +126,16 @@ class ScreenConnector : public ScreenConnectorInfo,
 
           {
             std::lock_guard<std::mutex> lock(streamer_callback_mutex_);
-            callback_from_streamer_(display_number, frame_w, frame_h,
-                                    frame_stride_bytes, frame_bytes,
-                                    processed_frame);
+            if (displays_with_full_frame_.insert(display_number).second) {
+              callback_from_streamer_(display_number, frame_w, frame_h,
+                                      frame_stride_bytes, frame_bytes,
+                                      FullFrameDamage(frame_w, frame_h),
+                                      processed_frame);
+            } else {
+              callback_from_streamer_(display_number, frame_w, frame_h,
+                                      frame_stride_bytes, frame_bytes,
+                                      frame_damage, processed_frame);
+            }
           }
 
           sc_frame_multiplexer_.PushToAndroidQueue(std::move(processed_frame));
@@ -144,6 +160,15 @@ class ScreenConnector : public ScreenConnectorInfo,
    */
   ProcessedFrameType OnNextFrame() { return sc_frame_multiplexer_.Pop(); }
 
+  // Statistics of the queue of Android frames waiting for OnNextFrame()
+  ScreenConnectorQueueStats FrameQueueStats() const {
+    return sc_frame_multiplexer_.AndroidQueueStats();
+  }
+
+  const LatencyHistogram& FrameQueueWaitHistogram() const {
+    return sc_frame_multiplexer_.AndroidQueueWaitHistogram();
+  }
+
   /**
    * ConfUi calls this when it has frames to render
    *
@@ -164,12 +189,20 @@ class ScreenConnector : public ScreenConnectorInfo,
       return false;
     }
     ProcessedFrameType processed_frame;
+    // The Android frames that follow are relative to the last Android frame,
+    // not to this one, on every display.
+    {
+      std::lock_guard<std::mutex> lock(streamer_callback_mutex_);
+      displays_with_full_frame_.clear();
+    }
     auto this_thread_name = cuttlefish::confui::thread::GetName();
     ConfUiLog(DEBUG) << this_thread_name
                      << "is sending a #" + std::to_string(render_confui_cnt_)
                      << "Conf UI frame";
     callback_from_streamer_(display_number, frame_width, frame_height,
-                            frame_stride_bytes, frame_bytes, processed_frame);
+                            frame_stride_bytes, frame_bytes,
+                            FullFrameDamage(frame_width, frame_height),
+                            processed_frame);
     // now add processed_frame to the queue
     sc_frame_multiplexer_.PushToConfUiQueue(std::move(processed_frame));
     return true;
@@ -179,6 +212,12 @@ class ScreenConnector : public ScreenConnectorInfo,
   ScreenConnector() = delete;
 
  private:
+  static FrameDamage FullFrameDamage(std::uint32_t frame_width,
+                                     std::uint32_t frame_height) {
+    return {FrameDamageRect{
+        .x = 0, .y = 0, .width = frame_width, .height = frame_height}};
+  }
+
   WaylandScreenConnector& sc_android_src_;
   HostModeCtrl& host_mode_ctrl_;
   unsigned long long int on_next_frame_cnt_;
@@ -193,6 +232,11 @@ class ScreenConnector : public ScreenConnectorInfo,
   GenerateProcessedFrameCallback callback_from_streamer_;
   std::mutex streamer_callback_mutex_; // mutex to set & read callback_from_streamer_
   std::condition_variable streamer_callback_set_cv_;
+  // displays whose last frame the streamer got was a whole Android frame, or
+  // one with damage relative to it. Any other display missed frames or saw
+  // Confirmation UI frames, so its next Android frame has to be processed as
+  // a whole. Guarded by streamer_callback_mutex_.
+  std::unordered_set<std::uint32_t> displays_with_full_frame_;
 };
 
 }  // namespace cuttlefish
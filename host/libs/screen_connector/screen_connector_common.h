@@ -23,6 +23,7 @@
 
 #include "common/libs/utils/size_utils.h"
 #include "host/libs/config/cuttlefish_config.h"
+#include "host/libs/wayland/wayland_server_callbacks.h"
 
 namespace cuttlefish {
 
@@ -39,7 +40,8 @@ using GenerateProcessedFrameCallbackImpl =
                        std::uint32_t /*frame_width*/,         //
                        std::uint32_t /*frame_height*/,        //
                        std::uint32_t /*frame_stride_bytes*/,  //
-                       std::uint8_t* /*frame_pixels*/)>;
+                       std::uint8_t* /*frame_pixels*/,        //
+                       const FrameDamage& /*frame_damage*/)>;
 
 struct ScreenConnectorInfo {
   // functions are intended to be inlined
@@ -102,6 +104,9 @@ struct ScreenConnectorFrameRenderer {
 struct ScreenConnectorFrameInfo {
   std::uint32_t display_number_;
   bool is_success_;
+  // identical to the previous frame of the display, so there is nothing new
+  // to show
+  bool is_unchanged_ = false;
 };
 
 }  // namespace cuttlefish
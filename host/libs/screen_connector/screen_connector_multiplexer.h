@@ -31,10 +31,15 @@ class ScreenConnectorInputMultiplexer {
   using Multiplexer = Multiplexer<ProcessedFrameType, Queue>;
 
  public:
-  ScreenConnectorInputMultiplexer(HostModeCtrl& host_mode_ctrl)
+  ScreenConnectorInputMultiplexer(
+      HostModeCtrl& host_mode_ctrl,
+      ScreenConnectorQueueMode android_queue_mode =
+          ScreenConnectorQueueMode::kBlocking)
       : host_mode_ctrl_(host_mode_ctrl) {
-    sc_android_queue_id_ =
-        multiplexer_.RegisterQueue(multiplexer_.CreateQueue(/* q size */ 2));
+    auto android_queue =
+        multiplexer_.CreateQueue(/* q size */ 2, android_queue_mode);
+    sc_android_queue_ = android_queue.get();
+    sc_android_queue_id_ = multiplexer_.RegisterQueue(std::move(android_queue));
     sc_confui_queue_id_ =
         multiplexer_.RegisterQueue(multiplexer_.CreateQueue(/* q size */ 2));
   }
@@ -90,15 +95,25 @@ class ScreenConnectorInputMultiplexer {
       if (!is_discard_frame) {
         return processed_frame;
       }
+      sc_android_queue_->RecordDropped();
       is_discard_frame = false;
     }
   }
 
+  ScreenConnectorQueueStats AndroidQueueStats() const {
+    return sc_android_queue_->Stats();
+  }
+
+  const LatencyHistogram& AndroidQueueWaitHistogram() const {
+    return sc_android_queue_->WaitHistogram();
+  }
+
  private:
   HostModeCtrl& host_mode_ctrl_;
   Multiplexer multiplexer_;
   unsigned long long int on_next_frame_cnt_;
   int sc_android_queue_id_;
+  Queue* sc_android_queue_;  // owned by multiplexer_
   int sc_confui_queue_id_;
 };
 }  // end of namespace cuttlefish
@@ -16,15 +16,39 @@
 
 #pragma once
 
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <deque>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <thread>
 
 #include "common/libs/concurrency/semaphore.h"
+#include "common/libs/utils/latency_histogram.h"
+#include "host/libs/screen_connector/screen_connector_common.h"
 
 namespace cuttlefish {
+
+enum class ScreenConnectorQueueMode {
+  // Push() waits for the consumer to empty the queue when it is full.
+  kBlocking,
+  // Push() never waits: each display has at most one pending frame, which is
+  // replaced when a newer frame for the same display arrives, unless the newer
+  // one is unchanged.
+  kMailbox,
+};
+
+struct ScreenConnectorQueueStats {
+  std::uint64_t pushed_frames = 0;
+  std::uint64_t popped_frames = 0;
+  // popped frames the consumer chose not to use
+  std::uint64_t dropped_frames = 0;
+  // pending frames replaced by a newer one, by display number
+  std::map<std::uint32_t, std::uint64_t> overwritten_frames;
+};
+
 // move-based concurrent queue
 template<typename T>
 class ScreenConnectorQueue {
@@ -33,8 +57,12 @@ class ScreenConnectorQueue {
   static_assert( is_movable<T>::value,
                  "Items in ScreenConnectorQueue should be std::mov-able");
 
-  ScreenConnectorQueue(const int q_max_size = 2)
-      : q_mutex_(std::make_unique<std::mutex>()), q_max_size_{q_max_size} {}
+  ScreenConnectorQueue(
+      const int q_max_size = 2,
+      const ScreenConnectorQueueMode mode = ScreenConnectorQueueMode::kBlocking)
+      : q_mutex_(std::make_unique<std::mutex>()),
+        q_max_size_{q_max_size},
+        mode_{mode} {}
   ScreenConnectorQueue(ScreenConnectorQueue&& cq) = delete;
   ScreenConnectorQueue(const ScreenConnectorQueue& cq) = delete;
   ScreenConnectorQueue& operator=(const ScreenConnectorQueue& cq) = delete;
@@ -72,39 +100,84 @@ class ScreenConnectorQueue {
    * WebRTC would not call OnNextFrame --, the producer
    * should stop adding itmes to the queue.
    *
+   * In kMailbox mode, the producer is never stopped. Instead, a frame
+   * the consumer hasn't picked up yet is replaced by a newer one for
+   * the same display, so the consumer always gets the latest frames. An
+   * unchanged frame is dropped instead, as the pending one is as recent.
+   *
+   * Returns whether the queue holds one more item than before.
    */
-  void Push(T&& item) {
+  bool Push(T&& item) {
     std::unique_lock<std::mutex> lock(*q_mutex_);
-    if (Full()) {
+    stats_.pushed_frames++;
+    if (mode_ == ScreenConnectorQueueMode::kMailbox) {
+      for (auto& slot : buffer_) {
+        if (slot.item.display_number_ == item.display_number_) {
+          if (item.is_unchanged_) {
+            return false;
+          }
+          stats_.overwritten_frames[item.display_number_]++;
+          slot.item = std::move(item);
+          slot.pushed_at = std::chrono::steady_clock::now();
+          return false;
+        }
+      }
+    } else if (Full()) {
       auto is_empty =
           [this](void){ return buffer_.empty(); };
       q_empty_.wait(lock, is_empty);
     }
-    buffer_.push_back(std::move(item));
+    buffer_.push_back(Slot{.item = std::move(item),
+                           .pushed_at = std::chrono::steady_clock::now()});
+    return true;
   }
-  void Push(T& item) = delete;
-  void Push(const T& item) = delete;
+  bool Push(T& item) = delete;
+  bool Push(const T& item) = delete;
 
   T Pop() {
     const std::lock_guard<std::mutex> lock(*q_mutex_);
-    auto item = std::move(buffer_.front());
+    auto slot = std::move(buffer_.front());
     buffer_.pop_front();
+    stats_.popped_frames++;
+    wait_histogram_.Record(std::chrono::steady_clock::now() - slot.pushed_at);
     if (buffer_.empty()) {
       q_empty_.notify_all();
     }
-    return item;
+    return std::move(slot.item);
+  }
+
+  // Counts a popped item that was not used by the consumer.
+  void RecordDropped() {
+    const std::lock_guard<std::mutex> lock(*q_mutex_);
+    stats_.dropped_frames++;
   }
 
+  ScreenConnectorQueueStats Stats() const {
+    const std::lock_guard<std::mutex> lock(*q_mutex_);
+    return stats_;
+  }
+
+  // Time items spent in the queue between Push() and Pop().
+  const LatencyHistogram& WaitHistogram() const { return wait_histogram_; }
+
  private:
+  struct Slot {
+    T item;
+    std::chrono::steady_clock::time_point pushed_at;
+  };
+
   bool Full() const {
     // call this in a critical section
     // after acquiring q_mutex_
     return q_max_size_ == buffer_.size();
   }
-  std::deque<T> buffer_;
+  std::deque<Slot> buffer_;
   std::unique_ptr<std::mutex> q_mutex_;
   std::condition_variable q_empty_;
   const int q_max_size_;
+  const ScreenConnectorQueueMode mode_;
+  ScreenConnectorQueueStats stats_;
+  LatencyHistogram wait_histogram_;
 };
 
 } // namespace cuttlefish
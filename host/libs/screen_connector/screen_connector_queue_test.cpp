@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/libs/screen_connector/screen_connector_queue.h"
+
+#include <cstdint>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "host/libs/screen_connector/screen_connector_common.h"
+
+namespace cuttlefish {
+namespace {
+
+struct TestFrame : public ScreenConnectorFrameInfo {
+  std::string contents;
+};
+
+TestFrame Frame(std::uint32_t display_number, std::string contents) {
+  TestFrame frame;
+  frame.display_number_ = display_number;
+  frame.is_success_ = true;
+  frame.contents = std::move(contents);
+  return frame;
+}
+
+TestFrame UnchangedFrame(std::uint32_t display_number) {
+  TestFrame frame = Frame(display_number, "");
+  frame.is_unchanged_ = true;
+  return frame;
+}
+
+TEST(ScreenConnectorQueueTest, MailboxKeepsLatestFrame) {
+  ScreenConnectorQueue<TestFrame> queue(2, ScreenConnectorQueueMode::kMailbox);
+
+  EXPECT_TRUE(queue.Push(Frame(0, "first")));
+  EXPECT_FALSE(queue.Push(Frame(0, "second")));
+  EXPECT_TRUE(queue.Push(Frame(1, "other display")));
+
+  ASSERT_EQ(queue.Size(), 2u);
+  EXPECT_EQ(queue.Pop().contents, "second");
+  EXPECT_EQ(queue.Pop().contents, "other display");
+  EXPECT_EQ(queue.Stats().overwritten_frames[0], 1u);
+}
+
+TEST(ScreenConnectorQueueTest, MailboxKeepsChangedFrameOverUnchangedOne) {
+  ScreenConnectorQueue<TestFrame> queue(2, ScreenConnectorQueueMode::kMailbox);
+
+  EXPECT_TRUE(queue.Push(Frame(0, "changed")));
+  EXPECT_FALSE(queue.Push(UnchangedFrame(0)));
+
+  ASSERT_EQ(queue.Size(), 1u);
+  auto frame = queue.Pop();
+  EXPECT_FALSE(frame.is_unchanged_);
+  EXPECT_EQ(frame.contents, "changed");
+  EXPECT_EQ(queue.Stats().overwritten_frames.count(0), 0u);
+}
+
+TEST(ScreenConnectorQueueTest, MailboxQueuesUnchangedFrameWhenNothingPending) {
+  ScreenConnectorQueue<TestFrame> queue(2, ScreenConnectorQueueMode::kMailbox);
+
+  EXPECT_TRUE(queue.Push(UnchangedFrame(0)));
+  EXPECT_TRUE(queue.Pop().is_unchanged_);
+}
+
+TEST(ScreenConnectorQueueTest, BlockingKeepsEveryFrame) {
+  ScreenConnectorQueue<TestFrame> queue(2,
+                                        ScreenConnectorQueueMode::kBlocking);
+
+  EXPECT_TRUE(queue.Push(Frame(0, "changed")));
+  EXPECT_TRUE(queue.Push(UnchangedFrame(0)));
+
+  EXPECT_EQ(queue.Pop().contents, "changed");
+  EXPECT_TRUE(queue.Pop().is_unchanged_);
+}
+
+}  // namespace
+}  // namespace cuttlefish
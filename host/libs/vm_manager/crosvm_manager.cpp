@@ -49,6 +49,28 @@ namespace vm_manager {
 
 constexpr auto kTouchpadDefaultPrefix = "Crosvm_Virtio_Multitouch_Touchpad_";
 
+// The images attached as virtio-pmem devices, in the order the guest numbers
+// them: /dev/block/pmem0 is the first one. assemble_cvd creates all of them,
+// so whether they are attached only depends on the configuration and the
+// guest device names can be worked out before launch.
+std::vector<std::string> PmemDevicePaths(
+    const CuttlefishConfig::InstanceSpecific& instance) {
+  const bool pmem_disabled = instance.mte() || !instance.use_pmem();
+  if (pmem_disabled) {
+    return {};
+  }
+  std::vector<std::string> paths = {instance.access_kregistry_path()};
+  if (instance.hwcomposer() != kHwComposerNone) {
+    paths.push_back(instance.hwcomposer_pmem_path());
+  }
+  // The guest camera HAL falls back to streaming frames over vsock if the
+  // frame ring isn't attached.
+  if (instance.camera_server_port()) {
+    paths.push_back(instance.camera_pmem_path());
+  }
+  return paths;
+}
+
 bool CrosvmManager::IsSupported() {
 #ifdef __ANDROID__
   return true;
@@ -137,6 +159,14 @@ CrosvmManager::ConfigureBootDevices(
     const CuttlefishConfig::InstanceSpecific& instance) {
   const int num_disks = instance.virtual_disk_paths().size();
   const bool has_gpu = instance.hwcomposer() != kHwComposerNone;
+  std::unordered_map<std::string, std::string> bootconfig_args;
+  const auto pmem_paths = PmemDevicePaths(instance);
+  for (size_t i = 0; i < pmem_paths.size(); i++) {
+    if (pmem_paths[i] == instance.camera_pmem_path()) {
+      bootconfig_args["androidboot.vsock_camera_pmem"] =
+          "/dev/block/pmem" + std::to_string(i);
+    }
+  }
   // TODO There is no way to control this assignment with crosvm (yet)
   if (HostArch() == Arch::X86_64) {
     int num_gpu_pcis = has_gpu ? 1 : 0;
@@ -147,13 +177,15 @@ CrosvmManager::ConfigureBootDevices(
       num_gpu_pcis += 1;
     }
     // virtio_gpu and virtio_wl precedes the first console or disk
-    return ConfigureMultipleBootDevices("pci0000:00/0000:00:", 1 + num_gpu_pcis,
-                                        num_disks);
+    auto boot_devices = CF_EXPECT(ConfigureMultipleBootDevices(
+        "pci0000:00/0000:00:", 1 + num_gpu_pcis, num_disks));
+    bootconfig_args.insert(boot_devices.begin(), boot_devices.end());
   } else {
     // On ARM64 crosvm, block devices are on their own bridge, so we don't
     // need to calculate it, and the path is always the same
-    return {{{"androidboot.boot_devices", "10000.pci"}}};
+    bootconfig_args["androidboot.boot_devices"] = "10000.pci";
   }
+  return bootconfig_args;
 }
 
 std::string ToSingleLineString(const Json::Value& value) {
@@ -480,14 +512,6 @@ Result<std::vector<MonitorCommand>> CrosvmManager::StartCommands(
     CF_EXPECT(ConfigureGpu(config, &crosvm_cmd.Cmd()));
   }
 
-  if (instance.hwcomposer() != kHwComposerNone) {
-    const bool pmem_disabled = instance.mte() || !instance.use_pmem();
-    if (!pmem_disabled && FileExists(instance.hwcomposer_pmem_path())) {
-      crosvm_cmd.Cmd().AddParameter("--rw-pmem-device=",
-                                    instance.hwcomposer_pmem_path());
-    }
-  }
-
   const auto gpu_capture_enabled = !instance.gpu_capture_binary().empty();
 
   // crosvm_cmd.Cmd().AddParameter("--null-audio");
@@ -563,12 +587,21 @@ Result<std::vector<MonitorCommand>> CrosvmManager::StartCommands(
   }
 #endif
 
-  const bool pmem_disabled = instance.mte() || !instance.use_pmem();
-  if (!pmem_disabled && FileExists(instance.access_kregistry_path())) {
-    crosvm_cmd.Cmd().AddParameter("--rw-pmem-device=",
-                                  instance.access_kregistry_path());
+  // The guest numbers the pmem devices in the reverse order of the arguments.
+  // Missing images are skipped as before. The camera's is the last device, so
+  // skipping any image leaves androidboot.vsock_camera_pmem naming a device
+  // that doesn't exist, and the camera HAL streams over vsock instead.
+  const auto pmem_paths = PmemDevicePaths(instance);
+  for (auto it = pmem_paths.rbegin(); it != pmem_paths.rend(); it++) {
+    if (!FileExists(*it)) {
+      LOG(WARNING) << "Not attaching missing pmem image \"" << *it << "\"";
+      continue;
+    }
+    crosvm_cmd.Cmd().AddParameter("--rw-pmem-device=", *it);
   }
 
+  const bool pmem_disabled = instance.mte() || !instance.use_pmem();
+
   if (!pmem_disabled && FileExists(instance.pstore_path())) {
     crosvm_cmd.Cmd().AddParameter("--pstore=path=", instance.pstore_path(),
                                   ",size=", FileSize(instance.pstore_path()));
@@ -107,6 +107,11 @@ void surface_damage(wl_client*,
                << " y=" << y
                << " w=" << w
                << " h=" << h;
+
+  // Surfaces are never scaled or transformed so surface and buffer coordinates
+  // are the same.
+  GetUserData<Surface>(surface_resource)->Damage(
+      Surface::Region{.x = x, .y = y, .w = w, .h = h});
 }
 
 void surface_frame(wl_client*, wl_resource* surface, uint32_t) {
@@ -169,6 +174,9 @@ void surface_damage_buffer(wl_client*,
                << " y=" << y
                << " w=" << w
                << " h=" << h;
+
+  GetUserData<Surface>(surface_resource)->Damage(
+      Surface::Region{.x = x, .y = y, .w = w, .h = h});
 }
 
 const struct wl_surface_interface surface_implementation = {
@@ -16,6 +16,17 @@
 
 #include "host/libs/wayland/wayland_dmabuf.h"
 
+#include <errno.h>
+#include <linux/dma-buf.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <memory>
+#include <optional>
+#include <string>
+
 #include <android-base/logging.h>
 
 #include <drm_fourcc.h>
@@ -24,9 +35,13 @@
 #include <wayland-server-core.h>
 #include <wayland-server-protocol.h>
 
+#include "host/libs/wayland/wayland_utils.h"
+
 namespace wayland {
 namespace {
 
+constexpr uint32_t kBytesPerPixel = 4;
+
 void buffer_destroy(wl_client*, wl_resource* buffer) {
   LOG(VERBOSE) << __FUNCTION__
                << " buffer=" << buffer;
@@ -45,8 +60,6 @@ void linux_buffer_params_destroy(wl_client*, wl_resource* params) {
   wl_resource_destroy(params);
 }
 
-void params_destroy_resource_callback(struct wl_resource*) {}
-
 void linux_buffer_params_add(wl_client*,
                              wl_resource* params,
                              int32_t fd,
@@ -63,6 +76,12 @@ void linux_buffer_params_add(wl_client*,
                << " stride=" << stride
                << " mod_hi=" << modifier_hi
                << " mod_lo=" << modifier_lo;
+
+  auto error = GetUserData<DmabufParams>(params)->AddPlane(
+      fd, plane, offset, stride, (uint64_t{modifier_hi} << 32) | modifier_lo);
+  if (error) {
+    wl_resource_post_error(params, error->code, "%s", error->message.c_str());
+  }
 }
 
 void linux_buffer_params_create(wl_client* client,
@@ -78,11 +97,26 @@ void linux_buffer_params_create(wl_client* client,
                << " format=" << format
                << " flags=" << flags;
 
+  std::unique_ptr<DmabufBuffer> buffer;
+  auto error =
+      GetUserData<DmabufParams>(params)->Create(w, h, format, &buffer);
+  if (error) {
+    wl_resource_post_error(params, error->code, "%s", error->message.c_str());
+    return;
+  }
+  if (!buffer) {
+    zwp_linux_buffer_params_v1_send_failed(params);
+    return;
+  }
+
   wl_resource* buffer_resource =
       wl_resource_create(client, &wl_buffer_interface, 1, 0);
 
   wl_resource_set_implementation(buffer_resource, &buffer_implementation,
-                                 nullptr, params_destroy_resource_callback);
+                                 buffer.release(),
+                                 DestroyUserData<DmabufBuffer>);
+
+  zwp_linux_buffer_params_v1_send_created(params, buffer_resource);
 }
 
 void linux_buffer_params_create_immed(wl_client* client,
@@ -100,11 +134,26 @@ void linux_buffer_params_create_immed(wl_client* client,
                << " format=" << format
                << " flags=" << flags;
 
+  std::unique_ptr<DmabufBuffer> buffer;
+  auto error =
+      GetUserData<DmabufParams>(params)->Create(w, h, format, &buffer);
+  if (error) {
+    wl_resource_post_error(params, error->code, "%s", error->message.c_str());
+    return;
+  }
+  if (!buffer) {
+    wl_resource_post_error(params,
+                           ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_INVALID_WL_BUFFER,
+                           "failed to import dmabuf");
+    return;
+  }
+
   wl_resource* buffer_resource =
       wl_resource_create(client, &wl_buffer_interface, 1, id);
 
   wl_resource_set_implementation(buffer_resource, &buffer_implementation,
-                                 nullptr, params_destroy_resource_callback);
+                                 buffer.release(),
+                                 DestroyUserData<DmabufBuffer>);
 }
 
 const struct zwp_linux_buffer_params_v1_interface
@@ -131,9 +180,12 @@ void linux_dmabuf_create_params(wl_client* client,
   wl_resource* buffer_params_resource =
       wl_resource_create(client, &zwp_linux_buffer_params_v1_interface, 1, id);
 
+  std::unique_ptr<DmabufParams> params(new DmabufParams());
+
   wl_resource_set_implementation(buffer_params_resource,
                                  &zwp_linux_buffer_params_implementation,
-                                 nullptr, params_destroy_resource_callback);
+                                 params.release(),
+                                 DestroyUserData<DmabufParams>);
 }
 
 const struct zwp_linux_dmabuf_v1_interface
@@ -164,4 +216,153 @@ void BindDmabufInterface(wl_display* display) {
                    kLinuxDmabufVersion, nullptr, bind_linux_dmabuf);
 }
 
+DmabufParams::~DmabufParams() {
+  for (auto& plane : planes_) {
+    if (plane.fd >= 0) {
+      close(plane.fd);
+    }
+  }
+}
+
+std::optional<DmabufParamsError> DmabufParams::AddPlane(int fd, uint32_t plane,
+                                                        uint32_t offset,
+                                                        uint32_t stride,
+                                                        uint64_t modifier) {
+  if (used_) {
+    close(fd);
+    return DmabufParamsError{ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_ALREADY_USED,
+                             "params were already used"};
+  }
+  if (plane >= planes_.size()) {
+    close(fd);
+    return DmabufParamsError{
+        ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_PLANE_IDX,
+        "plane index " + std::to_string(plane) + " is out of bounds"};
+  }
+  auto& buffer_plane = planes_[plane];
+  if (buffer_plane.fd >= 0) {
+    close(fd);
+    return DmabufParamsError{
+        ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_PLANE_SET,
+        "plane " + std::to_string(plane) + " was already set"};
+  }
+  buffer_plane.fd = fd;
+  buffer_plane.offset = offset;
+  buffer_plane.stride = stride;
+  buffer_plane.modifier = modifier;
+  return std::nullopt;
+}
+
+// Maps the planes into a buffer. Only single plane ARGB8888 buffers, the
+// format advertised to clients, are supported.
+std::optional<DmabufParamsError> DmabufParams::Create(
+    int32_t width, int32_t height, uint32_t format,
+    std::unique_ptr<DmabufBuffer>* buffer) {
+  if (used_) {
+    return DmabufParamsError{ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_ALREADY_USED,
+                             "params were already used"};
+  }
+  used_ = true;
+  if (format != DRM_FORMAT_ARGB8888) {
+    return DmabufParamsError{
+        ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_INVALID_FORMAT,
+        "format " + std::to_string(format) + " is not supported"};
+  }
+  auto& plane = planes_[0];
+  if (plane.fd < 0) {
+    return DmabufParamsError{ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_INCOMPLETE,
+                             "plane 0 is missing"};
+  }
+  for (size_t i = 1; i < planes_.size(); i++) {
+    if (planes_[i].fd >= 0) {
+      return DmabufParamsError{
+          ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_INCOMPLETE,
+          "format has a single plane but plane " + std::to_string(i) +
+              " was set"};
+    }
+  }
+  if (width <= 0 || height <= 0) {
+    return DmabufParamsError{
+        ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_INVALID_DIMENSIONS,
+        "invalid size " + std::to_string(width) + "x" + std::to_string(height)};
+  }
+  if (plane.stride / kBytesPerPixel < uint32_t(width)) {
+    return DmabufParamsError{
+        ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_OUT_OF_BOUNDS,
+        "stride " + std::to_string(plane.stride) + " is too small for width " +
+            std::to_string(width)};
+  }
+  const size_t mapping_size =
+      size_t{plane.offset} + size_t{plane.stride} * size_t(height);
+  const off_t fd_size = lseek(plane.fd, 0, SEEK_END);
+  if (fd_size >= 0 && size_t(fd_size) < mapping_size) {
+    return DmabufParamsError{
+        ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_OUT_OF_BOUNDS,
+        "dmabuf of " + std::to_string(fd_size) + " bytes is too small for " +
+            std::to_string(mapping_size) + " bytes"};
+  }
+  if (plane.modifier != DRM_FORMAT_MOD_LINEAR &&
+      plane.modifier != DRM_FORMAT_MOD_INVALID) {
+    LOG(ERROR) << "Unsupported dmabuf modifier " << plane.modifier;
+    return std::nullopt;
+  }
+  void* mapping =
+      mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, plane.fd, 0);
+  if (mapping == MAP_FAILED) {
+    LOG(ERROR) << "Failed to map dmabuf: " << strerror(errno);
+    return std::nullopt;
+  }
+  *buffer = std::make_unique<DmabufBuffer>(
+      plane.fd, static_cast<uint8_t*>(mapping), mapping_size, plane.offset,
+      plane.stride, width, height, format);
+  plane.fd = -1;
+  return std::nullopt;
+}
+
+DmabufBuffer::DmabufBuffer(int fd, uint8_t* mapping, size_t mapping_size,
+                           uint32_t offset, uint32_t stride, int32_t width,
+                           int32_t height, uint32_t format)
+    : fd_(fd),
+      mapping_(mapping),
+      mapping_size_(mapping_size),
+      offset_(offset),
+      stride_(stride),
+      width_(width),
+      height_(height),
+      format_(format) {}
+
+DmabufBuffer::~DmabufBuffer() {
+  munmap(mapping_, mapping_size_);
+  close(fd_);
+}
+
+void DmabufBuffer::BeginAccess() {
+  Sync(DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ);
+}
+
+void DmabufBuffer::EndAccess() {
+  Sync(DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ);
+}
+
+void DmabufBuffer::Sync(uint64_t flags) {
+  struct dma_buf_sync sync = {.flags = flags};
+  int ret;
+  do {
+    ret = ioctl(fd_, DMA_BUF_IOCTL_SYNC, &sync);
+  } while (ret == -1 && (errno == EINTR || errno == EAGAIN));
+  // Buffers backed by plain memory (e.g. memfd) don't support the ioctl and
+  // need no synchronization.
+  if (ret == -1 && errno != ENOTTY) {
+    LOG(VERBOSE) << "Failed to sync dmabuf: " << strerror(errno);
+  }
+}
+
+DmabufBuffer* GetDmabufBuffer(wl_resource* buffer) {
+  if (!wl_resource_instance_of(buffer, &wl_buffer_interface,
+                               &buffer_implementation)) {
+    return nullptr;
+  }
+  return static_cast<DmabufBuffer*>(wl_resource_get_user_data(buffer));
+}
+
 }  // namespace wayland
\ No newline at end of file
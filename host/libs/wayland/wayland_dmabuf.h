@@ -19,6 +19,11 @@
 
 #include <stdint.h>
 
+#include <array>
+#include <memory>
+#include <optional>
+#include <string>
+
 #include <wayland-server-core.h>
 
 namespace wayland {
@@ -26,4 +31,87 @@ namespace wayland {
 // Binds the dmabuf interface to the given wayland server.
 void BindDmabufInterface(wl_display* display);
 
+// A single plane, linear dmabuf backing a wl_buffer. The buffer is mapped
+// for reading for its whole lifetime so its pixels can be consumed without
+// any intermediate copy.
+class DmabufBuffer {
+ public:
+  DmabufBuffer(int fd, uint8_t* mapping, size_t mapping_size, uint32_t offset,
+               uint32_t stride, int32_t width, int32_t height,
+               uint32_t format);
+  ~DmabufBuffer();
+
+  DmabufBuffer(const DmabufBuffer& rhs) = delete;
+  DmabufBuffer& operator=(const DmabufBuffer& rhs) = delete;
+
+  // Brackets CPU reads of the buffer, so they see the complete results of
+  // the device writes that produced it.
+  void BeginAccess();
+  void EndAccess();
+
+  const uint8_t* Data() const { return mapping_ + offset_; }
+  uint32_t Stride() const { return stride_; }
+  int32_t Width() const { return width_; }
+  int32_t Height() const { return height_; }
+  uint32_t Format() const { return format_; }
+
+ private:
+  void Sync(uint64_t flags);
+
+  const int fd_;
+  uint8_t* const mapping_;
+  const size_t mapping_size_;
+  const uint32_t offset_;
+  const uint32_t stride_;
+  const int32_t width_;
+  const int32_t height_;
+  const uint32_t format_;
+};
+
+// A zwp_linux_buffer_params_v1 protocol error.
+struct DmabufParamsError {
+  uint32_t code;
+  std::string message;
+};
+
+// The planes received so far for a buffer being created. Owns the fds until
+// they are handed over to a buffer.
+class DmabufParams {
+ public:
+  DmabufParams() = default;
+  ~DmabufParams();
+
+  DmabufParams(const DmabufParams& rhs) = delete;
+  DmabufParams& operator=(const DmabufParams& rhs) = delete;
+
+  // Takes ownership of `fd`, also when an error is returned.
+  std::optional<DmabufParamsError> AddPlane(int fd, uint32_t plane,
+                                            uint32_t offset, uint32_t stride,
+                                            uint64_t modifier);
+
+  // Imports the planes as a buffer, which can only be attempted once. On
+  // success `buffer` takes ownership of the planes. If the planes are valid
+  // but can't be read in place, e.g. because of their modifier, neither an
+  // error nor a buffer is returned and the client should be told the import
+  // failed.
+  std::optional<DmabufParamsError> Create(
+      int32_t width, int32_t height, uint32_t format,
+      std::unique_ptr<DmabufBuffer>* buffer);
+
+ private:
+  struct Plane {
+    int fd = -1;
+    uint32_t offset = 0;
+    uint32_t stride = 0;
+    uint64_t modifier = 0;
+  };
+
+  std::array<Plane, 4> planes_;
+  bool used_ = false;
+};
+
+// Returns the dmabuf backing the given wl_buffer resource or nullptr if the
+// buffer was not created through the dmabuf interface.
+DmabufBuffer* GetDmabufBuffer(wl_resource* buffer);
+
 }  // namespace wayland
\ No newline at end of file
@@ -0,0 +1,162 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/libs/wayland/wayland_dmabuf.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include <drm_fourcc.h>
+#include <gtest/gtest.h>
+
+#include <linux-dmabuf-unstable-v1-server-protocol.h>
+
+namespace wayland {
+namespace {
+
+constexpr int32_t kWidth = 4;
+constexpr int32_t kHeight = 3;
+// Rows are padded past the 16 bytes of pixels.
+constexpr uint32_t kStride = 20;
+constexpr uint32_t kOffset = 8;
+
+// A memfd stands in for a dmabuf, its mapping is backed by the same pages.
+int CreateBuffer(const std::string& contents) {
+  int fd = memfd_create("wayland_dmabuf_test", MFD_CLOEXEC);
+  EXPECT_GE(fd, 0) << strerror(errno);
+  EXPECT_EQ(write(fd, contents.data(), contents.size()),
+            ssize_t(contents.size()));
+  return fd;
+}
+
+std::string Pixels() {
+  std::string pixels(kOffset + kStride * kHeight, '\0');
+  for (size_t i = kOffset; i < pixels.size(); i++) {
+    pixels[i] = static_cast<char>(i);
+  }
+  return pixels;
+}
+
+TEST(DmabufParamsTest, ImportsBufferInPlace) {
+  const std::string pixels = Pixels();
+  DmabufParams params;
+  ASSERT_FALSE(params.AddPlane(CreateBuffer(pixels), 0, kOffset, kStride,
+                               DRM_FORMAT_MOD_LINEAR));
+
+  std::unique_ptr<DmabufBuffer> buffer;
+  auto error = params.Create(kWidth, kHeight, DRM_FORMAT_ARGB8888, &buffer);
+
+  ASSERT_FALSE(error) << error->message;
+  ASSERT_NE(buffer, nullptr);
+  EXPECT_EQ(buffer->Width(), kWidth);
+  EXPECT_EQ(buffer->Height(), kHeight);
+  EXPECT_EQ(buffer->Stride(), kStride);
+  EXPECT_EQ(buffer->Format(), uint32_t{DRM_FORMAT_ARGB8888});
+  buffer->BeginAccess();
+  EXPECT_EQ(std::string(reinterpret_cast<const char*>(buffer->Data()),
+                        kStride * kHeight),
+            pixels.substr(kOffset));
+  buffer->EndAccess();
+}
+
+TEST(DmabufParamsTest, RejectsSecondCreate) {
+  DmabufParams params;
+  ASSERT_FALSE(params.AddPlane(CreateBuffer(Pixels()), 0, kOffset, kStride,
+                               DRM_FORMAT_MOD_LINEAR));
+  std::unique_ptr<DmabufBuffer> buffer;
+  ASSERT_FALSE(params.Create(kWidth, kHeight, DRM_FORMAT_ARGB8888, &buffer));
+
+  std::unique_ptr<DmabufBuffer> second_buffer;
+  auto error =
+      params.Create(kWidth, kHeight, DRM_FORMAT_ARGB8888, &second_buffer);
+
+  ASSERT_TRUE(error);
+  EXPECT_EQ(error->code,
+            uint32_t{ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_ALREADY_USED});
+  EXPECT_EQ(second_buffer, nullptr);
+}
+
+TEST(DmabufParamsTest, RejectsUnsupportedFormat) {
+  DmabufParams params;
+  ASSERT_FALSE(params.AddPlane(CreateBuffer(Pixels()), 0, kOffset, kStride,
+                               DRM_FORMAT_MOD_LINEAR));
+
+  std::unique_ptr<DmabufBuffer> buffer;
+  auto error = params.Create(kWidth, kHeight, DRM_FORMAT_NV12, &buffer);
+
+  ASSERT_TRUE(error);
+  EXPECT_EQ(error->code,
+            uint32_t{ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_INVALID_FORMAT});
+  EXPECT_EQ(buffer, nullptr);
+}
+
+TEST(DmabufParamsTest, RejectsPlaneSetTwice) {
+  DmabufParams params;
+  ASSERT_FALSE(params.AddPlane(CreateBuffer(Pixels()), 0, kOffset, kStride,
+                               DRM_FORMAT_MOD_LINEAR));
+
+  auto error = params.AddPlane(CreateBuffer(Pixels()), 0, kOffset, kStride,
+                               DRM_FORMAT_MOD_LINEAR);
+
+  ASSERT_TRUE(error);
+  EXPECT_EQ(error->code,
+            uint32_t{ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_PLANE_SET});
+}
+
+TEST(DmabufParamsTest, RejectsMissingPlane) {
+  DmabufParams params;
+
+  std::unique_ptr<DmabufBuffer> buffer;
+  auto error = params.Create(kWidth, kHeight, DRM_FORMAT_ARGB8888, &buffer);
+
+  ASSERT_TRUE(error);
+  EXPECT_EQ(error->code,
+            uint32_t{ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_INCOMPLETE});
+}
+
+TEST(DmabufParamsTest, RejectsBufferTooSmall) {
+  DmabufParams params;
+  ASSERT_FALSE(params.AddPlane(CreateBuffer(Pixels()), 0, kOffset, kStride,
+                               DRM_FORMAT_MOD_LINEAR));
+
+  std::unique_ptr<DmabufBuffer> buffer;
+  auto error =
+      params.Create(kWidth, kHeight + 1, DRM_FORMAT_ARGB8888, &buffer);
+
+  ASSERT_TRUE(error);
+  EXPECT_EQ(error->code,
+            uint32_t{ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_OUT_OF_BOUNDS});
+}
+
+TEST(DmabufParamsTest, FailsImportOfTiledBuffer) {
+  DmabufParams params;
+  ASSERT_FALSE(params.AddPlane(CreateBuffer(Pixels()), 0, kOffset, kStride,
+                               I915_FORMAT_MOD_X_TILED));
+
+  std::unique_ptr<DmabufBuffer> buffer;
+  auto error = params.Create(kWidth, kHeight, DRM_FORMAT_ARGB8888, &buffer);
+
+  // The client isn't at fault, it's only told the import failed.
+  EXPECT_FALSE(error);
+  EXPECT_EQ(buffer, nullptr);
+}
+
+}  // namespace
+}  // namespace wayland
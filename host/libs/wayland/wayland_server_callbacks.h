@@ -19,6 +19,7 @@
 #include <cstdint>
 #include <functional>
 #include <variant>
+#include <vector>
 
 struct DisplayCreatedEvent {
   std::uint32_t display_number;
@@ -32,3 +33,17 @@ struct DisplayDestroyedEvent {
 
 using DisplayEvent = std::variant<DisplayCreatedEvent, DisplayDestroyedEvent>;
 using DisplayEventCallback = std::function<void(const DisplayEvent&)>;
+
+// A rectangle, in buffer pixels, of a frame whose contents changed since the
+// previous frame delivered for the same display.
+struct FrameDamageRect {
+  std::uint32_t x;
+  std::uint32_t y;
+  std::uint32_t width;
+  std::uint32_t height;
+};
+
+// The damaged areas of a frame. The rectangles are clipped to the frame and
+// may overlap. A frame without damage information is reported as a single
+// rectangle covering the whole frame.
+using FrameDamage = std::vector<FrameDamageRect>;
@@ -16,12 +16,46 @@
 
 #include "host/libs/wayland/wayland_surface.h"
 
+#include <algorithm>
+#include <limits>
+
 #include <android-base/logging.h>
 #include <wayland-server-protocol.h>
 
+#include "host/libs/wayland/wayland_dmabuf.h"
 #include "host/libs/wayland/wayland_surfaces.h"
 
 namespace wayland {
+namespace {
+
+// Clients that damage many small regions are tracked with their bounding box
+// instead to keep the per commit bookkeeping bounded.
+constexpr const size_t kMaxPendingDamageRects = 32;
+
+FrameDamage ClipDamage(const std::vector<Surface::Region>& damage,
+                       int32_t frame_w, int32_t frame_h) {
+  FrameDamage clipped;
+  for (const auto& rect : damage) {
+    // Widen to 64 bits as clients commonly damage (0, 0, INT32_MAX, INT32_MAX)
+    // to mean the whole surface.
+    const int64_t x0 = std::max<int64_t>(rect.x, 0);
+    const int64_t y0 = std::max<int64_t>(rect.y, 0);
+    const int64_t x1 = std::min<int64_t>(int64_t{rect.x} + rect.w, frame_w);
+    const int64_t y1 = std::min<int64_t>(int64_t{rect.y} + rect.h, frame_h);
+    if (x0 >= x1 || y0 >= y1) {
+      continue;
+    }
+    clipped.push_back(FrameDamageRect{
+        .x = static_cast<uint32_t>(x0),
+        .y = static_cast<uint32_t>(y0),
+        .width = static_cast<uint32_t>(x1 - x0),
+        .height = static_cast<uint32_t>(y1 - y0),
+    });
+  }
+  return clipped;
+}
+
+}  // namespace
 
 Surface::Surface(Surfaces& surfaces) : surfaces_(surfaces) {}
 
@@ -42,11 +76,45 @@ void Surface::Attach(struct wl_resource* buffer) {
   state_.pending_buffer = buffer;
 }
 
+void Surface::Damage(const Region& region) {
+  std::unique_lock<std::mutex> lock(state_mutex_);
+  auto& damage = state_.pending_damage;
+  if (damage.size() < kMaxPendingDamageRects) {
+    damage.push_back(region);
+    return;
+  }
+  int64_t x0 = region.x;
+  int64_t y0 = region.y;
+  int64_t x1 = int64_t{region.x} + region.w;
+  int64_t y1 = int64_t{region.y} + region.h;
+  for (const auto& rect : damage) {
+    x0 = std::min<int64_t>(x0, rect.x);
+    y0 = std::min<int64_t>(y0, rect.y);
+    x1 = std::max<int64_t>(x1, int64_t{rect.x} + rect.w);
+    y1 = std::max<int64_t>(y1, int64_t{rect.y} + rect.h);
+  }
+  const auto clamp = [](int64_t v) {
+    return static_cast<int32_t>(std::clamp<int64_t>(
+        v, std::numeric_limits<int32_t>::min(),
+        std::numeric_limits<int32_t>::max()));
+  };
+  damage.clear();
+  damage.push_back(Region{
+      .x = clamp(x0),
+      .y = clamp(y0),
+      .w = clamp(x1 - x0),
+      .h = clamp(y1 - y0),
+  });
+}
+
 void Surface::Commit() {
   std::unique_lock<std::mutex> lock(state_mutex_);
   state_.current_buffer = state_.pending_buffer;
   state_.pending_buffer = nullptr;
 
+  std::vector<Region> damage = std::move(state_.pending_damage);
+  state_.pending_damage.clear();
+
   if (state_.current_buffer == nullptr) {
     return;
   }
@@ -54,29 +122,67 @@ void Surface::Commit() {
   if (state_.virtio_gpu_metadata_.scanout_id.has_value()) {
     const uint32_t display_number = *state_.virtio_gpu_metadata_.scanout_id;
 
+    // Both kinds of buffers are read in place: the consumers are done with
+    // the pixels by the time the buffer is released below.
     struct wl_shm_buffer* shm_buffer = wl_shm_buffer_get(state_.current_buffer);
-    CHECK(shm_buffer != nullptr);
-
-    wl_shm_buffer_begin_access(shm_buffer);
-
-    const int32_t buffer_w = wl_shm_buffer_get_width(shm_buffer);
+    DmabufBuffer* dmabuf_buffer =
+        shm_buffer ? nullptr : GetDmabufBuffer(state_.current_buffer);
+    CHECK(shm_buffer != nullptr || dmabuf_buffer != nullptr)
+        << "Unsupported buffer type";
+
+    int32_t buffer_w;
+    int32_t buffer_h;
+    int32_t buffer_stride_bytes;
+    uint8_t* buffer_pixels;
+    if (shm_buffer) {
+      wl_shm_buffer_begin_access(shm_buffer);
+      buffer_w = wl_shm_buffer_get_width(shm_buffer);
+      buffer_h = wl_shm_buffer_get_height(shm_buffer);
+      buffer_stride_bytes = wl_shm_buffer_get_stride(shm_buffer);
+      buffer_pixels =
+          reinterpret_cast<uint8_t*>(wl_shm_buffer_get_data(shm_buffer));
+    } else {
+      dmabuf_buffer->BeginAccess();
+      buffer_w = dmabuf_buffer->Width();
+      buffer_h = dmabuf_buffer->Height();
+      buffer_stride_bytes = dmabuf_buffer->Stride();
+      // The mapping is read only, frame consumers never write to the pixels.
+      buffer_pixels = const_cast<uint8_t*>(dmabuf_buffer->Data());
+    }
     CHECK(buffer_w == state_.region.w);
-    const int32_t buffer_h = wl_shm_buffer_get_height(shm_buffer);
     CHECK(buffer_h == state_.region.h);
-    const int32_t buffer_stride_bytes = wl_shm_buffer_get_stride(shm_buffer);
 
     if (!state_.has_notified_surface_create) {
       surfaces_.HandleSurfaceCreated(display_number, buffer_w, buffer_h);
       state_.has_notified_surface_create = true;
     }
 
-    uint8_t* buffer_pixels =
-        reinterpret_cast<uint8_t*>(wl_shm_buffer_get_data(shm_buffer));
+    // Only trust the client's damage once the consumer has seen a full frame
+    // of the current size.
+    FrameDamage frame_damage;
+    if (buffer_w == state_.last_frame_w && buffer_h == state_.last_frame_h) {
+      frame_damage = ClipDamage(damage, buffer_w, buffer_h);
+    }
+    if (frame_damage.empty()) {
+      frame_damage.push_back(FrameDamageRect{
+          .x = 0,
+          .y = 0,
+          .width = static_cast<uint32_t>(buffer_w),
+          .height = static_cast<uint32_t>(buffer_h),
+      });
+    }
+    state_.last_frame_w = buffer_w;
+    state_.last_frame_h = buffer_h;
 
     surfaces_.HandleSurfaceFrame(display_number, buffer_w, buffer_h,
-                                 buffer_stride_bytes, buffer_pixels);
+                                 buffer_stride_bytes, buffer_pixels,
+                                 frame_damage);
 
-    wl_shm_buffer_end_access(shm_buffer);
+    if (shm_buffer) {
+      wl_shm_buffer_end_access(shm_buffer);
+    } else {
+      dmabuf_buffer->EndAccess();
+    }
   }
 
   wl_buffer_send_release(state_.current_buffer);
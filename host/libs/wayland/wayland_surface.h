@@ -20,6 +20,7 @@
 #include <stdint.h>
 #include <mutex>
 #include <optional>
+#include <vector>
 
 #include <wayland-server-core.h>
 
@@ -51,6 +52,9 @@ class Surface {
   // Sets the buffer of the pending frame.
   void Attach(struct wl_resource* buffer);
 
+  // Marks a region of the pending frame as changed since the last frame.
+  void Damage(const Region& region);
+
   // Commits the pending frame state.
   void Commit();
 
@@ -75,6 +79,13 @@ class Surface {
     // The buffers expected dimensions.
     Region region;
 
+    // The regions of the next frame that changed since the current frame.
+    std::vector<Region> pending_damage;
+
+    // The dimensions of the last frame sent to the frame callback.
+    int32_t last_frame_w = 0;
+    int32_t last_frame_h = 0;
+
     VirtioGpuMetadata virtio_gpu_metadata_;
 
     bool has_notified_surface_create = false;
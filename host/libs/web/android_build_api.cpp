@@ -20,6 +20,7 @@
 
 #include <chrono>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <string>
@@ -33,12 +34,14 @@
 #include <android-base/logging.h>
 #include <android-base/strings.h>
 
+#include "common/libs/utils/archive.h"
 #include "common/libs/utils/contains.h"
 #include "common/libs/utils/environment.h"
 #include "common/libs/utils/files.h"
 #include "common/libs/utils/result.h"
 #include "host/libs/web/android_build_string.h"
 #include "host/libs/web/credential_source.h"
+#include "host/libs/web/zip_stream_extractor.h"
 
 namespace cuttlefish {
 namespace {
@@ -116,13 +119,15 @@ BuildApi::BuildApi(std::unique_ptr<HttpClient> http_client,
                    std::unique_ptr<HttpClient> inner_http_client,
                    std::unique_ptr<CredentialSource> credential_source,
                    std::string api_key, const std::chrono::seconds retry_period,
-                   std::string api_base_url)
+                   std::string api_base_url,
+                   std::unique_ptr<ArtifactCache> artifact_cache)
     : http_client(std::move(http_client)),
       inner_http_client(std::move(inner_http_client)),
       credential_source(std::move(credential_source)),
       api_key_(std::move(api_key)),
       retry_period_(retry_period),
-      api_base_url_(std::move(api_base_url)) {}
+      api_base_url_(std::move(api_base_url)),
+      artifact_cache_(std::move(artifact_cache)) {}
 
 Result<void> BuildApi::ArtifactToCallback(const DeviceBuild& build,
                                           const std::string& artifact,
@@ -222,9 +227,63 @@ Result<std::string> BuildApi::DownloadFileWithBackup(
   return DownloadTargetFile(build, target_directory, selected_artifact);
 }
 
+Result<std::vector<std::string>> BuildApi::DownloadAndExtract(
+    const Build& build, const std::string& target_directory,
+    const std::string& artifact_name, const std::vector<std::string>& files,
+    bool keep_archive) {
+  const auto* device_build = std::get_if<DeviceBuild>(&build);
+  // Cached artifacts have to be stored whole anyway.
+  if (device_build && !keep_archive && !artifact_cache_ &&
+      android::base::EndsWith(artifact_name, ".zip")) {
+    std::unordered_set<std::string> artifacts =
+        CF_EXPECT(Artifacts(build, {artifact_name}));
+    CF_EXPECT(Contains(artifacts, artifact_name),
+              "Target " << build << " did not contain " << artifact_name);
+    ZipStreamExtractor extractor(target_directory, files);
+    auto callback = [&extractor](char* data, size_t size) {
+      return extractor.Append(data, size);
+    };
+    Result<void> streamed =
+        ArtifactToCallback(*device_build, artifact_name, callback);
+    // Also reports why the extractor stopped the download.
+    Result<std::vector<std::string>> extracted = extractor.Finish();
+    if (streamed.ok() && extracted.ok()) {
+      return extracted;
+    }
+    LOG(WARNING) << "Failed to extract \"" << artifact_name
+                 << "\" while downloading it, downloading it first instead: "
+                 << (extracted.ok() ? streamed.error() : extracted.error())
+                        .FormatForEnv();
+  }
+
+  std::string archive =
+      CF_EXPECT(DownloadFile(build, target_directory, artifact_name));
+  if (files.empty()) {
+    return CF_EXPECT(
+        ExtractArchiveContents(archive, target_directory, keep_archive));
+  }
+  return CF_EXPECT(
+      ExtractImages(archive, target_directory, files, keep_archive));
+}
+
+std::optional<ArtifactCacheStats> BuildApi::CacheStats() const {
+  if (!artifact_cache_) {
+    return {};
+  }
+  return artifact_cache_->Stats();
+}
+
+void BuildApi::CancelDownloads() {
+  http_client->Cancel();
+  if (inner_http_client) {
+    inner_http_client->Cancel();
+  }
+}
+
 Result<std::vector<std::string>> BuildApi::Headers() {
   std::vector<std::string> headers;
   if (credential_source) {
+    std::lock_guard<std::mutex> lock(*credential_mutex_);
     headers.push_back("Authorization: Bearer " +
                       CF_EXPECT(credential_source->Credential()));
   }
@@ -378,6 +437,21 @@ Result<std::unordered_set<std::string>> BuildApi::Artifacts(
 Result<void> BuildApi::ArtifactToFile(const DeviceBuild& build,
                                       const std::string& artifact,
                                       const std::string& path) {
+  if (!artifact_cache_) {
+    CF_EXPECT(DownloadArtifactToFile(build, artifact, path));
+    return {};
+  }
+  auto fetch = [this, &build, &artifact](const std::string& entry) {
+    return DownloadArtifactToFile(build, artifact, entry);
+  };
+  CF_EXPECT(
+      artifact_cache_->Get(build.id, build.target, artifact, path, fetch));
+  return {};
+}
+
+Result<void> BuildApi::DownloadArtifactToFile(const DeviceBuild& build,
+                                              const std::string& artifact,
+                                              const std::string& path) {
   std::string download_url_endpoint =
       api_base_url_ + "/builds/" + http_client->UrlEscape(build.id) + "/" +
       http_client->UrlEscape(build.target) + "/attempts/latest/artifacts/" +
@@ -18,6 +18,7 @@
 #include <chrono>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <ostream>
 #include <string>
@@ -29,6 +30,7 @@
 
 #include "common/libs/utils/result.h"
 #include "host/libs/web/android_build_string.h"
+#include "host/libs/web/artifact_cache.h"
 #include "host/libs/web/credential_source.h"
 #include "host/libs/web/http_client/http_client.h"
 
@@ -78,7 +80,8 @@ class BuildApi {
            std::unique_ptr<HttpClient> inner_http_client,
            std::unique_ptr<CredentialSource> credential_source,
            std::string api_key, const std::chrono::seconds retry_period,
-           std::string api_base_url);
+           std::string api_base_url,
+           std::unique_ptr<ArtifactCache> artifact_cache = nullptr);
   ~BuildApi() = default;
 
   // download the artifact from the build and apply the callback
@@ -102,6 +105,20 @@ class BuildApi {
       const std::string& artifact_name,
       const std::string& backup_artifact_name);
 
+  // Downloads an archive and extracts `files` from it into the target
+  // directory, or all of its contents when `files` is empty. Zip archives of
+  // remote builds are extracted as they arrive and never stored, unless they
+  // are kept.
+  Result<std::vector<std::string>> DownloadAndExtract(
+      const Build& build, const std::string& target_directory,
+      const std::string& artifact_name, const std::vector<std::string>& files,
+      bool keep_archive);
+
+  std::optional<ArtifactCacheStats> CacheStats() const;
+
+  // Makes the downloads in progress fail soon, and any later request fail.
+  void CancelDownloads();
+
  private:
   Result<std::vector<std::string>> Headers();
 
@@ -127,6 +144,10 @@ class BuildApi {
                               const std::string& artifact,
                               const std::string& path);
 
+  Result<void> DownloadArtifactToFile(const DeviceBuild& build,
+                                      const std::string& artifact,
+                                      const std::string& path);
+
   Result<void> ArtifactToFile(const DirectoryBuild& build,
                               const std::string& artifact,
                               const std::string& path);
@@ -141,9 +162,14 @@ class BuildApi {
   std::unique_ptr<HttpClient> http_client;
   std::unique_ptr<HttpClient> inner_http_client;
   std::unique_ptr<CredentialSource> credential_source;
+  // Credential sources refresh their token in place, downloads running on
+  // several threads must not do so at the same time.
+  std::unique_ptr<std::mutex> credential_mutex_ =
+      std::make_unique<std::mutex>();
   std::string api_key_;
   std::chrono::seconds retry_period_;
   std::string api_base_url_;
+  std::unique_ptr<ArtifactCache> artifact_cache_;
 };
 
 std::string GetBuildZipName(const Build& build, const std::string& name);
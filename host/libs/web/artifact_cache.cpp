@@ -0,0 +1,290 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/libs/web/artifact_cache.h"
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
+
+#include "common/libs/utils/files.h"
+#include "common/libs/utils/result.h"
+
+// Missing from older sysroot headers, supported by the kernels since 4.5.
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+namespace cuttlefish {
+namespace {
+
+constexpr char kEntriesDirectory[] = "/artifacts";
+constexpr char kCacheLock[] = "/cache.lock";
+constexpr char kLockExtension[] = ".lock";
+// Followed by the pid of the process fetching into it.
+constexpr char kTemporaryInfix[] = ".tmp.";
+
+// Turns a name into a single path component that can't collide with the
+// escaped form of any other name.
+std::string EscapePathComponent(const std::string& name) {
+  std::string escaped;
+  for (char c : name) {
+    if (c == '%') {
+      escaped += "%25";
+    } else if (c == '/') {
+      escaped += "%2F";
+    } else {
+      escaped += c;
+    }
+  }
+  if (escaped.empty() || escaped[0] == '.') {
+    escaped = "%2E" + escaped.substr(escaped.empty() ? 0 : 1);
+  }
+  return escaped;
+}
+
+// Locks the file at `path`, creating it and its directory when needed.
+// Eviction removes the lock files of entries and then empty directories, so
+// this retries until the file locked is still the one at `path`.
+Result<android::base::unique_fd> LockPath(const std::string& path,
+                                          int operation) {
+  for (;;) {
+    CF_EXPECT(EnsureDirectoryExists(cpp_dirname(path)));
+    android::base::unique_fd fd(
+        open(path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0666));
+    if (fd.get() < 0 && errno == ENOENT) {
+      // The directory was removed after it was created above.
+      continue;
+    }
+    CF_EXPECTF(fd.get() >= 0, "Failed to open \"{}\": {}", path,
+               strerror(errno));
+    CF_EXPECTF(flock(fd.get(), operation) == 0, "Failed to lock \"{}\": {}",
+               path, strerror(errno));
+    struct stat locked;
+    struct stat current;
+    CF_EXPECTF(fstat(fd.get(), &locked) == 0, "Failed to stat \"{}\": {}",
+               path, strerror(errno));
+    if (stat(path.c_str(), &current) == 0 && current.st_dev == locked.st_dev &&
+        current.st_ino == locked.st_ino) {
+      return fd;
+    }
+  }
+}
+
+// Gives `destination` the contents of `entry`, sharing its data blocks rather
+// than copying them whenever the filesystem allows it.
+Result<void> Materialize(const std::string& entry,
+                         const std::string& destination) {
+  if (FileExists(destination, /* follow_symlinks */ false)) {
+    CF_EXPECTF(RemoveFile(destination), "Failed to remove \"{}\"",
+               destination);
+  }
+  android::base::unique_fd source(open(entry.c_str(), O_RDONLY | O_CLOEXEC));
+  CF_EXPECTF(source.get() >= 0, "Failed to open \"{}\": {}", entry,
+             strerror(errno));
+  android::base::unique_fd target(open(
+      destination.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644));
+  CF_EXPECTF(target.get() >= 0, "Failed to create \"{}\": {}", destination,
+             strerror(errno));
+  if (ioctl(target.get(), FICLONE, source.get()) == 0) {
+    return {};
+  }
+  target.reset();
+  unlink(destination.c_str());
+  if (link(entry.c_str(), destination.c_str()) == 0) {
+    return {};
+  }
+  CF_EXPECTF(Copy(entry, destination), "Failed to copy \"{}\" to \"{}\"",
+             entry, destination);
+  return {};
+}
+
+Result<void> FetchInto(const std::string& path,
+                       const ArtifactCache::Fetcher& fetch) {
+  // Left behind if a process with the same pid was killed while fetching.
+  if (FileExists(path, /* follow_symlinks */ false)) {
+    CF_EXPECTF(RemoveFile(path), "Failed to remove \"{}\"", path);
+  }
+  CF_EXPECT(fetch(path));
+  CF_EXPECTF(chmod(path.c_str(), S_IRUSR | S_IRGRP | S_IROTH) == 0,
+             "Failed to make \"{}\" read only: {}", path, strerror(errno));
+  return {};
+}
+
+}  // namespace
+
+ArtifactCache::ArtifactCache(std::string directory,
+                             std::uint64_t max_size_bytes)
+    : directory_(std::move(directory)), max_size_bytes_(max_size_bytes) {}
+
+Result<std::unique_ptr<ArtifactCache>> ArtifactCache::Create(
+    const std::string& directory, std::uint64_t max_size_bytes) {
+  CF_EXPECT(EnsureDirectoryExists(directory + kEntriesDirectory));
+  return std::unique_ptr<ArtifactCache>(
+      new ArtifactCache(directory, max_size_bytes));
+}
+
+std::string ArtifactCache::EntryPath(const std::string& build_id,
+                                     const std::string& target,
+                                     const std::string& artifact) const {
+  return directory_ + kEntriesDirectory + "/" + EscapePathComponent(build_id) +
+         "/" + EscapePathComponent(target) + "/" +
+         EscapePathComponent(artifact);
+}
+
+Result<void> ArtifactCache::Get(const std::string& build_id,
+                                const std::string& target,
+                                const std::string& artifact,
+                                const std::string& destination,
+                                const Fetcher& fetch) {
+  const std::string entry = EntryPath(build_id, target, artifact);
+  // Held until the artifact is in place, so the entry is neither evicted nor
+  // downloaded twice in the meantime.
+  auto entry_lock = CF_EXPECT(LockPath(entry + kLockExtension, LOCK_EX));
+
+  const bool hit = FileExists(entry);
+  if (hit) {
+    // The modification time orders the entries for eviction.
+    if (utimensat(AT_FDCWD, entry.c_str(), nullptr, 0) != 0) {
+      PLOG(DEBUG) << "Failed to update the time of \"" << entry << "\"";
+    }
+  } else {
+    // Fetched next to the entry and renamed, so an interrupted or failed
+    // download never looks like a complete entry.
+    const std::string temporary =
+        entry + kTemporaryInfix + std::to_string(getpid());
+    auto fetched = FetchInto(temporary, fetch);
+    if (!fetched.ok()) {
+      if (unlink(temporary.c_str()) != 0 && errno != ENOENT) {
+        PLOG(WARNING) << "Failed to remove \"" << temporary << "\"";
+      }
+      CF_EXPECTF(std::move(fetched), "Failed to fetch \"{}\" into the cache",
+                 entry);
+    }
+    CF_EXPECTF(rename(temporary.c_str(), entry.c_str()) == 0,
+               "Failed to rename \"{}\" to \"{}\": {}", temporary, entry,
+               strerror(errno));
+  }
+  CF_EXPECT(Materialize(entry, destination));
+
+  const std::uint64_t size = FileSize(entry);
+  if (hit) {
+    LOG(INFO) << "Artifact cache hit for \"" << artifact << "\" of build "
+              << build_id << " (" << size << " bytes)";
+    hits_++;
+    hit_bytes_ += size;
+  } else {
+    misses_++;
+    miss_bytes_ += size;
+    auto evicted = Evict();
+    if (!evicted.ok()) {
+      LOG(WARNING) << "Failed to evict artifact cache entries: "
+                   << evicted.error().FormatForEnv();
+    }
+  }
+  return {};
+}
+
+Result<void> ArtifactCache::Evict() {
+  auto cache_lock = CF_EXPECT(LockPath(directory_ + kCacheLock, LOCK_EX));
+
+  struct Entry {
+    std::string path;
+    std::uint64_t size;
+    struct timespec last_use;
+  };
+  std::vector<Entry> entries;
+  std::uint64_t total_size = 0;
+  CF_EXPECT(WalkDirectory(
+      directory_ + kEntriesDirectory, [&](const std::string& path) {
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode) ||
+            android::base::EndsWith(path, kLockExtension)) {
+          return true;
+        }
+        // Partial downloads take space too but can't be evicted, they have no
+        // lock file of their own.
+        total_size += st.st_size;
+        if (FileExists(path + kLockExtension)) {
+          entries.push_back(Entry{path, (std::uint64_t)st.st_size, st.st_mtim});
+        }
+        return true;
+      }));
+  if (total_size <= max_size_bytes_) {
+    return {};
+  }
+
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+    return std::tie(a.last_use.tv_sec, a.last_use.tv_nsec) <
+           std::tie(b.last_use.tv_sec, b.last_use.tv_nsec);
+  });
+  for (const auto& entry : entries) {
+    if (total_size <= max_size_bytes_) {
+      break;
+    }
+    // Entries in use by this or another process are skipped.
+    auto entry_lock = LockPath(entry.path + kLockExtension, LOCK_EX | LOCK_NB);
+    if (!entry_lock.ok()) {
+      continue;
+    }
+    if (!RemoveFile(entry.path)) {
+      PLOG(WARNING) << "Failed to evict \"" << entry.path << "\"";
+      continue;
+    }
+    LOG(DEBUG) << "Evicted \"" << entry.path << "\" from the artifact cache";
+    total_size -= entry.size;
+    // Processes waiting for the lock notice it was removed and create a new
+    // one, see LockPath.
+    if (unlink((entry.path + kLockExtension).c_str()) != 0) {
+      PLOG(WARNING) << "Failed to remove the lock of \"" << entry.path << "\"";
+      continue;
+    }
+    entry_lock->reset();
+    // The target and build directories, unless other entries remain in them.
+    const std::string target_directory = cpp_dirname(entry.path);
+    if (rmdir(target_directory.c_str()) == 0) {
+      rmdir(cpp_dirname(target_directory).c_str());
+    }
+  }
+  return {};
+}
+
+ArtifactCacheStats ArtifactCache::Stats() const {
+  return ArtifactCacheStats{
+      .hits = hits_,
+      .misses = misses_,
+      .hit_bytes = hit_bytes_,
+      .miss_bytes = miss_bytes_,
+  };
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,78 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "common/libs/utils/result.h"
+
+namespace cuttlefish {
+
+struct ArtifactCacheStats {
+  std::uint64_t hits = 0;
+  std::uint64_t misses = 0;
+  std::uint64_t hit_bytes = 0;
+  std::uint64_t miss_bytes = 0;
+};
+
+/**
+ * A host wide cache of build artifacts, shared by concurrent fetch_cvd
+ * processes. Artifacts of a build never change, so they are looked up by
+ * build id, target and artifact name.
+ *
+ * Each entry is guarded by a lock file, so only one process downloads a given
+ * artifact while the others wait for it. Artifacts are placed in the target
+ * directories as reflinks where the filesystem supports it, otherwise as hard
+ * links. Entries are made read only as hard links share them with the target
+ * directories. The least recently used entries are evicted once the cache
+ * grows past its size limit.
+ */
+class ArtifactCache {
+ public:
+  // Writes the artifact to the given path.
+  using Fetcher = std::function<Result<void>(const std::string&)>;
+
+  static Result<std::unique_ptr<ArtifactCache>> Create(
+      const std::string& directory, std::uint64_t max_size_bytes);
+
+  // Places the artifact at `destination`, calling `fetch` to fill the cache
+  // entry first if it's not present yet.
+  Result<void> Get(const std::string& build_id, const std::string& target,
+                   const std::string& artifact, const std::string& destination,
+                   const Fetcher& fetch);
+
+  ArtifactCacheStats Stats() const;
+
+ private:
+  ArtifactCache(std::string directory, std::uint64_t max_size_bytes);
+
+  std::string EntryPath(const std::string& build_id, const std::string& target,
+                        const std::string& artifact) const;
+  Result<void> Evict();
+
+  const std::string directory_;
+  const std::uint64_t max_size_bytes_;
+  std::atomic<std::uint64_t> hits_ = 0;
+  std::atomic<std::uint64_t> misses_ = 0;
+  std::atomic<std::uint64_t> hit_bytes_ = 0;
+  std::atomic<std::uint64_t> miss_bytes_ = 0;
+};
+
+}  // namespace cuttlefish
@@ -16,21 +16,31 @@
 #include "host/libs/web/http_client/http_client.h"
 
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <fstream>
 #include <functional>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <regex>
 #include <sstream>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/parseint.h>
 #include <android-base/strings.h>
 #include <curl/curl.h>
 #include <json/json.h>
 
+#include "common/libs/utils/files.h"
 #include "common/libs/utils/json.h"
 #include "common/libs/utils/subprocess.h"
 #include "host/libs/web/http_client/http_client_util.h"
@@ -113,18 +123,117 @@ Result<ManagedCurlSlist> SlistFromStrings(
   return curl_headers;
 }
 
+size_t curl_to_headers_cb(char* ptr, size_t, size_t nmemb, void* userdata) {
+  auto headers = (std::vector<std::string>*)userdata;
+  headers->emplace_back(TrimWhitespace(ptr, nmemb));
+  return nmemb;
+}
+
+int curl_to_cancelled_cb(void* userdata, curl_off_t, curl_off_t, curl_off_t,
+                         curl_off_t) {
+  auto cancelled = (std::atomic<bool>*)userdata;
+  return *cancelled ? 1 : 0;  // Non zero aborts the transfer
+}
+
+// Downloads at least this large are split into byte ranges that are fetched
+// over separate connections.
+constexpr int64_t kMinChunkedDownloadSize = 64 << 20;
+constexpr int64_t kMaxDownloadChunks = 4;
+// Data is downloaded next to the destination and only renamed into place once
+// complete. A partial file is resumed by a later download of the same path.
+constexpr char kPartialDownloadExtension[] = ".partial";
+// Exists while a chunked download writes to the partial file out of order, in
+// which case its size doesn't tell how much data is valid.
+constexpr char kChunkedDownloadExtension[] = ".chunked";
+// Holds the `ETag` or `Last-Modified` value of the resource the partial file
+// has data of. The partial file is only resumed if it is still the same.
+constexpr char kPartialValidatorExtension[] = ".validator";
+// A response that isn't the requested range is read up to this size, enough
+// for an error message but not for a whole changed resource.
+constexpr size_t kMaxDiscardedBodySize = 64 << 10;
+
+// Reads the full size of the resource from a `Content-Range` header like
+// "bytes 0-0/1234" or "bytes */1234".
+std::optional<int64_t> ContentRangeSize(
+    const std::vector<std::string>& headers) {
+  for (const auto& header : headers) {
+    if (!android::base::StartsWithIgnoreCase(header, "content-range:")) {
+      continue;
+    }
+    auto slash = header.rfind('/');
+    int64_t size;
+    if (slash == std::string::npos ||
+        !android::base::ParseInt(header.substr(slash + 1), &size, int64_t(0))) {
+      return {};
+    }
+    return size;
+  }
+  return {};
+}
+
+// Reads where the range of a `Content-Range` header like "bytes 10-19/1234"
+// begins.
+std::optional<int64_t> ContentRangeBegin(
+    const std::vector<std::string>& headers) {
+  for (const auto& header : headers) {
+    if (!android::base::StartsWithIgnoreCase(header, "content-range:")) {
+      continue;
+    }
+    auto begin = header.find("bytes ");
+    auto dash = header.find('-', begin);
+    int64_t value;
+    if (begin == std::string::npos || dash == std::string::npos ||
+        !android::base::ParseInt(header.substr(begin + 6, dash - begin - 6),
+                                 &value, int64_t(0))) {
+      return {};
+    }
+    return value;
+  }
+  return {};
+}
+
+// The value of the last `name` header, the one of the final response when
+// there were redirects.
+std::optional<std::string> HeaderValue(const std::vector<std::string>& headers,
+                                       const std::string& name) {
+  std::optional<std::string> value;
+  for (const auto& header : headers) {
+    if (header.size() > name.size() && header[name.size()] == ':' &&
+        android::base::StartsWithIgnoreCase(header, name)) {
+      value = android::base::Trim(header.substr(name.size() + 1));
+    }
+  }
+  return value;
+}
+
+// A value for an `If-Range` header, which only takes a strong entity tag or a
+// date.
+std::optional<std::string> RangeValidator(
+    const std::vector<std::string>& headers) {
+  auto etag = HeaderValue(headers, "etag");
+  if (etag && !android::base::StartsWith(*etag, "W/")) {
+    return etag;
+  }
+  return HeaderValue(headers, "last-modified");
+}
+
+struct DownloadChunk {
+  int64_t begin;
+  int64_t end;  // exclusive
+  int64_t written = 0;
+  Result<long> http_code = 0L;
+};
+
 class CurlClient : public HttpClient {
  public:
   CurlClient(NameResolver resolver, const bool use_logging_debug_function)
       : resolver_(std::move(resolver)),
-        use_logging_debug_function_(use_logging_debug_function) {
-    curl_ = curl_easy_init();
-    if (!curl_) {
-      LOG(ERROR) << "failed to initialize curl";
-      return;
+        use_logging_debug_function_(use_logging_debug_function) {}
+  ~CurlClient() {
+    for (auto curl : idle_curls_) {
+      curl_easy_cleanup(curl);
     }
   }
-  ~CurlClient() { curl_easy_cleanup(curl_); }
 
   Result<HttpResponse<std::string>> GetToString(
       const std::string& url,
@@ -168,17 +277,70 @@ class CurlClient : public HttpClient {
       const std::string& url, const std::string& path,
       const std::vector<std::string>& headers) {
     LOG(INFO) << "Attempting to save \"" << url << "\" to \"" << path << "\"";
-    std::fstream stream;
-    auto callback = [&stream, path](char* data, size_t size) -> bool {
-      if (data == nullptr) {
-        stream.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
-        return !stream.fail();
-      }
-      stream.write(data, size);
-      return !stream.fail();
+    const std::string partial_path = path + kPartialDownloadExtension;
+    const std::string chunked_marker = partial_path + kChunkedDownloadExtension;
+    const std::string validator_path =
+        partial_path + kPartialValidatorExtension;
+    if (FileExists(chunked_marker)) {
+      // An earlier chunked download was interrupted, nothing can be reused.
+      RemoveFile(partial_path);
+      RemoveFile(chunked_marker);
+    }
+
+    std::vector<std::string> probe_headers = headers;
+    probe_headers.emplace_back("Range: bytes=0-0");
+    std::vector<std::string> response_headers;
+    // Abort as soon as the server sends more than the requested byte, it
+    // ignores the range and is sending the whole resource.
+    int64_t probe_received = 0;
+    auto probe_callback = [&probe_received](char* data, size_t size) {
+      probe_received += data ? size : 0;
+      return probe_received <= 1;
     };
-    auto http_response = CF_EXPECT(DownloadToCallback(callback, url, headers));
-    return HttpResponse<std::string>{path, http_response.http_code};
+    auto probe = DownloadToCallback(HttpMethod::kGet, probe_callback, url,
+                                    probe_headers, "", &response_headers);
+    std::optional<int64_t> size;
+    if (probe.ok() && probe->http_code == 206) {
+      size = ContentRangeSize(response_headers);
+    } else if (probe.ok() && probe->http_code == 416) {
+      size = ContentRangeSize(response_headers);  // Only for empty resources
+    } else if (probe.ok() && !probe->HttpSuccess()) {
+      return HttpResponse<std::string>{path, probe->http_code};
+    }
+
+    long http_code;
+    if (size) {
+      const std::optional<std::string> validator =
+          RangeValidator(response_headers);
+      std::string partial_validator;
+      if (FileExists(partial_path) &&
+          (!validator ||
+           !android::base::ReadFileToString(validator_path,
+                                            &partial_validator) ||
+           partial_validator != *validator)) {
+        LOG(INFO) << "\"" << url << "\" may have changed since \""
+                  << partial_path << "\" was downloaded, starting over";
+        RemoveFile(partial_path);
+      }
+      if (validator) {
+        CF_EXPECT(android::base::WriteStringToFile(*validator, validator_path),
+                  "Failed to write \"" << validator_path << "\"");
+      } else {
+        RemoveFile(validator_path);
+      }
+      http_code = CF_EXPECT(
+          DownloadRanges(url, headers, partial_path, *size, validator));
+    } else {
+      LOG(DEBUG) << "No range support for \"" << url << "\", downloading "
+                 << "it as a whole";
+      RemoveFile(validator_path);
+      http_code = CF_EXPECT(DownloadWhole(url, headers, partial_path));
+    }
+    if (IsHttpSuccess(http_code)) {
+      CF_EXPECT(RenameFile(partial_path, path));
+      RemoveFile(validator_path);
+    }
+    return HttpResponse<std::string>{path, http_code};
   }
 
   Result<HttpResponse<Json::Value>> DownloadToJson(
@@ -192,14 +354,195 @@ class CurlClient : public HttpClient {
     return DownloadToJson(HttpMethod::kDelete, url, headers);
   }
 
+  void Cancel() override { cancelled_ = true; }
+
   std::string UrlEscape(const std::string& text) override {
-    char* escaped_str = curl_easy_escape(curl_, text.c_str(), text.size());
+    auto curl = AcquireCurl();
+    char* escaped_str = curl_easy_escape(curl.get(), text.c_str(), text.size());
     std::string ret{escaped_str};
     curl_free(escaped_str);
     return ret;
   }
 
  private:
+  using ManagedCurl = std::unique_ptr<CURL, std::function<void(CURL*)>>;
+
+  // Every request uses its own handle so they can run concurrently, idle
+  // handles are kept around to reuse their connections.
+  ManagedCurl AcquireCurl() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CURL* curl;
+    if (idle_curls_.empty()) {
+      curl = curl_easy_init();
+      if (!curl) {
+        LOG(ERROR) << "failed to initialize curl";
+      }
+    } else {
+      curl = idle_curls_.back();
+      idle_curls_.pop_back();
+    }
+    return ManagedCurl(curl, [this](CURL* curl) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      idle_curls_.push_back(curl);
+    });
+  }
+
+  Result<long> DownloadWhole(const std::string& url,
+                             const std::vector<std::string>& headers,
+                             const std::string& path) {
+    std::fstream stream;
+    auto callback = [&stream, path](char* data, size_t size) -> bool {
+      if (data == nullptr) {
+        stream.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        return !stream.fail();
+      }
+      stream.write(data, size);
+      return !stream.fail();
+    };
+    auto response =
+        CF_EXPECT(DownloadToCallback(HttpMethod::kGet, callback, url, headers));
+    return response.http_code;
+  }
+
+  // Downloads whatever `path` is missing of the `size` bytes of the resource.
+  // On failure the file is cut back to the data received contiguously from
+  // the start, so a later call can resume from there. The ranges are only
+  // accepted from the version of the resource `validator` identifies.
+  Result<long> DownloadRanges(const std::string& url,
+                              const std::vector<std::string>& headers,
+                              const std::string& path, int64_t size,
+                              const std::optional<std::string>& validator) {
+    int64_t existing = FileExists(path) ? FileSize(path) : 0;
+    if (existing > size) {
+      existing = 0;
+    }
+    if (existing > 0) {
+      LOG(INFO) << "Resuming download of \"" << path << "\" at " << existing
+                << " of " << size << " bytes";
+    }
+    {
+      std::ofstream create(path, std::ios::out | std::ios::binary |
+                                     (existing ? std::ios::app
+                                               : std::ios::trunc));
+      CF_EXPECT(!create.fail(), "Failed to open \"" << path << "\"");
+    }
+    const int64_t remaining = size - existing;
+    if (remaining == 0) {
+      return 200L;
+    }
+
+    const int64_t chunk_count =
+        remaining >= kMinChunkedDownloadSize ? kMaxDownloadChunks : 1;
+    const int64_t chunk_size = (remaining + chunk_count - 1) / chunk_count;
+    std::vector<DownloadChunk> chunks;
+    for (int64_t begin = existing; begin < size; begin += chunk_size) {
+      chunks.push_back(DownloadChunk{
+          .begin = begin,
+          .end = std::min(begin + chunk_size, size),
+      });
+    }
+    const std::string chunked_marker = path + kChunkedDownloadExtension;
+    if (chunks.size() > 1) {
+      std::ofstream marker(chunked_marker);
+      CF_EXPECT(!marker.fail(),
+                "Failed to create \"" << chunked_marker << "\"");
+    }
+
+    std::vector<std::thread> threads;
+    for (auto& chunk : chunks) {
+      threads.emplace_back([this, &url, &headers, &path, &validator,
+                            &chunk]() {
+        chunk.http_code = DownloadRange(url, headers, path, validator, chunk);
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    int64_t valid = existing;
+    std::optional<Result<long>> failure;
+    for (auto& chunk : chunks) {
+      valid = chunk.begin + chunk.written;
+      if (!chunk.http_code.ok() || !IsHttpSuccess(*chunk.http_code)) {
+        failure = std::move(chunk.http_code);
+        break;
+      }
+    }
+    if (failure) {
+      CF_EXPECT(truncate(path.c_str(), valid) == 0,
+                "Failed to truncate \"" << path << "\": " << strerror(errno));
+    }
+    RemoveFile(chunked_marker);
+    if (failure) {
+      return CF_EXPECT(std::move(*failure));
+    }
+    return *chunks.back().http_code;
+  }
+
+  Result<long> DownloadRange(const std::string& url,
+                             const std::vector<std::string>& headers,
+                             const std::string& path,
+                             const std::optional<std::string>& validator,
+                             DownloadChunk& chunk) {
+    std::vector<std::string> range_headers = headers;
+    range_headers.emplace_back("Range: bytes=" + std::to_string(chunk.begin) +
+                               "-" + std::to_string(chunk.end - 1));
+    if (validator) {
+      // The server sends the whole resource instead if it changed.
+      range_headers.emplace_back("If-Range: " + *validator);
+    }
+    std::vector<std::string> response_headers;
+    std::fstream stream;
+    // Set for a response that isn't the requested range, which is discarded.
+    bool other_body = false;
+    size_t discarded = 0;
+    auto callback = [&](char* data, size_t size) -> bool {
+      if (data == nullptr) {
+        chunk.written = 0;
+        response_headers.clear();
+        other_body = false;
+        discarded = 0;
+        stream.open(path, std::ios::in | std::ios::out | std::ios::binary);
+        stream.seekp(chunk.begin);
+        return !stream.fail();
+      }
+      if (chunk.written == 0 && discarded == 0) {
+        other_body = ContentRangeBegin(response_headers) != chunk.begin;
+      }
+      if (other_body) {
+        discarded += size;
+        return discarded <= kMaxDiscardedBodySize;
+      }
+      if (chunk.written + (int64_t)size > chunk.end - chunk.begin) {
+        return false;  // The server sent more than requested
+      }
+      stream.write(data, size);
+      stream.flush();
+      if (stream.fail()) {
+        return false;
+      }
+      chunk.written += size;
+      return true;
+    };
+    auto response =
+        DownloadToCallback(HttpMethod::kGet, callback, url, range_headers, "",
+                           &response_headers);
+    if (response.ok() && !IsHttpSuccess(response->http_code)) {
+      return response->http_code;
+    }
+    CF_EXPECT(!other_body, "Expected the range starting at "
+                               << chunk.begin << " of \"" << url
+                               << "\", which may have changed meanwhile");
+    const long http_code = CF_EXPECT(std::move(response)).http_code;
+    CF_EXPECT(http_code == 206,
+              "Expected a partial response, got " << http_code);
+    CF_EXPECT(chunk.written == chunk.end - chunk.begin,
+              "Received " << chunk.written << " bytes of the range starting at "
+                          << chunk.begin << ", expected "
+                          << (chunk.end - chunk.begin));
+    return http_code;
+  }
+
   Result<ManagedCurlSlist> ManuallyResolveUrl(const std::string& url_str) {
     if (!resolver_) {
       return ManagedCurlSlist(nullptr, curl_slist_free_all);
@@ -258,14 +601,17 @@ class CurlClient : public HttpClient {
   Result<HttpResponse<void>> DownloadToCallback(
       HttpMethod method, DataCallback callback, const std::string& url,
       const std::vector<std::string>& headers,
-      const std::string& data_to_write = "") {
-    std::lock_guard<std::mutex> lock(mutex_);
+      const std::string& data_to_write = "",
+      std::vector<std::string>* response_headers = nullptr) {
+    auto curl = AcquireCurl();
+    CURL* curl_ = curl.get();
+    CF_EXPECT(curl_ != nullptr, "curl was not initialized");
     auto extra_cache_entries = CF_EXPECT(ManuallyResolveUrl(url));
     curl_easy_setopt(curl_, CURLOPT_RESOLVE, extra_cache_entries.get());
     LOG(INFO) << "Attempting to download \"" << url << "\"";
     CF_EXPECT(data_to_write.empty() || method == HttpMethod::kPost,
               "data must be empty for non POST requests");
-    CF_EXPECT(curl_ != nullptr, "curl was not initialized");
+    CF_EXPECT(!cancelled_, "Request to \"" << url << "\" was cancelled");
     CF_EXPECT(callback(nullptr, 0) /* Signal start of data */,
               "callback failure");
     auto curl_headers = CF_EXPECT(SlistFromStrings(headers));
@@ -283,6 +629,13 @@ class CurlClient : public HttpClient {
     }
     curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, curl_to_function_cb);
     curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &callback);
+    curl_easy_setopt(curl_, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl_, CURLOPT_XFERINFOFUNCTION, curl_to_cancelled_cb);
+    curl_easy_setopt(curl_, CURLOPT_XFERINFODATA, &cancelled_);
+    if (response_headers) {
+      curl_easy_setopt(curl_, CURLOPT_HEADERFUNCTION, curl_to_headers_cb);
+      curl_easy_setopt(curl_, CURLOPT_HEADERDATA, response_headers);
+    }
     char error_buf[CURL_ERROR_SIZE];
     curl_easy_setopt(curl_, CURLOPT_ERRORBUFFER, error_buf);
     curl_easy_setopt(curl_, CURLOPT_VERBOSE, 1L);
@@ -301,10 +654,11 @@ class CurlClient : public HttpClient {
     return HttpResponse<void>{{}, http_code};
   }
 
-  CURL* curl_;
   NameResolver resolver_;
-  std::mutex mutex_;
+  std::mutex mutex_;  // guards idle_curls_
+  std::vector<CURL*> idle_curls_;
   bool use_logging_debug_function_;
+  std::atomic<bool> cancelled_ = false;
 };
 
 class ServerErrorRetryClient : public HttpClient {
@@ -393,6 +747,8 @@ class ServerErrorRetryClient : public HttpClient {
     return inner_client_.UrlEscape(text);
   }
 
+  void Cancel() override { inner_client_.Cancel(); }
+
  private:
   template <typename T>
   Result<HttpResponse<T>> RetryImpl(
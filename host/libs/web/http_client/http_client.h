@@ -100,6 +100,10 @@ class HttpClient {
       const std::vector<std::string>& headers = {}) = 0;
 
   virtual std::string UrlEscape(const std::string&) = 0;
+
+  // Makes the requests in progress fail as soon as possible, and every later
+  // request fail right away. For when their results are no longer needed.
+  virtual void Cancel() = 0;
 };
 
 }  // namespace cuttlefish
@@ -138,5 +138,8 @@ Result<HttpResponse<Json::Value>> SsoClient::DeleteToJson(
 
 std::string SsoClient::UrlEscape(const std::string&) { return ""; }
 
+// Requests run the sso_client tool to completion.
+void SsoClient::Cancel() {}
+
 }  // namespace http_client
 }  // namespace cuttlefish
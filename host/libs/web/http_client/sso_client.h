@@ -71,6 +71,8 @@ class SsoClient : public HttpClient {
 
   std::string UrlEscape(const std::string&) override;
 
+  void Cancel() override;
+
  private:
   ExecCmdFunc exec_cmd_func_;
 };
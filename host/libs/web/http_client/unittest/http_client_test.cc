@@ -0,0 +1,357 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/libs/web/http_client/http_client.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+#include <gtest/gtest.h>
+
+#include "common/libs/utils/files.h"
+
+namespace cuttlefish {
+namespace {
+
+struct Request {
+  std::string range;
+  std::string if_range;
+};
+
+// Serves a single resource over HTTP/1.1 on a loopback port, like the storage
+// behind the build API does.
+class LocalHttpServer {
+ public:
+  LocalHttpServer() {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    EXPECT_EQ(bind(listen_fd_, (sockaddr*)&addr, sizeof(addr)), 0);
+    EXPECT_EQ(listen(listen_fd_, 16), 0);
+    EXPECT_EQ(getsockname(listen_fd_, (sockaddr*)&addr, &addr_len), 0);
+    port_ = ntohs(addr.sin_port);
+    accept_thread_ = std::thread([this]() { AcceptLoop(); });
+  }
+
+  ~LocalHttpServer() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    released_.notify_all();
+    shutdown(listen_fd_, SHUT_RDWR);
+    accept_thread_.join();
+    for (auto& thread : connection_threads_) {
+      thread.join();
+    }
+    close(listen_fd_);
+  }
+
+  std::string Url() const {
+    return "http://127.0.0.1:" + std::to_string(port_) + "/artifact";
+  }
+
+  void SetResource(std::string body, std::optional<std::string> etag) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    body_ = std::move(body);
+    etag_ = std::move(etag);
+  }
+  void SetRangeSupport(bool supported) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ranges_supported_ = supported;
+  }
+  // Responses only send this much of their body, and then hang until the
+  // server is released.
+  void StallAfter(std::optional<std::size_t> bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stall_after_ = bytes;
+  }
+  // Changes the resource right after the next range probe is answered.
+  void ChangeAfterProbe(std::string body, std::string etag) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    change_after_probe_ = std::make_pair(std::move(body), std::move(etag));
+  }
+
+  std::vector<Request> Requests() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return requests_;
+  }
+  // The ranges asked for apart from the one byte probes.
+  std::vector<std::string> DataRanges() {
+    std::vector<std::string> ranges;
+    for (const auto& request : Requests()) {
+      if (request.range != "bytes=0-0") {
+        ranges.push_back(request.range);
+      }
+    }
+    return ranges;
+  }
+
+ private:
+  void AcceptLoop() {
+    while (true) {
+      int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd < 0) {
+        return;
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      connection_threads_.emplace_back([this, fd]() {
+        HandleConnection(fd);
+        close(fd);
+      });
+    }
+  }
+
+  void HandleConnection(int fd) {
+    std::string request;
+    char buffer[4096];
+    while (request.find("\r\n\r\n") == std::string::npos) {
+      ssize_t bytes_read = read(fd, buffer, sizeof(buffer));
+      if (bytes_read <= 0) {
+        return;
+      }
+      request.append(buffer, bytes_read);
+    }
+    Request parsed;
+    for (const auto& line : android::base::Split(request, "\r\n")) {
+      if (android::base::StartsWithIgnoreCase(line, "range:")) {
+        parsed.range = android::base::Trim(line.substr(6));
+      } else if (android::base::StartsWithIgnoreCase(line, "if-range:")) {
+        parsed.if_range = android::base::Trim(line.substr(9));
+      }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    requests_.push_back(parsed);
+    const std::string body = body_;
+    std::string status = "200 OK";
+    std::string headers;
+    std::string content = body;
+    if (etag_) {
+      headers += "ETag: " + *etag_ + "\r\n";
+    }
+    std::vector<std::string> range;
+    if (ranges_supported_ && !parsed.range.empty() &&
+        (parsed.if_range.empty() || (etag_ && parsed.if_range == *etag_))) {
+      range = android::base::Split(parsed.range.substr(6), "-");
+    }
+    std::uint64_t begin;
+    std::uint64_t end;
+    if (range.size() == 2 && android::base::ParseUint(range[0], &begin) &&
+        android::base::ParseUint(range[1], &end)) {
+      end = std::min<std::uint64_t>(end, body.size() - 1);
+      status = "206 Partial Content";
+      headers += "Content-Range: bytes " + std::to_string(begin) + "-" +
+                 std::to_string(end) + "/" + std::to_string(body.size()) +
+                 "\r\n";
+      content = body.substr(begin, end - begin + 1);
+    }
+    if (parsed.range == "bytes=0-0" && change_after_probe_) {
+      body_ = change_after_probe_->first;
+      etag_ = change_after_probe_->second;
+      change_after_probe_.reset();
+    }
+    const std::optional<std::size_t> stall_after = stall_after_;
+    lock.unlock();
+
+    std::string response = "HTTP/1.1 " + status + "\r\n" + headers +
+                           "Content-Length: " +
+                           std::to_string(content.size()) +
+                           "\r\nConnection: close\r\n\r\n";
+    // Not the probes though.
+    const bool stall = stall_after && content.size() > 1;
+    if (stall) {
+      content.resize(*stall_after);
+    }
+    response += content;
+    if (!android::base::WriteFully(fd, response.data(), response.size())) {
+      return;
+    }
+    if (stall) {
+      lock.lock();
+      released_.wait(lock, [this]() { return stopping_; });
+    }
+  }
+
+  int listen_fd_;
+  int port_;
+  std::thread accept_thread_;
+  std::mutex mutex_;
+  std::condition_variable released_;
+  bool stopping_ = false;
+  std::vector<std::thread> connection_threads_;
+  std::vector<Request> requests_;
+  std::string body_;
+  std::optional<std::string> etag_;
+  bool ranges_supported_ = true;
+  std::optional<std::size_t> stall_after_;
+  std::optional<std::pair<std::string, std::string>> change_after_probe_;
+};
+
+std::string Contents(std::size_t size, char seed) {
+  std::string contents(size, '\0');
+  for (std::size_t i = 0; i < size; i++) {
+    contents[i] = static_cast<char>(seed + i * 7 + i / 4099);
+  }
+  return contents;
+}
+
+std::string ReadFile(const std::string& path) {
+  std::string contents;
+  EXPECT_TRUE(android::base::ReadFileToString(path, &contents)) << path;
+  return contents;
+}
+
+class HttpClientTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    path_ = std::string(dir_.path) + "/artifact";
+    client_ = HttpClient::CurlClient();
+  }
+
+  // Starts a download that stalls halfway through, and cancels it once the
+  // first half is on disk.
+  void InterruptedDownload() {
+    const std::size_t half = body_.size() / 2;
+    server_.StallAfter(half);
+    auto client = HttpClient::CurlClient();
+    std::thread cancel([this, &client, half]() {
+      const std::string partial_path = path_ + ".partial";
+      auto deadline =
+          std::chrono::steady_clock::now() + std::chrono::seconds(30);
+      while (std::chrono::steady_clock::now() < deadline &&
+             !(FileExists(partial_path) && FileSize(partial_path) >= off_t(half))) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+      client->Cancel();
+    });
+    auto result = client->DownloadToFile(server_.Url(), path_);
+    cancel.join();
+    EXPECT_FALSE(result.ok());
+    EXPECT_FALSE(FileExists(path_));
+    server_.StallAfter(std::nullopt);
+  }
+
+  TemporaryDir dir_;
+  std::string path_;
+  LocalHttpServer server_;
+  std::unique_ptr<HttpClient> client_;
+  std::string body_ = Contents(1 << 20, 'a');
+};
+
+TEST_F(HttpClientTest, DownloadsWithoutRangeSupport) {
+  server_.SetResource(body_, "\"v1\"");
+  server_.SetRangeSupport(false);
+
+  auto result = client_->DownloadToFile(server_.Url(), path_);
+
+  ASSERT_TRUE(result.ok()) << result.error().FormatForEnv();
+  EXPECT_EQ(result->http_code, 200);
+  EXPECT_EQ(ReadFile(path_), body_);
+  EXPECT_FALSE(FileExists(path_ + ".partial"));
+}
+
+TEST_F(HttpClientTest, DownloadsRange) {
+  server_.SetResource(body_, "\"v1\"");
+
+  auto result = client_->DownloadToFile(server_.Url(), path_);
+
+  ASSERT_TRUE(result.ok()) << result.error().FormatForEnv();
+  EXPECT_TRUE(IsHttpSuccess(result->http_code));
+  EXPECT_EQ(ReadFile(path_), body_);
+  EXPECT_EQ(server_.DataRanges(),
+            std::vector<std::string>{"bytes=0-" +
+                                     std::to_string(body_.size() - 1)});
+  EXPECT_EQ(server_.Requests().back().if_range, "\"v1\"");
+  EXPECT_FALSE(FileExists(path_ + ".partial"));
+}
+
+TEST_F(HttpClientTest, DownloadsLargeFileInChunks) {
+  body_ = Contents(64 << 20, 'b');
+  server_.SetResource(body_, "\"v1\"");
+
+  auto result = client_->DownloadToFile(server_.Url(), path_);
+
+  ASSERT_TRUE(result.ok()) << result.error().FormatForEnv();
+  EXPECT_TRUE(IsHttpSuccess(result->http_code));
+  EXPECT_EQ(ReadFile(path_), body_);
+  EXPECT_EQ(server_.DataRanges().size(), 4u);
+}
+
+TEST_F(HttpClientTest, CancelledClientFailsRightAway) {
+  server_.SetResource(body_, "\"v1\"");
+  client_->Cancel();
+
+  EXPECT_FALSE(client_->GetToString(server_.Url()).ok());
+  EXPECT_TRUE(server_.Requests().empty());
+}
+
+TEST_F(HttpClientTest, ResumesInterruptedDownload) {
+  server_.SetResource(body_, "\"v1\"");
+  InterruptedDownload();
+
+  auto result = client_->DownloadToFile(server_.Url(), path_);
+
+  ASSERT_TRUE(result.ok()) << result.error().FormatForEnv();
+  EXPECT_EQ(ReadFile(path_), body_);
+  auto ranges = server_.DataRanges();
+  ASSERT_EQ(ranges.size(), 2u);
+  EXPECT_EQ(ranges[1], "bytes=" + std::to_string(body_.size() / 2) + "-" +
+                           std::to_string(body_.size() - 1));
+}
+
+TEST_F(HttpClientTest, RestartsDownloadOfChangedResource) {
+  server_.SetResource(body_, "\"v1\"");
+  InterruptedDownload();
+  const std::string new_body = Contents(body_.size(), 'c');
+  server_.SetResource(new_body, "\"v2\"");
+
+  auto result = client_->DownloadToFile(server_.Url(), path_);
+
+  ASSERT_TRUE(result.ok()) << result.error().FormatForEnv();
+  EXPECT_EQ(ReadFile(path_), new_body);
+  auto ranges = server_.DataRanges();
+  ASSERT_EQ(ranges.size(), 2u);
+  EXPECT_EQ(ranges[1], "bytes=0-" + std::to_string(body_.size() - 1));
+}
+
+TEST_F(HttpClientTest, ResourceChangingDuringDownloadFails) {
+  server_.SetResource(body_, "\"v1\"");
+  server_.ChangeAfterProbe(Contents(body_.size(), 'c'), "\"v2\"");
+
+  auto result = client_->DownloadToFile(server_.Url(), path_);
+
+  EXPECT_FALSE(result.ok());
+  EXPECT_FALSE(FileExists(path_));
+}
+
+}  // namespace
+}  // namespace cuttlefish
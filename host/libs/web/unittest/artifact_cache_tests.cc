@@ -0,0 +1,219 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/libs/web/artifact_cache.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include <android-base/file.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "common/libs/utils/files.h"
+#include "common/libs/utils/result.h"
+#include "common/libs/utils/result_matchers.h"
+
+namespace cuttlefish {
+namespace {
+
+class ArtifactCacheTests : public ::testing::Test {
+ protected:
+  std::unique_ptr<ArtifactCache> MakeCache(std::uint64_t max_size_bytes) {
+    auto cache = ArtifactCache::Create(std::string(cache_dir_.path) + "/cache",
+                                       max_size_bytes);
+    EXPECT_THAT(cache, IsOk());
+    return std::move(*cache);
+  }
+
+  // Returns a fetcher writing `contents` and counting its calls.
+  ArtifactCache::Fetcher Writes(const std::string& contents) {
+    return [this, contents](const std::string& path) -> Result<void> {
+      fetches_++;
+      std::ofstream(path) << contents;
+      return {};
+    };
+  }
+
+  std::string Destination(const std::string& name) {
+    return std::string(target_dir_.path) + "/" + name;
+  }
+
+  std::string EntryPath(const std::string& artifact) {
+    return std::string(cache_dir_.path) + "/cache/artifacts/1234/target/" +
+           artifact;
+  }
+
+  // Backdates the last use of an entry of build "1234" and target "target".
+  void SetLastUse(const std::string& artifact, time_t seconds) {
+    const struct timespec times[2] = {{.tv_sec = seconds, .tv_nsec = 0},
+                                      {.tv_sec = seconds, .tv_nsec = 0}};
+    ASSERT_EQ(utimensat(AT_FDCWD, EntryPath(artifact).c_str(), times, 0), 0)
+        << strerror(errno);
+  }
+
+  TemporaryDir cache_dir_;
+  TemporaryDir target_dir_;
+  int fetches_ = 0;
+};
+
+TEST_F(ArtifactCacheTests, SecondGetIsHit) {
+  auto cache = MakeCache(1 << 20);
+
+  EXPECT_THAT(cache->Get("1234", "target", "a.img", Destination("first"),
+                         Writes("contents")),
+              IsOk());
+  EXPECT_THAT(cache->Get("1234", "target", "a.img", Destination("second"),
+                         Writes("other contents")),
+              IsOk());
+
+  EXPECT_EQ(fetches_, 1);
+  EXPECT_EQ(ReadFile(Destination("first")), "contents");
+  EXPECT_EQ(ReadFile(Destination("second")), "contents");
+  auto stats = cache->Stats();
+  EXPECT_EQ(stats.hits, 1u);
+  EXPECT_EQ(stats.misses, 1u);
+  EXPECT_EQ(stats.hit_bytes, 8u);
+  EXPECT_EQ(stats.miss_bytes, 8u);
+}
+
+TEST_F(ArtifactCacheTests, KeyIncludesBuildTargetAndArtifact) {
+  auto cache = MakeCache(1 << 20);
+
+  EXPECT_THAT(cache->Get("1234", "target", "a.img", Destination("a"),
+                         Writes("a")),
+              IsOk());
+  EXPECT_THAT(cache->Get("1235", "target", "a.img", Destination("b"),
+                         Writes("b")),
+              IsOk());
+  EXPECT_THAT(cache->Get("1234", "other", "a.img", Destination("c"),
+                         Writes("c")),
+              IsOk());
+  EXPECT_THAT(cache->Get("1234", "target", "b.img", Destination("d"),
+                         Writes("d")),
+              IsOk());
+
+  EXPECT_EQ(fetches_, 4);
+  EXPECT_EQ(ReadFile(Destination("c")), "c");
+}
+
+TEST_F(ArtifactCacheTests, FailedFetchIsNotCached) {
+  auto cache = MakeCache(1 << 20);
+  auto fail = [](const std::string&) -> Result<void> {
+    return CF_ERR("download failed");
+  };
+
+  EXPECT_THAT(cache->Get("1234", "target", "a.img", Destination("a"), fail),
+              IsError());
+  EXPECT_THAT(cache->Get("1234", "target", "a.img", Destination("a"),
+                         Writes("contents")),
+              IsOk());
+
+  EXPECT_EQ(fetches_, 1);
+  EXPECT_EQ(ReadFile(Destination("a")), "contents");
+}
+
+TEST_F(ArtifactCacheTests, FetchesNextToEntry) {
+  auto cache = MakeCache(1 << 20);
+  std::string fetched_path;
+  auto fail_midway = [&fetched_path](const std::string& path) -> Result<void> {
+    fetched_path = path;
+    std::ofstream(path) << "partial";
+    return CF_ERR("download interrupted");
+  };
+
+  EXPECT_THAT(
+      cache->Get("1234", "target", "a.img", Destination("a"), fail_midway),
+      IsError());
+
+  EXPECT_NE(fetched_path, EntryPath("a.img"));
+  EXPECT_EQ(cpp_dirname(fetched_path), cpp_dirname(EntryPath("a.img")));
+  EXPECT_FALSE(FileExists(fetched_path));
+  EXPECT_FALSE(FileExists(EntryPath("a.img")));
+}
+
+TEST_F(ArtifactCacheTests, EvictsLeastRecentlyUsed) {
+  auto cache = MakeCache(12);
+  for (const std::string name : {"a", "b", "c"}) {
+    EXPECT_THAT(cache->Get("1234", "target", name + ".img", Destination(name),
+                           Writes(name + name + name + name)),
+                IsOk());
+  }
+  ASSERT_EQ(fetches_, 3);
+  // Oldest first, "a" is then used again and becomes the most recent.
+  SetLastUse("a.img", 1000);
+  SetLastUse("b.img", 2000);
+  SetLastUse("c.img", 3000);
+  EXPECT_THAT(cache->Get("1234", "target", "a.img", Destination("a"),
+                         Writes("aaaa")),
+              IsOk());
+
+  EXPECT_THAT(cache->Get("1234", "target", "d.img", Destination("d"),
+                         Writes("dddd")),
+              IsOk());
+
+  EXPECT_EQ(fetches_, 4);
+  EXPECT_FALSE(FileExists(EntryPath("b.img")));
+  for (const std::string name : {"a", "c", "d"}) {
+    EXPECT_TRUE(FileExists(EntryPath(name + ".img"))) << name;
+    EXPECT_THAT(cache->Get("1234", "target", name + ".img", Destination(name),
+                           Writes("other")),
+                IsOk());
+  }
+  EXPECT_EQ(fetches_, 4);
+  // Materialized artifacts outlive their cache entries.
+  EXPECT_EQ(ReadFile(Destination("b")), "bbbb");
+  EXPECT_THAT(cache->Get("1234", "target", "b.img", Destination("b"),
+                         Writes("bbbb")),
+              IsOk());
+  EXPECT_EQ(fetches_, 5);
+}
+
+TEST_F(ArtifactCacheTests, EvictionRemovesLockAndEmptyDirectories) {
+  auto cache = MakeCache(4);
+  EXPECT_THAT(cache->Get("1233", "old", "a.img", Destination("a"),
+                         Writes("aaaa")),
+              IsOk());
+  const std::string build_directory =
+      std::string(cache_dir_.path) + "/cache/artifacts/1233";
+  const std::string evicted = build_directory + "/old/a.img";
+  const struct timespec times[2] = {{.tv_sec = 1000, .tv_nsec = 0},
+                                    {.tv_sec = 1000, .tv_nsec = 0}};
+  ASSERT_EQ(utimensat(AT_FDCWD, evicted.c_str(), times, 0), 0)
+      << strerror(errno);
+
+  EXPECT_THAT(cache->Get("1234", "target", "b.img", Destination("b"),
+                         Writes("bbbb")),
+              IsOk());
+
+  EXPECT_FALSE(FileExists(evicted));
+  EXPECT_FALSE(FileExists(evicted + ".lock"));
+  EXPECT_FALSE(FileExists(build_directory));
+  EXPECT_TRUE(FileExists(EntryPath("b.img")));
+  EXPECT_THAT(cache->Get("1233", "old", "a.img", Destination("a"),
+                         Writes("aaaa")),
+              IsOk());
+  EXPECT_EQ(fetches_, 3);
+}
+
+}  // namespace
+}  // namespace cuttlefish
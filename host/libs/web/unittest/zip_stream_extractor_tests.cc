@@ -0,0 +1,363 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/libs/web/zip_stream_extractor.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+#include "common/libs/utils/files.h"
+#include "common/libs/utils/result_matchers.h"
+
+namespace cuttlefish {
+namespace {
+
+void Append16(std::string& out, std::uint16_t value) {
+  out += char(value & 0xff);
+  out += char(value >> 8);
+}
+
+void Append32(std::string& out, std::uint32_t value) {
+  Append16(out, value & 0xffff);
+  Append16(out, value >> 16);
+}
+
+void Append64(std::string& out, std::uint64_t value) {
+  Append32(out, value & 0xffffffff);
+  Append32(out, value >> 32);
+}
+
+struct TestEntry {
+  std::string name;
+  std::string contents;
+  bool deflated = false;
+  // Sets flag bit 3, the sizes and CRC follow the data.
+  bool descriptor = false;
+  // Stores the sizes in a zip64 extra field.
+  bool zip64 = false;
+};
+
+std::string Deflate(const std::string& data) {
+  z_stream stream = {};
+  EXPECT_EQ(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                         -MAX_WBITS, 8, Z_DEFAULT_STRATEGY),
+            Z_OK);
+  std::string deflated(deflateBound(&stream, data.size()), '\0');
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = data.size();
+  stream.next_out = reinterpret_cast<Bytef*>(deflated.data());
+  stream.avail_out = deflated.size();
+  EXPECT_EQ(deflate(&stream, Z_FINISH), Z_STREAM_END);
+  deflated.resize(stream.total_out);
+  deflateEnd(&stream);
+  return deflated;
+}
+
+// Bytes that don't compress, so they reach the extractor as they are.
+std::string RandomBytes(std::size_t size) {
+  std::mt19937 random(size);
+  std::string bytes(size, '\0');
+  for (auto& byte : bytes) {
+    byte = char(random());
+  }
+  return bytes;
+}
+
+// Builds a zip with only the local headers the extractor reads and an end of
+// central directory record.
+std::string BuildZip(const std::vector<TestEntry>& entries) {
+  std::string zip;
+  for (const auto& entry : entries) {
+    const std::string data =
+        entry.deflated ? Deflate(entry.contents) : entry.contents;
+    const std::uint32_t crc =
+        crc32(0, reinterpret_cast<const Bytef*>(entry.contents.data()),
+              entry.contents.size());
+    // Sizes aren't known up front when there is a data descriptor.
+    const std::uint64_t compressed_size = entry.descriptor ? 0 : data.size();
+    const std::uint64_t uncompressed_size =
+        entry.descriptor ? 0 : entry.contents.size();
+
+    Append32(zip, 0x04034b50);
+    Append16(zip, entry.zip64 ? 45 : 20);  // version needed
+    Append16(zip, entry.descriptor ? 1 << 3 : 0);
+    Append16(zip, entry.deflated ? 8 : 0);
+    Append32(zip, 0);  // modification time and date
+    Append32(zip, entry.descriptor ? 0 : crc);
+    Append32(zip, entry.zip64 ? 0xffffffff : compressed_size);
+    Append32(zip, entry.zip64 ? 0xffffffff : uncompressed_size);
+    Append16(zip, entry.name.size());
+    Append16(zip, entry.zip64 ? 20 : 0);  // extra field length
+    zip += entry.name;
+    if (entry.zip64) {
+      Append16(zip, 0x0001);
+      Append16(zip, 16);
+      Append64(zip, uncompressed_size);
+      Append64(zip, compressed_size);
+    }
+    zip += data;
+    if (entry.descriptor) {
+      Append32(zip, 0x08074b50);
+      Append32(zip, crc);
+      if (entry.zip64) {
+        Append64(zip, data.size());
+        Append64(zip, entry.contents.size());
+      } else {
+        Append32(zip, data.size());
+        Append32(zip, entry.contents.size());
+      }
+    }
+  }
+  Append32(zip, 0x06054b50);
+  zip += std::string(18, '\0');
+  return zip;
+}
+
+// Feeds the archive in small pieces by default, so headers are split between
+// calls.
+Result<std::vector<std::string>> Extract(ZipStreamExtractor& extractor,
+                                         std::string zip,
+                                         std::size_t chunk_size = 7) {
+  for (std::size_t i = 0; i < zip.size(); i += chunk_size) {
+    std::size_t size = std::min(chunk_size, zip.size() - i);
+    if (!extractor.Append(zip.data() + i, size)) {
+      break;
+    }
+  }
+  return extractor.Finish();
+}
+
+std::string ReadFile(const std::string& path) {
+  std::string contents;
+  EXPECT_TRUE(android::base::ReadFileToString(path, &contents)) << path;
+  return contents;
+}
+
+TEST(ZipStreamExtractorTests, ExtractsAllEntries) {
+  TemporaryDir dir;
+  ZipStreamExtractor extractor(dir.path, {});
+
+  auto files = Extract(
+      extractor,
+      BuildZip({{"a.img", "aaaa"}, {"b.img", std::string(9000, 0)}}));
+
+  ASSERT_THAT(files, IsOk());
+  EXPECT_THAT(*files, ::testing::UnorderedElementsAre(
+                          std::string(dir.path) + "/a.img",
+                          std::string(dir.path) + "/b.img"));
+  std::string contents;
+  ASSERT_TRUE(android::base::ReadFileToString(std::string(dir.path) + "/a.img",
+                                              &contents));
+  EXPECT_EQ(contents, "aaaa");
+  EXPECT_EQ(FileSize(std::string(dir.path) + "/b.img"), 9000);
+}
+
+TEST(ZipStreamExtractorTests, ExtractsOnlyWantedEntries) {
+  TemporaryDir dir;
+  ZipStreamExtractor extractor(dir.path, {"b.img"});
+
+  auto files = Extract(extractor, BuildZip({{"a.img", "aaaa"},
+                                             {"b.img", "bbbb"}}));
+
+  ASSERT_THAT(files, IsOk());
+  EXPECT_THAT(*files,
+              ::testing::ElementsAre(std::string(dir.path) + "/b.img"));
+  EXPECT_FALSE(FileExists(std::string(dir.path) + "/a.img"));
+}
+
+TEST(ZipStreamExtractorTests, MissingWantedEntryFails) {
+  TemporaryDir dir;
+  ZipStreamExtractor extractor(dir.path, {"a.img", "c.img"});
+
+  EXPECT_THAT(Extract(extractor, BuildZip({{"a.img", "aaaa"}})), IsError());
+  EXPECT_FALSE(FileExists(std::string(dir.path) + "/a.img"));
+}
+
+TEST(ZipStreamExtractorTests, CorruptEntryFailsAndCleansUp) {
+  TemporaryDir dir;
+  ZipStreamExtractor extractor(dir.path, {});
+  std::string zip = BuildZip({{"a.img", "aaaa"}, {"b.img", "bbbb"}});
+  zip[zip.find("bbbb")] = 'c';
+
+  EXPECT_THAT(Extract(extractor, zip), IsError());
+  EXPECT_FALSE(FileExists(std::string(dir.path) + "/a.img"));
+  EXPECT_FALSE(FileExists(std::string(dir.path) + "/b.img"));
+}
+
+TEST(ZipStreamExtractorTests, TruncatedArchiveFails) {
+  TemporaryDir dir;
+  ZipStreamExtractor extractor(dir.path, {});
+  std::string zip = BuildZip({{"a.img", "aaaa"}});
+
+  EXPECT_THAT(Extract(extractor, zip.substr(0, zip.size() - 30)), IsError());
+}
+
+TEST(ZipStreamExtractorTests, RejectsNamesOutsideTarget) {
+  TemporaryDir dir;
+  ZipStreamExtractor extractor(dir.path, {});
+
+  EXPECT_THAT(Extract(extractor, BuildZip({{"../a.img", "aaaa"}})),
+              IsError());
+}
+
+TEST(ZipStreamExtractorTests, RestartDiscardsEarlierData) {
+  TemporaryDir dir;
+  ZipStreamExtractor extractor(dir.path, {});
+  std::string zip = BuildZip({{"a.img", "aaaa"}});
+
+  ASSERT_TRUE(extractor.Append(zip.data(), zip.size() / 2));
+  ASSERT_TRUE(extractor.Append(nullptr, 0));
+  auto files = Extract(extractor, zip);
+
+  ASSERT_THAT(files, IsOk());
+  EXPECT_THAT(*files,
+              ::testing::ElementsAre(std::string(dir.path) + "/a.img"));
+}
+
+TEST(ZipStreamExtractorTests, ExtractsDeflatedEntries) {
+  TemporaryDir dir;
+  ZipStreamExtractor extractor(dir.path, {});
+  std::string text;
+  for (int i = 0; i < 100000; i++) {
+    text += std::to_string(i) + "\n";
+  }
+  // Zeroes in between data, left as a hole.
+  const std::string sparse = "head" + std::string(1 << 20, 0) + "tail";
+
+  auto files = Extract(extractor, BuildZip({{"a.txt", text, true},
+                                            {"b.img", sparse, true},
+                                            {"empty.txt", "", true}}));
+
+  ASSERT_THAT(files, IsOk());
+  EXPECT_EQ(ReadFile(std::string(dir.path) + "/a.txt"), text);
+  EXPECT_EQ(ReadFile(std::string(dir.path) + "/b.img"), sparse);
+  EXPECT_EQ(ReadFile(std::string(dir.path) + "/empty.txt"), "");
+}
+
+TEST(ZipStreamExtractorTests, ExtractsEntriesWithDataDescriptors) {
+  TemporaryDir dir;
+  ZipStreamExtractor extractor(dir.path, {"b.img", "c.img"});
+  const std::string contents = RandomBytes(100000);
+
+  auto files = Extract(
+      extractor, BuildZip({{"a.img", "skipped", true, true},
+                           {"b.img", contents, true, true},
+                           {"c.img", std::string(9000, 'c'), true, true}}));
+
+  ASSERT_THAT(files, IsOk());
+  EXPECT_THAT(*files, ::testing::ElementsAre(std::string(dir.path) + "/b.img",
+                                             std::string(dir.path) + "/c.img"));
+  EXPECT_FALSE(FileExists(std::string(dir.path) + "/a.img"));
+  EXPECT_EQ(ReadFile(std::string(dir.path) + "/b.img"), contents);
+  EXPECT_EQ(ReadFile(std::string(dir.path) + "/c.img"), std::string(9000, 'c'));
+}
+
+TEST(ZipStreamExtractorTests, DataDescriptorMismatchFails) {
+  TemporaryDir dir;
+  ZipStreamExtractor extractor(dir.path, {});
+  std::string zip = BuildZip({{"a.img", "aaaa", true, true}});
+  // The uncompressed size is the last field of the descriptor.
+  const std::size_t descriptor_end = zip.size() - 22;
+  zip[descriptor_end - 4] = 5;
+
+  EXPECT_THAT(Extract(extractor, zip), IsError());
+  EXPECT_FALSE(FileExists(std::string(dir.path) + "/a.img"));
+}
+
+TEST(ZipStreamExtractorTests, ReadsZip64Sizes) {
+  TemporaryDir dir;
+  ZipStreamExtractor extractor(dir.path, {});
+  const std::string contents = RandomBytes(10000);
+
+  // The descriptor of a zip64 entry has 8 byte sizes.
+  auto files = Extract(
+      extractor,
+      BuildZip({{"stored.img", contents, false, false, true},
+                {"deflated.img", contents, true, false, true},
+                {"descriptor.img", contents, true, true, true}}));
+
+  ASSERT_THAT(files, IsOk());
+  EXPECT_EQ(ReadFile(std::string(dir.path) + "/stored.img"), contents);
+  EXPECT_EQ(ReadFile(std::string(dir.path) + "/deflated.img"), contents);
+  EXPECT_EQ(ReadFile(std::string(dir.path) + "/descriptor.img"), contents);
+}
+
+// More entries than are inflated in parallel, one of which queues up more than
+// the workers may buffer.
+TEST(ZipStreamExtractorTests, ExtractsLargeEntriesOnWorkers) {
+  TemporaryDir dir;
+  ZipStreamExtractor extractor(dir.path, {});
+  std::vector<TestEntry> entries;
+  entries.push_back({"large.img", RandomBytes(20 << 20)});
+  for (int i = 0; i < 6; i++) {
+    entries.push_back({std::to_string(i) + ".img", RandomBytes(300000 + i),
+                       i % 2 == 0});
+  }
+
+  auto files = Extract(extractor, BuildZip(entries), 64 << 10);
+
+  ASSERT_THAT(files, IsOk());
+  EXPECT_EQ(files->size(), entries.size());
+  for (const auto& entry : entries) {
+    EXPECT_EQ(ReadFile(std::string(dir.path) + "/" + entry.name),
+              entry.contents)
+        << entry.name;
+  }
+}
+
+TEST(ZipStreamExtractorTests, FailedWorkerDoesNotBlockReader) {
+  TemporaryDir dir;
+  ZipStreamExtractor extractor(dir.path, {});
+  std::string zip = BuildZip({{"a.img", "aaaa"},
+                              {"large.img", RandomBytes(20 << 20), true}});
+  // Turns the first deflate block into one of the reserved type, the worker
+  // fails right away while most of the entry is yet to be read.
+  zip[zip.find("large.img") + 9] |= 0x06;
+
+  EXPECT_THAT(Extract(extractor, zip, 64 << 10), IsError());
+  EXPECT_FALSE(FileExists(std::string(dir.path) + "/a.img"));
+  EXPECT_FALSE(FileExists(std::string(dir.path) + "/large.img"));
+}
+
+TEST(ZipStreamExtractorTests, FailsWhereverTheArchiveIsTruncated) {
+  const std::string zip =
+      BuildZip({{"a.img", std::string(1000, 'a')},
+                {"b.img", std::string(1000, 'b'), true},
+                {"c.img", std::string(1000, 'c'), true, true}});
+
+  // Everything up to the end of central directory record is needed.
+  for (std::size_t size = 0; size < zip.size() - 22; size++) {
+    TemporaryDir dir;
+    ZipStreamExtractor extractor(dir.path, {});
+
+    EXPECT_THAT(Extract(extractor, zip.substr(0, size)), IsError()) << size;
+    EXPECT_FALSE(FileExists(std::string(dir.path) + "/a.img")) << size;
+    EXPECT_FALSE(FileExists(std::string(dir.path) + "/b.img")) << size;
+    EXPECT_FALSE(FileExists(std::string(dir.path) + "/c.img")) << size;
+  }
+}
+
+}  // namespace
+}  // namespace cuttlefish
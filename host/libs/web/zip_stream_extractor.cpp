@@ -0,0 +1,596 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/libs/web/zip_stream_extractor.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
+#include <zlib.h>
+
+#include "common/libs/utils/files.h"
+#include "common/libs/utils/result.h"
+
+namespace cuttlefish {
+namespace {
+
+constexpr std::uint32_t kLocalHeaderSignature = 0x04034b50;
+constexpr std::uint32_t kDataDescriptorSignature = 0x08074b50;
+constexpr std::uint32_t kCentralDirectorySignature = 0x02014b50;
+constexpr std::uint32_t kEndOfCentralDirectorySignature = 0x06054b50;
+constexpr std::size_t kLocalHeaderSize = 30;
+constexpr std::uint16_t kEncryptedFlag = 1 << 0;
+constexpr std::uint16_t kDataDescriptorFlag = 1 << 3;
+constexpr std::uint16_t kStoredMethod = 0;
+constexpr std::uint16_t kDeflatedMethod = 8;
+constexpr std::uint16_t kZip64ExtraId = 0x0001;
+constexpr std::uint32_t kZip64Marker = 0xffffffff;
+
+// Holes are only left for blocks of zeroes aligned to this size.
+constexpr std::size_t kSparseBlockSize = 4096;
+constexpr std::size_t kInflateBufferSize = 256 << 10;
+// Bytes an entry inflated on a worker thread may have queued up before the
+// archive reader has to wait for it.
+constexpr std::size_t kMaxQueuedBytes = 16 << 20;
+constexpr std::size_t kMaxParallelEntries = 4;
+
+std::uint16_t Read16(const char* data) {
+  const auto* bytes = reinterpret_cast<const unsigned char*>(data);
+  return bytes[0] | (bytes[1] << 8);
+}
+
+std::uint32_t Read32(const char* data) {
+  return Read16(data) | (std::uint32_t(Read16(data + 2)) << 16);
+}
+
+std::uint64_t Read64(const char* data) {
+  return Read32(data) | (std::uint64_t(Read32(data + 4)) << 32);
+}
+
+bool IsZero(const char* data, std::size_t size) {
+  return std::all_of(data, data + size, [](char c) { return c == 0; });
+}
+
+// Rejects names that would be extracted outside of the target directory.
+bool IsSafeName(const std::string& name) {
+  if (name.empty() || name[0] == '/') {
+    return false;
+  }
+  for (const auto& component : android::base::Split(name, "/")) {
+    if (component == "..") {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+// Inflates or copies the data of one entry into a file, or only checks it
+// when there is no file to write.
+class ZipStreamExtractor::EntryWriter {
+ public:
+  static Result<std::unique_ptr<EntryWriter>> Create(const std::string& path,
+                                                     bool deflated) {
+    std::unique_ptr<EntryWriter> writer(new EntryWriter(path, deflated));
+    if (deflated) {
+      // Negative window bits select a raw deflate stream.
+      CF_EXPECT_EQ(inflateInit2(&writer->stream_, -MAX_WBITS), Z_OK,
+                   "Failed to initialize zlib");
+      writer->stream_initialized_ = true;
+    }
+    if (!path.empty()) {
+      writer->fd_.reset(
+          open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+      CF_EXPECTF(writer->fd_.get() >= 0, "Failed to create \"{}\": {}", path,
+                 strerror(errno));
+    }
+    return writer;
+  }
+
+  ~EntryWriter() {
+    if (stream_initialized_) {
+      inflateEnd(&stream_);
+    }
+  }
+
+  // Returns how many of the bytes belong to the entry, which is less than
+  // `size` only once the end of a deflate stream was reached.
+  Result<std::size_t> Consume(const char* data, std::size_t size) {
+    if (!deflated_) {
+      CF_EXPECT(Output(data, size));
+      return size;
+    }
+    CF_EXPECT(!ended_, "Data after the end of the deflate stream");
+    stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream_.avail_in = size;
+    // A full output buffer may leave more output pending inside zlib even
+    // once all the input was taken.
+    do {
+      stream_.next_out = reinterpret_cast<Bytef*>(output_.data());
+      stream_.avail_out = output_.size();
+      int ret = inflate(&stream_, Z_NO_FLUSH);
+      CF_EXPECTF(ret == Z_OK || ret == Z_STREAM_END || ret == Z_BUF_ERROR,
+                 "Failed to inflate \"{}\": {}", path_,
+                 stream_.msg ? stream_.msg : std::to_string(ret));
+      CF_EXPECT(Output(output_.data(), output_.size() - stream_.avail_out));
+      ended_ = ret == Z_STREAM_END;
+    } while (!ended_ && (stream_.avail_in > 0 || stream_.avail_out == 0));
+    return size - stream_.avail_in;
+  }
+
+  bool Ended() const { return !deflated_ || ended_; }
+  std::uint64_t Size() const { return size_; }
+
+  Result<void> Finish(std::uint32_t expected_crc) {
+    CF_EXPECTF(Ended(), "Deflate stream of \"{}\" is truncated", path_);
+    CF_EXPECTF(crc_ == expected_crc,
+               "CRC mismatch in \"{}\": expected {:#x}, got {:#x}", path_,
+               expected_crc, crc_);
+    if (fd_.get() >= 0) {
+      // Trailing zeroes were skipped, they only exist once the size is set.
+      CF_EXPECTF(ftruncate(fd_.get(), size_) == 0,
+                 "Failed to truncate \"{}\": {}", path_, strerror(errno));
+      fd_.reset();
+    }
+    return {};
+  }
+
+ private:
+  EntryWriter(std::string path, bool deflated)
+      : path_(std::move(path)),
+        deflated_(deflated),
+        output_(deflated ? kInflateBufferSize : 0) {}
+
+  Result<void> Output(const char* data, std::size_t size) {
+    crc_ = crc32(crc_, reinterpret_cast<const Bytef*>(data), size);
+    const std::uint64_t offset = size_;
+    size_ += size;
+    if (fd_.get() < 0) {
+      return {};
+    }
+    // Runs of zero blocks are skipped, everything else is written in as few
+    // calls as possible.
+    std::size_t pos = 0;
+    while (pos < size) {
+      std::size_t run = std::min<std::size_t>(
+          size - pos, kSparseBlockSize - (offset + pos) % kSparseBlockSize);
+      const bool zero = IsZero(data + pos, run);
+      while (pos + run < size) {
+        std::size_t next = std::min(size - pos - run, kSparseBlockSize);
+        if (IsZero(data + pos + run, next) != zero) {
+          break;
+        }
+        run += next;
+      }
+      if (!zero) {
+        CF_EXPECT(WriteAt(data + pos, run, offset + pos));
+      }
+      pos += run;
+    }
+    return {};
+  }
+
+  Result<void> WriteAt(const char* data, std::size_t size,
+                       std::uint64_t offset) {
+    while (size > 0) {
+      ssize_t written =
+          TEMP_FAILURE_RETRY(pwrite(fd_.get(), data, size, offset));
+      CF_EXPECTF(written > 0, "Failed to write \"{}\": {}", path_,
+                 strerror(errno));
+      data += written;
+      size -= written;
+      offset += written;
+    }
+    return {};
+  }
+
+  const std::string path_;
+  const bool deflated_;
+  android::base::unique_fd fd_;
+  z_stream stream_ = {};
+  bool stream_initialized_ = false;
+  bool ended_ = false;
+  std::vector<char> output_;
+  std::uint32_t crc_ = crc32(0, nullptr, 0);
+  std::uint64_t size_ = 0;
+};
+
+// Feeds the data of an entry to an `EntryWriter` on a thread of its own.
+class ZipStreamExtractor::AsyncEntry {
+ public:
+  AsyncEntry(std::unique_ptr<EntryWriter> writer, std::uint32_t crc)
+      : writer_(std::move(writer)), crc_(crc), thread_([this]() { Run(); }) {}
+
+  ~AsyncEntry() {
+    Abort();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  // Blocks while too much of the entry is waiting to be written.
+  void Push(const char* data, std::size_t size) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    space_available_.wait(
+        lock, [this]() { return queued_bytes_ < kMaxQueuedBytes || done_; });
+    if (done_) {
+      return;  // The error is reported by `Join`
+    }
+    chunks_.emplace_back(data, data + size);
+    queued_bytes_ += size;
+    data_available_.notify_one();
+  }
+
+  Result<void> Join() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    data_available_.notify_one();
+    thread_.join();
+    return std::move(result_);
+  }
+
+  void Abort() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+    }
+    data_available_.notify_one();
+    space_available_.notify_one();
+  }
+
+ private:
+  void Run() {
+    result_ = Process();
+    if (!result_.ok()) {
+      Abort();  // Unblocks `Push`
+    }
+  }
+
+  Result<void> Process() {
+    while (true) {
+      std::vector<char> chunk;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        data_available_.wait(
+            lock, [this]() { return !chunks_.empty() || closed_ || done_; });
+        CF_EXPECT(!done_, "Extraction was aborted");
+        if (chunks_.empty()) {
+          break;
+        }
+        chunk = std::move(chunks_.front());
+        chunks_.pop_front();
+        queued_bytes_ -= chunk.size();
+      }
+      space_available_.notify_one();
+      std::size_t consumed =
+          CF_EXPECT(writer_->Consume(chunk.data(), chunk.size()));
+      CF_EXPECT_EQ(consumed, chunk.size(), "Data after the end of the entry");
+    }
+    CF_EXPECT(writer_->Finish(crc_));
+    return {};
+  }
+
+  std::unique_ptr<EntryWriter> writer_;
+  const std::uint32_t crc_;
+  std::mutex mutex_;
+  std::condition_variable data_available_;
+  std::condition_variable space_available_;
+  std::deque<std::vector<char>> chunks_;
+  std::size_t queued_bytes_ = 0;
+  bool closed_ = false;
+  bool done_ = false;
+  Result<void> result_;
+  std::thread thread_;
+};
+
+ZipStreamExtractor::ZipStreamExtractor(std::string target_directory,
+                                       const std::vector<std::string>& files)
+    : target_directory_(std::move(target_directory)),
+      wanted_(files.begin(), files.end()),
+      max_parallel_entries_(std::clamp<std::size_t>(
+          std::thread::hardware_concurrency(), 1, kMaxParallelEntries)) {}
+
+ZipStreamExtractor::~ZipStreamExtractor() {
+  if (!finished_) {
+    Abort();
+  }
+}
+
+bool ZipStreamExtractor::Append(char* data, std::size_t size) {
+  if (data == nullptr) {
+    Abort();
+    return true;
+  }
+  if (!status_.ok()) {
+    return false;
+  }
+  status_ = Parse(data, size);
+  return status_.ok();
+}
+
+Result<std::vector<std::string>> ZipStreamExtractor::Finish() {
+  auto result = [this]() -> Result<void> {
+    CF_EXPECT(std::move(status_));
+    CF_EXPECT(state_ == State::kDone, "The archive is truncated");
+    CF_EXPECT(JoinAsyncEntries(0));
+    for (const auto& file : wanted_) {
+      CF_EXPECTF(found_.count(file) > 0, "\"{}\" not found in the archive",
+                 file);
+    }
+    return {};
+  }();
+  if (!result.ok()) {
+    Abort();
+  }
+  CF_EXPECT(std::move(result));
+  finished_ = true;
+  return extracted_;
+}
+
+Result<void> ZipStreamExtractor::Parse(const char* data, std::size_t size) {
+  while (size > 0) {
+    switch (state_) {
+      case State::kHeader:
+        CF_EXPECT(ParseHeader(data, size));
+        break;
+      case State::kData:
+        CF_EXPECT(ParseData(data, size));
+        break;
+      case State::kDescriptor:
+        CF_EXPECT(ParseDescriptor(data, size));
+        break;
+      case State::kDone:
+        return {};  // The central directory isn't needed
+    }
+  }
+  return {};
+}
+
+// Moves bytes into `buffer_` until it holds at least `needed` of them. A
+// header is filled in steps, so earlier steps may find more bytes buffered.
+bool ZipStreamExtractor::Fill(const char*& data, std::size_t& size,
+                              std::size_t needed) {
+  if (buffer_.size() < needed) {
+    std::size_t count = std::min(size, needed - buffer_.size());
+    buffer_.insert(buffer_.end(), data, data + count);
+    data += count;
+    size -= count;
+  }
+  return buffer_.size() >= needed;
+}
+
+Result<void> ZipStreamExtractor::ParseHeader(const char*& data,
+                                             std::size_t& size) {
+  if (!Fill(data, size, 4)) {
+    return {};
+  }
+  std::uint32_t signature = Read32(buffer_.data());
+  if (signature != kLocalHeaderSignature) {
+    CF_EXPECTF(signature == kCentralDirectorySignature ||
+                   signature == kEndOfCentralDirectorySignature,
+               "Unexpected zip signature {:#x}", signature);
+    state_ = State::kDone;
+    buffer_.clear();
+    return {};
+  }
+  if (!Fill(data, size, kLocalHeaderSize)) {
+    return {};
+  }
+  std::size_t header_size = kLocalHeaderSize + Read16(&buffer_[26]) +
+                            Read16(&buffer_[28]);
+  if (!Fill(data, size, header_size)) {
+    return {};
+  }
+  CF_EXPECT(StartEntry());
+  buffer_.clear();
+  return {};
+}
+
+Result<void> ZipStreamExtractor::StartEntry() {
+  const char* header = buffer_.data();
+  const std::uint16_t flags = Read16(header + 6);
+  const std::uint16_t method = Read16(header + 8);
+  const std::uint16_t name_size = Read16(header + 26);
+  const std::uint16_t extra_size = Read16(header + 28);
+  std::uint64_t compressed_size = Read32(header + 18);
+  std::uint64_t uncompressed_size = Read32(header + 22);
+  entry_ = Entry{
+      .name = std::string(header + kLocalHeaderSize, name_size),
+      .crc = Read32(header + 14),
+      .zip64 = false,
+      .has_descriptor = (flags & kDataDescriptorFlag) != 0,
+  };
+
+  const char* extra = header + kLocalHeaderSize + name_size;
+  const char* extra_end = extra + extra_size;
+  while (extra + 4 <= extra_end) {
+    const std::uint16_t id = Read16(extra);
+    const char* field = extra + 4;
+    const char* field_end = std::min(field + Read16(extra + 2), extra_end);
+    if (id == kZip64ExtraId) {
+      entry_.zip64 = true;
+      if (uncompressed_size == kZip64Marker && field + 8 <= field_end) {
+        uncompressed_size = Read64(field);
+        field += 8;
+      }
+      if (compressed_size == kZip64Marker && field + 8 <= field_end) {
+        compressed_size = Read64(field);
+      }
+    }
+    extra = field_end;
+  }
+  entry_.compressed_size = compressed_size;
+
+  CF_EXPECTF(IsSafeName(entry_.name), "Unsafe entry name \"{}\"",
+             entry_.name);
+  CF_EXPECTF((flags & kEncryptedFlag) == 0, "\"{}\" is encrypted",
+             entry_.name);
+  CF_EXPECTF(method == kStoredMethod || method == kDeflatedMethod,
+             "\"{}\" uses unsupported compression method {}", entry_.name,
+             method);
+  const bool directory = android::base::EndsWith(entry_.name, "/");
+  // Only the deflate stream itself tells where such an entry ends, unless it's
+  // a directory without any data.
+  CF_EXPECTF(!entry_.has_descriptor || method == kDeflatedMethod || directory,
+             "Stored entry \"{}\" has no size", entry_.name);
+  const bool wanted = !directory && (wanted_.empty() ||
+                                     wanted_.count(entry_.name) > 0);
+  if (directory && wanted_.empty()) {
+    CF_EXPECT(EnsureDirectoryExists(target_directory_ + "/" + entry_.name));
+  }
+  std::string path;
+  if (wanted) {
+    path = target_directory_ + "/" + entry_.name;
+    CF_EXPECT(EnsureDirectoryExists(cpp_dirname(path)));
+    extracted_.push_back(path);
+    found_.insert(entry_.name);
+  }
+
+  compressed_seen_ = 0;
+  if (wanted || entry_.has_descriptor) {
+    auto writer =
+        CF_EXPECT(EntryWriter::Create(path, method == kDeflatedMethod));
+    if (wanted && !entry_.has_descriptor && entry_.compressed_size > 0) {
+      CF_EXPECT(JoinAsyncEntries(max_parallel_entries_ - 1));
+      async_entry_ =
+          std::make_unique<AsyncEntry>(std::move(writer), entry_.crc);
+    } else {
+      writer_ = std::move(writer);
+    }
+  }
+  if (entry_.has_descriptor && method == kStoredMethod) {
+    state_ = State::kDescriptor;
+  } else if (entry_.has_descriptor || entry_.compressed_size > 0) {
+    state_ = State::kData;
+  } else if (writer_) {
+    CF_EXPECT(writer_->Finish(entry_.crc));  // An empty file
+    writer_.reset();
+  }
+  return {};
+}
+
+Result<void> ZipStreamExtractor::ParseData(const char*& data,
+                                           std::size_t& size) {
+  if (entry_.has_descriptor) {
+    std::size_t consumed = CF_EXPECT(writer_->Consume(data, size));
+    compressed_seen_ += consumed;
+    data += consumed;
+    size -= consumed;
+    if (writer_->Ended()) {
+      state_ = State::kDescriptor;
+    }
+    return {};
+  }
+
+  std::size_t count = std::min<std::uint64_t>(
+      size, entry_.compressed_size - compressed_seen_);
+  if (async_entry_) {
+    async_entry_->Push(data, count);
+  } else if (writer_) {
+    CF_EXPECT_EQ(CF_EXPECT(writer_->Consume(data, count)), count,
+                 "Data after the end of \"" << entry_.name << "\"");
+  }
+  compressed_seen_ += count;
+  data += count;
+  size -= count;
+  if (compressed_seen_ == entry_.compressed_size) {
+    if (async_entry_) {
+      async_entries_.push_back(std::move(async_entry_));
+    } else if (writer_) {
+      CF_EXPECT(writer_->Finish(entry_.crc));
+      writer_.reset();
+    }
+    state_ = State::kHeader;
+  }
+  return {};
+}
+
+Result<void> ZipStreamExtractor::ParseDescriptor(const char*& data,
+                                                 std::size_t& size) {
+  if (!Fill(data, size, 4)) {
+    return {};
+  }
+  const std::size_t signature_size =
+      Read32(buffer_.data()) == kDataDescriptorSignature ? 4 : 0;
+  // The sizes are 8 bytes wide for zip64 entries, announced by their local
+  // header or implied by sizes that don't fit in 4 bytes.
+  const bool wide = entry_.zip64 || compressed_seen_ >= kZip64Marker ||
+                    writer_->Size() >= kZip64Marker;
+  if (!Fill(data, size, signature_size + 4 + (wide ? 16 : 8))) {
+    return {};
+  }
+  const char* descriptor = buffer_.data() + signature_size;
+  const std::uint32_t crc = Read32(descriptor);
+  const std::uint64_t compressed_size =
+      wide ? Read64(descriptor + 4) : Read32(descriptor + 4);
+  const std::uint64_t uncompressed_size =
+      wide ? Read64(descriptor + 12) : Read32(descriptor + 8);
+  CF_EXPECTF(compressed_size == compressed_seen_ &&
+                 uncompressed_size == writer_->Size(),
+             "Sizes of \"{}\" don't match its data descriptor", entry_.name);
+  CF_EXPECT(writer_->Finish(crc));
+  writer_.reset();
+  buffer_.clear();
+  state_ = State::kHeader;
+  return {};
+}
+
+// Waits until at most `remaining` entries are still written in the background.
+Result<void> ZipStreamExtractor::JoinAsyncEntries(std::size_t remaining) {
+  while (async_entries_.size() > remaining) {
+    auto entry = std::move(async_entries_.front());
+    async_entries_.pop_front();
+    CF_EXPECT(entry->Join());
+  }
+  return {};
+}
+
+// Stops all writes and removes what was extracted so far.
+void ZipStreamExtractor::Abort() {
+  async_entry_.reset();
+  async_entries_.clear();
+  writer_.reset();
+  for (const auto& path : extracted_) {
+    if (FileExists(path) && !RemoveFile(path)) {
+      LOG(ERROR) << "Failed to remove \"" << path << "\"";
+    }
+  }
+  extracted_.clear();
+  found_.clear();
+  buffer_.clear();
+  state_ = State::kHeader;
+  status_ = {};
+}
+
+}  // namespace cuttlefish
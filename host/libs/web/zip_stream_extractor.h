@@ -0,0 +1,97 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "common/libs/utils/result.h"
+
+namespace cuttlefish {
+
+/**
+ * Extracts a zip archive while its bytes arrive, e.g. from an
+ * `HttpClient::DataCallback`, so the archive itself never has to be stored.
+ *
+ * Entries are found through their local headers, the central directory is
+ * never needed. Entries with a known compressed size are inflated on worker
+ * threads while the following entries are still arriving. Like `bsdtar -S`,
+ * blocks of zeroes are left as holes in the extracted files.
+ */
+class ZipStreamExtractor {
+ public:
+  // Extracts the entries named in `files`, or every entry when it's empty.
+  ZipStreamExtractor(std::string target_directory,
+                     const std::vector<std::string>& files);
+  ~ZipStreamExtractor();
+
+  // Consumes the next bytes of the archive. A null `data` restarts the
+  // extraction from the start of the archive. Returns false after an error,
+  // which is reported by `Finish`.
+  bool Append(char* data, std::size_t size);
+
+  // Waits for the remaining entries to be written. Returns the paths of the
+  // extracted files, or removes them on failure.
+  Result<std::vector<std::string>> Finish();
+
+ private:
+  class EntryWriter;
+  class AsyncEntry;
+
+  enum class State { kHeader, kData, kDescriptor, kDone };
+
+  struct Entry {
+    std::string name;
+    std::uint32_t crc;
+    std::uint64_t compressed_size;
+    bool zip64;
+    bool has_descriptor;
+  };
+
+  Result<void> Parse(const char* data, std::size_t size);
+  Result<void> ParseHeader(const char*& data, std::size_t& size);
+  Result<void> StartEntry();
+  Result<void> ParseData(const char*& data, std::size_t& size);
+  Result<void> ParseDescriptor(const char*& data, std::size_t& size);
+  bool Fill(const char*& data, std::size_t& size, std::size_t needed);
+  Result<void> JoinAsyncEntries(std::size_t remaining);
+  void Abort();
+
+  const std::string target_directory_;
+  const std::set<std::string> wanted_;
+  const std::size_t max_parallel_entries_;
+
+  State state_ = State::kHeader;
+  std::vector<char> buffer_;
+  Entry entry_;
+  std::uint64_t compressed_seen_ = 0;
+  // Only one of these is set while an entry is extracted, neither when the
+  // entry is skipped.
+  std::unique_ptr<EntryWriter> writer_;
+  std::unique_ptr<AsyncEntry> async_entry_;
+  std::deque<std::unique_ptr<AsyncEntry>> async_entries_;
+  std::vector<std::string> extracted_;
+  std::set<std::string> found_;
+  Result<void> status_;
+  bool finished_ = false;
+};
+
+}  // namespace cuttlefish